@@ -121,6 +121,12 @@ else ( WITH_FLOAT )
   message ( "Samples type=float:    no (using double)" )
 endif ( WITH_FLOAT )
 
+if ( WITH_FIXED_POINT )
+  message ( "Fixed point kernels:   yes" )
+else ( WITH_FIXED_POINT )
+  message ( "Fixed point kernels:   no" )
+endif ( WITH_FIXED_POINT )
+
 if ( WITH_PROFILING )
   message ( "Profiling:             yes" )
 else ( WITH_PROFILING )
@@ -97,6 +97,9 @@ FLUIDSYNTH_API void fluid_midi_router_rule_set_param1 (fluid_midi_router_rule_t
                                                        int min, int max, float mul, int add);
 FLUIDSYNTH_API void fluid_midi_router_rule_set_param2 (fluid_midi_router_rule_t *rule,
                                                        int min, int max, float mul, int add);
+FLUIDSYNTH_API int fluid_midi_router_get_dropped_events (fluid_midi_router_t *router);
+FLUIDSYNTH_API int fluid_midi_router_get_thinned_events (fluid_midi_router_t *router);
+FLUIDSYNTH_API int fluid_midi_router_get_merged_events (fluid_midi_router_t *router);
 FLUIDSYNTH_API int fluid_midi_router_handle_midi_event(void* data, fluid_midi_event_t* event);
 FLUIDSYNTH_API int fluid_midi_dump_prerouter(void* data, fluid_midi_event_t* event); 
 FLUIDSYNTH_API int fluid_midi_dump_postrouter(void* data, fluid_midi_event_t* event); 
@@ -62,6 +62,7 @@ extern "C" {
 
 FLUIDSYNTH_API int fluid_is_soundfont (const char *filename);
 FLUIDSYNTH_API int fluid_is_midifile (const char *filename);
+FLUIDSYNTH_API double fluid_get_shared_sample_bytes (void);
 
 
 #ifdef WIN32
@@ -98,6 +98,11 @@ struct _fluid_stream_loader_t {
 
   int (*is_open)(fluid_stream_loader_t* loader);
 
+  /**
+   * Stream lengths, positions and seek offsets are int, so a stream
+   * loader of the application can't reach data past 2 GB. The loaders
+   * of FluidSynth (file, memory) use 64 bit offsets internally.
+   */
   int (*length)(fluid_stream_loader_t* loader);
 
   int (*position)(fluid_stream_loader_t* loader);
@@ -310,6 +315,7 @@ struct _fluid_sample_t
 #define FLUID_SAMPLETYPE_RIGHT	2       /**< Flag for #fluid_sample_t \a sampletype field for right samples of a stereo pair */
 #define FLUID_SAMPLETYPE_LEFT	4       /**< Flag for #fluid_sample_t \a sampletype field for left samples of a stereo pair */
 #define FLUID_SAMPLETYPE_LINKED	8       /**< Flag for #fluid_sample_t \a sampletype field, not used currently */
+#define FLUID_SAMPLETYPE_OGG_VORBIS	0x10 /**< Flag for #fluid_sample_t \a sampletype field, sample data is Ogg Vorbis compressed (SF3) @since 1.1.7 */
 #define FLUID_SAMPLETYPE_ROM	0x8000  /**< Flag for #fluid_sample_t \a sampletype field, ROM sample, causes sample to be ignored */
 
 
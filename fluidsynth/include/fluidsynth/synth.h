@@ -145,6 +145,7 @@ FLUIDSYNTH_API double fluid_synth_get_reverb_roomsize(fluid_synth_t* synth);
 FLUIDSYNTH_API double fluid_synth_get_reverb_damp(fluid_synth_t* synth);
 FLUIDSYNTH_API double fluid_synth_get_reverb_level(fluid_synth_t* synth);
 FLUIDSYNTH_API double fluid_synth_get_reverb_width(fluid_synth_t* synth);
+FLUIDSYNTH_API int fluid_synth_get_reverb_sleeping(fluid_synth_t* synth, int* wakeups);
 
 #define FLUID_REVERB_DEFAULT_ROOMSIZE 0.2f      /**< Default reverb room size */
 #define FLUID_REVERB_DEFAULT_DAMP 0.0f          /**< Default reverb damping */
@@ -170,6 +171,7 @@ FLUIDSYNTH_API double fluid_synth_get_chorus_level(fluid_synth_t* synth);
 FLUIDSYNTH_API double fluid_synth_get_chorus_speed_Hz(fluid_synth_t* synth);
 FLUIDSYNTH_API double fluid_synth_get_chorus_depth_ms(fluid_synth_t* synth);
 FLUIDSYNTH_API int fluid_synth_get_chorus_type(fluid_synth_t* synth); /* see fluid_chorus_mod */
+FLUIDSYNTH_API int fluid_synth_get_chorus_sleeping(fluid_synth_t* synth, int* wakeups);
 
 #define FLUID_CHORUS_DEFAULT_N 3                                /**< Default chorus voice count */
 #define FLUID_CHORUS_DEFAULT_LEVEL 2.0f                         /**< Default chorus level */
@@ -194,6 +196,9 @@ FLUIDSYNTH_API float fluid_synth_get_gain(fluid_synth_t* synth);
 FLUIDSYNTH_API int fluid_synth_set_polyphony(fluid_synth_t* synth, int polyphony);
 FLUIDSYNTH_API int fluid_synth_get_polyphony(fluid_synth_t* synth);
 FLUIDSYNTH_API int fluid_synth_get_active_voice_count(fluid_synth_t* synth);
+FLUIDSYNTH_API int fluid_synth_set_channel_polyphony(fluid_synth_t* synth, int chan, int polyphony);
+FLUIDSYNTH_API int fluid_synth_get_channel_polyphony(fluid_synth_t* synth, int chan);
+FLUIDSYNTH_API int fluid_synth_get_channel_voice_count(fluid_synth_t* synth, int chan);
 FLUIDSYNTH_API int fluid_synth_get_internal_bufsize(fluid_synth_t* synth);
 
 FLUIDSYNTH_API 
@@ -257,6 +262,10 @@ FLUIDSYNTH_API int fluid_synth_tuning_dump(fluid_synth_t* synth, int bank, int p
 /* Misc */
 
 FLUIDSYNTH_API double fluid_synth_get_cpu_load(fluid_synth_t* synth);
+FLUIDSYNTH_API int fluid_synth_get_stream_underruns(fluid_synth_t* synth);
+FLUIDSYNTH_API int fluid_synth_get_culled_voices(fluid_synth_t* synth);
+FLUIDSYNTH_API int fluid_synth_get_degraded_voices(fluid_synth_t* synth);
+FLUIDSYNTH_API int fluid_synth_get_render_cache_hits(fluid_synth_t* synth, int* misses);
 FLUIDSYNTH_API char* fluid_synth_error(fluid_synth_t* synth);
 
 
@@ -300,6 +309,7 @@ typedef int (*fluid_audio_callback_t)(fluid_synth_t* synth, int len,
 
 FLUIDSYNTH_API fluid_sfloader_t* fluid_synth_new_stream_sfloader(fluid_synth_t* synth, fluid_stream_loader_t* stream);
 FLUIDSYNTH_API void fluid_synth_delete_stream_sfloader(fluid_sfloader_t* sfloader);
+FLUIDSYNTH_API fluid_stream_loader_t* fluid_synth_new_memory_stream_loader(const void* data, fluid_long_long_t size);
 #if ANDROID
 FLUIDSYNTH_API fluid_sfloader_t* fluid_synth_android_asset_stream_loader(void* jniEnv, void* assetManager);
 #endif
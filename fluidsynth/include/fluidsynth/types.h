@@ -61,6 +61,12 @@ typedef struct _fluid_rampreset_t fluid_rampreset_t;            /**< RAM SoundFo
 typedef int fluid_istream_t;    /**< Input stream descriptor */
 typedef int fluid_ostream_t;    /**< Output stream descriptor */
 
+#if defined(_MSC_VER) && (_MSC_VER < 1800)
+typedef __int64 fluid_long_long_t;      /**< At least 64 bit signed integer, for file offsets @since 1.1.7 */
+#else
+typedef long long fluid_long_long_t;    /**< At least 64 bit signed integer, for file offsets @since 1.1.7 */
+#endif
+
 
 #ifdef __cplusplus
 }
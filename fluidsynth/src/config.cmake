@@ -199,6 +199,9 @@
 /* Define to do all DSP in single floating point precision */
 #cmakedefine WITH_FLOAT @WITH_FLOAT@
 
+/* Define to build the integer voice and reverb kernels */
+#cmakedefine WITH_FIXED_POINT @WITH_FIXED_POINT@
+
 /* Define to profile the DSP code */
 #cmakedefine WITH_PROFILING @WITH_PROFILING@
 
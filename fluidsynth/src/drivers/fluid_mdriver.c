@@ -148,6 +148,12 @@ void fluid_midi_driver_settings(fluid_settings_t* settings)
   fluid_settings_register_int (settings, "midi.realtime-prio",
                                FLUID_DEFAULT_MIDI_RT_PRIO, 0, 99, 0, NULL, NULL);
 
+  /* MIDI router flood protection */
+  fluid_settings_register_int (settings, "midi.router.rate-limit", 0, 0, 100000, 0, NULL, NULL);
+  fluid_settings_register_int (settings, "midi.router.rate-burst", 32, 1, 10000, 0, NULL, NULL);
+  fluid_settings_register_int (settings, "midi.router.cc-interval", 0, 0, 1000, 0, NULL, NULL);
+  fluid_settings_register_int (settings, "midi.router.retrigger-interval", 0, 0, 1000, 0, NULL, NULL);
+
   /* Set the default driver */
 #if ALSA_SUPPORT
   fluid_settings_register_str(settings, "midi.driver", "alsa_seq", 0, NULL, NULL);
@@ -46,6 +46,28 @@ struct _fluid_midi_router_t {
   /* FIXME - If there are multiple command handlers, they will conflict! */
   fluid_midi_router_rule_t *cmd_rule;        /* Rule currently being processed by shell command handler */
   int cmd_rule_type;                         /* Type of the rule (fluid_midi_router_rule_type) */
+
+  /* Flood protection, see fluid_midi_router_admit_LOCAL() */
+  int rate_limit;                            /* Events per second and channel, 0 for no limit */
+  int rate_burst;                            /* Events a channel may send at once */
+  float *tokens;                             /* Token bucket of each channel */
+  unsigned int *token_time;                  /* Time of the last bucket update of each channel, in msec */
+
+  int cc_interval;                           /* Min. time between values of a continuous controller, in msec */
+  unsigned int *cc_time;                     /* Time the last value of each channel and controller was sent */
+  signed char *cc_pending;                   /* Latest held back value of each channel and controller, or -1 */
+  int cc_pending_count;                      /* Number of held back controller values */
+  char *cc_lsb_due;                          /* Flag of each channel and MSB controller 1-31, set while the
+                                                LSB of its last sent value may still follow it */
+  fluid_timer_t *cc_timer;                   /* Sends the held back controller values, NULL if none */
+  int cc_timer_armed;                        /* TRUE until the timer has sent all held back values */
+
+  int retrigger_interval;                    /* Min. time between noteons of the same key, in msec */
+  unsigned int *key_time;                    /* Time of the last noteon of each channel and key */
+
+  int dropped_events;                        /* Events dropped by the rate limit */
+  int thinned_events;                        /* Controller values replaced by a later value */
+  int merged_events;                         /* Noteons merged into a previous noteon of the same key */
 };
 
 struct _fluid_midi_router_rule_t {
@@ -70,6 +92,13 @@ struct _fluid_midi_router_rule_t {
     int waiting;                             /* Set to TRUE when rule has been deactivated but there are still pending_events */
 };
 
+static int fluid_midi_router_admit_LOCAL (fluid_midi_router_t *router,
+                                          fluid_midi_event_t *event);
+static int fluid_midi_router_route_LOCAL (fluid_midi_router_t *router,
+                                          fluid_midi_event_t *event);
+static int fluid_midi_router_send_pending_cc (void *data, unsigned int msec);
+static int fluid_midi_router_arm_cc_timer_LOCAL (fluid_midi_router_t *router);
+
 
 /**
  * Create a new midi router.  The default rules will pass all events unmodified.
@@ -88,6 +117,7 @@ new_fluid_midi_router(fluid_settings_t *settings, handle_midi_event_func_t handl
                       void *event_handler_data)
 {
   fluid_midi_router_t *router = NULL;
+  unsigned int now;
   int i;
 
   router = FLUID_NEW (fluid_midi_router_t);
@@ -105,6 +135,51 @@ new_fluid_midi_router(fluid_settings_t *settings, handle_midi_event_func_t handl
 
   fluid_mutex_init (router->rules_mutex);
 
+  /* Flood protection. The times start one interval in the past, so the
+   * first events pass. */
+  fluid_settings_getint(settings, "midi.router.rate-limit", &router->rate_limit);
+  fluid_settings_getint(settings, "midi.router.rate-burst", &router->rate_burst);
+  fluid_settings_getint(settings, "midi.router.cc-interval", &router->cc_interval);
+  fluid_settings_getint(settings, "midi.router.retrigger-interval", &router->retrigger_interval);
+  now = fluid_curtime ();
+
+  if (router->rate_limit > 0)
+  {
+    router->tokens = FLUID_ARRAY (float, router->nr_midi_channels);
+    router->token_time = FLUID_ARRAY (unsigned int, router->nr_midi_channels);
+    if (!router->tokens || !router->token_time) goto error_oom;
+
+    for (i = 0; i < router->nr_midi_channels; i++)
+    {
+      router->tokens[i] = router->rate_burst;
+      router->token_time[i] = now;
+    }
+  }
+
+  if (router->cc_interval > 0)
+  {
+    router->cc_time = FLUID_ARRAY (unsigned int, router->nr_midi_channels * 128);
+    router->cc_pending = FLUID_ARRAY (signed char, router->nr_midi_channels * 128);
+    router->cc_lsb_due = FLUID_ARRAY (char, router->nr_midi_channels * 32);
+    if (!router->cc_time || !router->cc_pending || !router->cc_lsb_due) goto error_oom;
+
+    for (i = 0; i < router->nr_midi_channels * 128; i++)
+    {
+      router->cc_time[i] = now - router->cc_interval;
+      router->cc_pending[i] = -1;
+    }
+    FLUID_MEMSET (router->cc_lsb_due, 0, router->nr_midi_channels * 32);
+  }
+
+  if (router->retrigger_interval > 0)
+  {
+    router->key_time = FLUID_ARRAY (unsigned int, router->nr_midi_channels * 128);
+    if (!router->key_time) goto error_oom;
+
+    for (i = 0; i < router->nr_midi_channels * 128; i++)
+      router->key_time[i] = now - router->retrigger_interval;
+  }
+
   router->synth = (fluid_synth_t *)event_handler_data;
   router->event_handler = handler;
   router->event_handler_data = event_handler_data;
@@ -118,6 +193,8 @@ new_fluid_midi_router(fluid_settings_t *settings, handle_midi_event_func_t handl
 
   return router;
 
+ error_oom:
+  FLUID_LOG(FLUID_ERR, "Out of memory");
  error_recovery:
   delete_fluid_midi_router (router);
   return NULL;
@@ -138,6 +215,10 @@ delete_fluid_midi_router (fluid_midi_router_t *router)
 
   fluid_return_val_if_fail (router != NULL, FLUID_FAILED);
 
+  /* Stop the timer first, it routes events */
+  if (router->cc_timer)
+    delete_fluid_timer (router->cc_timer);
+
   for (i = 0; i < FLUID_MIDI_ROUTER_RULE_COUNT; i++)
   {
     for (rule = router->rules[i]; rule; rule = next_rule)
@@ -147,6 +228,13 @@ delete_fluid_midi_router (fluid_midi_router_t *router)
     }
   }
 
+  if (router->tokens) FLUID_FREE (router->tokens);
+  if (router->token_time) FLUID_FREE (router->token_time);
+  if (router->cc_time) FLUID_FREE (router->cc_time);
+  if (router->cc_pending) FLUID_FREE (router->cc_pending);
+  if (router->cc_lsb_due) FLUID_FREE (router->cc_lsb_due);
+  if (router->key_time) FLUID_FREE (router->key_time);
+
   fluid_mutex_destroy (router->rules_mutex);
   FLUID_FREE (router);
 
@@ -496,6 +584,69 @@ fluid_midi_router_rule_set_param2 (fluid_midi_router_rule_t *rule, int min, int
   rule->par2_add = add;
 }
 
+/**
+ * Get the number of events dropped by the MIDI router's rate limit.
+ * @param router MIDI router instance
+ * @return Count of events, which a channel sent faster than the
+ *   midi.router.rate-limit setting allows
+ * @since 1.1.7
+ */
+int
+fluid_midi_router_get_dropped_events (fluid_midi_router_t *router)
+{
+  int count;
+
+  fluid_return_val_if_fail (router != NULL, 0);
+
+  fluid_mutex_lock (router->rules_mutex);   /* ++ lock rules */
+  count = router->dropped_events;
+  fluid_mutex_unlock (router->rules_mutex);         /* -- unlock rules */
+
+  return count;
+}
+
+/**
+ * Get the number of controller values thinned out by the MIDI router.
+ * @param router MIDI router instance
+ * @return Count of continuous controller values, which were replaced by a
+ *   later value before they were sent, see the midi.router.cc-interval setting
+ * @since 1.1.7
+ */
+int
+fluid_midi_router_get_thinned_events (fluid_midi_router_t *router)
+{
+  int count;
+
+  fluid_return_val_if_fail (router != NULL, 0);
+
+  fluid_mutex_lock (router->rules_mutex);   /* ++ lock rules */
+  count = router->thinned_events;
+  fluid_mutex_unlock (router->rules_mutex);         /* -- unlock rules */
+
+  return count;
+}
+
+/**
+ * Get the number of noteons merged by the MIDI router.
+ * @param router MIDI router instance
+ * @return Count of noteons, which retriggered a key faster than the
+ *   midi.router.retrigger-interval setting allows and were dropped
+ * @since 1.1.7
+ */
+int
+fluid_midi_router_get_merged_events (fluid_midi_router_t *router)
+{
+  int count;
+
+  fluid_return_val_if_fail (router != NULL, 0);
+
+  fluid_mutex_lock (router->rules_mutex);   /* ++ lock rules */
+  count = router->merged_events;
+  fluid_mutex_unlock (router->rules_mutex);         /* -- unlock rules */
+
+  return count;
+}
+
 /**
  * Handle a MIDI event through a MIDI router instance.
  * @param data MIDI router instance #fluid_midi_router_t, its a void * so that
@@ -520,11 +671,334 @@ fluid_midi_router_rule_set_param2 (fluid_midi_router_rule_t *rule, int min, int
  * - velocity switching ("v <=100: Angel Choir; V > 100: Hell's Bells")
  * - get rid of aftertouch
  * - ...
+ *
+ * Before the rules are applied, events may be dropped or merged to protect the
+ * synth from MIDI floods, see the midi.router.* settings.
  */
 int
 fluid_midi_router_handle_midi_event (void* data, fluid_midi_event_t* event)
 {
   fluid_midi_router_t* router = (fluid_midi_router_t *)data;
+  int ret_val = FLUID_OK;
+
+  /* Some keyboards report noteoff through a noteon event with vel=0.
+   * Convert those to noteoff to ease processing. */
+  if (event->type == NOTE_ON && event->param2 == 0)
+  {
+    event->type = NOTE_OFF;
+    event->param2 = 127;        /* Release velocity */
+  }
+
+  fluid_mutex_lock (router->rules_mutex);   /* ++ lock rules */
+
+  if (fluid_midi_router_admit_LOCAL (router, event))
+    ret_val = fluid_midi_router_route_LOCAL (router, event);
+
+  fluid_mutex_unlock (router->rules_mutex);         /* -- unlock rules */
+
+  return ret_val;
+}
+
+/* Is a controller continuous, so that only its latest value matters? Bank
+ * select, data entry and (N)RPN controllers depend on their order with other
+ * events, switches (including the general purpose controllers 5-8, which
+ * are commonly used as buttons) and channel mode messages must not be lost. */
+static int
+fluid_midi_router_is_continuous_cc (int ctrl)
+{
+  return (ctrl > BANK_SELECT_MSB && ctrl < BANK_SELECT_LSB && ctrl != DATA_ENTRY_MSB)
+    || (ctrl > BANK_SELECT_LSB && ctrl < SUSTAIN_SWITCH && ctrl != DATA_ENTRY_LSB)
+    || (ctrl >= SOUND_CTRL1 && ctrl <= EFFECTS_DEPTH5
+        && (ctrl < GPC5 || ctrl > PORTAMENTO_CTRL));
+}
+
+/* The MSB controller of the 14 bit pair of a continuous controller, or -1
+ * if it isn't part of one. The values of a pair are held back and sent
+ * together, so that the synth never sees the new MSB with the old LSB. */
+static FLUID_INLINE int
+fluid_midi_router_cc_pair (int ctrl)
+{
+  if (!fluid_midi_router_is_continuous_cc (ctrl))
+    return -1;
+  if (ctrl < BANK_SELECT_LSB)
+    return ctrl;
+  if (ctrl < SUSTAIN_SWITCH)
+    return ctrl - BANK_SELECT_LSB;
+  return -1;
+}
+
+/* Forgets the held back controller values of a channel and, if
+ * 'release_keys' is TRUE, the noteons merged into (see
+ * fluid_midi_router_admit_LOCAL), called with the rules locked */
+static void
+fluid_midi_router_reset_channel_LOCAL (fluid_midi_router_t *router, int chan,
+                                       int release_keys, unsigned int now)
+{
+  int i;
+
+  if (router->cc_interval > 0)
+  {
+    for (i = chan * 128; i < (chan + 1) * 128; i++)
+    {
+      if (router->cc_pending[i] >= 0)
+      {
+        router->cc_pending[i] = -1;
+        router->cc_pending_count--;
+      }
+    }
+    FLUID_MEMSET (router->cc_lsb_due + chan * 32, 0, 32);
+  }
+
+  if (release_keys && router->retrigger_interval > 0)
+  {
+    for (i = chan * 128; i < (chan + 1) * 128; i++)
+      router->key_time[i] = now - router->retrigger_interval;
+  }
+}
+
+/*
+ * Flood protection, called with the rules locked. Returns TRUE if the event
+ * is to be routed now, FALSE if it was dropped or held back:
+ * - A noteon on a key, which is still held from a noteon less than
+ *   midi.router.retrigger-interval msec before, is merged into that noteon.
+ * - A value of a continuous controller, less than midi.router.cc-interval
+ *   msec after the previous value, is held back. Only the latest held back
+ *   value is sent, by fluid_midi_router_send_pending_cc(). The MSB and LSB
+ *   of a 14 bit controller count as one: the LSB following a sent MSB is
+ *   sent, too, and held back values of both are sent together.
+ * - Each channel has a bucket of midi.router.rate-burst tokens, refilled at
+ *   midi.router.rate-limit tokens per second. An event needs a token.
+ * Events which end something (noteoffs, sustain pedal up, channel mode
+ * messages) always pass, so that no notes get stuck. Channel mode messages
+ * and system resets drop the held back controller values they supersede.
+ */
+static int
+fluid_midi_router_admit_LOCAL (fluid_midi_router_t *router, fluid_midi_event_t *event)
+{
+  int chan = event->channel;
+  unsigned int now;
+  float tokens;
+  int i, pair, msb, lsb;
+
+  if (router->rate_limit <= 0 && router->cc_interval <= 0
+      && router->retrigger_interval <= 0)
+    return TRUE;
+
+  if (event->type == MIDI_SYSTEM_RESET)
+  {
+    now = fluid_curtime ();
+    for (i = 0; i < router->nr_midi_channels; i++)
+      fluid_midi_router_reset_channel_LOCAL (router, i, TRUE, now);
+    return TRUE;
+  }
+
+  if (chan < 0 || chan >= router->nr_midi_channels)
+    return TRUE;
+
+  switch (event->type)
+  {
+      case NOTE_ON:
+      case PROGRAM_CHANGE:
+      case PITCH_BEND:
+      case CHANNEL_PRESSURE:
+      case KEY_PRESSURE:
+        break;
+      case NOTE_OFF:
+        /* A noteon after the key was released isn't merged */
+        if (router->retrigger_interval > 0)
+          router->key_time[chan * 128 + event->param1]
+            = fluid_curtime () - router->retrigger_interval;
+        return TRUE;
+      case CONTROL_CHANGE:
+        if (event->param1 >= ALL_SOUND_OFF)
+        {
+          /* All except reset all controllers end the notes, too */
+          fluid_midi_router_reset_channel_LOCAL (router, chan,
+                                                 event->param1 != ALL_CTRL_OFF,
+                                                 fluid_curtime ());
+          return TRUE;
+        }
+        if (event->param1 == SUSTAIN_SWITCH && event->param2 < 64)
+          return TRUE;
+        break;
+      default:
+        return TRUE;
+  }
+
+  now = fluid_curtime ();
+
+  if (event->type == NOTE_ON && router->retrigger_interval > 0)
+  {
+    i = chan * 128 + event->param1;
+    if (now - router->key_time[i] < (unsigned int)router->retrigger_interval)
+    {
+      router->merged_events++;
+      return FALSE;
+    }
+    router->key_time[i] = now;
+  }
+
+  if (event->type == CONTROL_CHANGE && router->cc_interval > 0
+      && fluid_midi_router_is_continuous_cc (event->param1))
+  {
+    i = chan * 128 + event->param1;
+    pair = fluid_midi_router_cc_pair (event->param1);
+
+    if (pair < 0)
+    {
+      /* The interval of a controller pair is kept by its MSB */
+      msb = lsb = i;
+    }
+    else
+    {
+      msb = chan * 128 + pair;
+      lsb = msb + BANK_SELECT_LSB;
+    }
+
+    if (router->cc_pending[i] >= 0)
+    {
+      router->thinned_events++;
+      router->cc_pending[i] = event->param2;
+      return FALSE;
+    }
+
+    /* The LSB completing a sent MSB goes right after it */
+    if (pair >= 0 && i == lsb && router->cc_lsb_due[chan * 32 + pair]
+        && router->cc_pending[msb] < 0)
+      router->cc_lsb_due[chan * 32 + pair] = FALSE;
+    else if (router->cc_pending[msb] >= 0 || router->cc_pending[lsb] >= 0
+             || now - router->cc_time[msb] < (unsigned int)router->cc_interval)
+    {
+      if (router->cc_pending_count == 0
+          && fluid_midi_router_arm_cc_timer_LOCAL (router) != FLUID_OK)
+        return TRUE;    /* Better sent too often than never */
+      router->cc_pending[i] = event->param2;
+      router->cc_pending_count++;
+      return FALSE;
+    }
+    else
+    {
+      router->cc_time[msb] = now;
+      if (pair >= 0)
+        router->cc_lsb_due[chan * 32 + pair] = (i == msb);
+    }
+  }
+
+  if (router->rate_limit > 0)
+  {
+    tokens = router->tokens[chan]
+      + (now - router->token_time[chan]) * router->rate_limit / 1000.0f;
+    router->token_time[chan] = now;
+    if (tokens > router->rate_burst)
+      tokens = router->rate_burst;
+
+    if (tokens < 1.0f)
+    {
+      router->tokens[chan] = tokens;
+      router->dropped_events++;
+      return FALSE;
+    }
+    router->tokens[chan] = tokens - 1.0f;
+  }
+
+  return TRUE;
+}
+
+/* Starts the timer sending held back controller values, called with the
+ * rules locked when a value is held back while none is. A timer which
+ * stopped after sending the last values is waited for first. */
+static int
+fluid_midi_router_arm_cc_timer_LOCAL (fluid_midi_router_t *router)
+{
+  if (router->cc_timer_armed)
+    return FLUID_OK;
+
+  if (router->cc_timer)
+  {
+    /* Its thread only exits, it doesn't lock the rules anymore */
+    delete_fluid_timer (router->cc_timer);
+    router->cc_timer = NULL;
+  }
+
+  router->cc_timer = new_fluid_timer (router->cc_interval, fluid_midi_router_send_pending_cc,
+                                      router, TRUE, FALSE, FALSE);
+  if (!router->cc_timer)
+    return FLUID_FAILED;
+
+  router->cc_timer_armed = TRUE;
+  return FLUID_OK;
+}
+
+/* Sends a held back controller value, called with the rules locked */
+static void
+fluid_midi_router_send_cc_LOCAL (fluid_midi_router_t *router, int i)
+{
+  fluid_midi_event_t event;
+
+  fluid_midi_event_set_type (&event, CONTROL_CHANGE);
+  fluid_midi_event_set_channel (&event, i / 128);
+  event.param1 = i % 128;
+  event.param2 = router->cc_pending[i];
+
+  router->cc_pending[i] = -1;
+  router->cc_pending_count--;
+
+  fluid_midi_router_route_LOCAL (router, &event);
+}
+
+/* Timer callback, which sends the held back controller values, once their
+ * interval has passed (see fluid_midi_router_admit_LOCAL). The timer stops
+ * when none are left, until the next value is held back. */
+static int
+fluid_midi_router_send_pending_cc (void *data, unsigned int msec)
+{
+  fluid_midi_router_t *router = (fluid_midi_router_t *)data;
+  unsigned int now;
+  int i, pair, lsb, chan, sent_msb, armed;
+
+  fluid_mutex_lock (router->rules_mutex);   /* ++ lock rules */
+
+  now = fluid_curtime ();
+  for (i = 0; router->cc_pending_count > 0 && i < router->nr_midi_channels * 128; i++)
+  {
+    pair = fluid_midi_router_cc_pair (i % 128);
+
+    /* The LSB of a pair is sent with its MSB */
+    if (pair >= 0 && i % 128 >= BANK_SELECT_LSB)
+      continue;
+
+    lsb = (pair >= 0) ? i + BANK_SELECT_LSB : i;
+    if ((router->cc_pending[i] < 0 && router->cc_pending[lsb] < 0)
+        || now - router->cc_time[i] < (unsigned int)router->cc_interval)
+      continue;
+
+    router->cc_time[i] = now;
+    sent_msb = (router->cc_pending[i] >= 0);
+    if (sent_msb)
+      fluid_midi_router_send_cc_LOCAL (router, i);
+
+    if (pair >= 0)
+    {
+      chan = i / 128;
+      router->cc_lsb_due[chan * 32 + pair] = sent_msb && router->cc_pending[lsb] < 0;
+      if (router->cc_pending[lsb] >= 0)
+        fluid_midi_router_send_cc_LOCAL (router, lsb);
+    }
+  }
+
+  if (router->cc_pending_count == 0)
+    router->cc_timer_armed = FALSE;
+  armed = router->cc_timer_armed;
+
+  fluid_mutex_unlock (router->rules_mutex);         /* -- unlock rules */
+
+  return armed;
+}
+
+/* Applies the rules to an event, called with the rules locked */
+static int
+fluid_midi_router_route_LOCAL (fluid_midi_router_t *router, fluid_midi_event_t *event)
+{
   fluid_midi_router_rule_t **rulep, *rule, *next_rule, *prev_rule = NULL;
   int event_has_par2 = 0; /* Flag, indicates that current event needs two parameters */
   int par1_max = 127;     /* Range limit for par1 */
@@ -538,16 +1012,6 @@ fluid_midi_router_handle_midi_event (void* data, fluid_midi_event_t* event)
   int event_par2;
   fluid_midi_event_t new_event;
 
-  /* Some keyboards report noteoff through a noteon event with vel=0.
-   * Convert those to noteoff to ease processing. */
-  if (event->type == NOTE_ON && event->param2 == 0)
-  {
-    event->type = NOTE_OFF;
-    event->param2 = 127;        /* Release velocity */
-  }
-
-  fluid_mutex_lock (router->rules_mutex);   /* ++ lock rules */
-
   /* Depending on the event type, choose the correct list of rules. */
   switch (event->type)
   {
@@ -579,9 +1043,7 @@ fluid_midi_router_handle_midi_event (void* data, fluid_midi_event_t* event)
 	break;
       case MIDI_SYSTEM_RESET:
       case MIDI_SYSEX:
-        ret_val = router->event_handler (router->event_handler_data,event);
-        fluid_mutex_unlock (router->rules_mutex);  /* -- unlock rules */
-        return ret_val;
+        return router->event_handler (router->event_handler_data,event);
       default:
         rulep = NULL;    /* Event will not be passed on */
 	break;
@@ -737,8 +1199,6 @@ send_event:
       ret_val = FLUID_FAILED;
   }
 
-  fluid_mutex_unlock (router->rules_mutex);         /* -- unlock rules */
-
   return ret_val;
 }
 
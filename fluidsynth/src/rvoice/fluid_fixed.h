@@ -0,0 +1,88 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+
+#ifndef _FLUID_FIXED_H
+#define _FLUID_FIXED_H
+
+#include "fluidsynth_priv.h"
+#include "fluid_sys.h"
+
+#ifdef WITH_FIXED_POINT
+
+/*
+ * Fixed point numbers of the integer kernels (synth.fixed-point). A value
+ * with n fraction bits is stored as value * 2^n. Products are taken in 64
+ * bits and shifted back.
+ *
+ * The kernels are scalar C like the floating point ones, they process one
+ * sample point at a time and use no SIMD instructions. They only gain on
+ * CPUs with a slow FPU or none, on x86-64 they run about as fast as the
+ * floating point kernels.
+ */
+typedef sint32 fluid_fixed_t;
+
+/* Voice blocks, in sample point units like the floating point blocks */
+#define FLUID_FIXED_BLOCK_BITS 8
+/* Voice amplitude (at most 1, the attenuation is never negative). The
+ * increment is added up over a block, so the amplitude needs the bits. */
+#define FLUID_FIXED_AMP_BITS 30
+/* Interpolation coefficients, a weighted sum of 16 bit points fits into
+ * 31 bits as long as the sum of the coefficients' magnitudes is below 2 */
+#define FLUID_FIXED_COEFF_BITS 15
+/* IIR filter coefficients (magnitude below 8) */
+#define FLUID_FIXED_FILTER_BITS 28
+/* Reverb signal (at most 31, the reverb input is attenuated a lot) and
+ * reverb filter coefficients (at most 7) */
+#define FLUID_FIXED_REVERB_BITS 26
+#define FLUID_FIXED_GAIN_BITS 28
+/* Reverb output gains (at most 2047, they grow with the reverb width) */
+#define FLUID_FIXED_WET_BITS 20
+/* Pan and effect send gains of a voice block (at most 10/32768, the synth
+ * gain scaled to sample points). Blocks are mixed into 64 bit accumulators
+ * with FLUID_FIXED_BLOCK_BITS + FLUID_FIXED_MIX_BITS fraction bits. */
+#define FLUID_FIXED_MIX_BITS 36
+
+typedef long long fluid_fixed_acc_t;
+
+/* Product of a and b, where b has the given count of fraction bits */
+#define fluid_fixed_mul(_a, _b, _bits) \
+  ((fluid_fixed_t) (((long long) (_a) * (_b)) >> (_bits)))
+
+/* The same, rounded to the nearest value. Truncation errors add up to a DC
+ * offset over many voices and in feedback loops, use this one there. */
+#define fluid_fixed_mul_round(_a, _b, _bits) \
+  ((fluid_fixed_t) (((long long) (_a) * (_b) + (1LL << ((_bits) - 1))) >> (_bits)))
+
+/* Convert to floating point */
+#define fluid_fixed_to_real(_x, _bits) \
+  ((fluid_real_t) (_x) * (fluid_real_t) (1.0 / (double) (1LL << (_bits))))
+
+/* Convert from floating point, rounded to the nearest value */
+static FLUID_INLINE fluid_fixed_t
+fluid_fixed_from_real(double x, int bits)
+{
+  x *= (double) (1LL << bits);
+  return (fluid_fixed_t) (x < 0.0 ? x - 0.5 : x + 0.5);
+}
+
+#endif /* WITH_FIXED_POINT */
+
+#endif /* _FLUID_FIXED_H */
@@ -22,6 +22,104 @@
 #include "fluid_sys.h"
 #include "fluid_conv.h"
 
+/*
+ * Filter with changing coefficients, until the increments have been added
+ * filter_coeff_incr_count times. The compensation of the history is only
+ * compiled in, where compensate is 1.
+ */
+static FLUID_INLINE int
+fluid_iir_filter_apply_ramp(fluid_iir_filter_t* iir_filter,
+                            fluid_real_t *dsp_buf, int count,
+                            const int compensate)
+{
+  /* IIR filter sample history */
+  fluid_real_t dsp_hist1 = iir_filter->hist1;
+  fluid_real_t dsp_hist2 = iir_filter->hist2;
+
+  /* IIR filter coefficients */
+  fluid_real_t dsp_a1 = iir_filter->a1;
+  fluid_real_t dsp_a2 = iir_filter->a2;
+  fluid_real_t dsp_b02 = iir_filter->b02;
+  fluid_real_t dsp_b1 = iir_filter->b1;
+  fluid_real_t dsp_a1_incr = iir_filter->a1_incr;
+  fluid_real_t dsp_a2_incr = iir_filter->a2_incr;
+  fluid_real_t dsp_b02_incr = iir_filter->b02_incr;
+  fluid_real_t dsp_b1_incr = iir_filter->b1_incr;
+  fluid_real_t dsp_offset = iir_filter->denormal_offset;
+
+  fluid_real_t dsp_centernode;
+  int dsp_i;
+
+  if (count > iir_filter->filter_coeff_incr_count)
+    count = iir_filter->filter_coeff_incr_count;
+
+  for (dsp_i = 0; dsp_i < count; dsp_i++)
+  {
+    fluid_real_t old_b02 = dsp_b02;
+
+    /* The filter is implemented in Direct-II form. */
+    dsp_centernode = dsp_buf[dsp_i] + dsp_offset - dsp_a1 * dsp_hist1 - dsp_a2 * dsp_hist2;
+    dsp_buf[dsp_i] = dsp_b02 * (dsp_centernode + dsp_hist2) + dsp_b1 * dsp_hist1;
+    dsp_hist2 = dsp_hist1;
+    dsp_hist1 = dsp_centernode;
+
+    dsp_a1 += dsp_a1_incr;
+    dsp_a2 += dsp_a2_incr;
+    dsp_b02 += dsp_b02_incr;
+    dsp_b1 += dsp_b1_incr;
+
+    /* Compensate history to avoid the filter going havoc with large frequency changes */
+    if (compensate && fabs(dsp_b02) > 0.001) {
+      fluid_real_t compensation = old_b02 / dsp_b02;
+      dsp_centernode *= compensation;
+      dsp_hist1 *= compensation;
+      dsp_hist2 *= compensation;
+    }
+  } /* for dsp_i */
+
+  iir_filter->hist1 = dsp_hist1;
+  iir_filter->hist2 = dsp_hist2;
+  iir_filter->a1 = dsp_a1;
+  iir_filter->a2 = dsp_a2;
+  iir_filter->b02 = dsp_b02;
+  iir_filter->b1 = dsp_b1;
+  iir_filter->filter_coeff_incr_count -= count;
+  return count;
+}
+
+/*
+ * Filter with constant coefficients.
+ */
+static FLUID_INLINE void
+fluid_iir_filter_apply_steady(fluid_iir_filter_t* iir_filter,
+                              fluid_real_t *dsp_buf, int count)
+{
+  /* IIR filter sample history */
+  fluid_real_t dsp_hist1 = iir_filter->hist1;
+  fluid_real_t dsp_hist2 = iir_filter->hist2;
+
+  /* IIR filter coefficients */
+  fluid_real_t dsp_a1 = iir_filter->a1;
+  fluid_real_t dsp_a2 = iir_filter->a2;
+  fluid_real_t dsp_b02 = iir_filter->b02;
+  fluid_real_t dsp_b1 = iir_filter->b1;
+  fluid_real_t dsp_offset = iir_filter->denormal_offset;
+
+  fluid_real_t dsp_centernode;
+  int dsp_i;
+
+  for (dsp_i = 0; dsp_i < count; dsp_i++)
+  { /* The filter is implemented in Direct-II form. */
+    dsp_centernode = dsp_buf[dsp_i] + dsp_offset - dsp_a1 * dsp_hist1 - dsp_a2 * dsp_hist2;
+    dsp_buf[dsp_i] = dsp_b02 * (dsp_centernode + dsp_hist2) + dsp_b1 * dsp_hist1;
+    dsp_hist2 = dsp_hist1;
+    dsp_hist1 = dsp_centernode;
+  }
+
+  iir_filter->hist1 = dsp_hist1;
+  iir_filter->hist2 = dsp_hist2;
+}
+
 /**
  * Applies a lowpass filter with variable cutoff frequency and quality factor.
  * Also modifies filter state accordingly.
@@ -35,107 +133,177 @@
  *
  * A couple of variables are used internally, their results are discarded:
  * - dsp_i: Index through the output buffer
- * - dsp_phase_fractional: The fractional part of dsp_phase
- * - dsp_coeff: A table of four coefficients, depending on the fractional phase.
- *              Used to interpolate between samples.
- * - dsp_process_buffer: Holds the processed signal between stages
  * - dsp_centernode: delay line for the IIR filter
  * - dsp_hist1: same
  * - dsp_hist2: same
+ *
+ * The filter loop is specialized: the block is left as it is while the
+ * filter is bypassed, filtered with changing coefficients (with or
+ * without compensation of the history) while the filter is changing
+ * towards its new setting, and with constant coefficients after that.
  */
 void 
 fluid_iir_filter_apply(fluid_iir_filter_t* iir_filter,
                        fluid_real_t *dsp_buf, int count)
 {
-  /* IIR filter sample history */
-  fluid_real_t dsp_hist1 = iir_filter->hist1;
-  fluid_real_t dsp_hist2 = iir_filter->hist2;
+  int done = 0;
 
-  /* IIR filter coefficients */
-  fluid_real_t dsp_a1 = iir_filter->a1;
-  fluid_real_t dsp_a2 = iir_filter->a2;
-  fluid_real_t dsp_b02 = iir_filter->b02;
-  fluid_real_t dsp_b1 = iir_filter->b1;
-  int dsp_filter_coeff_incr_count = iir_filter->filter_coeff_incr_count;
+  if (iir_filter->bypassed)
+  {
+    /* Keep the history at the level of the signal, as if the (nearly
+     * transparent) filter had run, so that it picks up without a click */
+    if (count > 0)
+      iir_filter->hist1 = iir_filter->hist2 = dsp_buf[count - 1]
+        / (1.0f + iir_filter->a1 + iir_filter->a2);
+    return;
+  }
 
-  fluid_real_t dsp_centernode;
-  int dsp_i;
+  /* Check for denormal number (too close to zero). */
+  if (fabs (iir_filter->hist1) < 1e-20) iir_filter->hist1 = 0.0f;  /* FIXME JMG - Is this even needed? */
 
-  /* filter (implement the voice filter according to SoundFont standard) */
+  if (iir_filter->filter_coeff_incr_count > 0)
+  {
+    if (iir_filter->compensate_incr)
+      done = fluid_iir_filter_apply_ramp(iir_filter, dsp_buf, count, 1);
+    else
+      done = fluid_iir_filter_apply_ramp(iir_filter, dsp_buf, count, 0);
+  }
 
-  /* Check for denormal number (too close to zero). */
-  if (fabs (dsp_hist1) < 1e-20) dsp_hist1 = 0.0f;  /* FIXME JMG - Is this even needed? */
+  /* The filter parameters are constant for the rest of the block */
+  if (done < count)
+    fluid_iir_filter_apply_steady(iir_filter, dsp_buf + done, count - done);
 
-  /* Two versions of the filter loop. One, while the filter is
-  * changing towards its new setting. The other, if the filter
-  * doesn't change.
-  */
+  fluid_check_fpe ("voice_filter");
+}
 
-  if (dsp_filter_coeff_incr_count > 0)
-  {
-    fluid_real_t dsp_a1_incr = iir_filter->a1_incr;
-    fluid_real_t dsp_a2_incr = iir_filter->a2_incr;
-    fluid_real_t dsp_b02_incr = iir_filter->b02_incr;
-    fluid_real_t dsp_b1_incr = iir_filter->b1_incr;
+#ifdef WITH_FIXED_POINT
 
+/* Saturate a 64 bit filter output to fluid_fixed_t */
+#define fluid_iir_filter_saturate(_y) \
+  ((_y) > 0x7fffffffLL ? 0x7fffffff : (_y) < -0x7fffffffLL ? -0x7fffffff : (fluid_fixed_t) (_y))
 
-    /* Increment is added to each filter coefficient filter_coeff_incr_count times. */
-    for (dsp_i = 0; dsp_i < count; dsp_i++)
+/*
+ * Fixed point filter loop, with changing coefficients where ramp is 1.
+ * hist holds x1, x2, y1, y2, coeffs and incr hold b02, b1, a1, a2.
+ */
+static FLUID_INLINE void
+fluid_iir_filter_run_fixed(fluid_fixed_t *hist, fluid_fixed_t *coeffs,
+                           const fluid_fixed_t *incr, fluid_fixed_t *fixed_buf,
+                           int count, const int ramp)
+{
+  fluid_fixed_t x1 = hist[0], x2 = hist[1], y1 = hist[2], y2 = hist[3];
+  fluid_fixed_t b02 = coeffs[0], b1 = coeffs[1], a1 = coeffs[2], a2 = coeffs[3];
+  long long acc;
+  int dsp_i;
+
+  for (dsp_i = 0; dsp_i < count; dsp_i++)
+  {
+    acc = (long long) b02 * ((long long) fixed_buf[dsp_i] + x2)
+      + (long long) b1 * x1 - (long long) a1 * y1 - (long long) a2 * y2
+      + (1LL << (FLUID_FIXED_FILTER_BITS - 1));
+    acc >>= FLUID_FIXED_FILTER_BITS;
+    x2 = x1;
+    x1 = fixed_buf[dsp_i];
+    y2 = y1;
+    y1 = fluid_iir_filter_saturate(acc);
+    fixed_buf[dsp_i] = y1;
+
+    if (ramp)
     {
-      /* The filter is implemented in Direct-II form. */
-      dsp_centernode = dsp_buf[dsp_i] - dsp_a1 * dsp_hist1 - dsp_a2 * dsp_hist2;
-      dsp_buf[dsp_i] = dsp_b02 * (dsp_centernode + dsp_hist2) + dsp_b1 * dsp_hist1;
-      dsp_hist2 = dsp_hist1;
-      dsp_hist1 = dsp_centernode;
-
-      if (dsp_filter_coeff_incr_count-- > 0)
-      {
-        fluid_real_t old_b02 = dsp_b02;
-	dsp_a1 += dsp_a1_incr;
-	dsp_a2 += dsp_a2_incr;
-	dsp_b02 += dsp_b02_incr;
-	dsp_b1 += dsp_b1_incr;
-
-        /* Compensate history to avoid the filter going havoc with large frequency changes */
-	if (iir_filter->compensate_incr && fabs(dsp_b02) > 0.001) {
-          fluid_real_t compensate = old_b02 / dsp_b02;
-          dsp_centernode *= compensate;
-          dsp_hist1 *= compensate;
-          dsp_hist2 *= compensate;
-        }
-      }
-    } /* for dsp_i */
+      b02 += incr[0];
+      b1 += incr[1];
+      a1 += incr[2];
+      a2 += incr[3];
+    }
   }
-  else /* The filter parameters are constant.  This is duplicated to save time. */
+
+  hist[0] = x1;
+  hist[1] = x2;
+  hist[2] = y1;
+  hist[3] = y2;
+  coeffs[0] = b02;
+  coeffs[1] = b1;
+  coeffs[2] = a1;
+  coeffs[3] = a2;
+}
+
+/**
+ * Applies the lowpass filter to a block of the fixed point kernels
+ * (synth.fixed-point). It is the same filter in Direct-I form: its history
+ * stays at the level of the signal, so it needs neither the headroom nor
+ * the history compensation of the Direct-II form. The coefficients are
+ * converted once per block and ramped like in fluid_iir_filter_apply.
+ * @param iir_filter Filter parameter
+ * @param fixed_buf Block with FLUID_FIXED_BLOCK_BITS fraction bits
+ * @param count Count of samples in fixed_buf
+ */
+void
+fluid_iir_filter_apply_fixed(fluid_iir_filter_t* iir_filter,
+                             fluid_fixed_t *fixed_buf, int count)
+{
+  fluid_fixed_t hist[4], coeffs[4], incr[4];
+  int ramp = 0;
+
+  if (iir_filter->bypassed)
   {
-    for (dsp_i = 0; dsp_i < count; dsp_i++)
-    { /* The filter is implemented in Direct-II form. */
-      dsp_centernode = dsp_buf[dsp_i] - dsp_a1 * dsp_hist1 - dsp_a2 * dsp_hist2;
-      dsp_buf[dsp_i] = dsp_b02 * (dsp_centernode + dsp_hist2) + dsp_b1 * dsp_hist1;
-      dsp_hist2 = dsp_hist1;
-      dsp_hist1 = dsp_centernode;
-    }
+    /* Keep the history at the level of the signal, as in
+     * fluid_iir_filter_apply */
+    if (count > 0)
+      iir_filter->fixed_x1 = iir_filter->fixed_x2 = iir_filter->fixed_y1
+        = iir_filter->fixed_y2 = fixed_buf[count - 1];
+    return;
   }
 
-  iir_filter->hist1 = dsp_hist1;
-  iir_filter->hist2 = dsp_hist2;
-  iir_filter->a1 = dsp_a1;
-  iir_filter->a2 = dsp_a2;
-  iir_filter->b02 = dsp_b02;
-  iir_filter->b1 = dsp_b1;
-  iir_filter->filter_coeff_incr_count = dsp_filter_coeff_incr_count;
+  hist[0] = iir_filter->fixed_x1;
+  hist[1] = iir_filter->fixed_x2;
+  hist[2] = iir_filter->fixed_y1;
+  hist[3] = iir_filter->fixed_y2;
+  coeffs[0] = fluid_fixed_from_real(iir_filter->b02, FLUID_FIXED_FILTER_BITS);
+  coeffs[1] = fluid_fixed_from_real(iir_filter->b1, FLUID_FIXED_FILTER_BITS);
+  coeffs[2] = fluid_fixed_from_real(iir_filter->a1, FLUID_FIXED_FILTER_BITS);
+  coeffs[3] = fluid_fixed_from_real(iir_filter->a2, FLUID_FIXED_FILTER_BITS);
 
-  fluid_check_fpe ("voice_filter");
+  if (iir_filter->filter_coeff_incr_count > 0)
+  {
+    ramp = (count < iir_filter->filter_coeff_incr_count)
+      ? count : iir_filter->filter_coeff_incr_count;
+    incr[0] = fluid_fixed_from_real(iir_filter->b02_incr, FLUID_FIXED_FILTER_BITS);
+    incr[1] = fluid_fixed_from_real(iir_filter->b1_incr, FLUID_FIXED_FILTER_BITS);
+    incr[2] = fluid_fixed_from_real(iir_filter->a1_incr, FLUID_FIXED_FILTER_BITS);
+    incr[3] = fluid_fixed_from_real(iir_filter->a2_incr, FLUID_FIXED_FILTER_BITS);
+    fluid_iir_filter_run_fixed(hist, coeffs, incr, fixed_buf, ramp, 1);
+
+    /* Keep the floating point coefficients in step */
+    iir_filter->b02 += ramp * iir_filter->b02_incr;
+    iir_filter->b1 += ramp * iir_filter->b1_incr;
+    iir_filter->a1 += ramp * iir_filter->a1_incr;
+    iir_filter->a2 += ramp * iir_filter->a2_incr;
+    iir_filter->filter_coeff_incr_count -= ramp;
+  }
+
+  if (ramp < count)
+    fluid_iir_filter_run_fixed(hist, coeffs, NULL, fixed_buf + ramp, count - ramp, 0);
+
+  iir_filter->fixed_x1 = hist[0];
+  iir_filter->fixed_x2 = hist[1];
+  iir_filter->fixed_y1 = hist[2];
+  iir_filter->fixed_y2 = hist[3];
 }
 
+#endif /* WITH_FIXED_POINT */
 
 void 
 fluid_iir_filter_reset(fluid_iir_filter_t* iir_filter)
 {
   iir_filter->hist1 = 0;
   iir_filter->hist2 = 0;
+#ifdef WITH_FIXED_POINT
+  iir_filter->fixed_x1 = iir_filter->fixed_x2 = 0;
+  iir_filter->fixed_y1 = iir_filter->fixed_y2 = 0;
+#endif
   iir_filter->last_fres = -1.;
   iir_filter->filter_startup = 1;
+  iir_filter->bypassed = 0;
 }
 
 void 
@@ -147,6 +315,31 @@ fluid_iir_filter_set_fres(fluid_iir_filter_t* iir_filter,
 }
 
 
+/**
+ * Allow to bypass the filter, while it is wide open (at 0.45 times the
+ * output rate) and has no resonance. It is nearly, but not entirely
+ * transparent then, see fluid_iir_filter_calc.
+ */
+void 
+fluid_iir_filter_set_bypass(fluid_iir_filter_t* iir_filter, 
+                            int bypass_open)
+{
+  iir_filter->bypass_open = bypass_open;
+}
+
+/**
+ * Keep the filter history out of the denormal range by adding an inaudible
+ * offset to its input, for FPUs which can't flush denormals to zero. The
+ * history of a decaying voice would otherwise decay into them.
+ */
+void 
+fluid_iir_filter_set_denormal_offset(fluid_iir_filter_t* iir_filter, 
+                                     int enabled)
+{
+  iir_filter->denormal_offset = enabled ? FLUID_DENORMAL_OFFSET_VALUE : 0.0f;
+}
+
+
 void 
 fluid_iir_filter_set_q_dB(fluid_iir_filter_t* iir_filter, 
                           fluid_real_t q_dB)
@@ -168,6 +361,10 @@ fluid_iir_filter_set_q_dB(fluid_iir_filter_t* iir_filter,
      */
     iir_filter->filter_gain = (fluid_real_t) (1.0 / sqrt(iir_filter->q_lin));
 
+    /* The voice takes 3.01 dB off the Q generator, so that a Q of 0
+     * gives no resonance hump (see GEN_FILTERQ in fluid_voice.c) */
+    iir_filter->q_zero = (q_dB <= -3.0f);
+
     /* The synthesis loop will have to recalculate the filter coefficients. */
     iir_filter->last_fres = -1.;
 
@@ -258,6 +455,7 @@ void fluid_iir_filter_calc(fluid_iir_filter_t* iir_filter,
                            fluid_real_t fres_mod)
 {
   fluid_real_t fres;
+  int wide_open = 0;
 
   /* calculate the frequency of the resonant filter in Hz */
   fres = fluid_ct2hz(iir_filter->fres + fres_mod);
@@ -275,8 +473,11 @@ void fluid_iir_filter_calc(fluid_iir_filter_t* iir_filter,
    * clipping the maximum filter frequency at 0.45*srate, the filter
    * is used as an anti-aliasing filter. */
 
-  if (fres > 0.45f * output_rate)
+  if (fres >= 0.45f * output_rate)
+  {
     fres = 0.45f * output_rate;
+    wide_open = 1;
+  }
   else if (fres < 5)
     fres = 5;
 
@@ -294,6 +495,10 @@ void fluid_iir_filter_calc(fluid_iir_filter_t* iir_filter,
                                             output_rate);
   }
 
+  /* Bypass the wide open filter once its coefficients have settled */
+  iir_filter->bypassed = iir_filter->bypass_open && iir_filter->q_zero
+    && wide_open && iir_filter->filter_coeff_incr_count <= 0;
+
 
   fluid_check_fpe ("voice_write DSP coefficients");
 
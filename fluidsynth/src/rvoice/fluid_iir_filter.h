@@ -22,6 +22,7 @@
 #define _FLUID_IIR_FILTER_H
 
 #include "fluidsynth_priv.h"
+#include "fluid_fixed.h"
 
 typedef struct _fluid_iir_filter_t fluid_iir_filter_t;
 
@@ -29,6 +30,11 @@ typedef struct _fluid_iir_filter_t fluid_iir_filter_t;
 void fluid_iir_filter_apply(fluid_iir_filter_t* iir_filter,
                             fluid_real_t *dsp_buf, int dsp_buf_count); 
 
+#ifdef WITH_FIXED_POINT
+void fluid_iir_filter_apply_fixed(fluid_iir_filter_t* iir_filter,
+                                  fluid_fixed_t *fixed_buf, int count);
+#endif
+
 void fluid_iir_filter_reset(fluid_iir_filter_t* iir_filter);
 
 void fluid_iir_filter_set_q_dB(fluid_iir_filter_t* iir_filter, 
@@ -37,6 +43,12 @@ void fluid_iir_filter_set_q_dB(fluid_iir_filter_t* iir_filter,
 void fluid_iir_filter_set_fres(fluid_iir_filter_t* iir_filter, 
                                fluid_real_t fres);
 
+void fluid_iir_filter_set_bypass(fluid_iir_filter_t* iir_filter, 
+                                 int bypass_open);
+
+void fluid_iir_filter_set_denormal_offset(fluid_iir_filter_t* iir_filter, 
+                                          int enabled);
+
 void fluid_iir_filter_calc(fluid_iir_filter_t* iir_filter, 
                            fluid_real_t output_rate, 
                            fluid_real_t fres_mod); 
@@ -69,6 +81,16 @@ struct _fluid_iir_filter_t
 	/* indicates, that the filter has to be recalculated. */
 	fluid_real_t q_lin;             /* the q-factor on a linear scale */
 	fluid_real_t filter_gain;       /* Gain correction factor, depends on q */
+	int q_zero;                     /* Flag: the filter has no resonance (Q generator 0) */
+	int bypass_open;                /* Flag: bypass the filter while it is wide open
+					   with no resonance (synth.filter-bypass) */
+	int bypassed;                   /* Flag: the filter is bypassed for this block */
+	fluid_real_t denormal_offset;   /* Added to the input to keep the history out of the
+					   denormal range, 0 unless FLUID_DENORMAL_OFFSET */
+#ifdef WITH_FIXED_POINT
+	fluid_fixed_t fixed_x1, fixed_x2; /* Input history of the fixed point filter */
+	fluid_fixed_t fixed_y1, fixed_y2; /* Output history of the fixed point filter */
+#endif
 };
 
 #endif
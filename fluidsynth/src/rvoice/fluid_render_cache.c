@@ -0,0 +1,743 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+/*
+ * Render memoization.
+ *
+ * Drum hits and other one-shot notes are often played again and again
+ * with the same sample, pitch and filter, only at other velocities.
+ * Such a voice renders the same waveform every time, just scaled by its
+ * attenuation. The render cache keeps the interpolated and filtered
+ * blocks of one of these voices (an entry), and later voices starting
+ * the same way replay them, multiplied by the ratio of the attenuations,
+ * instead of rendering the sample again.
+ *
+ * A block is only replayed if everything its rendering depends on is
+ * equal: the playhead, the phase increment, the interpolation method,
+ * the filter coefficients and the volume envelope. A voice which is
+ * bent, filtered or released differently drops out of replaying at the
+ * first block that doesn't match, and renders the rest itself from the
+ * playhead and filter history stored with the last block it replayed.
+ *
+ * The blocks are allocated at once for the whole budget. An entry is
+ * recorded by the first voice playing a note and published when that
+ * voice finishes or stops matching its own recording. When the budget
+ * is spent, the least recently used entries which aren't being replayed
+ * are dropped: those are kept in a list ordered by their last use, so
+ * finding one takes constant time.
+ *
+ * All rvoices share the cache from the rendering threads. It is guarded
+ * by a lock which the rendering threads only try to take, when a voice
+ * starts, finishes and records a block, never while copying sample data.
+ * When the cache is busy, a starting voice renders itself and a
+ * recording voice stops recording. A finishing voice can't skip its
+ * entry, so it hands the entry over on a lock-free list instead, and
+ * the next thread taking the lock finishes it.
+ */
+
+#include "fluid_render_cache.h"
+#include "fluid_rvoice.h"
+#include "fluid_conv.h"
+#include "fluid_sys.h"
+
+/* Hash buckets of the published entries */
+#define FLUID_RENDER_CACHE_BUCKETS 256
+/* An entry takes at most this fraction of the blocks */
+#define FLUID_RENDER_CACHE_MAX_SHARE 4
+/* Blocks per entry (on average) the entry table is sized for */
+#define FLUID_RENDER_CACHE_BLOCKS_PER_ENTRY 8
+
+enum fluid_render_entry_state {
+  FLUID_RENDER_ENTRY_FREE,
+  FLUID_RENDER_ENTRY_RECORDING,
+  FLUID_RENDER_ENTRY_PUBLISHED
+};
+
+/* Everything the rendering of a block depends on */
+typedef struct
+{
+  fluid_phase_t phase;
+  fluid_real_t phase_incr;
+  int interp_method;
+  int env_section;
+  fluid_real_t env_val;
+  fluid_real_t b02, b1, a1, a2;
+  int bypassed;
+} fluid_render_inputs_t;
+
+typedef struct
+{
+  fluid_render_inputs_t inputs;
+  int count;                         /* count of samples in data */
+  fluid_phase_t end_phase;           /* playhead after the block */
+  fluid_real_t hist1, hist2;         /* filter history after the block */
+  int next;                          /* next block of the entry or the free list, -1 at the end */
+  fluid_real_t data[FLUID_BUFSIZE];
+} fluid_render_block_t;
+
+typedef struct
+{
+  int state;                         /* enum fluid_render_entry_state */
+  unsigned int generation;           /* cache generation it was recorded in */
+  fluid_sample_t* sample;
+  int end;                           /* sample end point */
+  fluid_real_t gain;                 /* amplitude of the recorded blocks */
+  int first, last;                   /* first and last block, -1 if none */
+  int length;                        /* count of blocks */
+  int refcount;                      /* count of voices replaying the entry */
+  int next;                          /* next entry of the bucket or the free list */
+  int lru_prev, lru_next;            /* neighbours in the LRU list, -1 at the ends */
+
+  /* Handed over by voices finishing while the cache was busy */
+  int pending;                       /* Atomic: TRUE while on the pending list */
+  int pending_next;                  /* next entry of the pending list, -1 at the end */
+  int released;                      /* Atomic: count of replaying voices finished */
+  int recorded;                      /* Atomic: TRUE if the recording voice finished */
+  int spare_block;                   /* unused block of the recording voice, or -1 */
+} fluid_render_entry_t;
+
+struct _fluid_render_cache_t
+{
+  int lock;                          /* Atomic: lock for the fields below */
+  int pending;                       /* Atomic: entries handed over, -1 if none */
+
+  fluid_render_block_t* blocks;
+  int block_count;
+  int free_block;                    /* free list of blocks, -1 if empty */
+  int max_length;                    /* most blocks per entry */
+
+  fluid_render_entry_t* entries;
+  int entry_count;
+  int free_entry;                    /* free list of entries, -1 if empty */
+  int buckets[FLUID_RENDER_CACHE_BUCKETS];
+
+  unsigned int generation;           /* incremented when samples may have gone */
+  int lru_head, lru_tail;            /* published entries not being replayed,
+                                        least recently used first, -1 if none */
+
+  int hits;                          /* Atomic: count of replayed blocks */
+  int misses;                        /* Atomic: count of rendered blocks of cacheable voices */
+};
+
+static FLUID_INLINE int
+fluid_render_cache_bucket(fluid_sample_t* sample, fluid_phase_t phase)
+{
+  return (int) ((((size_t) sample) / sizeof(fluid_sample_t)
+                 + fluid_phase_index(phase)) % FLUID_RENDER_CACHE_BUCKETS);
+}
+
+/*
+ * Create the render cache.
+ * @param budget Megabytes of memory for the cached blocks
+ */
+fluid_render_cache_t*
+new_fluid_render_cache(int budget)
+{
+  fluid_render_cache_t* cache;
+  int i;
+
+  cache = FLUID_NEW(fluid_render_cache_t);
+  if (cache == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return NULL;
+  }
+  FLUID_MEMSET(cache, 0, sizeof(fluid_render_cache_t));
+
+  cache->block_count = (int) (((double) budget * 1024 * 1024) / sizeof(fluid_render_block_t));
+  if (cache->block_count < FLUID_RENDER_CACHE_MAX_SHARE)
+    cache->block_count = FLUID_RENDER_CACHE_MAX_SHARE;
+  cache->max_length = cache->block_count / FLUID_RENDER_CACHE_MAX_SHARE;
+  cache->entry_count = cache->block_count / FLUID_RENDER_CACHE_BLOCKS_PER_ENTRY + 1;
+
+  cache->blocks = FLUID_ARRAY(fluid_render_block_t, cache->block_count);
+  cache->entries = FLUID_ARRAY(fluid_render_entry_t, cache->entry_count);
+  if (cache->blocks == NULL || cache->entries == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    delete_fluid_render_cache(cache);
+    return NULL;
+  }
+
+  for (i = 0; i < cache->block_count; i++)
+    cache->blocks[i].next = i + 1;
+  cache->blocks[cache->block_count - 1].next = -1;
+  cache->free_block = 0;
+
+  for (i = 0; i < cache->entry_count; i++) {
+    cache->entries[i].state = FLUID_RENDER_ENTRY_FREE;
+    cache->entries[i].next = i + 1;
+    cache->entries[i].lru_prev = cache->entries[i].lru_next = -1;
+    cache->entries[i].pending_next = -1;
+    cache->entries[i].spare_block = -1;
+  }
+  cache->entries[cache->entry_count - 1].next = -1;
+  cache->free_entry = 0;
+  cache->lru_head = cache->lru_tail = -1;
+  cache->pending = -1;
+
+  for (i = 0; i < FLUID_RENDER_CACHE_BUCKETS; i++)
+    cache->buckets[i] = -1;
+
+  return cache;
+}
+
+void
+delete_fluid_render_cache(fluid_render_cache_t* cache)
+{
+  if (cache == NULL)
+    return;
+  FLUID_FREE(cache->blocks);
+  FLUID_FREE(cache->entries);
+  FLUID_FREE(cache);
+}
+
+static void
+fluid_render_cache_free_block_LOCAL(fluid_render_cache_t* cache, int block)
+{
+  cache->blocks[block].next = cache->free_block;
+  cache->free_block = block;
+}
+
+/* Append an entry to the LRU list, as the most recently used */
+static void
+fluid_render_cache_lru_push_LOCAL(fluid_render_cache_t* cache, int index)
+{
+  fluid_render_entry_t* entry = &cache->entries[index];
+
+  entry->lru_prev = cache->lru_tail;
+  entry->lru_next = -1;
+  if (cache->lru_tail >= 0)
+    cache->entries[cache->lru_tail].lru_next = index;
+  else
+    cache->lru_head = index;
+  cache->lru_tail = index;
+}
+
+/* Remove an entry from the LRU list */
+static void
+fluid_render_cache_lru_remove_LOCAL(fluid_render_cache_t* cache, int index)
+{
+  fluid_render_entry_t* entry = &cache->entries[index];
+
+  if (entry->lru_prev >= 0)
+    cache->entries[entry->lru_prev].lru_next = entry->lru_next;
+  else
+    cache->lru_head = entry->lru_next;
+  if (entry->lru_next >= 0)
+    cache->entries[entry->lru_next].lru_prev = entry->lru_prev;
+  else
+    cache->lru_tail = entry->lru_prev;
+  entry->lru_prev = entry->lru_next = -1;
+}
+
+/*
+ * Free an entry and its blocks. A published entry must not be replayed,
+ * it is taken off the LRU list if it was published in this generation.
+ */
+static void
+fluid_render_cache_free_entry_LOCAL(fluid_render_cache_t* cache, int index)
+{
+  fluid_render_entry_t* entry = &cache->entries[index];
+  int* link;
+
+  if (entry->state == FLUID_RENDER_ENTRY_PUBLISHED) {
+    if (entry->lru_prev >= 0 || cache->lru_head == index)
+      fluid_render_cache_lru_remove_LOCAL(cache, index);
+    link = &cache->buckets[fluid_render_cache_bucket(entry->sample,
+                           cache->blocks[entry->first].inputs.phase)];
+    while (*link != index)
+      link = &cache->entries[*link].next;
+    *link = entry->next;
+  }
+
+  /* The blocks of the entry go back in one piece */
+  if (entry->first >= 0) {
+    cache->blocks[entry->last].next = cache->free_block;
+    cache->free_block = entry->first;
+  }
+
+  entry->state = FLUID_RENDER_ENTRY_FREE;
+  entry->next = cache->free_entry;
+  cache->free_entry = index;
+}
+
+/*
+ * Drop the published entry unused for the longest time. Entries of
+ * older generations are never on the LRU list, they are freed by the
+ * flush or when their last voice finishes.
+ * @return TRUE if an entry was dropped
+ */
+static int
+fluid_render_cache_evict_LOCAL(fluid_render_cache_t* cache)
+{
+  if (cache->lru_head < 0)
+    return FALSE;
+  fluid_render_cache_free_entry_LOCAL(cache, cache->lru_head);
+  return TRUE;
+}
+
+static int
+fluid_render_cache_new_block_LOCAL(fluid_render_cache_t* cache)
+{
+  int block;
+
+  if (cache->free_block < 0 && !fluid_render_cache_evict_LOCAL(cache))
+    return -1;
+  block = cache->free_block;
+  cache->free_block = cache->blocks[block].next;
+  cache->blocks[block].next = -1;
+  return block;
+}
+
+static int
+fluid_render_cache_new_entry_LOCAL(fluid_render_cache_t* cache)
+{
+  int index;
+
+  if (cache->free_entry < 0 && !fluid_render_cache_evict_LOCAL(cache))
+    return -1;
+  index = cache->free_entry;
+  cache->free_entry = cache->entries[index].next;
+  cache->entries[index].next = -1;
+  return index;
+}
+
+static int
+fluid_render_inputs_equal(const fluid_render_inputs_t* a, const fluid_render_inputs_t* b)
+{
+  return a->phase == b->phase
+    && a->phase_incr == b->phase_incr
+    && a->interp_method == b->interp_method
+    && a->env_section == b->env_section
+    && a->env_val == b->env_val
+    && a->b02 == b->b02 && a->b1 == b->b1
+    && a->a1 == b->a1 && a->a2 == b->a2
+    && a->bypassed == b->bypassed;
+}
+
+/*
+ * Find the published entry starting with the given block inputs.
+ * @return Index of the entry, -1 if there is none
+ */
+static int
+fluid_render_cache_lookup_LOCAL(fluid_render_cache_t* cache, fluid_sample_t* sample,
+                                int end, const fluid_render_inputs_t* inputs)
+{
+  fluid_render_entry_t* entry;
+  int i;
+
+  for (i = cache->buckets[fluid_render_cache_bucket(sample, inputs->phase)];
+       i >= 0; i = entry->next) {
+    entry = &cache->entries[i];
+    if (entry->sample == sample && entry->end == end
+        && entry->generation == cache->generation
+        && fluid_render_inputs_equal(&cache->blocks[entry->first].inputs, inputs))
+      return i;
+  }
+  return -1;
+}
+
+/* A voice stops replaying an entry */
+static void
+fluid_render_cache_release_LOCAL(fluid_render_cache_t* cache, int index, int count)
+{
+  fluid_render_entry_t* entry = &cache->entries[index];
+
+  entry->refcount -= count;
+  if (entry->refcount == 0) {
+    if (entry->generation != cache->generation)
+      fluid_render_cache_free_entry_LOCAL(cache, index);
+    else
+      fluid_render_cache_lru_push_LOCAL(cache, index);
+  }
+}
+
+/* Publish a recorded entry, unless an equal one was published in the meantime */
+static void
+fluid_render_cache_publish_LOCAL(fluid_render_cache_t* cache, int index)
+{
+  fluid_render_entry_t* entry = &cache->entries[index];
+  int bucket;
+
+  if (entry->length > 0 && entry->generation == cache->generation
+      && fluid_render_cache_lookup_LOCAL(cache, entry->sample, entry->end,
+                                         &cache->blocks[entry->first].inputs) < 0) {
+    bucket = fluid_render_cache_bucket(entry->sample, cache->blocks[entry->first].inputs.phase);
+    entry->state = FLUID_RENDER_ENTRY_PUBLISHED;
+    entry->next = cache->buckets[bucket];
+    cache->buckets[bucket] = index;
+    fluid_render_cache_lru_push_LOCAL(cache, index);
+  }
+  else
+    fluid_render_cache_free_entry_LOCAL(cache, index);
+}
+
+/*
+ * Put an entry on the pending list, for the next thread taking the lock.
+ * An entry is on the list at most once. It may be freed and reused while
+ * on the list, finishing it then does nothing.
+ */
+static void
+fluid_render_cache_hand_over(fluid_render_cache_t* cache, int index)
+{
+  fluid_render_entry_t* entry = &cache->entries[index];
+  int head;
+
+  if (!fluid_atomic_int_compare_and_exchange(&entry->pending, FALSE, TRUE))
+    return;
+  do {
+    head = fluid_atomic_int_get(&cache->pending);
+    entry->pending_next = head;
+  } while (!fluid_atomic_int_compare_and_exchange(&cache->pending, head, index));
+}
+
+/* Finish what voices handed over while the cache was busy */
+static void
+fluid_render_cache_finish_pending_LOCAL(fluid_render_cache_t* cache)
+{
+  fluid_render_entry_t* entry;
+  int index, next, released;
+
+  /* Take the whole list, hand-overs from now on start a new one */
+  do
+    index = fluid_atomic_int_get(&cache->pending);
+  while (index >= 0 && !fluid_atomic_int_compare_and_exchange(&cache->pending, index, -1));
+
+  for (; index >= 0; index = next) {
+    entry = &cache->entries[index];
+    /* The entry can be handed over again as soon as it's off the list */
+    next = entry->pending_next;
+    fluid_atomic_int_set(&entry->pending, FALSE);
+
+    released = fluid_atomic_int_get(&entry->released);
+    if (released > 0) {
+      fluid_atomic_int_add(&entry->released, -released);
+      fluid_render_cache_release_LOCAL(cache, index, released);
+    }
+    if (fluid_atomic_int_get(&entry->recorded)) {
+      fluid_atomic_int_set(&entry->recorded, FALSE);
+      if (entry->spare_block >= 0)
+        fluid_render_cache_free_block_LOCAL(cache, entry->spare_block);
+      entry->spare_block = -1;
+      fluid_render_cache_publish_LOCAL(cache, index);
+    }
+  }
+}
+
+/*
+ * Try to take the lock, without waiting for it.
+ * @return TRUE if the lock was taken
+ */
+static int
+fluid_render_cache_trylock(fluid_render_cache_t* cache)
+{
+  if (!fluid_atomic_int_compare_and_exchange(&cache->lock, 0, 1))
+    return FALSE;
+  fluid_render_cache_finish_pending_LOCAL(cache);
+  return TRUE;
+}
+
+static FLUID_INLINE void
+fluid_render_cache_unlock(fluid_render_cache_t* cache)
+{
+  fluid_atomic_int_set(&cache->lock, 0);
+}
+
+/*
+ * Forget all entries, because the samples they were recorded from may
+ * be freed. Must be called before the samples are freed, so no new
+ * voice can find an entry of a freed sample at a reused address.
+ * Entries which are still replayed are dropped when their last voice
+ * finishes, and entries still being recorded are not published.
+ */
+void
+fluid_render_cache_flush(fluid_render_cache_t* cache)
+{
+  /* Not called from the rendering threads, so this may wait */
+  while (!fluid_render_cache_trylock(cache))
+    fluid_msleep(0);
+  cache->generation++;
+  /* The LRU list holds all published entries which aren't replayed */
+  while (cache->lru_head >= 0)
+    fluid_render_cache_free_entry_LOCAL(cache, cache->lru_head);
+  fluid_render_cache_unlock(cache);
+}
+
+/*
+ * Get the count of replayed blocks.
+ * @param misses Location to store the count of blocks which voices that
+ *   could have been replayed had to render, or NULL
+ */
+int
+fluid_render_cache_get_hits(fluid_render_cache_t* cache, int* misses)
+{
+  if (misses)
+    *misses = fluid_atomic_int_get(&cache->misses);
+  return fluid_atomic_int_get(&cache->hits);
+}
+
+static void
+fluid_rvoice_memo_get_inputs(fluid_rvoice_t* voice, fluid_render_inputs_t* inputs)
+{
+  inputs->phase = voice->dsp.phase;
+  inputs->phase_incr = voice->dsp.phase_incr;
+  inputs->interp_method = voice->dsp.interp_method;
+  inputs->env_section = fluid_adsr_env_get_section(&voice->envlfo.volenv);
+  inputs->env_val = fluid_adsr_env_get_val(&voice->envlfo.volenv);
+  inputs->b02 = voice->resonant_filter.b02;
+  inputs->b1 = voice->resonant_filter.b1;
+  inputs->a1 = voice->resonant_filter.a1;
+  inputs->a2 = voice->resonant_filter.a2;
+  inputs->bypassed = voice->resonant_filter.bypassed;
+}
+
+/*
+ * Check what the blocks of an entry don't record: the amplitude of the
+ * voice only scales them as long as its attenuation stays the same and
+ * the LFO doesn't modulate it, and a filter in transition changes its
+ * coefficients within the block.
+ */
+static int
+fluid_rvoice_memo_is_steady(fluid_rvoice_t* voice)
+{
+  return voice->dsp.attenuation == voice->memo.attenuation
+    && voice->dsp.end == voice->memo.end
+    && voice->dsp.samplemode == FLUID_UNLOOPED
+    && voice->envlfo.modlfo_to_vol == 0
+    && voice->resonant_filter.filter_coeff_incr_count <= 0;
+}
+
+/*
+ * Look up the entry to replay when a voice renders its first block,
+ * or start recording one.
+ */
+static void
+fluid_rvoice_memo_start(fluid_rvoice_t* voice)
+{
+  fluid_render_memo_t* memo = &voice->memo;
+  fluid_render_cache_t* cache = memo->cache;
+  fluid_render_entry_t* entry;
+  fluid_render_inputs_t inputs;
+  fluid_real_t gain;
+  int index;
+
+  memo->state = FLUID_MEMO_OFF;
+  memo->block = -1;
+  memo->attenuation = voice->dsp.attenuation;
+  memo->end = voice->dsp.end;
+
+  /* Linked stereo samples and streamed samples are left out */
+  if (fluid_sample_get_stream(voice->dsp.sample) != NULL || voice->dsp.linked_sample != NULL
+      || !fluid_rvoice_memo_is_steady(voice))
+    return;
+  gain = fluid_atten2amp(voice->dsp.attenuation);
+  if (gain <= 0)
+    return;
+
+  /* Render the voice if the cache is busy */
+  memo->state = FLUID_MEMO_MISS;
+  fluid_rvoice_memo_get_inputs(voice, &inputs);
+  if (!fluid_render_cache_trylock(cache))
+    return;
+
+  index = fluid_render_cache_lookup_LOCAL(cache, voice->dsp.sample, voice->dsp.end, &inputs);
+  if (index >= 0) {
+    entry = &cache->entries[index];
+    if (entry->refcount++ == 0)
+      fluid_render_cache_lru_remove_LOCAL(cache, index);
+    memo->state = FLUID_MEMO_REPLAY;
+    memo->entry = index;
+    memo->block = entry->first;
+    memo->gain = gain / entry->gain;
+  }
+  else {
+    index = fluid_render_cache_new_entry_LOCAL(cache);
+    if (index >= 0) {
+      entry = &cache->entries[index];
+      entry->state = FLUID_RENDER_ENTRY_RECORDING;
+      entry->generation = cache->generation;
+      entry->sample = voice->dsp.sample;
+      entry->end = voice->dsp.end;
+      entry->gain = gain;
+      entry->first = entry->last = -1;
+      entry->length = 0;
+      entry->refcount = 0;
+      memo->state = FLUID_MEMO_RECORD;
+      memo->entry = index;
+    }
+  }
+  fluid_render_cache_unlock(cache);
+}
+
+/*
+ * Stop recording or replaying. A recorded entry is published, unless
+ * an equal one was published in the meantime.
+ */
+void
+fluid_rvoice_memo_finish(fluid_rvoice_t* voice)
+{
+  fluid_render_memo_t* memo = &voice->memo;
+  fluid_render_cache_t* cache = memo->cache;
+  fluid_render_entry_t* entry;
+
+  if (memo->state == FLUID_MEMO_REPLAY || memo->state == FLUID_MEMO_RECORD) {
+    entry = &cache->entries[memo->entry];
+
+    if (fluid_render_cache_trylock(cache)) {
+      if (memo->state == FLUID_MEMO_REPLAY)
+        fluid_render_cache_release_LOCAL(cache, memo->entry, 1);
+      else {
+        if (memo->block >= 0)
+          fluid_render_cache_free_block_LOCAL(cache, memo->block);
+        fluid_render_cache_publish_LOCAL(cache, memo->entry);
+      }
+      fluid_render_cache_unlock(cache);
+    }
+    else if (memo->state == FLUID_MEMO_REPLAY) {
+      fluid_atomic_int_inc(&entry->released);
+      fluid_render_cache_hand_over(cache, memo->entry);
+    }
+    else {
+      /* The entry isn't published, no one else uses it until it's taken off the list */
+      entry->spare_block = memo->block;
+      fluid_atomic_int_set(&entry->recorded, TRUE);
+      fluid_render_cache_hand_over(cache, memo->entry);
+    }
+  }
+
+  memo->state = FLUID_MEMO_OFF;
+  memo->block = -1;
+}
+
+/*
+ * Called for each block of a voice with a render cache, after the
+ * filter coefficients have been calculated. Replays the block if it
+ * matches the entry of the voice, otherwise gets the voice ready for
+ * rendering it.
+ * @return Count of samples written to the dsp buffer of the voice,
+ *   -1 if the voice has to render the block
+ */
+int
+fluid_rvoice_memo_begin(fluid_rvoice_t* voice)
+{
+  fluid_render_memo_t* memo = &voice->memo;
+  fluid_render_cache_t* cache = memo->cache;
+  fluid_render_entry_t* entry;
+  fluid_render_block_t* block;
+  fluid_render_inputs_t inputs;
+  fluid_real_t* dsp_buf = voice->dsp.dsp_buf;
+  fluid_real_t gain;
+  int i, index;
+
+  if (memo->state == FLUID_MEMO_START)
+    fluid_rvoice_memo_start(voice);
+
+  switch (memo->state) {
+  case FLUID_MEMO_REPLAY:
+    fluid_rvoice_memo_get_inputs(voice, &inputs);
+    block = (memo->block >= 0) ? &cache->blocks[memo->block] : NULL;
+    if (block == NULL || !fluid_rvoice_memo_is_steady(voice)
+        || !fluid_render_inputs_equal(&block->inputs, &inputs)) {
+      /* Render from here on, the state after the last replayed block is set */
+      fluid_rvoice_memo_finish(voice);
+      memo->state = FLUID_MEMO_MISS;
+      fluid_atomic_int_inc(&cache->misses);
+      return -1;
+    }
+
+    gain = memo->gain;
+    for (i = 0; i < block->count; i++)
+      dsp_buf[i] = block->data[i] * gain;
+
+    voice->dsp.phase = block->end_phase;
+    voice->dsp.amp += voice->dsp.amp_incr * block->count;
+    voice->resonant_filter.hist1 = block->hist1 * gain;
+    voice->resonant_filter.hist2 = block->hist2 * gain;
+    memo->block = block->next;
+    fluid_atomic_int_inc(&cache->hits);
+    return block->count;
+
+  case FLUID_MEMO_RECORD:
+    entry = &cache->entries[memo->entry];
+    /* A block which wasn't filled last time is used again */
+    index = memo->block;
+    if (!fluid_rvoice_memo_is_steady(voice) || entry->length >= cache->max_length)
+      index = -1;
+    else if (index < 0 && fluid_render_cache_trylock(cache)) {
+      index = fluid_render_cache_new_block_LOCAL(cache);
+      fluid_render_cache_unlock(cache);
+    }
+    if (index < 0) {
+      /* Publish what has been recorded so far, also if the cache is busy */
+      fluid_rvoice_memo_finish(voice);
+      memo->state = FLUID_MEMO_MISS;
+    }
+    else {
+      fluid_rvoice_memo_get_inputs(voice, &cache->blocks[index].inputs);
+      memo->block = index;
+    }
+    fluid_atomic_int_inc(&cache->misses);
+    return -1;
+
+  case FLUID_MEMO_MISS:
+    fluid_atomic_int_inc(&cache->misses);
+    return -1;
+
+  default:
+    return -1;
+  }
+}
+
+/*
+ * Called after a voice rendered a block, to record it.
+ * @param count Count of samples rendered
+ */
+void
+fluid_rvoice_memo_end(fluid_rvoice_t* voice, int count)
+{
+  fluid_render_memo_t* memo = &voice->memo;
+  fluid_render_cache_t* cache = memo->cache;
+  fluid_render_entry_t* entry;
+  fluid_render_block_t* block;
+
+  if (memo->state != FLUID_MEMO_RECORD || memo->block < 0)
+    return;
+
+  /* Keep the block for the next one, or until the voice finishes */
+  if (count <= 0)
+    return;
+
+  /* The entry isn't published yet, it belongs to this voice */
+  entry = &cache->entries[memo->entry];
+  block = &cache->blocks[memo->block];
+  FLUID_MEMCPY(block->data, voice->dsp.dsp_buf, count * sizeof(fluid_real_t));
+  block->count = count;
+  block->end_phase = voice->dsp.phase;
+  block->hist1 = voice->resonant_filter.hist1;
+  block->hist2 = voice->resonant_filter.hist2;
+  block->next = -1;
+
+  if (entry->last >= 0)
+    cache->blocks[entry->last].next = memo->block;
+  else
+    entry->first = memo->block;
+  entry->last = memo->block;
+  entry->length++;
+  memo->block = -1;
+}
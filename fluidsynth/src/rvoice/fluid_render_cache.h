@@ -0,0 +1,58 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+
+#ifndef _FLUID_RENDER_CACHE_H
+#define _FLUID_RENDER_CACHE_H
+
+#include "fluidsynth_priv.h"
+
+typedef struct _fluid_render_cache_t fluid_render_cache_t;
+typedef struct _fluid_render_memo_t fluid_render_memo_t;
+
+enum fluid_render_memo_state {
+  FLUID_MEMO_START = 0,   /* the voice hasn't rendered a block yet */
+  FLUID_MEMO_OFF,         /* the voice can't be cached */
+  FLUID_MEMO_MISS,        /* the voice renders its blocks itself */
+  FLUID_MEMO_RECORD,      /* the voice records its blocks to an entry */
+  FLUID_MEMO_REPLAY       /* the voice replays the blocks of an entry */
+};
+
+/**
+ * Render cache state of an rvoice, see fluid_render_cache.c
+ */
+struct _fluid_render_memo_t
+{
+  fluid_render_cache_t* cache;   /* NULL if synth.render-cache-budget is 0 */
+  int state;                     /* enum fluid_render_memo_state */
+  int entry;                     /* entry recorded or replayed */
+  int block;                     /* next block to replay, or block being recorded */
+  int end;                       /* sample end point when the voice started */
+  fluid_real_t attenuation;      /* attenuation when the voice started */
+  fluid_real_t gain;             /* amplitude of the replayed blocks */
+};
+
+/* Owned by the synth, shared by all rvoices */
+fluid_render_cache_t* new_fluid_render_cache(int budget);
+void delete_fluid_render_cache(fluid_render_cache_t* cache);
+void fluid_render_cache_flush(fluid_render_cache_t* cache);
+int fluid_render_cache_get_hits(fluid_render_cache_t* cache, int* misses);
+
+#endif
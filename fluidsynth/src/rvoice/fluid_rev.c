@@ -69,6 +69,10 @@ struct _fluid_allpass {
   fluid_real_t *buffer;
   int bufsize;
   int bufidx;
+#ifdef WITH_FIXED_POINT
+  fluid_fixed_t fixed_feedback;
+  fluid_fixed_t *fixed_buffer; /* the same memory as buffer, see fluid_revmodel_set_fixed_point */
+#endif
 };
 
 void fluid_allpass_init(fluid_allpass* allpass);
@@ -81,6 +85,9 @@ fluid_allpass_setbuffer(fluid_allpass* allpass, int size)
   allpass->bufidx = 0;
   allpass->buffer = FLUID_ARRAY(fluid_real_t,size);
   allpass->bufsize = size;
+#ifdef WITH_FIXED_POINT
+  allpass->fixed_buffer = (fluid_fixed_t*) allpass->buffer;
+#endif
 }
 
 void
@@ -104,6 +111,9 @@ void
 fluid_allpass_setfeedback(fluid_allpass* allpass, fluid_real_t val)
 {
   allpass->feedback = val;
+#ifdef WITH_FIXED_POINT
+  allpass->fixed_feedback = fluid_fixed_from_real(val, FLUID_FIXED_GAIN_BITS);
+#endif
 }
 
 fluid_real_t
@@ -147,6 +157,13 @@ struct _fluid_comb {
   fluid_real_t *buffer;
   int bufsize;
   int bufidx;
+#ifdef WITH_FIXED_POINT
+  fluid_fixed_t fixed_feedback;
+  fluid_fixed_t fixed_filterstore;
+  fluid_fixed_t fixed_damp1;
+  fluid_fixed_t fixed_damp2;
+  fluid_fixed_t *fixed_buffer; /* the same memory as buffer, see fluid_revmodel_set_fixed_point */
+#endif
 };
 
 void fluid_comb_setbuffer(fluid_comb* comb, int size);
@@ -164,6 +181,9 @@ fluid_comb_setbuffer(fluid_comb* comb, int size)
   comb->bufidx = 0;
   comb->buffer = FLUID_ARRAY(fluid_real_t,size);
   comb->bufsize = size;
+#ifdef WITH_FIXED_POINT
+  comb->fixed_buffer = (fluid_fixed_t*) comb->buffer;
+#endif
 }
 
 void
@@ -188,6 +208,10 @@ fluid_comb_setdamp(fluid_comb* comb, fluid_real_t val)
 {
   comb->damp1 = val;
   comb->damp2 = 1 - val;
+#ifdef WITH_FIXED_POINT
+  comb->fixed_damp1 = fluid_fixed_from_real(comb->damp1, FLUID_FIXED_GAIN_BITS);
+  comb->fixed_damp2 = fluid_fixed_from_real(comb->damp2, FLUID_FIXED_GAIN_BITS);
+#endif
 }
 
 fluid_real_t
@@ -200,6 +224,9 @@ void
 fluid_comb_setfeedback(fluid_comb* comb, fluid_real_t val)
 {
   comb->feedback = val;
+#ifdef WITH_FIXED_POINT
+  comb->fixed_feedback = fluid_fixed_from_real(val, FLUID_FIXED_GAIN_BITS);
+#endif
 }
 
 fluid_real_t
@@ -219,6 +246,38 @@ fluid_comb_getfeedback(fluid_comb* comb)
   _output += _tmp; \
 }
 
+#ifdef WITH_FIXED_POINT
+/* The comb and allpass filters in fixed point. The signal has
+ * FLUID_FIXED_REVERB_BITS fraction bits, the coefficients
+ * FLUID_FIXED_GAIN_BITS. */
+#define fluid_comb_process_fixed(_comb, _input, _output) \
+{ \
+  fluid_fixed_t _tmp = _comb.fixed_buffer[_comb.bufidx]; \
+  _comb.fixed_filterstore = fluid_fixed_mul_round(_tmp, _comb.fixed_damp2, FLUID_FIXED_GAIN_BITS) \
+    + fluid_fixed_mul_round(_comb.fixed_filterstore, _comb.fixed_damp1, FLUID_FIXED_GAIN_BITS); \
+  _comb.fixed_buffer[_comb.bufidx] = _input \
+    + fluid_fixed_mul_round(_comb.fixed_filterstore, _comb.fixed_feedback, FLUID_FIXED_GAIN_BITS); \
+  if (++_comb.bufidx >= _comb.bufsize) { \
+    _comb.bufidx = 0; \
+  } \
+  _output += _tmp; \
+}
+
+#define fluid_allpass_process_fixed(_allpass, _input) \
+{ \
+  fluid_fixed_t output; \
+  fluid_fixed_t bufout; \
+  bufout = _allpass.fixed_buffer[_allpass.bufidx]; \
+  output = bufout - _input; \
+  _allpass.fixed_buffer[_allpass.bufidx] = _input \
+    + fluid_fixed_mul_round(bufout, _allpass.fixed_feedback, FLUID_FIXED_GAIN_BITS); \
+  if (++_allpass.bufidx >= _allpass.bufsize) { \
+    _allpass.bufidx = 0; \
+  } \
+  _input = output; \
+}
+#endif
+
 /* fluid_real_t fluid_comb_process(fluid_comb* comb, fluid_real_t input) */
 /* { */
 /*    fluid_real_t output; */
@@ -286,6 +345,10 @@ struct _fluid_revmodel_t {
   fluid_real_t wet, wet1, wet2;
   fluid_real_t width;
   fluid_real_t gain;
+#ifdef WITH_FIXED_POINT
+  int fixed;              /* Flag: run the fixed point filters */
+  fluid_fixed_t fixed_wet1, fixed_wet2;
+#endif
   /*
    The following are all declared inline
    to remove the need for dynamic allocation
@@ -311,6 +374,9 @@ new_fluid_revmodel(fluid_real_t sample_rate)
   if (rev == NULL) {
     return NULL;
   }
+#ifdef WITH_FIXED_POINT
+  rev->fixed = 0;
+#endif
 
   fluid_set_revmodel_buffers(rev, sample_rate);
 
@@ -393,7 +459,83 @@ fluid_revmodel_init(fluid_revmodel_t* rev)
     fluid_allpass_init(&rev->allpassL[i]);
     fluid_allpass_init(&rev->allpassR[i]);
   }
+
+#ifdef WITH_FIXED_POINT
+  /* The fixed point filters need no DC offset against denormals */
+  if (rev->fixed) {
+    for (i = 0; i < numcombs;i++) {
+      FLUID_MEMSET(rev->combL[i].fixed_buffer, 0, rev->combL[i].bufsize * sizeof(fluid_fixed_t));
+      FLUID_MEMSET(rev->combR[i].fixed_buffer, 0, rev->combR[i].bufsize * sizeof(fluid_fixed_t));
+      rev->combL[i].fixed_filterstore = 0;
+      rev->combR[i].fixed_filterstore = 0;
+    }
+    for (i = 0; i < numallpasses; i++) {
+      FLUID_MEMSET(rev->allpassL[i].fixed_buffer, 0, rev->allpassL[i].bufsize * sizeof(fluid_fixed_t));
+      FLUID_MEMSET(rev->allpassR[i].fixed_buffer, 0, rev->allpassR[i].bufsize * sizeof(fluid_fixed_t));
+    }
+  }
+#endif
+}
+
+#ifdef WITH_FIXED_POINT
+/*
+ * Run the reverb in fixed point (synth.fixed-point), or in floating point
+ * again. The delay lines keep their memory, fixed point samples are never
+ * larger than fluid_real_t ones. The reverb is cleared.
+ */
+void
+fluid_revmodel_set_fixed_point(fluid_revmodel_t* rev, int fixed)
+{
+  rev->fixed = fixed;
+  fluid_revmodel_init(rev);
+}
+
+/*
+ * Fixed point version of fluid_revmodel_processreplace (mix is 0) and
+ * fluid_revmodel_processmix (mix is 1). Only the input and output samples
+ * are converted.
+ */
+static FLUID_INLINE void
+fluid_revmodel_process_fixed(fluid_revmodel_t* rev, fluid_real_t *in,
+                             fluid_real_t *left_out, fluid_real_t *right_out,
+                             const int mix)
+{
+  int i, k;
+  fluid_fixed_t outL, outR, input;
+  /* 'input' is twice the input sample, see fluid_revmodel_processreplace */
+  fluid_real_t in_scale = 2.0f * rev->gain * (fluid_real_t) (1 << FLUID_FIXED_REVERB_BITS);
+  fluid_real_t out_scale = fluid_fixed_to_real(1, FLUID_FIXED_REVERB_BITS + FLUID_FIXED_WET_BITS);
+  fluid_real_t left, right;
+
+  for (k = 0; k < FLUID_BUFSIZE; k++) {
+
+    outL = outR = 0;
+    input = (fluid_fixed_t) (in[k] * in_scale);
+
+    for (i = 0; i < numcombs; i++) {
+      fluid_comb_process_fixed(rev->combL[i], input, outL);
+      fluid_comb_process_fixed(rev->combR[i], input, outR);
+    }
+    for (i = 0; i < numallpasses; i++) {
+      fluid_allpass_process_fixed(rev->allpassL[i], outL);
+      fluid_allpass_process_fixed(rev->allpassR[i], outR);
+    }
+
+    left = (fluid_real_t) ((long long) outL * rev->fixed_wet1
+                           + (long long) outR * rev->fixed_wet2);
+    right = (fluid_real_t) ((long long) outR * rev->fixed_wet1
+                            + (long long) outL * rev->fixed_wet2);
+    if (mix) {
+      left_out[k] += left * out_scale;
+      right_out[k] += right * out_scale;
+    }
+    else {
+      left_out[k] = left * out_scale;
+      right_out[k] = right * out_scale;
+    }
+  }
 }
+#endif
 
 void
 fluid_revmodel_reset(fluid_revmodel_t* rev)
@@ -401,6 +543,78 @@ fluid_revmodel_reset(fluid_revmodel_t* rev)
   fluid_revmodel_init(rev);
 }
 
+/* TRUE if no sample of a delay line reaches the given magnitude */
+static int
+fluid_revmodel_buffer_is_silent(fluid_real_t* buffer, int size, fluid_real_t limit)
+{
+  int i;
+  for (i = 0; i < size; i++)
+    if (buffer[i] > limit || buffer[i] < -limit)
+      return FALSE;
+  return TRUE;
+}
+
+/*
+ * Check if the delay lines and comb filter states are silent, i.e. the
+ * reverb would produce no output above threshold with a silent input from
+ * now on. A silent output alone doesn't tell, the sum of the combs may
+ * cancel out for a while. The delay lines hold the DC offset against
+ * denormals, which is far below any sensible threshold.
+ */
+int
+fluid_revmodel_is_silent(fluid_revmodel_t* rev, fluid_real_t threshold)
+{
+  int i;
+  /* A sample in the delay lines reaches the output at most multiplied by
+     the wet gains, and all combs may add up */
+  fluid_real_t gain = (fabs(rev->wet1) + fabs(rev->wet2)) * numcombs;
+  fluid_real_t limit;
+
+  if (gain <= 0.0)
+    return TRUE;
+  limit = threshold / gain;
+
+#ifdef WITH_FIXED_POINT
+  if (rev->fixed) {
+    fluid_fixed_t fixed_limit = fluid_fixed_from_real(limit, FLUID_FIXED_REVERB_BITS);
+    int k;
+    for (i = 0; i < numcombs; i++) {
+      if (abs(rev->combL[i].fixed_filterstore) > fixed_limit
+          || abs(rev->combR[i].fixed_filterstore) > fixed_limit)
+        return FALSE;
+      for (k = 0; k < rev->combL[i].bufsize; k++)
+        if (abs(rev->combL[i].fixed_buffer[k]) > fixed_limit)
+          return FALSE;
+      for (k = 0; k < rev->combR[i].bufsize; k++)
+        if (abs(rev->combR[i].fixed_buffer[k]) > fixed_limit)
+          return FALSE;
+    }
+    for (i = 0; i < numallpasses; i++) {
+      for (k = 0; k < rev->allpassL[i].bufsize; k++)
+        if (abs(rev->allpassL[i].fixed_buffer[k]) > fixed_limit)
+          return FALSE;
+      for (k = 0; k < rev->allpassR[i].bufsize; k++)
+        if (abs(rev->allpassR[i].fixed_buffer[k]) > fixed_limit)
+          return FALSE;
+    }
+    return TRUE;
+  }
+#endif
+
+  for (i = 0; i < numcombs; i++) {
+    if (fabs(rev->combL[i].filterstore) > limit || fabs(rev->combR[i].filterstore) > limit
+        || !fluid_revmodel_buffer_is_silent(rev->combL[i].buffer, rev->combL[i].bufsize, limit)
+        || !fluid_revmodel_buffer_is_silent(rev->combR[i].buffer, rev->combR[i].bufsize, limit))
+      return FALSE;
+  }
+  for (i = 0; i < numallpasses; i++) {
+    if (!fluid_revmodel_buffer_is_silent(rev->allpassL[i].buffer, rev->allpassL[i].bufsize, limit)
+        || !fluid_revmodel_buffer_is_silent(rev->allpassR[i].buffer, rev->allpassR[i].bufsize, limit))
+      return FALSE;
+  }
+  return TRUE;
+}
+
 void
 fluid_revmodel_processreplace(fluid_revmodel_t* rev, fluid_real_t *in,
 			     fluid_real_t *left_out, fluid_real_t *right_out)
@@ -408,6 +622,13 @@ fluid_revmodel_processreplace(fluid_revmodel_t* rev, fluid_real_t *in,
   int i, k = 0;
   fluid_real_t outL, outR, input;
 
+#ifdef WITH_FIXED_POINT
+  if (rev->fixed) {
+    fluid_revmodel_process_fixed(rev, in, left_out, right_out, 0);
+    return;
+  }
+#endif
+
   for (k = 0; k < FLUID_BUFSIZE; k++) {
 
     outL = outR = 0;
@@ -446,6 +667,13 @@ fluid_revmodel_processmix(fluid_revmodel_t* rev, fluid_real_t *in,
   int i, k = 0;
   fluid_real_t outL, outR, input;
 
+#ifdef WITH_FIXED_POINT
+  if (rev->fixed) {
+    fluid_revmodel_process_fixed(rev, in, left_out, right_out, 1);
+    return;
+  }
+#endif
+
   for (k = 0; k < FLUID_BUFSIZE; k++) {
 
     outL = outR = 0;
@@ -485,6 +713,10 @@ fluid_revmodel_update(fluid_revmodel_t* rev)
 
   rev->wet1 = rev->wet * (rev->width / 2.0f + 0.5f);
   rev->wet2 = rev->wet * ((1.0f - rev->width) / 2.0f);
+#ifdef WITH_FIXED_POINT
+  rev->fixed_wet1 = fluid_fixed_from_real(rev->wet1, FLUID_FIXED_WET_BITS);
+  rev->fixed_wet2 = fluid_fixed_from_real(rev->wet2, FLUID_FIXED_WET_BITS);
+#endif
 
   for (i = 0; i < numcombs; i++) {
     fluid_comb_setfeedback(&rev->combL[i], rev->roomsize);
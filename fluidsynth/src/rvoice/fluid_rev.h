@@ -23,6 +23,7 @@
 #define _FLUID_REV_H
 
 #include "fluidsynth_priv.h"
+#include "fluid_fixed.h"
 
 typedef struct _fluid_revmodel_t fluid_revmodel_t;
 
@@ -64,10 +65,15 @@ void fluid_revmodel_processreplace(fluid_revmodel_t* rev, fluid_real_t *in,
 				  fluid_real_t *left_out, fluid_real_t *right_out);
 
 void fluid_revmodel_reset(fluid_revmodel_t* rev);
+int fluid_revmodel_is_silent(fluid_revmodel_t* rev, fluid_real_t threshold);
 
 void fluid_revmodel_set(fluid_revmodel_t* rev, int set, float roomsize,
                         float damping, float width, float level);
 
 void fluid_revmodel_samplerate_change(fluid_revmodel_t* rev, fluid_real_t sample_rate);
 
+#ifdef WITH_FIXED_POINT
+void fluid_revmodel_set_fixed_point(fluid_revmodel_t* rev, int fixed);
+#endif
+
 #endif /* _FLUID_REV_H */
@@ -162,6 +162,12 @@ fluid_rvoice_check_sample_sanity(fluid_rvoice_t* voice)
 	return;
     }
 
+    /* Streamed samples are never looped, the loop points might not be
+       resident (see fluid_rvoice_stream.c) */
+    if (fluid_sample_get_stream(voice->dsp.sample) != NULL) {
+      voice->dsp.samplemode = FLUID_UNLOOPED;
+    }
+
     if ((voice->dsp.samplemode == FLUID_LOOP_UNTIL_RELEASE)
 	|| (voice->dsp.samplemode == FLUID_LOOP_DURING_RELEASE)) {
 	/* Keep the loop start point within the sample data */
@@ -195,9 +201,15 @@ fluid_rvoice_check_sample_sanity(fluid_rvoice_t* voice)
       /* Is the voice loop within the sample loop? */
       if ((int)voice->dsp.loopstart >= (int)voice->dsp.sample->loopstart
 	  && (int)voice->dsp.loopend <= (int)voice->dsp.sample->loopend){
+	fluid_sample_t* linked = voice->dsp.linked_sample;
 	/* Is there a valid peak amplitude available for the loop, and can we use it? */
-	if (voice->dsp.sample->amplitude_that_reaches_noise_floor_is_valid && voice->dsp.samplemode == FLUID_LOOP_DURING_RELEASE){
-	  voice->dsp.amplitude_that_reaches_noise_floor_loop=voice->dsp.sample->amplitude_that_reaches_noise_floor / voice->dsp.synth_gain;
+	if (voice->dsp.sample->amplitude_that_reaches_noise_floor_is_valid && voice->dsp.samplemode == FLUID_LOOP_DURING_RELEASE
+	    && (linked == NULL || linked->amplitude_that_reaches_noise_floor_is_valid)){
+	  fluid_real_t amplitude = voice->dsp.sample->amplitude_that_reaches_noise_floor;
+	  /* The louder channel of a linked stereo sample decides */
+	  if (linked != NULL && linked->amplitude_that_reaches_noise_floor < amplitude)
+	    amplitude = linked->amplitude_that_reaches_noise_floor;
+	  voice->dsp.amplitude_that_reaches_noise_floor_loop=amplitude / voice->dsp.synth_gain;
 	} else {
 	  /* Worst case */
 	  voice->dsp.amplitude_that_reaches_noise_floor_loop=voice->dsp.amplitude_that_reaches_noise_floor_nonloop;
@@ -218,6 +230,10 @@ fluid_rvoice_check_sample_sanity(fluid_rvoice_t* voice)
       /* Set the initial phase of the voice (using the result from the
 	 start offset modulators). */
       fluid_phase_set_int(voice->dsp.phase, voice->dsp.start);
+
+      if (voice->stream != NULL) {
+        fluid_rvoice_stream_attach(voice->stream, voice->dsp.sample, voice->dsp.start);
+      }
     } /* if startup */
 
     /* Is this voice run in loop mode, or does it run straight to the
@@ -254,19 +270,233 @@ fluid_rvoice_check_sample_sanity(fluid_rvoice_t* voice)
 }
 
 
-/**
- * Synthesize a voice to a buffer.
- *
- * @param voice rvoice to synthesize
- * @param dsp_buf Audio buffer to synthesize to (#FLUID_BUFSIZE in length)
- * @return Count of samples written to dsp_buf. (-1 means voice is currently 
- * quiet, 0 .. #FLUID_BUFSIZE-1 means voice finished.)
- *
- * Panning, reverb and chorus are processed separately. The dsp interpolation
- * routine is in (fluid_dsp_float.c).
+/*
+ * Interpolate a block of a streamed sample. The start and end points
+ * are narrowed down to the sample points available in memory.
  */
-int
-fluid_rvoice_write (fluid_rvoice_t* voice, fluid_real_t *dsp_buf)
+static int
+fluid_rvoice_interpolate_streamed(fluid_rvoice_t* voice)
+{
+  fluid_rvoice_dsp_t* dsp = &voice->dsp;
+  int start = dsp->start;
+  int end = dsp->end;
+  int index = fluid_phase_index(dsp->phase);
+  int needed, first, last, count;
+
+  /* Highest point the block reads, including the interpolation points */
+  needed = index + (int) (dsp->phase_incr * FLUID_BUFSIZE) + 4;
+  if (needed > end) needed = end;
+
+  if (voice->stream == NULL) {
+    /* Not streaming, play the resident points only */
+    first = 0;
+    last = (int) fluid_sample_get_stream(dsp->sample)->resident - 1;
+    if (index > last) return 0;
+  }
+  else {
+    dsp->data = fluid_rvoice_stream_window(voice->stream, index, dsp->phase_incr,
+                                           needed, &first, &last);
+    if (dsp->data == NULL && first < 0) {
+      /* Pitched up too far to ever be fed, end the voice */
+      return 0;
+    }
+    if (dsp->data == NULL) {
+      /* Underrun: rather play silence than wait for the disk. The
+         playhead stays, so nothing is skipped. */
+      FLUID_MEMSET(dsp->dsp_buf, 0, FLUID_BUFSIZE * sizeof(fluid_real_t));
+      return FLUID_BUFSIZE;
+    }
+  }
+
+  if (first > start) dsp->start = first;
+  if (last < end) dsp->end = last;
+  count = fluid_rvoice_dsp_interpolate(dsp);
+  dsp->start = start;
+  dsp->end = end;
+  return count;
+}
+
+/*
+ * Pick the copy of the sample at the lowest rate which still has at least
+ * one point per output sample (see synth.sample-mipmaps), NULL to play the
+ * sample itself. The copies loop like the sample, so they can only be used
+ * while the voice loop is the sample loop.
+ */
+static fluid_sample_t*
+fluid_rvoice_get_mipmap(fluid_rvoice_dsp_t* dsp)
+{
+  fluid_sample_t* mip = NULL;
+  fluid_sample_t* next = fluid_sample_get_mipmap(dsp->sample);
+  fluid_real_t step = 2;
+
+  if (next == NULL || dsp->phase_incr < step)
+    return NULL;
+
+  if (dsp->samplemode != FLUID_UNLOOPED
+      && (dsp->loopstart != (int) dsp->sample->loopstart
+          || dsp->loopend != (int) dsp->sample->loopend))
+    return NULL;
+
+  for ( ; next != NULL && dsp->phase_incr >= step; step *= 2) {
+    mip = next;
+    next = fluid_sample_get_mipmap(next);
+  }
+  return mip;
+}
+
+/* Position in a copy of the sample at a lower rate */
+#define fluid_rvoice_mipmap_pos(_sample, _mip, _ratio, _pos) \
+  ((_mip)->loopstart + ((double) (_pos) - (_sample)->loopstart) * (_ratio))
+
+/*
+ * Interpolate a block from a copy of the sample at a lower rate. The
+ * playback position, the sample points and the phase increment are
+ * mapped to the copy and the position is mapped back afterwards.
+ */
+static int
+fluid_rvoice_interpolate_mipmap(fluid_rvoice_dsp_t* dsp, fluid_sample_t* mip)
+{
+  fluid_sample_t* sample = dsp->sample;
+  int start = dsp->start;
+  int end = dsp->end;
+  int loopstart = dsp->loopstart;
+  int loopend = dsp->loopend;
+  fluid_real_t phase_incr = dsp->phase_incr;
+  double ratio, pos;
+  int count;
+
+  ratio = (double) (mip->loopend - mip->loopstart) / (sample->loopend - sample->loopstart);
+
+  pos = fluid_rvoice_mipmap_pos(sample, mip, ratio, start) + 0.5;
+  dsp->start = (pos < mip->start) ? (int) mip->start : (int) pos;
+  pos = fluid_rvoice_mipmap_pos(sample, mip, ratio, end);
+  dsp->end = (pos > mip->end) ? (int) mip->end : (int) pos;
+  dsp->loopstart = (int) (fluid_rvoice_mipmap_pos(sample, mip, ratio, loopstart) + 0.5);
+  dsp->loopend = (int) (fluid_rvoice_mipmap_pos(sample, mip, ratio, loopend) + 0.5);
+  dsp->phase_incr = phase_incr * ratio;
+  dsp->data = mip->data;
+  dsp->float_data = fluid_sample_get_float_data(mip);
+
+  pos = fluid_rvoice_mipmap_pos(sample, mip, ratio, fluid_phase_double(dsp->phase));
+  fluid_phase_set_float(dsp->phase, (pos > 0.0) ? pos : 0.0);
+
+  count = fluid_rvoice_dsp_interpolate(dsp);
+
+  pos = sample->loopstart + (fluid_phase_double(dsp->phase) - mip->loopstart) / ratio;
+  fluid_phase_set_float(dsp->phase, (pos > 0.0) ? pos : 0.0);
+
+  dsp->start = start;
+  dsp->end = end;
+  dsp->loopstart = loopstart;
+  dsp->loopend = loopend;
+  dsp->phase_incr = phase_incr;
+  return count;
+}
+
+/*
+ * Interpolate a block of the voice's sample, from a copy at a lower rate
+ * if there is a suitable one.
+ */
+static FLUID_INLINE int
+fluid_rvoice_interpolate_sample(fluid_rvoice_dsp_t* dsp)
+{
+  fluid_sample_t* mip = fluid_rvoice_get_mipmap(dsp);
+
+  if (mip != NULL)
+    return fluid_rvoice_interpolate_mipmap(dsp, mip);
+  return fluid_rvoice_dsp_interpolate(dsp);
+}
+
+/*
+ * Interpolate a block of both channels of a linked stereo sample. The
+ * linked sample has the same length and loop as the voice's sample (see
+ * fluid_defpreset_noteon), so it is played from the same phase with the
+ * same amplitude, only shifted by the distance between the two samples.
+ */
+static int
+fluid_rvoice_interpolate_linked(fluid_rvoice_t* voice, fluid_real_t *linked_buf)
+{
+  fluid_rvoice_dsp_t* dsp = &voice->dsp;
+  fluid_sample_t* sample = dsp->sample;
+  fluid_sample_t* linked = dsp->linked_sample;
+  fluid_real_t *dsp_buf = dsp->dsp_buf;
+  int offset = (int) sample->start - (int) linked->start;
+  fluid_phase_t phase = dsp->phase;
+  fluid_real_t amp = dsp->amp;
+  int has_looped = dsp->has_looped;
+  fluid_phase_t end_phase;
+  fluid_real_t end_amp;
+  int end_has_looped;
+  int count;
+
+  count = fluid_rvoice_interpolate_sample(dsp);
+  end_phase = dsp->phase;
+  end_amp = dsp->amp;
+  end_has_looped = dsp->has_looped;
+
+  dsp->sample = linked;
+  dsp->data = linked->data;
+  dsp->float_data = fluid_sample_get_float_data(linked);
+  dsp->dsp_buf = linked_buf;
+  dsp->start -= offset;
+  dsp->end -= offset;
+  dsp->loopstart -= offset;
+  dsp->loopend -= offset;
+  dsp->phase = phase;
+  fluid_phase_sub_int(dsp->phase, offset);
+  dsp->amp = amp;
+  dsp->has_looped = has_looped;
+
+  fluid_rvoice_interpolate_sample(dsp);
+
+  dsp->sample = sample;
+  dsp->data = sample->data;
+  dsp->float_data = fluid_sample_get_float_data(sample);
+  dsp->dsp_buf = dsp_buf;
+  dsp->start += offset;
+  dsp->end += offset;
+  dsp->loopstart += offset;
+  dsp->loopend += offset;
+  dsp->phase = end_phase;
+  dsp->amp = end_amp;
+  dsp->has_looped = end_has_looped;
+  return count;
+}
+
+/*
+ * Run the dsp chain of a voice which may replay its blocks from the
+ * render cache (see fluid_render_cache.c). The filter coefficients are
+ * calculated first, a cached block has to match them.
+ */
+static int
+fluid_rvoice_write_memo(fluid_rvoice_t* voice)
+{
+  int count;
+
+  fluid_iir_filter_calc(&voice->resonant_filter, voice->dsp.output_rate,
+  		        fluid_lfo_get_val(&voice->envlfo.modlfo) * voice->envlfo.modlfo_to_fc +
+ 		        fluid_adsr_env_get_val(&voice->envlfo.modenv) * voice->envlfo.modenv_to_fc);
+
+  count = fluid_rvoice_memo_begin(voice);
+  if (count >= 0)
+    return count;
+
+  count = fluid_rvoice_interpolate_sample (&voice->dsp);
+  fluid_check_fpe ("voice_write interpolation");
+  if (count > 0)
+    fluid_iir_filter_apply(&voice->resonant_filter, voice->dsp.dsp_buf, count);
+  fluid_rvoice_memo_end(voice, count);
+  return count;
+}
+
+/*
+ * Advance the envelopes and LFOs of a voice by a block and calculate its
+ * amplitude and phase increment for the block.
+ * @return 1 if the block is to be synthesized, otherwise the return value
+ * of fluid_rvoice_write
+ */
+static int
+fluid_rvoice_prepare (fluid_rvoice_t* voice)
 {
   int ticks = voice->envlfo.ticks;
   int count;
@@ -333,29 +563,47 @@ fluid_rvoice_write (fluid_rvoice_t* voice, fluid_real_t *dsp_buf)
     || (voice->dsp.samplemode == FLUID_LOOP_UNTIL_RELEASE
 	&& fluid_adsr_env_get_section(&voice->envlfo.volenv) < FLUID_VOICE_ENVRELEASE);
 
+  return 1;
+}
+
+/**
+ * Synthesize a voice to a buffer.
+ *
+ * @param voice rvoice to synthesize
+ * @param dsp_buf Audio buffer to synthesize to (#FLUID_BUFSIZE in length)
+ * @param linked_buf Audio buffer to synthesize the linked channel of a stereo
+ * voice to (#FLUID_BUFSIZE in length), NULL to leave that channel out
+ * @return Count of samples written to dsp_buf. (-1 means voice is currently 
+ * quiet, 0 .. #FLUID_BUFSIZE-1 means voice finished.)
+ *
+ * Panning, reverb and chorus are processed separately. The dsp interpolation
+ * routine is in (fluid_dsp_float.c).
+ */
+int
+fluid_rvoice_write (fluid_rvoice_t* voice, fluid_real_t *dsp_buf,
+                    fluid_real_t *linked_buf)
+{
+  int count = fluid_rvoice_prepare(voice);
+  if (count <= 0)
+    return count;
+
   /*********************** run the dsp chain ************************
    * The sample is mixed with the output buffer.
    * The buffer has to be filled from 0 to FLUID_BUFSIZE-1.
    * Depending on the position in the loop and the loop size, this
    * may require several runs. */
   voice->dsp.dsp_buf = dsp_buf; 
-
-  switch (voice->dsp.interp_method)
-  {
-    case FLUID_INTERP_NONE:
-      count = fluid_rvoice_dsp_interpolate_none (&voice->dsp);
-      break;
-    case FLUID_INTERP_LINEAR:
-      count = fluid_rvoice_dsp_interpolate_linear (&voice->dsp);
-      break;
-    case FLUID_INTERP_4THORDER:
-    default:
-      count = fluid_rvoice_dsp_interpolate_4th_order (&voice->dsp);
-      break;
-    case FLUID_INTERP_7THORDER:
-      count = fluid_rvoice_dsp_interpolate_7th_order (&voice->dsp);
-      break;
-  }
+  voice->dsp.data = voice->dsp.sample->data;
+  voice->dsp.float_data = fluid_sample_get_float_data(voice->dsp.sample);
+
+  if (fluid_sample_get_stream(voice->dsp.sample) != NULL)
+    count = fluid_rvoice_interpolate_streamed (voice);
+  else if (voice->dsp.linked_sample != NULL && linked_buf != NULL)
+    count = fluid_rvoice_interpolate_linked (voice, linked_buf);
+  else if (voice->memo.cache != NULL)
+    return fluid_rvoice_write_memo (voice);
+  else
+    count = fluid_rvoice_interpolate_sample (&voice->dsp);
   fluid_check_fpe ("voice_write interpolation");
   if (count == 0)
     return count;
@@ -365,11 +613,133 @@ fluid_rvoice_write (fluid_rvoice_t* voice, fluid_real_t *dsp_buf)
   		        fluid_lfo_get_val(&voice->envlfo.modlfo) * voice->envlfo.modlfo_to_fc +
  		        fluid_adsr_env_get_val(&voice->envlfo.modenv) * voice->envlfo.modenv_to_fc);
 
+  if (voice->dsp.linked_sample != NULL && linked_buf != NULL) {
+    /* Same filter, but the linked channel keeps its own history */
+    fluid_iir_filter_t linked_filter = voice->resonant_filter;
+    linked_filter.hist1 = voice->linked_hist1;
+    linked_filter.hist2 = voice->linked_hist2;
+    fluid_iir_filter_apply(&linked_filter, linked_buf, count);
+    voice->linked_hist1 = linked_filter.hist1;
+    voice->linked_hist2 = linked_filter.hist2;
+  }
   fluid_iir_filter_apply(&voice->resonant_filter, dsp_buf, count);
 
   return count;
 }
 
+#ifdef WITH_FIXED_POINT
+/**
+ * Check if the voice can be synthesized by the fixed point kernels
+ * (synth.fixed-point): they interpolate the 16 bit points of a sample in
+ * memory. Streamed samples, linked stereo voices and voices using the
+ * render cache take the floating point chain.
+ */
+int
+fluid_rvoice_can_write_fixed (fluid_rvoice_t* voice)
+{
+  return voice->dsp.sample != NULL && voice->dsp.sample->data != NULL
+    && fluid_sample_get_stream(voice->dsp.sample) == NULL && voice->dsp.linked_sample == NULL
+    && voice->memo.cache == NULL;
+}
+
+/**
+ * Synthesize a voice to a buffer with the fixed point kernels.
+ *
+ * @param voice rvoice to synthesize, see fluid_rvoice_can_write_fixed
+ * @param fixed_buf Buffer to synthesize to (#FLUID_BUFSIZE in length), the
+ * samples have FLUID_FIXED_BLOCK_BITS fraction bits
+ * @return Count of samples written to fixed_buf, like fluid_rvoice_write
+ */
+int
+fluid_rvoice_write_fixed (fluid_rvoice_t* voice, fluid_fixed_t *fixed_buf)
+{
+  int count = fluid_rvoice_prepare(voice);
+  if (count <= 0)
+    return count;
+
+  voice->dsp.fixed_buf = fixed_buf;
+  voice->dsp.data = voice->dsp.sample->data;
+  voice->dsp.float_data = NULL;
+  count = fluid_rvoice_interpolate_sample (&voice->dsp);
+  voice->dsp.fixed_buf = NULL;
+  if (count == 0)
+    return count;
+
+  fluid_iir_filter_calc(&voice->resonant_filter, voice->dsp.output_rate,
+  		        fluid_lfo_get_val(&voice->envlfo.modlfo) * voice->envlfo.modlfo_to_fc +
+ 		        fluid_adsr_env_get_val(&voice->envlfo.modenv) * voice->envlfo.modenv_to_fc);
+  fluid_iir_filter_apply_fixed(&voice->resonant_filter, fixed_buf, count);
+
+  return count;
+}
+#endif
+
+
+/* Bytes of sample points prefetched for a voice at most, and the size of
+ * a cache line */
+#define FLUID_RVOICE_PREFETCH_SIZE 1024
+#define FLUID_CACHE_LINE_SIZE 64
+
+/*
+ * Get the address of the sample points the next block of the voice
+ * starts reading at, NULL if the voice has no sample.
+ */
+static const void*
+fluid_rvoice_get_next_points(fluid_rvoice_t* voice)
+{
+  fluid_sample_t* sample = voice->dsp.sample;
+  int index = fluid_phase_index(voice->dsp.phase);
+
+  if (sample == NULL)
+    return NULL;
+  /* Only the start of a streamed sample is in sample->data */
+  if (fluid_sample_get_stream(sample) != NULL)
+    return sample->data;
+  if (fluid_sample_get_float_data(sample) != NULL)
+    return fluid_sample_get_float_data(sample) + index;
+  return sample->data + index;
+}
+
+static FLUID_INLINE void
+fluid_rvoice_prefetch_points(const char* points, int size)
+{
+  int i;
+
+  if (size > FLUID_RVOICE_PREFETCH_SIZE)
+    size = FLUID_RVOICE_PREFETCH_SIZE;
+  for (i = 0; i < size; i += FLUID_CACHE_LINE_SIZE)
+    FLUID_PREFETCH(points + i);
+}
+
+/**
+ * Prefetch the sample points the next block of the voice reads, so that
+ * they are in the cache once the voice is rendered. The mixer calls this
+ * for the voice it renders next.
+ */
+void
+fluid_rvoice_prefetch(fluid_rvoice_t* voice)
+{
+  fluid_sample_t* sample = voice->dsp.sample;
+  fluid_sample_t* linked = voice->dsp.linked_sample;
+  int index, size;
+
+  if (sample == NULL || fluid_sample_get_stream(sample) != NULL)
+    return;
+
+  /* the block's points, plus the ones around them for interpolation */
+  size = (int) (voice->dsp.phase_incr * FLUID_BUFSIZE) + 4;
+  size *= (fluid_sample_get_float_data(sample) != NULL) ? sizeof(float) : sizeof(short);
+  fluid_rvoice_prefetch_points(fluid_rvoice_get_next_points(voice), size);
+
+  /* The linked channel is read at the same position in its own sample */
+  if (linked != NULL) {
+    index = fluid_phase_index(voice->dsp.phase) + (int) linked->start - (int) sample->start;
+    if (fluid_sample_get_float_data(linked) != NULL)
+      fluid_rvoice_prefetch_points((const char*) (fluid_sample_get_float_data(linked) + index), size);
+    else
+      fluid_rvoice_prefetch_points((const char*) (linked->data + index), size);
+  }
+}
 
 static inline fluid_real_t* 
 get_dest_buf(fluid_rvoice_buffers_t* buffers, int index,
@@ -380,6 +750,32 @@ get_dest_buf(fluid_rvoice_buffers_t* buffers, int index,
   return dest_bufs[j];
 }
 
+/*
+ * Mix a block down to count (1 to FLUID_RVOICE_MAX_BUFS) buffers in one
+ * pass. Called with constant count and centered, so that every combination
+ * is compiled to a loop of its own. Centered: the first two buffers (left
+ * and right of a centered voice) get the same amplitude, which saves one
+ * multiplication per sample.
+ */
+static FLUID_INLINE void
+fluid_rvoice_buffers_mix_n(fluid_real_t** bufs, const fluid_real_t* amps,
+                           const int count, const int centered,
+                           const fluid_real_t* dsp_buf, int samplecount)
+{
+  int dsp_i;
+
+  for (dsp_i = 0; dsp_i < samplecount; dsp_i++) {
+    fluid_real_t samp = amps[0] * dsp_buf[dsp_i];
+    bufs[0][dsp_i] += samp;
+    if (count > 1)
+      bufs[1][dsp_i] += centered ? samp : amps[1] * dsp_buf[dsp_i];
+    if (count > 2)
+      bufs[2][dsp_i] += amps[2] * dsp_buf[dsp_i];
+    if (count > 3)
+      bufs[3][dsp_i] += amps[3] * dsp_buf[dsp_i];
+  }
+}
+
 /**
  * Mix data down to buffers
  *
@@ -395,34 +791,85 @@ fluid_rvoice_buffers_mix(fluid_rvoice_buffers_t* buffers,
                          fluid_real_t** dest_bufs, int dest_bufcount)
 {
   int bufcount = buffers->count;
-  int i, dsp_i;
+  fluid_real_t* bufs[FLUID_RVOICE_MAX_BUFS];
+  fluid_real_t amps[FLUID_RVOICE_MAX_BUFS];
+  int i, count = 0;
   if (!samplecount || !bufcount || !dest_bufcount) 
     return;
 
+  /* Collect the buffers the voice is actually heard in */
   for (i=0; i < bufcount; i++) {
     fluid_real_t* buf = get_dest_buf(buffers, i, dest_bufs, dest_bufcount);
-    fluid_real_t* next_buf;
     fluid_real_t amp = buffers->bufs[i].amp;
     if (buf == NULL || amp == 0.0f)
       continue;
+    bufs[count] = buf;
+    amps[count] = amp;
+    count++;
+  }
 
-    /* Optimization for centered stereo samples - we can save one 
-       multiplication per sample */
-    next_buf = (i+1 >= bufcount ? NULL : get_dest_buf(buffers, i+1, dest_bufs, dest_bufcount));
-    if (next_buf && buffers->bufs[i+1].amp == amp) {
-      for (dsp_i = 0; dsp_i < samplecount; dsp_i++) {
-        fluid_real_t samp = amp * dsp_buf[dsp_i]; 
-        buf[dsp_i] += samp;
-        next_buf[dsp_i] += samp;
-      }
-      i++;
-    }
-    else {
-      for (dsp_i = 0; dsp_i < samplecount; dsp_i++)
-        buf[dsp_i] += amp * dsp_buf[dsp_i];
+  /* Optimization for centered stereo samples - we can save one 
+     multiplication per sample */
+  if (count >= 2 && amps[0] == amps[1]) {
+    switch (count) {
+      case 2: fluid_rvoice_buffers_mix_n(bufs, amps, 2, 1, dsp_buf, samplecount); break;
+      case 3: fluid_rvoice_buffers_mix_n(bufs, amps, 3, 1, dsp_buf, samplecount); break;
+      case 4: fluid_rvoice_buffers_mix_n(bufs, amps, 4, 1, dsp_buf, samplecount); break;
     }
+    return;
+  }
+
+  switch (count) {
+    case 1: fluid_rvoice_buffers_mix_n(bufs, amps, 1, 0, dsp_buf, samplecount); break;
+    case 2: fluid_rvoice_buffers_mix_n(bufs, amps, 2, 0, dsp_buf, samplecount); break;
+    case 3: fluid_rvoice_buffers_mix_n(bufs, amps, 3, 0, dsp_buf, samplecount); break;
+    case 4: fluid_rvoice_buffers_mix_n(bufs, amps, 4, 0, dsp_buf, samplecount); break;
+  }
+}
+
+#ifdef WITH_FIXED_POINT
+/**
+ * Mix a block of the fixed point kernels down to 64 bit accumulators.
+ * The amplitudes are converted to fixed point once per block, the mix is
+ * exact. The accumulators are converted to the mixdown buffers after all
+ * voices of a block are mixed (see fluid_mixer_buffers_flush_fixed).
+ *
+ * @param buffers Destination buffer(s)
+ * @param fixed_buf Mono sample source, with FLUID_FIXED_BLOCK_BITS fraction bits
+ * @param samplecount Number of samples to process (no FLUID_BUFSIZE restriction)
+ * @param dest_bufs Array of accumulators to mixdown to, with
+ *   FLUID_FIXED_BLOCK_BITS + FLUID_FIXED_MIX_BITS fraction bits
+ * @param dest_bufcount Length of dest_bufs
+ */
+void
+fluid_rvoice_buffers_mix_fixed(fluid_rvoice_buffers_t* buffers,
+                               fluid_fixed_t* fixed_buf, int samplecount,
+                               fluid_fixed_acc_t** dest_bufs, int dest_bufcount)
+{
+  fluid_fixed_acc_t* bufs[FLUID_RVOICE_MAX_BUFS];
+  fluid_fixed_t amps[FLUID_RVOICE_MAX_BUFS];
+  int i, j, dsp_i, count = 0;
+  if (!samplecount || !buffers->count || !dest_bufcount)
+    return;
+
+  for (i = 0; i < (int) buffers->count; i++) {
+    fluid_fixed_t amp = fluid_fixed_from_real(buffers->bufs[i].amp, FLUID_FIXED_MIX_BITS);
+    j = buffers->bufs[i].mapping;
+    if (j < 0 || j >= dest_bufcount || dest_bufs[j] == NULL || amp == 0)
+      continue;
+    bufs[count] = dest_bufs[j];
+    amps[count] = amp;
+    count++;
+  }
+
+  for (i = 0; i < count; i++) {
+    fluid_fixed_acc_t* buf = bufs[i];
+    fluid_fixed_acc_t amp = amps[i];
+    for (dsp_i = 0; dsp_i < samplecount; dsp_i++)
+      buf[dsp_i] += amp * fixed_buf[dsp_i];
   }
 }
+#endif
 
 /**
  * Initialize buffers up to (and including) bufnum
@@ -469,6 +916,10 @@ fluid_rvoice_reset(fluid_rvoice_t* voice)
   voice->dsp.has_looped = 0;
   voice->envlfo.ticks = 0;
   voice->envlfo.noteoff_ticks = 0;
+  voice->envlfo.culled = 0;
+  if (voice->memo.cache != NULL)
+    fluid_rvoice_memo_finish(voice);
+  voice->memo.state = FLUID_MEMO_START;
   voice->dsp.amp = 0.0f; /* The last value of the volume envelope, used to
                             calculate the volume increment during
                             processing */
@@ -487,6 +938,8 @@ fluid_rvoice_reset(fluid_rvoice_t* voice)
 
   /* Clear sample history in filter */
   fluid_iir_filter_reset(&voice->resonant_filter);
+  voice->linked_hist1 = 0;
+  voice->linked_hist2 = 0;
 
   /* Force setting of the phase at the first DSP loop run
    * This cannot be done earlier, because it depends on modulators. 
@@ -524,6 +977,49 @@ fluid_rvoice_noteoff(fluid_rvoice_t* voice, unsigned int min_ticks)
   fluid_adsr_env_set_section(&voice->envlfo.modenv, FLUID_VOICE_ENVRELEASE);
 }
 
+/* Blocks a culled voice is faded out in (about 12 ms at 44.1 kHz) */
+#define FLUID_CULL_FADE_BLOCKS 8
+
+/**
+ * Fade out a released voice, if it is quieter than level (see
+ * synth.cull-threshold). Its loudness is estimated like in
+ * fluid_rvoice_calc_amp, from the volume envelope, the attenuation and
+ * the peak of the sample.
+ * @param level amplitude relative to full scale
+ * @return 1 if the voice is culled now, 0 otherwise
+ */
+int
+fluid_rvoice_cull(fluid_rvoice_t* voice, fluid_real_t level)
+{
+  fluid_adsr_env_t* volenv = &voice->envlfo.volenv;
+  fluid_real_t amplitude_that_reaches_noise_floor;
+  fluid_real_t val, estimate;
+
+  /* Only release tails: a held note may come to the fore again */
+  if (voice->envlfo.culled
+      || fluid_adsr_env_get_section(volenv) != FLUID_VOICE_ENVRELEASE)
+    return 0;
+
+  if (voice->dsp.has_looped)
+    amplitude_that_reaches_noise_floor = voice->dsp.amplitude_that_reaches_noise_floor_loop;
+  else
+    amplitude_that_reaches_noise_floor = voice->dsp.amplitude_that_reaches_noise_floor_nonloop;
+
+  val = fluid_adsr_env_get_val(volenv);
+  estimate = fluid_atten2amp (voice->dsp.attenuation)
+    * fluid_cb2amp (960.0f * (1.0f - val))
+    * FLUID_NOISE_FLOOR / amplitude_that_reaches_noise_floor;
+  if (estimate >= level)
+    return 0;
+
+  /* Release the rest of the way in a few blocks */
+  voice->envlfo.culled = 1;
+  fluid_adsr_env_set_data(volenv, FLUID_VOICE_ENVRELEASE, FLUID_CULL_FADE_BLOCKS,
+                          1.0f, -val / FLUID_CULL_FADE_BLOCKS, 0.0f, 1.0f);
+  fluid_adsr_env_set_section(volenv, FLUID_VOICE_ENVRELEASE);
+  return 1;
+}
+
 
 void 
 fluid_rvoice_set_output_rate(fluid_rvoice_t* voice, fluid_real_t value)
@@ -654,6 +1150,16 @@ fluid_rvoice_set_sample(fluid_rvoice_t* voice, fluid_sample_t* value)
   }
 }
 
+/*
+ * Also play the other channel of a linked stereo sample, NULL for a mono
+ * voice. Set after the sample.
+ */
+void 
+fluid_rvoice_set_linked_sample(fluid_rvoice_t* voice, fluid_sample_t* value)
+{
+  voice->dsp.linked_sample = value;
+}
+
 void 
 fluid_rvoice_voiceoff(fluid_rvoice_t* voice)
 {
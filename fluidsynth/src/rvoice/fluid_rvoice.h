@@ -28,6 +28,8 @@
 #include "fluid_lfo.h"
 #include "fluid_phase.h"
 #include "fluid_sfont.h"
+#include "fluid_rvoice_stream.h"
+#include "fluid_render_cache.h"
 
 typedef struct _fluid_rvoice_envlfo_t fluid_rvoice_envlfo_t;
 typedef struct _fluid_rvoice_dsp_t fluid_rvoice_dsp_t;
@@ -57,6 +59,7 @@ struct _fluid_rvoice_envlfo_t
 	/* Note-off minimum length */
 	unsigned int ticks;
 	unsigned int noteoff_ticks;      
+	int culled;                     /* Flag: the voice is faded out early (synth.cull-threshold) */
 
 	/* vol env */
         fluid_adsr_env_t volenv;
@@ -85,6 +88,9 @@ struct _fluid_rvoice_dsp_t
 	/* interpolation method, as in fluid_interp in fluidsynth.h */
 	int interp_method;
 	fluid_sample_t* sample;
+	fluid_sample_t* linked_sample;	/* other channel of a linked stereo sample, NULL for mono voices */
+	short int* data;		/* points to interpolate, indexed like the sample (usually sample->data) */
+	float* float_data;		/* the same points converted to float, NULL if there is no float copy */
 	int check_sample_sanity_flag;   /* Flag that initiates, that sample-related parameters
 					   have to be checked. */
 
@@ -115,6 +121,9 @@ struct _fluid_rvoice_dsp_t
 	/* Dynamic input to the interpolator below */
 
 	fluid_real_t *dsp_buf;		/* buffer to store interpolated sample data to */
+#ifdef WITH_FIXED_POINT
+	fluid_fixed_t *fixed_buf;	/* buffer of the fixed point kernels, NULL to use dsp_buf */
+#endif
 
 	fluid_real_t amp;                /* current linear amplitude */
 	fluid_real_t amp_incr;		/* amplitude increment value for the next FLUID_BUFSIZE samples */
@@ -150,15 +159,32 @@ struct _fluid_rvoice_t
 	fluid_rvoice_envlfo_t envlfo;
 	fluid_rvoice_dsp_t dsp; 
 	fluid_iir_filter_t resonant_filter; /* IIR resonant dsp filter */
+	fluid_real_t linked_hist1, linked_hist2; /* filter history of the linked channel */
 	fluid_rvoice_buffers_t buffers;
+	fluid_rvoice_buffers_t linked_buffers; /* mixdown of the linked channel */
+	fluid_rvoice_stream_t* stream; /* disk stream for streamed samples, NULL if streaming is off */
+	fluid_render_memo_t memo; /* replaying and recording of cached blocks */
+	unsigned int mix_order; /* number given by the mixer when the voice was added, for sorting */
 };
 
 
-int fluid_rvoice_write(fluid_rvoice_t* voice, fluid_real_t *dsp_buf);
+int fluid_rvoice_write(fluid_rvoice_t* voice, fluid_real_t *dsp_buf,
+                       fluid_real_t *linked_buf);
+#ifdef WITH_FIXED_POINT
+int fluid_rvoice_can_write_fixed(fluid_rvoice_t* voice);
+int fluid_rvoice_write_fixed(fluid_rvoice_t* voice, fluid_fixed_t *fixed_buf);
+#endif
+
+void fluid_rvoice_prefetch(fluid_rvoice_t* voice);
 
 void fluid_rvoice_buffers_mix(fluid_rvoice_buffers_t* buffers, 
                               fluid_real_t* dsp_buf, int samplecount, 
                               fluid_real_t** dest_bufs, int dest_bufcount);
+#ifdef WITH_FIXED_POINT
+void fluid_rvoice_buffers_mix_fixed(fluid_rvoice_buffers_t* buffers,
+                                    fluid_fixed_t* fixed_buf, int samplecount,
+                                    fluid_fixed_acc_t** dest_bufs, int dest_bufcount);
+#endif
 void fluid_rvoice_buffers_set_amp(fluid_rvoice_buffers_t* buffers, 
                                   unsigned int bufnum, fluid_real_t value);
 void fluid_rvoice_buffers_set_mapping(fluid_rvoice_buffers_t* buffers,
@@ -167,6 +193,7 @@ void fluid_rvoice_buffers_set_mapping(fluid_rvoice_buffers_t* buffers,
 /* Dynamic update functions */
 
 void fluid_rvoice_noteoff(fluid_rvoice_t* voice, unsigned int min_ticks);
+int fluid_rvoice_cull(fluid_rvoice_t* voice, fluid_real_t level);
 void fluid_rvoice_voiceoff(fluid_rvoice_t* voice);
 void fluid_rvoice_reset(fluid_rvoice_t* voice);
 void fluid_rvoice_set_output_rate(fluid_rvoice_t* voice, fluid_real_t output_rate);
@@ -187,14 +214,18 @@ void fluid_rvoice_set_end(fluid_rvoice_t* voice, int value);
 void fluid_rvoice_set_loopstart(fluid_rvoice_t* voice, int value);
 void fluid_rvoice_set_loopend(fluid_rvoice_t* voice, int value);
 void fluid_rvoice_set_sample(fluid_rvoice_t* voice, fluid_sample_t* value);
+void fluid_rvoice_set_linked_sample(fluid_rvoice_t* voice, fluid_sample_t* value);
 void fluid_rvoice_set_samplemode(fluid_rvoice_t* voice, enum fluid_loop value);
 
 /* defined in fluid_rvoice_dsp.c */
 
 void fluid_rvoice_dsp_config (void);
-int fluid_rvoice_dsp_interpolate_none (fluid_rvoice_dsp_t *voice);
-int fluid_rvoice_dsp_interpolate_linear (fluid_rvoice_dsp_t *voice);
-int fluid_rvoice_dsp_interpolate_4th_order (fluid_rvoice_dsp_t *voice);
-int fluid_rvoice_dsp_interpolate_7th_order (fluid_rvoice_dsp_t *voice);
+int fluid_rvoice_dsp_interpolate (fluid_rvoice_dsp_t *voice);
+
+/* defined in fluid_render_cache.c */
+
+int fluid_rvoice_memo_begin(fluid_rvoice_t* voice);
+void fluid_rvoice_memo_end(fluid_rvoice_t* voice, int count);
+void fluid_rvoice_memo_finish(fluid_rvoice_t* voice);
 
 #endif
@@ -56,6 +56,13 @@ static fluid_real_t interp_coeff[FLUID_INTERP_MAX][4];
 /* 7th order interpolation (7 coefficients centered on 3rd) */
 static fluid_real_t sinc_table7[FLUID_INTERP_MAX][7];
 
+#ifdef WITH_FIXED_POINT
+/* The same tables with FLUID_FIXED_COEFF_BITS fraction bits */
+static fluid_fixed_t interp_coeff_linear_fixed[FLUID_INTERP_MAX][2];
+static fluid_fixed_t interp_coeff_fixed[FLUID_INTERP_MAX][4];
+static fluid_fixed_t sinc_table7_fixed[FLUID_INTERP_MAX][7];
+#endif
+
 
 #define SINC_INTERP_ORDER 7	/* 7th order constant */
 
@@ -107,6 +114,21 @@ void fluid_rvoice_dsp_config (void)
     }
   }
 
+#ifdef WITH_FIXED_POINT
+  for (i = 0; i < FLUID_INTERP_MAX; i++)
+  {
+    for (i2 = 0; i2 < 2; i2++)
+      interp_coeff_linear_fixed[i][i2] =
+        fluid_fixed_from_real (interp_coeff_linear[i][i2], FLUID_FIXED_COEFF_BITS);
+    for (i2 = 0; i2 < 4; i2++)
+      interp_coeff_fixed[i][i2] =
+        fluid_fixed_from_real (interp_coeff[i][i2], FLUID_FIXED_COEFF_BITS);
+    for (i2 = 0; i2 < SINC_INTERP_ORDER; i2++)
+      sinc_table7_fixed[i][i2] =
+        fluid_fixed_from_real (sinc_table7[i][i2], FLUID_FIXED_COEFF_BITS);
+  }
+#endif
+
 #if 0
   for (i = 0; i < FLUID_INTERP_MAX; i++)
   {
@@ -119,557 +141,181 @@ void fluid_rvoice_dsp_config (void)
   fluid_check_fpe("interpolation table calculation");
 }
 
-/* No interpolation. Just take the sample, which is closest to
-  * the playback pointer.  Questionable quality, but very
-  * efficient. */
-int
-fluid_rvoice_dsp_interpolate_none (fluid_rvoice_dsp_t *voice)
-{
-  fluid_phase_t dsp_phase = voice->phase;
-  fluid_phase_t dsp_phase_incr;
-  short int *dsp_data = voice->sample->data;
-  fluid_real_t *dsp_buf = voice->dsp_buf;
-  fluid_real_t dsp_amp = voice->amp;
-  fluid_real_t dsp_amp_incr = voice->amp_incr;
-  unsigned int dsp_i = 0;
-  unsigned int dsp_phase_index;
-  unsigned int end_index;
-  int looping;
-
-  /* Convert playback "speed" floating point value to phase index/fract */
-  fluid_phase_set_float (dsp_phase_incr, voice->phase_incr);
-
-  /* voice is currently looping? */
-  looping = voice->is_looping;
- 
-  end_index = looping ? voice->loopend - 1 : voice->end;
-
-  while (1)
-  {
-    dsp_phase_index = fluid_phase_index_round (dsp_phase);	/* round to nearest point */
-
-    /* interpolate sequence of sample points */
-    for ( ; dsp_i < FLUID_BUFSIZE && dsp_phase_index <= end_index; dsp_i++)
-    {
-      dsp_buf[dsp_i] = dsp_amp * dsp_data[dsp_phase_index];
-
-      /* increment phase and amplitude */
-      fluid_phase_incr (dsp_phase, dsp_phase_incr);
-      dsp_phase_index = fluid_phase_index_round (dsp_phase);	/* round to nearest point */
-      dsp_amp += dsp_amp_incr;
-    }
-
-    /* break out if not looping (buffer may not be full) */
-    if (!looping) break;
-
-    /* go back to loop start */
-    if (dsp_phase_index > end_index)
-    {
-      fluid_phase_sub_int (dsp_phase, voice->loopend - voice->loopstart);
-      voice->has_looped = 1;
-    }
-
-    /* break out if filled buffer */
-    if (dsp_i >= FLUID_BUFSIZE) break;
-  }
-
-  voice->phase = dsp_phase;
-  voice->amp = dsp_amp;
-
-  return (dsp_i);
-}
-
-/* Straight line interpolation.
- * Returns number of samples processed (usually FLUID_BUFSIZE but could be
- * smaller if end of sample occurs).
- */
-int
-fluid_rvoice_dsp_interpolate_linear (fluid_rvoice_dsp_t *voice)
-{
-  fluid_phase_t dsp_phase = voice->phase;
-  fluid_phase_t dsp_phase_incr;
-  short int *dsp_data = voice->sample->data;
-  fluid_real_t *dsp_buf = voice->dsp_buf;
-  fluid_real_t dsp_amp = voice->amp;
-  fluid_real_t dsp_amp_incr = voice->amp_incr;
-  unsigned int dsp_i = 0;
-  unsigned int dsp_phase_index;
-  unsigned int end_index;
-  short int point;
-  fluid_real_t *coeffs;
-  int looping;
-
-  /* Convert playback "speed" floating point value to phase index/fract */
-  fluid_phase_set_float (dsp_phase_incr, voice->phase_incr);
-
-  /* voice is currently looping? */
-  looping = voice->is_looping;
-
-  /* last index before 2nd interpolation point must be specially handled */
-  end_index = (looping ? voice->loopend - 1 : voice->end) - 1;
-
-  /* 2nd interpolation point to use at end of loop or sample */
-  if (looping) point = dsp_data[voice->loopstart];	/* loop start */
-  else point = dsp_data[voice->end];			/* duplicate end for samples no longer looping */
-
-  while (1)
-  {
-    dsp_phase_index = fluid_phase_index (dsp_phase);
-
-    /* interpolate the sequence of sample points */
-    for ( ; dsp_i < FLUID_BUFSIZE && dsp_phase_index <= end_index; dsp_i++)
-    {
-      coeffs = interp_coeff_linear[fluid_phase_fract_to_tablerow (dsp_phase)];
-      dsp_buf[dsp_i] = dsp_amp * (coeffs[0] * dsp_data[dsp_phase_index]
-				  + coeffs[1] * dsp_data[dsp_phase_index+1]);
-
-      /* increment phase and amplitude */
-      fluid_phase_incr (dsp_phase, dsp_phase_incr);
-      dsp_phase_index = fluid_phase_index (dsp_phase);
-      dsp_amp += dsp_amp_incr;
-    }
-
-    /* break out if buffer filled */
-    if (dsp_i >= FLUID_BUFSIZE) break;
-
-    end_index++;	/* we're now interpolating the last point */
-
-    /* interpolate within last point */
-    for (; dsp_phase_index <= end_index && dsp_i < FLUID_BUFSIZE; dsp_i++)
-    {
-      coeffs = interp_coeff_linear[fluid_phase_fract_to_tablerow (dsp_phase)];
-      dsp_buf[dsp_i] = dsp_amp * (coeffs[0] * dsp_data[dsp_phase_index]
-				  + coeffs[1] * point);
-
-      /* increment phase and amplitude */
-      fluid_phase_incr (dsp_phase, dsp_phase_incr);
-      dsp_phase_index = fluid_phase_index (dsp_phase);
-      dsp_amp += dsp_amp_incr;	/* increment amplitude */
-    }
-
-    if (!looping) break;	/* break out if not looping (end of sample) */
-
-    /* go back to loop start (if past */
-    if (dsp_phase_index > end_index)
-    {
-      fluid_phase_sub_int (dsp_phase, voice->loopend - voice->loopstart);
-      voice->has_looped = 1;
-    }
-
-    /* break out if filled buffer */
-    if (dsp_i >= FLUID_BUFSIZE) break;
-
-    end_index--;	/* set end back to second to last sample point */
-  }
-
-  voice->phase = dsp_phase;
-  voice->amp = dsp_amp;
-
-  return (dsp_i);
-}
-
-/* 4th order (cubic) interpolation.
- * Returns number of samples processed (usually FLUID_BUFSIZE but could be
- * smaller if end of sample occurs).
- */
-int
-fluid_rvoice_dsp_interpolate_4th_order (fluid_rvoice_dsp_t *voice)
-{
-  fluid_phase_t dsp_phase = voice->phase;
-  fluid_phase_t dsp_phase_incr;
-  short int *dsp_data = voice->sample->data;
-  fluid_real_t *dsp_buf = voice->dsp_buf;
-  fluid_real_t dsp_amp = voice->amp;
-  fluid_real_t dsp_amp_incr = voice->amp_incr;
-  unsigned int dsp_i = 0;
-  unsigned int dsp_phase_index;
-  unsigned int start_index, end_index;
-  short int start_point, end_point1, end_point2;
-  fluid_real_t *coeffs;
-  int looping;
-
-  /* Convert playback "speed" floating point value to phase index/fract */
-  fluid_phase_set_float (dsp_phase_incr, voice->phase_incr);
-
-  /* voice is currently looping? */
-  looping = voice->is_looping;
-
-  /* last index before 4th interpolation point must be specially handled */
-  end_index = (looping ? voice->loopend - 1 : voice->end) - 2;
-
-  if (voice->has_looped)	/* set start_index and start point if looped or not */
-  {
-    start_index = voice->loopstart;
-    start_point = dsp_data[voice->loopend - 1];	/* last point in loop (wrap around) */
-  }
-  else
-  {
-    start_index = voice->start;
-    start_point = dsp_data[voice->start];	/* just duplicate the point */
-  }
-
-  /* get points off the end (loop start if looping, duplicate point if end) */
-  if (looping)
-  {
-    end_point1 = dsp_data[voice->loopstart];
-    end_point2 = dsp_data[voice->loopstart + 1];
-  }
-  else
-  {
-    end_point1 = dsp_data[voice->end];
-    end_point2 = end_point1;
-  }
-
-  while (1)
-  {
-    dsp_phase_index = fluid_phase_index (dsp_phase);
-
-    /* interpolate first sample point (start or loop start) if needed */
-    for ( ; dsp_phase_index == start_index && dsp_i < FLUID_BUFSIZE; dsp_i++)
-    {
-      coeffs = interp_coeff[fluid_phase_fract_to_tablerow (dsp_phase)];
-      dsp_buf[dsp_i] = dsp_amp * (coeffs[0] * start_point
-				  + coeffs[1] * dsp_data[dsp_phase_index]
-				  + coeffs[2] * dsp_data[dsp_phase_index+1]
-				  + coeffs[3] * dsp_data[dsp_phase_index+2]);
-
-      /* increment phase and amplitude */
-      fluid_phase_incr (dsp_phase, dsp_phase_incr);
-      dsp_phase_index = fluid_phase_index (dsp_phase);
-      dsp_amp += dsp_amp_incr;
-    }
-
-    /* interpolate the sequence of sample points */
-    for ( ; dsp_i < FLUID_BUFSIZE && dsp_phase_index <= end_index; dsp_i++)
-    {
-      coeffs = interp_coeff[fluid_phase_fract_to_tablerow (dsp_phase)];
-      dsp_buf[dsp_i] = dsp_amp * (coeffs[0] * dsp_data[dsp_phase_index-1]
-				  + coeffs[1] * dsp_data[dsp_phase_index]
-				  + coeffs[2] * dsp_data[dsp_phase_index+1]
-				  + coeffs[3] * dsp_data[dsp_phase_index+2]);
-
-      /* increment phase and amplitude */
-      fluid_phase_incr (dsp_phase, dsp_phase_incr);
-      dsp_phase_index = fluid_phase_index (dsp_phase);
-      dsp_amp += dsp_amp_incr;
-    }
-
-    /* break out if buffer filled */
-    if (dsp_i >= FLUID_BUFSIZE) break;
-
-    end_index++;	/* we're now interpolating the 2nd to last point */
-
-    /* interpolate within 2nd to last point */
-    for (; dsp_phase_index <= end_index && dsp_i < FLUID_BUFSIZE; dsp_i++)
-    {
-      coeffs = interp_coeff[fluid_phase_fract_to_tablerow (dsp_phase)];
-      dsp_buf[dsp_i] = dsp_amp * (coeffs[0] * dsp_data[dsp_phase_index-1]
-				  + coeffs[1] * dsp_data[dsp_phase_index]
-				  + coeffs[2] * dsp_data[dsp_phase_index+1]
-				  + coeffs[3] * end_point1);
-
-      /* increment phase and amplitude */
-      fluid_phase_incr (dsp_phase, dsp_phase_incr);
-      dsp_phase_index = fluid_phase_index (dsp_phase);
-      dsp_amp += dsp_amp_incr;
-    }
-
-    end_index++;	/* we're now interpolating the last point */
-
-    /* interpolate within the last point */
-    for (; dsp_phase_index <= end_index && dsp_i < FLUID_BUFSIZE; dsp_i++)
-    {
-      coeffs = interp_coeff[fluid_phase_fract_to_tablerow (dsp_phase)];
-      dsp_buf[dsp_i] = dsp_amp * (coeffs[0] * dsp_data[dsp_phase_index-1]
-				  + coeffs[1] * dsp_data[dsp_phase_index]
-				  + coeffs[2] * end_point1
-				  + coeffs[3] * end_point2);
-
-      /* increment phase and amplitude */
-      fluid_phase_incr (dsp_phase, dsp_phase_incr);
-      dsp_phase_index = fluid_phase_index (dsp_phase);
-      dsp_amp += dsp_amp_incr;
-    }
-
-    if (!looping) break;	/* break out if not looping (end of sample) */
-
-    /* go back to loop start */
-    if (dsp_phase_index > end_index)
-    {
-      fluid_phase_sub_int (dsp_phase, voice->loopend - voice->loopstart);
-
-      if (!voice->has_looped)
-      {
-	voice->has_looped = 1;
-	start_index = voice->loopstart;
-	start_point = dsp_data[voice->loopend - 1];
-      }
-    }
 
-    /* break out if filled buffer */
-    if (dsp_i >= FLUID_BUFSIZE) break;
-
-    end_index -= 2;	/* set end back to third to last sample point */
-  }
+/* The floating point kernels write fluid_real_t samples to dsp_buf */
+#define FLUID_DSP_OUT fluid_real_t
+#define FLUID_DSP_BUF voice->dsp_buf
+#define FLUID_DSP_AMP fluid_real_t
+#define FLUID_DSP_AMP_IN(_x) (_x)
+#define FLUID_DSP_AMP_OUT(_x) (_x)
+#define FLUID_DSP_COEFF fluid_real_t
+#define FLUID_DSP_TABLE(_name) _name
+#define FLUID_DSP_SCALE(_amp, _sum) ((_amp) * (_sum))
+#define FLUID_DSP_SCALE_POINT(_amp, _point) ((_amp) * (_point))
+
+/* Kernels for the 16 bit sample points of fluid_sample_t::data */
+#define FLUID_DSP_SAMPLE short int
+#define FLUID_DSP_DATA voice->data
+#define FLUID_DSP_LOOPING 0
+#define FLUID_DSP_FUNC(_name) _name
+#include "fluid_rvoice_dsp_kernels.h"
+#undef FLUID_DSP_LOOPING
+#undef FLUID_DSP_FUNC
+#define FLUID_DSP_LOOPING 1
+#define FLUID_DSP_FUNC(_name) _name ## _looping
+#include "fluid_rvoice_dsp_kernels.h"
+#undef FLUID_DSP_SAMPLE
+#undef FLUID_DSP_DATA
+#undef FLUID_DSP_LOOPING
+#undef FLUID_DSP_FUNC
+
+/* Kernels for the pre-converted points of fluid_sample_t::float_data,
+ * they save converting every point read from integer */
+#define FLUID_DSP_SAMPLE float
+#define FLUID_DSP_DATA voice->float_data
+#define FLUID_DSP_LOOPING 0
+#define FLUID_DSP_FUNC(_name) _name ## _float
+#include "fluid_rvoice_dsp_kernels.h"
+#undef FLUID_DSP_LOOPING
+#undef FLUID_DSP_FUNC
+#define FLUID_DSP_LOOPING 1
+#define FLUID_DSP_FUNC(_name) _name ## _float_looping
+#include "fluid_rvoice_dsp_kernels.h"
+#undef FLUID_DSP_SAMPLE
+#undef FLUID_DSP_DATA
+#undef FLUID_DSP_LOOPING
+#undef FLUID_DSP_FUNC
+#undef FLUID_DSP_OUT
+#undef FLUID_DSP_BUF
+#undef FLUID_DSP_AMP
+#undef FLUID_DSP_AMP_IN
+#undef FLUID_DSP_AMP_OUT
+#undef FLUID_DSP_COEFF
+#undef FLUID_DSP_TABLE
+#undef FLUID_DSP_SCALE
+#undef FLUID_DSP_SCALE_POINT
+
+#ifdef WITH_FIXED_POINT
+/* Fixed point kernels for the 16 bit sample points (synth.fixed-point).
+ * They write fluid_fixed_t samples with FLUID_FIXED_BLOCK_BITS fraction
+ * bits to fixed_buf. The weighted sums of points have
+ * FLUID_FIXED_COEFF_BITS fraction bits, the amplitude has
+ * FLUID_FIXED_AMP_BITS. */
+#define FLUID_DSP_OUT fluid_fixed_t
+#define FLUID_DSP_BUF voice->fixed_buf
+#define FLUID_DSP_AMP fluid_fixed_t
+#define FLUID_DSP_AMP_IN(_x) fluid_fixed_from_real (_x, FLUID_FIXED_AMP_BITS)
+#define FLUID_DSP_AMP_OUT(_x) fluid_fixed_to_real (_x, FLUID_FIXED_AMP_BITS)
+#define FLUID_DSP_COEFF fluid_fixed_t
+#define FLUID_DSP_TABLE(_name) _name ## _fixed
+#define FLUID_DSP_SCALE(_amp, _sum) \
+  fluid_fixed_mul_round (_sum, _amp, FLUID_FIXED_COEFF_BITS + FLUID_FIXED_AMP_BITS - FLUID_FIXED_BLOCK_BITS)
+#define FLUID_DSP_SCALE_POINT(_amp, _point) \
+  fluid_fixed_mul_round (_point, _amp, FLUID_FIXED_AMP_BITS - FLUID_FIXED_BLOCK_BITS)
+
+#define FLUID_DSP_SAMPLE short int
+#define FLUID_DSP_DATA voice->data
+#define FLUID_DSP_LOOPING 0
+#define FLUID_DSP_FUNC(_name) _name ## _fixed
+#include "fluid_rvoice_dsp_kernels.h"
+#undef FLUID_DSP_LOOPING
+#undef FLUID_DSP_FUNC
+#define FLUID_DSP_LOOPING 1
+#define FLUID_DSP_FUNC(_name) _name ## _fixed_looping
+#include "fluid_rvoice_dsp_kernels.h"
+#undef FLUID_DSP_SAMPLE
+#undef FLUID_DSP_DATA
+#undef FLUID_DSP_LOOPING
+#undef FLUID_DSP_FUNC
+#undef FLUID_DSP_OUT
+#undef FLUID_DSP_BUF
+#undef FLUID_DSP_AMP
+#undef FLUID_DSP_AMP_IN
+#undef FLUID_DSP_AMP_OUT
+#undef FLUID_DSP_COEFF
+#undef FLUID_DSP_TABLE
+#undef FLUID_DSP_SCALE
+#undef FLUID_DSP_SCALE_POINT
+#endif
 
-  voice->phase = dsp_phase;
-  voice->amp = dsp_amp;
 
-  return (dsp_i);
-}
+typedef int (*fluid_rvoice_dsp_kernel_t) (fluid_rvoice_dsp_t *voice);
+
+/* Kernels in the order of the columns of fluid_rvoice_dsp_kernels */
+enum {
+  FLUID_DSP_KERNEL_COPY,
+  FLUID_DSP_KERNEL_NONE,
+  FLUID_DSP_KERNEL_LINEAR,
+  FLUID_DSP_KERNEL_4TH_ORDER,
+  FLUID_DSP_KERNEL_7TH_ORDER,
+  FLUID_DSP_KERNEL_COUNT
+};
+
+#define FLUID_DSP_KERNEL_ROW(_suffix) \
+  { fluid_rvoice_dsp_copy ## _suffix, \
+    fluid_rvoice_dsp_interpolate_none ## _suffix, \
+    fluid_rvoice_dsp_interpolate_linear ## _suffix, \
+    fluid_rvoice_dsp_interpolate_4th_order ## _suffix, \
+    fluid_rvoice_dsp_interpolate_7th_order ## _suffix }
+
+/* The kernels by sample point format (short, float), looping (no, yes)
+ * and interpolation */
+static const fluid_rvoice_dsp_kernel_t
+fluid_rvoice_dsp_kernels[2][2][FLUID_DSP_KERNEL_COUNT] = {
+  { FLUID_DSP_KERNEL_ROW(), FLUID_DSP_KERNEL_ROW(_looping) },
+  { FLUID_DSP_KERNEL_ROW(_float), FLUID_DSP_KERNEL_ROW(_float_looping) }
+};
+
+#ifdef WITH_FIXED_POINT
+/* The fixed point kernels by looping (no, yes) and interpolation */
+static const fluid_rvoice_dsp_kernel_t
+fluid_rvoice_dsp_fixed_kernels[2][FLUID_DSP_KERNEL_COUNT] = {
+  FLUID_DSP_KERNEL_ROW(_fixed), FLUID_DSP_KERNEL_ROW(_fixed_looping)
+};
+#endif
 
-/* 7th order interpolation.
+/**
+ * Interpolate a block of the voice with the kernel made for its
+ * interpolation method, sample point format and looping. This is the
+ * only branching per block, the kernels themselves don't check any of it.
+ * While voice->fixed_buf is set, the block is interpolated from the 16 bit
+ * points to fixed_buf with the fixed point kernels.
  * Returns number of samples processed (usually FLUID_BUFSIZE but could be
  * smaller if end of sample occurs).
  */
 int
-fluid_rvoice_dsp_interpolate_7th_order (fluid_rvoice_dsp_t *voice)
+fluid_rvoice_dsp_interpolate (fluid_rvoice_dsp_t *voice)
 {
-  fluid_phase_t dsp_phase = voice->phase;
-  fluid_phase_t dsp_phase_incr;
-  short int *dsp_data = voice->sample->data;
-  fluid_real_t *dsp_buf = voice->dsp_buf;
-  fluid_real_t dsp_amp = voice->amp;
-  fluid_real_t dsp_amp_incr = voice->amp_incr;
-  unsigned int dsp_i = 0;
-  unsigned int dsp_phase_index;
-  unsigned int start_index, end_index;
-  short int start_points[3];
-  short int end_points[3];
-  fluid_real_t *coeffs;
-  int looping;
-
-  /* Convert playback "speed" floating point value to phase index/fract */
-  fluid_phase_set_float (dsp_phase_incr, voice->phase_incr);
-
-  /* add 1/2 sample to dsp_phase since 7th order interpolation is centered on
-   * the 4th sample point */
-  fluid_phase_incr (dsp_phase, (fluid_phase_t)0x80000000);
-
-  /* voice is currently looping? */
-  looping = voice->is_looping;
-
-  /* last index before 7th interpolation point must be specially handled */
-  end_index = (looping ? voice->loopend - 1 : voice->end) - 3;
-
-  if (voice->has_looped)	/* set start_index and start point if looped or not */
-  {
-    start_index = voice->loopstart;
-    start_points[0] = dsp_data[voice->loopend - 1];
-    start_points[1] = dsp_data[voice->loopend - 2];
-    start_points[2] = dsp_data[voice->loopend - 3];
-  }
-  else
-  {
-    start_index = voice->start;
-    start_points[0] = dsp_data[voice->start];	/* just duplicate the start point */
-    start_points[1] = start_points[0];
-    start_points[2] = start_points[0];
-  }
+  int kernel;
 
-  /* get the 3 points off the end (loop start if looping, duplicate point if end) */
-  if (looping)
-  {
-    end_points[0] = dsp_data[voice->loopstart];
-    end_points[1] = dsp_data[voice->loopstart + 1];
-    end_points[2] = dsp_data[voice->loopstart + 2];
-  }
+  /* At unity pitch on a sample point, the interpolation is a copy */
+  if (voice->phase_incr == 1.0 && fluid_phase_fract (voice->phase) == 0)
+    kernel = FLUID_DSP_KERNEL_COPY;
   else
   {
-    end_points[0] = dsp_data[voice->end];
-    end_points[1] = end_points[0];
-    end_points[2] = end_points[0];
-  }
-
-  while (1)
-  {
-    dsp_phase_index = fluid_phase_index (dsp_phase);
-
-    /* interpolate first sample point (start or loop start) if needed */
-    for ( ; dsp_phase_index == start_index && dsp_i < FLUID_BUFSIZE; dsp_i++)
+    switch (voice->interp_method)
     {
-      coeffs = sinc_table7[fluid_phase_fract_to_tablerow (dsp_phase)];
-
-      dsp_buf[dsp_i] = dsp_amp
-	* (coeffs[0] * (fluid_real_t)start_points[2]
-	   + coeffs[1] * (fluid_real_t)start_points[1]
-	   + coeffs[2] * (fluid_real_t)start_points[0]
-	   + coeffs[3] * (fluid_real_t)dsp_data[dsp_phase_index]
-	   + coeffs[4] * (fluid_real_t)dsp_data[dsp_phase_index+1]
-	   + coeffs[5] * (fluid_real_t)dsp_data[dsp_phase_index+2]
-	   + coeffs[6] * (fluid_real_t)dsp_data[dsp_phase_index+3]);
-
-      /* increment phase and amplitude */
-      fluid_phase_incr (dsp_phase, dsp_phase_incr);
-      dsp_phase_index = fluid_phase_index (dsp_phase);
-      dsp_amp += dsp_amp_incr;
+      case FLUID_INTERP_NONE:
+        kernel = FLUID_DSP_KERNEL_NONE;
+        break;
+      case FLUID_INTERP_LINEAR:
+        kernel = FLUID_DSP_KERNEL_LINEAR;
+        break;
+      case FLUID_INTERP_4THORDER:
+      default:
+        kernel = FLUID_DSP_KERNEL_4TH_ORDER;
+        break;
+      case FLUID_INTERP_7THORDER:
+        kernel = FLUID_DSP_KERNEL_7TH_ORDER;
+        break;
     }
-
-    start_index++;
-
-    /* interpolate 2nd to first sample point (start or loop start) if needed */
-    for ( ; dsp_phase_index == start_index && dsp_i < FLUID_BUFSIZE; dsp_i++)
-    {
-      coeffs = sinc_table7[fluid_phase_fract_to_tablerow (dsp_phase)];
-
-      dsp_buf[dsp_i] = dsp_amp
-	* (coeffs[0] * (fluid_real_t)start_points[1]
-	   + coeffs[1] * (fluid_real_t)start_points[0]
-	   + coeffs[2] * (fluid_real_t)dsp_data[dsp_phase_index-1]
-	   + coeffs[3] * (fluid_real_t)dsp_data[dsp_phase_index]
-	   + coeffs[4] * (fluid_real_t)dsp_data[dsp_phase_index+1]
-	   + coeffs[5] * (fluid_real_t)dsp_data[dsp_phase_index+2]
-	   + coeffs[6] * (fluid_real_t)dsp_data[dsp_phase_index+3]);
-
-      /* increment phase and amplitude */
-      fluid_phase_incr (dsp_phase, dsp_phase_incr);
-      dsp_phase_index = fluid_phase_index (dsp_phase);
-      dsp_amp += dsp_amp_incr;
-    }
-
-    start_index++;
-
-    /* interpolate 3rd to first sample point (start or loop start) if needed */
-    for ( ; dsp_phase_index == start_index && dsp_i < FLUID_BUFSIZE; dsp_i++)
-    {
-      coeffs = sinc_table7[fluid_phase_fract_to_tablerow (dsp_phase)];
-
-      dsp_buf[dsp_i] = dsp_amp
-	* (coeffs[0] * (fluid_real_t)start_points[0]
-	   + coeffs[1] * (fluid_real_t)dsp_data[dsp_phase_index-2]
-	   + coeffs[2] * (fluid_real_t)dsp_data[dsp_phase_index-1]
-	   + coeffs[3] * (fluid_real_t)dsp_data[dsp_phase_index]
-	   + coeffs[4] * (fluid_real_t)dsp_data[dsp_phase_index+1]
-	   + coeffs[5] * (fluid_real_t)dsp_data[dsp_phase_index+2]
-	   + coeffs[6] * (fluid_real_t)dsp_data[dsp_phase_index+3]);
-
-      /* increment phase and amplitude */
-      fluid_phase_incr (dsp_phase, dsp_phase_incr);
-      dsp_phase_index = fluid_phase_index (dsp_phase);
-      dsp_amp += dsp_amp_incr;
-    }
-
-    start_index -= 2;	/* set back to original start index */
-
-
-    /* interpolate the sequence of sample points */
-    for ( ; dsp_i < FLUID_BUFSIZE && dsp_phase_index <= end_index; dsp_i++)
-    {
-      coeffs = sinc_table7[fluid_phase_fract_to_tablerow (dsp_phase)];
-
-      dsp_buf[dsp_i] = dsp_amp
-	* (coeffs[0] * (fluid_real_t)dsp_data[dsp_phase_index-3]
-	   + coeffs[1] * (fluid_real_t)dsp_data[dsp_phase_index-2]
-	   + coeffs[2] * (fluid_real_t)dsp_data[dsp_phase_index-1]
-	   + coeffs[3] * (fluid_real_t)dsp_data[dsp_phase_index]
-	   + coeffs[4] * (fluid_real_t)dsp_data[dsp_phase_index+1]
-	   + coeffs[5] * (fluid_real_t)dsp_data[dsp_phase_index+2]
-	   + coeffs[6] * (fluid_real_t)dsp_data[dsp_phase_index+3]);
-
-      /* increment phase and amplitude */
-      fluid_phase_incr (dsp_phase, dsp_phase_incr);
-      dsp_phase_index = fluid_phase_index (dsp_phase);
-      dsp_amp += dsp_amp_incr;
-    }
-
-    /* break out if buffer filled */
-    if (dsp_i >= FLUID_BUFSIZE) break;
-
-    end_index++;	/* we're now interpolating the 3rd to last point */
-
-    /* interpolate within 3rd to last point */
-    for (; dsp_phase_index <= end_index && dsp_i < FLUID_BUFSIZE; dsp_i++)
-    {
-      coeffs = sinc_table7[fluid_phase_fract_to_tablerow (dsp_phase)];
-
-      dsp_buf[dsp_i] = dsp_amp
-	* (coeffs[0] * (fluid_real_t)dsp_data[dsp_phase_index-3]
-	   + coeffs[1] * (fluid_real_t)dsp_data[dsp_phase_index-2]
-	   + coeffs[2] * (fluid_real_t)dsp_data[dsp_phase_index-1]
-	   + coeffs[3] * (fluid_real_t)dsp_data[dsp_phase_index]
-	   + coeffs[4] * (fluid_real_t)dsp_data[dsp_phase_index+1]
-	   + coeffs[5] * (fluid_real_t)dsp_data[dsp_phase_index+2]
-	   + coeffs[6] * (fluid_real_t)end_points[0]);
-
-      /* increment phase and amplitude */
-      fluid_phase_incr (dsp_phase, dsp_phase_incr);
-      dsp_phase_index = fluid_phase_index (dsp_phase);
-      dsp_amp += dsp_amp_incr;
-    }
-
-    end_index++;	/* we're now interpolating the 2nd to last point */
-
-    /* interpolate within 2nd to last point */
-    for (; dsp_phase_index <= end_index && dsp_i < FLUID_BUFSIZE; dsp_i++)
-    {
-      coeffs = sinc_table7[fluid_phase_fract_to_tablerow (dsp_phase)];
-
-      dsp_buf[dsp_i] = dsp_amp
-	* (coeffs[0] * (fluid_real_t)dsp_data[dsp_phase_index-3]
-	   + coeffs[1] * (fluid_real_t)dsp_data[dsp_phase_index-2]
-	   + coeffs[2] * (fluid_real_t)dsp_data[dsp_phase_index-1]
-	   + coeffs[3] * (fluid_real_t)dsp_data[dsp_phase_index]
-	   + coeffs[4] * (fluid_real_t)dsp_data[dsp_phase_index+1]
-	   + coeffs[5] * (fluid_real_t)end_points[0]
-	   + coeffs[6] * (fluid_real_t)end_points[1]);
-
-      /* increment phase and amplitude */
-      fluid_phase_incr (dsp_phase, dsp_phase_incr);
-      dsp_phase_index = fluid_phase_index (dsp_phase);
-      dsp_amp += dsp_amp_incr;
-    }
-
-    end_index++;	/* we're now interpolating the last point */
-
-    /* interpolate within last point */
-    for (; dsp_phase_index <= end_index && dsp_i < FLUID_BUFSIZE; dsp_i++)
-    {
-      coeffs = sinc_table7[fluid_phase_fract_to_tablerow (dsp_phase)];
-
-      dsp_buf[dsp_i] = dsp_amp
-	* (coeffs[0] * (fluid_real_t)dsp_data[dsp_phase_index-3]
-	   + coeffs[1] * (fluid_real_t)dsp_data[dsp_phase_index-2]
-	   + coeffs[2] * (fluid_real_t)dsp_data[dsp_phase_index-1]
-	   + coeffs[3] * (fluid_real_t)dsp_data[dsp_phase_index]
-	   + coeffs[4] * (fluid_real_t)end_points[0]
-	   + coeffs[5] * (fluid_real_t)end_points[1]
-	   + coeffs[6] * (fluid_real_t)end_points[2]);
-
-      /* increment phase and amplitude */
-      fluid_phase_incr (dsp_phase, dsp_phase_incr);
-      dsp_phase_index = fluid_phase_index (dsp_phase);
-      dsp_amp += dsp_amp_incr;
-    }
-
-    if (!looping) break;	/* break out if not looping (end of sample) */
-
-    /* go back to loop start */
-    if (dsp_phase_index > end_index)
-    {
-      fluid_phase_sub_int (dsp_phase, voice->loopend - voice->loopstart);
-
-      if (!voice->has_looped)
-      {
-	voice->has_looped = 1;
-	start_index = voice->loopstart;
-	start_points[0] = dsp_data[voice->loopend - 1];
-	start_points[1] = dsp_data[voice->loopend - 2];
-	start_points[2] = dsp_data[voice->loopend - 3];
-      }
-    }
-
-    /* break out if filled buffer */
-    if (dsp_i >= FLUID_BUFSIZE) break;
-
-    end_index -= 3;	/* set end back to 4th to last sample point */
   }
 
-  /* sub 1/2 sample from dsp_phase since 7th order interpolation is centered on
-   * the 4th sample point (correct back to real value) */
-  fluid_phase_decr (dsp_phase, (fluid_phase_t)0x80000000);
-
-  voice->phase = dsp_phase;
-  voice->amp = dsp_amp;
+#ifdef WITH_FIXED_POINT
+  if (voice->fixed_buf != NULL)
+    return fluid_rvoice_dsp_fixed_kernels[voice->is_looping != 0][kernel] (voice);
+#endif
 
-  return (dsp_i);
+  return fluid_rvoice_dsp_kernels[voice->float_data != NULL]
+                                 [voice->is_looping != 0][kernel] (voice);
 }
@@ -0,0 +1,525 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+/* Interpolation kernels, included by fluid_rvoice_dsp.c once for each
+ * combination of sample point format, arithmetic and looping. Before
+ * including, define:
+ * - FLUID_DSP_SAMPLE: type of the sample points
+ * - FLUID_DSP_DATA: the points to read, an expression of voice
+ * - FLUID_DSP_LOOPING: 1 for the kernels of looping voices, 0 otherwise
+ * - FLUID_DSP_FUNC(name): name of the kernel for this combination
+ * - FLUID_DSP_OUT, FLUID_DSP_BUF: type of the output samples and the
+ *   buffer to write them to, an expression of voice
+ * - FLUID_DSP_AMP, FLUID_DSP_AMP_IN(x), FLUID_DSP_AMP_OUT(x): type of the
+ *   amplitude while interpolating, conversion from and to voice->amp
+ * - FLUID_DSP_COEFF, FLUID_DSP_TABLE(name): type of the interpolation
+ *   coefficients and the table to read them from
+ * - FLUID_DSP_SCALE(amp, sum): output sample of a weighted sum of points
+ * - FLUID_DSP_SCALE_POINT(amp, point): output sample of a single point
+ * As the looping flag is a constant, the compiler drops the loop handling
+ * from the kernels of voices, which don't loop.
+ */
+
+/* Unity pitch: the phase increment is exactly one point and the phase
+ * is on a sample point, so any interpolation would give the points
+ * themselves. Just copy and scale them.
+ * Returns number of samples processed (usually FLUID_BUFSIZE but could be
+ * smaller if end of sample occurs).
+ */
+static int
+FLUID_DSP_FUNC(fluid_rvoice_dsp_copy) (fluid_rvoice_dsp_t *voice)
+{
+  const FLUID_DSP_SAMPLE *dsp_data = FLUID_DSP_DATA;
+  FLUID_DSP_OUT *dsp_buf = FLUID_DSP_BUF;
+  FLUID_DSP_AMP dsp_amp = FLUID_DSP_AMP_IN (voice->amp);
+  FLUID_DSP_AMP dsp_amp_incr = FLUID_DSP_AMP_IN (voice->amp_incr);
+  unsigned int dsp_i = 0;
+  unsigned int dsp_phase_index = fluid_phase_index (voice->phase);
+  unsigned int end_index;
+  int looping;
+
+  /* voice is currently looping? */
+  looping = FLUID_DSP_LOOPING;
+
+  end_index = looping ? voice->loopend - 1 : voice->end;
+
+  while (1)
+  {
+    /* copy sequence of sample points */
+    for ( ; dsp_i < FLUID_BUFSIZE && dsp_phase_index <= end_index; dsp_i++)
+    {
+      dsp_buf[dsp_i] = FLUID_DSP_SCALE_POINT (dsp_amp, dsp_data[dsp_phase_index++]);
+      dsp_amp += dsp_amp_incr;
+    }
+
+    /* break out if not looping (buffer may not be full) */
+    if (!looping) break;
+
+    /* go back to loop start */
+    if (dsp_phase_index > end_index)
+    {
+      dsp_phase_index -= voice->loopend - voice->loopstart;
+      voice->has_looped = 1;
+    }
+
+    /* break out if filled buffer */
+    if (dsp_i >= FLUID_BUFSIZE) break;
+  }
+
+  fluid_phase_set_int (voice->phase, dsp_phase_index);
+  voice->amp = FLUID_DSP_AMP_OUT (dsp_amp);
+
+  return (dsp_i);
+}
+
+/* No interpolation. Just take the sample, which is closest to
+  * the playback pointer.  Questionable quality, but very
+  * efficient. */
+static int
+FLUID_DSP_FUNC(fluid_rvoice_dsp_interpolate_none) (fluid_rvoice_dsp_t *voice)
+{
+  fluid_phase_t dsp_phase = voice->phase;
+  fluid_phase_t dsp_phase_incr;
+  const FLUID_DSP_SAMPLE *dsp_data = FLUID_DSP_DATA;
+  FLUID_DSP_OUT *dsp_buf = FLUID_DSP_BUF;
+  FLUID_DSP_AMP dsp_amp = FLUID_DSP_AMP_IN (voice->amp);
+  FLUID_DSP_AMP dsp_amp_incr = FLUID_DSP_AMP_IN (voice->amp_incr);
+  unsigned int dsp_i = 0;
+  unsigned int dsp_phase_index;
+  unsigned int end_index;
+  int looping;
+
+  /* Convert playback "speed" floating point value to phase index/fract */
+  fluid_phase_set_float (dsp_phase_incr, voice->phase_incr);
+
+  /* voice is currently looping? */
+  looping = FLUID_DSP_LOOPING;
+ 
+  end_index = looping ? voice->loopend - 1 : voice->end;
+
+  while (1)
+  {
+    dsp_phase_index = fluid_phase_index_round (dsp_phase);	/* round to nearest point */
+
+    /* interpolate sequence of sample points */
+    for ( ; dsp_i < FLUID_BUFSIZE && dsp_phase_index <= end_index; dsp_i++)
+    {
+      dsp_buf[dsp_i] = FLUID_DSP_SCALE_POINT (dsp_amp, dsp_data[dsp_phase_index]);
+
+      /* increment phase and amplitude */
+      fluid_phase_incr (dsp_phase, dsp_phase_incr);
+      dsp_phase_index = fluid_phase_index_round (dsp_phase);	/* round to nearest point */
+      dsp_amp += dsp_amp_incr;
+    }
+
+    /* break out if not looping (buffer may not be full) */
+    if (!looping) break;
+
+    /* go back to loop start */
+    if (dsp_phase_index > end_index)
+    {
+      fluid_phase_sub_int (dsp_phase, voice->loopend - voice->loopstart);
+      voice->has_looped = 1;
+    }
+
+    /* break out if filled buffer */
+    if (dsp_i >= FLUID_BUFSIZE) break;
+  }
+
+  voice->phase = dsp_phase;
+  voice->amp = FLUID_DSP_AMP_OUT (dsp_amp);
+
+  return (dsp_i);
+}
+
+/* Straight line interpolation.
+ * Returns number of samples processed (usually FLUID_BUFSIZE but could be
+ * smaller if end of sample occurs).
+ */
+static int
+FLUID_DSP_FUNC(fluid_rvoice_dsp_interpolate_linear) (fluid_rvoice_dsp_t *voice)
+{
+  fluid_phase_t dsp_phase = voice->phase;
+  fluid_phase_t dsp_phase_incr;
+  const FLUID_DSP_SAMPLE *dsp_data = FLUID_DSP_DATA;
+  FLUID_DSP_OUT *dsp_buf = FLUID_DSP_BUF;
+  FLUID_DSP_AMP dsp_amp = FLUID_DSP_AMP_IN (voice->amp);
+  FLUID_DSP_AMP dsp_amp_incr = FLUID_DSP_AMP_IN (voice->amp_incr);
+  unsigned int dsp_i = 0;
+  unsigned int dsp_phase_index;
+  unsigned int end_index;
+  FLUID_DSP_SAMPLE point;
+  FLUID_DSP_COEFF *coeffs;
+  int looping;
+
+  /* Convert playback "speed" floating point value to phase index/fract */
+  fluid_phase_set_float (dsp_phase_incr, voice->phase_incr);
+
+  /* voice is currently looping? */
+  looping = FLUID_DSP_LOOPING;
+
+  /* last index before 2nd interpolation point must be specially handled */
+  end_index = (looping ? voice->loopend - 1 : voice->end) - 1;
+
+  /* 2nd interpolation point to use at end of loop or sample */
+  if (looping) point = dsp_data[voice->loopstart];	/* loop start */
+  else point = dsp_data[voice->end];			/* duplicate end for samples no longer looping */
+
+  while (1)
+  {
+    dsp_phase_index = fluid_phase_index (dsp_phase);
+
+    /* interpolate the sequence of sample points */
+    for ( ; dsp_i < FLUID_BUFSIZE && dsp_phase_index <= end_index; dsp_i++)
+    {
+      coeffs = FLUID_DSP_TABLE(interp_coeff_linear)[fluid_phase_fract_to_tablerow (dsp_phase)];
+      dsp_buf[dsp_i] = FLUID_DSP_SCALE (dsp_amp, coeffs[0] * dsp_data[dsp_phase_index]
+				  + coeffs[1] * dsp_data[dsp_phase_index+1]);
+
+      /* increment phase and amplitude */
+      fluid_phase_incr (dsp_phase, dsp_phase_incr);
+      dsp_phase_index = fluid_phase_index (dsp_phase);
+      dsp_amp += dsp_amp_incr;
+    }
+
+    /* break out if buffer filled */
+    if (dsp_i >= FLUID_BUFSIZE) break;
+
+    end_index++;	/* we're now interpolating the last point */
+
+    /* interpolate within last point */
+    for (; dsp_phase_index <= end_index && dsp_i < FLUID_BUFSIZE; dsp_i++)
+    {
+      coeffs = FLUID_DSP_TABLE(interp_coeff_linear)[fluid_phase_fract_to_tablerow (dsp_phase)];
+      dsp_buf[dsp_i] = FLUID_DSP_SCALE (dsp_amp, coeffs[0] * dsp_data[dsp_phase_index]
+				  + coeffs[1] * point);
+
+      /* increment phase and amplitude */
+      fluid_phase_incr (dsp_phase, dsp_phase_incr);
+      dsp_phase_index = fluid_phase_index (dsp_phase);
+      dsp_amp += dsp_amp_incr;	/* increment amplitude */
+    }
+
+    if (!looping) break;	/* break out if not looping (end of sample) */
+
+    /* go back to loop start (if past */
+    if (dsp_phase_index > end_index)
+    {
+      fluid_phase_sub_int (dsp_phase, voice->loopend - voice->loopstart);
+      voice->has_looped = 1;
+    }
+
+    /* break out if filled buffer */
+    if (dsp_i >= FLUID_BUFSIZE) break;
+
+    end_index--;	/* set end back to second to last sample point */
+  }
+
+  voice->phase = dsp_phase;
+  voice->amp = FLUID_DSP_AMP_OUT (dsp_amp);
+
+  return (dsp_i);
+}
+
+/* Point i of the played region first .. last (start or loop start to end
+ * or last loop point) as the kernels read it, i counting from first. The
+ * points off the region are wrapped around the loop (once looped or while
+ * looping) or duplicate the start or end point. Regions and loops can be
+ * shorter than the kernel, so the wrapping may go round several times.
+ */
+static FLUID_INLINE FLUID_DSP_SAMPLE
+FLUID_DSP_FUNC(fluid_rvoice_dsp_guard_point) (fluid_rvoice_dsp_t *voice,
+					      const FLUID_DSP_SAMPLE *dsp_data,
+					      unsigned int first, unsigned int last,
+					      int i)
+{
+  unsigned int looplen = voice->loopend - voice->loopstart;
+
+  if (i < 0)
+  {
+    if (voice->has_looped && voice->loopend > voice->loopstart)
+      return dsp_data[voice->loopend - 1 - (unsigned int) (-i - 1) % looplen];
+    return dsp_data[first];
+  }
+
+  if ((unsigned int) i > last - first)
+  {
+    if (FLUID_DSP_LOOPING && voice->loopend > voice->loopstart)
+      return dsp_data[voice->loopstart + (i - (last - first) - 1) % looplen];
+    return dsp_data[last];
+  }
+
+  return dsp_data[first + i];
+}
+
+/* Fills the guard windows of the played region first .. last for a
+ * kernel, which reads 'before' points before and 'after' points after the
+ * playback point. head holds the points first - before .. first + before
+ * + after - 1, tail the points last - before - after + 1 .. last + after,
+ * as returned by fluid_rvoice_dsp_guard_point, so that the kernel can read
+ * straight through a window like through the sample itself. The windows
+ * overlap each other if the region is short.
+ */
+static FLUID_INLINE void
+FLUID_DSP_FUNC(fluid_rvoice_dsp_fill_guards) (fluid_rvoice_dsp_t *voice,
+					      const FLUID_DSP_SAMPLE *dsp_data,
+					      unsigned int first, unsigned int last,
+					      int before, int after,
+					      FLUID_DSP_SAMPLE *head,
+					      FLUID_DSP_SAMPLE *tail)
+{
+  int tail_first = (int) (last - first) - before - after + 1;
+  int i;
+
+  for (i = 0; i < 2 * before + after; i++)
+    head[i] = FLUID_DSP_FUNC(fluid_rvoice_dsp_guard_point) (voice, dsp_data, first,
+							     last, i - before);
+
+  for (i = 0; i < before + 2 * after; i++)
+    tail[i] = FLUID_DSP_FUNC(fluid_rvoice_dsp_guard_point) (voice, dsp_data, first,
+							     last, tail_first + i);
+}
+
+/* 4th order (cubic) interpolation.
+ * Returns number of samples processed (usually FLUID_BUFSIZE but could be
+ * smaller if end of sample occurs).
+ */
+static int
+FLUID_DSP_FUNC(fluid_rvoice_dsp_interpolate_4th_order) (fluid_rvoice_dsp_t *voice)
+{
+  fluid_phase_t dsp_phase = voice->phase;
+  fluid_phase_t dsp_phase_incr;
+  const FLUID_DSP_SAMPLE *dsp_data = FLUID_DSP_DATA;
+  FLUID_DSP_OUT *dsp_buf = FLUID_DSP_BUF;
+  FLUID_DSP_AMP dsp_amp = FLUID_DSP_AMP_IN (voice->amp);
+  FLUID_DSP_AMP dsp_amp_incr = FLUID_DSP_AMP_IN (voice->amp_incr);
+  unsigned int dsp_i = 0;
+  unsigned int dsp_phase_index;
+  unsigned int start_index, end_index;
+  unsigned int src_index, src_end;
+  FLUID_DSP_SAMPLE head[4], tail[5];
+  const FLUID_DSP_SAMPLE *src, *point;
+  FLUID_DSP_COEFF *coeffs;
+  int looping;
+
+  /* Convert playback "speed" floating point value to phase index/fract */
+  fluid_phase_set_float (dsp_phase_incr, voice->phase_incr);
+
+  /* voice is currently looping? */
+  looping = FLUID_DSP_LOOPING;
+
+  /* last point played (last point of loop or sample) */
+  end_index = looping ? voice->loopend - 1 : voice->end;
+
+  /* first point played (loop start once looped) */
+  start_index = voice->has_looped ? voice->loopstart : voice->start;
+
+  FLUID_DSP_FUNC(fluid_rvoice_dsp_fill_guards) (voice, dsp_data, start_index,
+						end_index, 1, 2, head, tail);
+  while (1)
+  {
+    dsp_phase_index = fluid_phase_index (dsp_phase);
+
+    /* past the last point, also at the start of a block following one
+     * that ended there */
+    if (dsp_phase_index > end_index)
+    {
+      if (!looping) break;	/* break out if not looping (end of sample) */
+
+      /* go back to loop start, again if the loop is shorter than the
+       * phase increment */
+      fluid_phase_sub_int (dsp_phase, voice->loopend - voice->loopstart);
+
+      if (!voice->has_looped)
+      {
+	voice->has_looped = 1;
+	start_index = voice->loopstart;
+	FLUID_DSP_FUNC(fluid_rvoice_dsp_fill_guards) (voice, dsp_data, start_index,
+						      end_index, 1, 2, head, tail);
+      }
+      continue;
+    }
+
+    /* read the guard windows at the first point and the last 2 points,
+     * the sample itself in between */
+    if (dsp_phase_index == start_index)
+    {
+      src = head;
+      src_index = start_index - 1;
+      src_end = start_index;
+    }
+    else if (dsp_phase_index + 2 > end_index && dsp_phase_index <= end_index)
+    {
+      src = tail;
+      src_index = end_index - 2;
+      src_end = end_index;
+    }
+    else
+    {
+      src = dsp_data;
+      src_index = 0;
+      src_end = end_index - 2;
+    }
+
+    /* interpolate the sequence of sample points */
+    for ( ; dsp_i < FLUID_BUFSIZE && dsp_phase_index <= src_end; dsp_i++)
+    {
+      point = src + (dsp_phase_index - src_index);
+      coeffs = FLUID_DSP_TABLE(interp_coeff)[fluid_phase_fract_to_tablerow (dsp_phase)];
+      dsp_buf[dsp_i] = FLUID_DSP_SCALE (dsp_amp, coeffs[0] * point[-1]
+				  + coeffs[1] * point[0]
+				  + coeffs[2] * point[1]
+				  + coeffs[3] * point[2]);
+
+      /* increment phase and amplitude */
+      fluid_phase_incr (dsp_phase, dsp_phase_incr);
+      dsp_phase_index = fluid_phase_index (dsp_phase);
+      dsp_amp += dsp_amp_incr;
+    }
+
+    /* break out if buffer filled */
+    if (dsp_i >= FLUID_BUFSIZE) break;
+  }
+
+  voice->phase = dsp_phase;
+  voice->amp = FLUID_DSP_AMP_OUT (dsp_amp);
+
+  return (dsp_i);
+}
+
+/* 7th order interpolation.
+ * Returns number of samples processed (usually FLUID_BUFSIZE but could be
+ * smaller if end of sample occurs).
+ */
+static int
+FLUID_DSP_FUNC(fluid_rvoice_dsp_interpolate_7th_order) (fluid_rvoice_dsp_t *voice)
+{
+  fluid_phase_t dsp_phase = voice->phase;
+  fluid_phase_t dsp_phase_incr;
+  const FLUID_DSP_SAMPLE *dsp_data = FLUID_DSP_DATA;
+  FLUID_DSP_OUT *dsp_buf = FLUID_DSP_BUF;
+  FLUID_DSP_AMP dsp_amp = FLUID_DSP_AMP_IN (voice->amp);
+  FLUID_DSP_AMP dsp_amp_incr = FLUID_DSP_AMP_IN (voice->amp_incr);
+  unsigned int dsp_i = 0;
+  unsigned int dsp_phase_index;
+  unsigned int start_index, end_index;
+  unsigned int src_index, src_end;
+  FLUID_DSP_SAMPLE head[9], tail[9];
+  const FLUID_DSP_SAMPLE *src, *point;
+  FLUID_DSP_COEFF *coeffs;
+  int looping;
+
+  /* Convert playback "speed" floating point value to phase index/fract */
+  fluid_phase_set_float (dsp_phase_incr, voice->phase_incr);
+
+  /* add 1/2 sample to dsp_phase since 7th order interpolation is centered on
+   * the 4th sample point */
+  fluid_phase_incr (dsp_phase, (fluid_phase_t)0x80000000);
+
+  /* voice is currently looping? */
+  looping = FLUID_DSP_LOOPING;
+
+  /* last point played (last point of loop or sample) */
+  end_index = looping ? voice->loopend - 1 : voice->end;
+
+  /* first point played (loop start once looped) */
+  start_index = voice->has_looped ? voice->loopstart : voice->start;
+
+  FLUID_DSP_FUNC(fluid_rvoice_dsp_fill_guards) (voice, dsp_data, start_index,
+						end_index, 3, 3, head, tail);
+  while (1)
+  {
+    dsp_phase_index = fluid_phase_index (dsp_phase);
+
+    /* past the last point, also at the start of a block following one
+     * that ended there */
+    if (dsp_phase_index > end_index)
+    {
+      if (!looping) break;	/* break out if not looping (end of sample) */
+
+      /* go back to loop start, again if the loop is shorter than the
+       * phase increment */
+      fluid_phase_sub_int (dsp_phase, voice->loopend - voice->loopstart);
+
+      if (!voice->has_looped)
+      {
+	voice->has_looped = 1;
+	start_index = voice->loopstart;
+	FLUID_DSP_FUNC(fluid_rvoice_dsp_fill_guards) (voice, dsp_data, start_index,
+						      end_index, 3, 3, head, tail);
+      }
+      continue;
+    }
+
+    /* read the guard windows at the first 3 and the last 3 points, the
+     * sample itself in between */
+    if (dsp_phase_index >= start_index && dsp_phase_index < start_index + 3)
+    {
+      src = head;
+      src_index = start_index - 3;
+      src_end = (end_index < start_index + 2) ? end_index : start_index + 2;
+    }
+    else if (dsp_phase_index + 3 > end_index && dsp_phase_index <= end_index)
+    {
+      src = tail;
+      src_index = end_index - 5;
+      src_end = end_index;
+    }
+    else
+    {
+      src = dsp_data;
+      src_index = 0;
+      src_end = end_index - 3;
+    }
+
+    /* interpolate the sequence of sample points */
+    for ( ; dsp_i < FLUID_BUFSIZE && dsp_phase_index <= src_end; dsp_i++)
+    {
+      point = src + (dsp_phase_index - src_index);
+      coeffs = FLUID_DSP_TABLE(sinc_table7)[fluid_phase_fract_to_tablerow (dsp_phase)];
+
+      dsp_buf[dsp_i] = FLUID_DSP_SCALE (dsp_amp,
+	   coeffs[0] * (FLUID_DSP_COEFF)point[-3]
+	   + coeffs[1] * (FLUID_DSP_COEFF)point[-2]
+	   + coeffs[2] * (FLUID_DSP_COEFF)point[-1]
+	   + coeffs[3] * (FLUID_DSP_COEFF)point[0]
+	   + coeffs[4] * (FLUID_DSP_COEFF)point[1]
+	   + coeffs[5] * (FLUID_DSP_COEFF)point[2]
+	   + coeffs[6] * (FLUID_DSP_COEFF)point[3]);
+
+      /* increment phase and amplitude */
+      fluid_phase_incr (dsp_phase, dsp_phase_incr);
+      dsp_phase_index = fluid_phase_index (dsp_phase);
+      dsp_amp += dsp_amp_incr;
+    }
+
+    /* break out if buffer filled */
+    if (dsp_i >= FLUID_BUFSIZE) break;
+  }
+
+  /* sub 1/2 sample from dsp_phase since 7th order interpolation is centered on
+   * the 4th sample point (correct back to real value) */
+  fluid_phase_decr (dsp_phase, (fluid_phase_t)0x80000000);
+
+  voice->phase = dsp_phase;
+  voice->amp = FLUID_DSP_AMP_OUT (dsp_amp);
+
+  return (dsp_i);
+}
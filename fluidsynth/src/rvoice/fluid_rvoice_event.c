@@ -80,6 +80,7 @@ fluid_rvoice_event_dispatch(fluid_rvoice_event_t* event)
 
   EVENTFUNC_R1(fluid_iir_filter_set_fres, fluid_iir_filter_t*);
   EVENTFUNC_R1(fluid_iir_filter_set_q_dB, fluid_iir_filter_t*);
+  EVENTFUNC_I1(fluid_iir_filter_set_bypass, fluid_iir_filter_t*);
 
   EVENTFUNC_IR(fluid_rvoice_buffers_set_mapping, fluid_rvoice_buffers_t*);
   EVENTFUNC_IR(fluid_rvoice_buffers_set_amp, fluid_rvoice_buffers_t*);
@@ -104,6 +105,7 @@ fluid_rvoice_event_dispatch(fluid_rvoice_event_t* event)
   EVENTFUNC_I1(fluid_rvoice_set_loopend, fluid_rvoice_t*);
   EVENTFUNC_I1(fluid_rvoice_set_samplemode, fluid_rvoice_t*);
   EVENTFUNC_PTR(fluid_rvoice_set_sample, fluid_rvoice_t*, fluid_sample_t*);
+  EVENTFUNC_PTR(fluid_rvoice_set_linked_sample, fluid_rvoice_t*, fluid_sample_t*);
 
   EVENTFUNC_R1(fluid_rvoice_mixer_set_samplerate, fluid_rvoice_mixer_t*);
   EVENTFUNC_I1(fluid_rvoice_mixer_set_polyphony, fluid_rvoice_mixer_t*);
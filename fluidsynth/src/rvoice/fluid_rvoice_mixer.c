@@ -25,6 +25,7 @@
 #include "fluid_chorus.h"
 #include "fluidsynth_priv.h"
 #include "fluid_ladspa.h"
+#include "fluid_upsampler.h"
 
 #define SYNTH_REVERB_CHANNEL 0
 #define SYNTH_CHORUS_CHANNEL 1
@@ -35,6 +36,10 @@
 // so don't activate the thread(s).
 #define VOICES_PER_THREAD 8
 
+// Threads claim this many neighbouring voices at a time, so voices reading
+// the same sample data end up on the same core.
+#define VOICES_PER_CHUNK 4
+
 typedef struct _fluid_mixer_buffers_t fluid_mixer_buffers_t;
 
 struct _fluid_mixer_buffers_t {
@@ -57,6 +62,38 @@ struct _fluid_mixer_buffers_t {
   int fx_buf_count;
   fluid_real_t** fx_left_buf;
   fluid_real_t** fx_right_buf;
+
+#ifdef WITH_FIXED_POINT
+  int fixed_buf_count;         /**< Number of buffers fluid_mixer_buffers_prepare hands out */
+  fluid_fixed_acc_t** fixed_buf; /**< Accumulator of the fixed point voices for each of them */
+  fluid_fixed_acc_t** fixed_out; /**< fixed_buf, NULL where the prepared buffer is NULL */
+  int fixed_voices;            /**< Voices mixed to the accumulators since the last flush */
+#endif
+};
+
+/* An effects unit is put to sleep (bypassed) once both its send input and
+ * its output tail have stayed below FX_SLEEP_THRESHOLD (about -120 dB) for
+ * FX_SLEEP_HOLD_TIME seconds. The hold time must be longer than the longest
+ * reverb comb and chorus delay line, so that no tail still travelling
+ * through a delay line gets cut off. A unit with feedback (the reverb) must
+ * also have silent delay lines, its output alone may be quiet while the
+ * combs still ring. */
+#define FX_SLEEP_THRESHOLD  1e-6
+#define FX_SLEEP_HOLD_TIME  0.2
+
+/* The output peak, which released voices are culled against, falls by this
+ * many dB per second after the loud material has stopped. */
+#define CULL_PEAK_DECAY_DB  20.0
+
+typedef void (*fluid_mixer_fx_process_t)(void* unit, fluid_real_t *in,
+                                         fluid_real_t *left_out, fluid_real_t *right_out);
+
+typedef struct _fluid_mixer_fx_sleep_t fluid_mixer_fx_sleep_t;
+
+struct _fluid_mixer_fx_sleep_t {
+  int sleeping;           /**< Atomic: TRUE if the unit is currently bypassed */
+  int wakeups;            /**< Atomic: number of times the unit woke up again */
+  int silent_samples;     /**< Samples since the last audible send or tail */
 };
 
 typedef struct _fluid_mixer_fx_t fluid_mixer_fx_t;
@@ -67,6 +104,9 @@ struct _fluid_mixer_fx_t {
   int with_reverb;        /**< Should the synth use the built-in reverb unit? */
   int with_chorus;        /**< Should the synth use the built-in chorus unit? */
   int mix_fx_to_out;      /**< Should the effects be mixed in with the primary output? */
+  fluid_mixer_fx_sleep_t reverb_sleep; /**< Sleep state of the reverb unit */
+  fluid_mixer_fx_sleep_t chorus_sleep; /**< Sleep state of the chorus unit */
+  int sleep_hold_samples; /**< Silent samples before a unit falls asleep */
 };
 
 struct _fluid_rvoice_mixer_t {
@@ -80,6 +120,23 @@ struct _fluid_rvoice_mixer_t {
   int polyphony; /**< Read-only: Length of voices array */
   int active_voices; /**< Read-only: Number of non-null voices */
   int current_blockcount;      /**< Read-only: how many blocks to process this time */
+  int denormal_mode;           /**< Read-only: #fluid_denormal_mode of all rendering threads */
+  unsigned int voices_added;   /**< Used by mixer only: count of voices added so far, numbers them */
+
+  fluid_real_t cull_factor;    /**< Read-only: culling level relative to the output peak, 0 if culling is off */
+  fluid_real_t cull_level;     /**< Read-only: released voices below this amplitude are culled in this block */
+  fluid_real_t peak;           /**< Used by mixer only: decaying peak of the dry output */
+  fluid_real_t peak_decay;     /**< Used by mixer only: factor the peak decays by per block */
+  int culled_voices;           /**< Atomic: number of voices culled so far */
+
+  int rate_divider;            /**< Read-only: output samples per rendered sample */
+  fluid_upsampler_t** upsamplers; /**< Used by mixer only: left and right of each buffer, NULL if rate_divider is 1 */
+  fluid_real_t** out_left;     /**< Used by mixer only: upsampled output, NULL if rate_divider is 1 */
+  fluid_real_t** out_right;
+
+#ifdef WITH_FIXED_POINT
+  int fixed_point;             /**< Read-only: synthesize with the fixed point kernels */
+#endif
 
 #ifdef LADSPA
   fluid_LADSPA_FxUnit_t* LADSPA_FxUnit; /**< Used by mixer only: Effects unit for LADSPA support. Never created or freed */
@@ -100,44 +157,167 @@ struct _fluid_rvoice_mixer_t {
 #endif
 };
 
-static FLUID_INLINE void 
-fluid_rvoice_mixer_process_fx(fluid_rvoice_mixer_t* mixer)
+static FLUID_INLINE int
+fluid_mixer_buf_is_silent(fluid_real_t* buf, int count)
 {
   int i;
-  fluid_profile_ref_var(prof_ref);
-  if (mixer->fx.with_reverb) {
+  for (i=0; i < count; i++)
+    if (buf[i] > FX_SLEEP_THRESHOLD || buf[i] < -FX_SLEEP_THRESHOLD)
+      return FALSE;
+  return TRUE;
+}
+
+/**
+ * Runs one effects unit over the current blocks, unless it is asleep.
+ * A sleeping unit wakes up at once when its send carries signal again. While
+ * the send is silent the tail is rendered separately, so that its level can
+ * be tracked and the unit put to sleep when it has decayed.
+ * @param reset Clears the unit's delay lines when falling asleep, or NULL
+ * @param is_silent Checks that the unit's delay lines are silent before it
+ *   falls asleep, or NULL if a silent input for the hold time empties them
+ */
+static void
+fluid_rvoice_mixer_process_fx_unit(fluid_rvoice_mixer_t* mixer, int fx_channel,
+                                   void* unit, fluid_mixer_fx_sleep_t* sleep,
+                                   fluid_mixer_fx_process_t processmix,
+                                   fluid_mixer_fx_process_t processreplace,
+                                   void (*reset)(void*),
+                                   int (*is_silent)(void*, fluid_real_t))
+{
+  int i, count = mixer->current_blockcount * FLUID_BUFSIZE;
+  fluid_real_t* fx_left = mixer->buffers.fx_left_buf[fx_channel];
+  fluid_real_t* fx_right = mixer->buffers.fx_right_buf[fx_channel];
+  fluid_real_t* left = mixer->buffers.left_buf[0];
+  fluid_real_t* right = mixer->buffers.right_buf[0];
+  int silent = fluid_mixer_buf_is_silent(fx_left, count);
+
+  if (silent && sleep->sleeping) {
+    /* The send may still hold inaudible residue, don't pass it on as
+       effects output */
+    if (!mixer->fx.mix_fx_to_out)
+      FLUID_MEMSET(fx_left, 0, count * sizeof(fluid_real_t));
+    return;
+  }
+
+  /* Keep the delay lines out of the denormal range where the FPU can't
+     flush them to zero */
+  if (mixer->denormal_mode == FLUID_DENORMAL_OFFSET) {
+    for (i=0; i < count; i++)
+      fx_left[i] += FLUID_DENORMAL_OFFSET_VALUE;
+  }
+
+  if (!silent) {
+    sleep->silent_samples = 0;
+    if (sleep->sleeping) {
+      fluid_atomic_int_set(&sleep->sleeping, FALSE);
+      fluid_atomic_int_inc(&sleep->wakeups);
+    }
+
     if (mixer->fx.mix_fx_to_out) {
-      for (i=0; i < mixer->current_blockcount * FLUID_BUFSIZE; i += FLUID_BUFSIZE)
-        fluid_revmodel_processmix(mixer->fx.reverb, 
-                                  &mixer->buffers.fx_left_buf[SYNTH_REVERB_CHANNEL][i],
-				  &mixer->buffers.left_buf[0][i],
-				  &mixer->buffers.right_buf[0][i]);
-    } 
+      for (i=0; i < count; i += FLUID_BUFSIZE)
+        processmix(unit, &fx_left[i], &left[i], &right[i]);
+    }
     else {
-      for (i=0; i < mixer->current_blockcount * FLUID_BUFSIZE; i += FLUID_BUFSIZE)
-        fluid_revmodel_processreplace(mixer->fx.reverb, 
-                                  &mixer->buffers.fx_left_buf[SYNTH_REVERB_CHANNEL][i],
-				  &mixer->buffers.fx_left_buf[SYNTH_REVERB_CHANNEL][i],
-				  &mixer->buffers.fx_right_buf[SYNTH_REVERB_CHANNEL][i]);
+      for (i=0; i < count; i += FLUID_BUFSIZE)
+        processreplace(unit, &fx_left[i], &fx_left[i], &fx_right[i]);
     }
+    return;
+  }
+
+  /* Silent send: render the tail in place and measure it */
+  for (i=0; i < count; i += FLUID_BUFSIZE)
+    processreplace(unit, &fx_left[i], &fx_left[i], &fx_right[i]);
+
+  if (fluid_mixer_buf_is_silent(fx_left, count)
+      && fluid_mixer_buf_is_silent(fx_right, count))
+    sleep->silent_samples += count;
+  else sleep->silent_samples = 0;
+
+  if (mixer->fx.mix_fx_to_out) {
+    for (i=0; i < count; i++) {
+      left[i] += fx_left[i];
+      right[i] += fx_right[i];
+    }
+    FLUID_MEMSET(fx_left, 0, count * sizeof(fluid_real_t));
+    FLUID_MEMSET(fx_right, 0, count * sizeof(fluid_real_t));
+  }
+
+  if (sleep->silent_samples >= mixer->fx.sleep_hold_samples) {
+    /* Still ringing inside, check again after another hold time */
+    if (is_silent && !is_silent(unit, FX_SLEEP_THRESHOLD)) {
+      sleep->silent_samples = 0;
+      return;
+    }
+    if (reset)
+      reset(unit);
+    fluid_atomic_int_set(&sleep->sleeping, TRUE);
+  }
+}
+
+/* The effects units behind the methods of fluid_rvoice_mixer_process_fx_unit */
+static void
+fluid_mixer_reverb_processmix(void* unit, fluid_real_t *in,
+                              fluid_real_t *left_out, fluid_real_t *right_out)
+{
+  fluid_revmodel_processmix((fluid_revmodel_t*) unit, in, left_out, right_out);
+}
+
+static void
+fluid_mixer_reverb_processreplace(void* unit, fluid_real_t *in,
+                                  fluid_real_t *left_out, fluid_real_t *right_out)
+{
+  fluid_revmodel_processreplace((fluid_revmodel_t*) unit, in, left_out, right_out);
+}
+
+static void
+fluid_mixer_reverb_reset(void* unit)
+{
+  fluid_revmodel_reset((fluid_revmodel_t*) unit);
+}
+
+static int
+fluid_mixer_reverb_is_silent(void* unit, fluid_real_t threshold)
+{
+  return fluid_revmodel_is_silent((fluid_revmodel_t*) unit, threshold);
+}
+
+static void
+fluid_mixer_chorus_processmix(void* unit, fluid_real_t *in,
+                              fluid_real_t *left_out, fluid_real_t *right_out)
+{
+  fluid_chorus_processmix((fluid_chorus_t*) unit, in, left_out, right_out);
+}
+
+static void
+fluid_mixer_chorus_processreplace(void* unit, fluid_real_t *in,
+                                  fluid_real_t *left_out, fluid_real_t *right_out)
+{
+  fluid_chorus_processreplace((fluid_chorus_t*) unit, in, left_out, right_out);
+}
+
+static FLUID_INLINE void 
+fluid_rvoice_mixer_process_fx(fluid_rvoice_mixer_t* mixer)
+{
+  fluid_profile_ref_var(prof_ref);
+  if (mixer->fx.with_reverb) {
+    fluid_rvoice_mixer_process_fx_unit(mixer, SYNTH_REVERB_CHANNEL,
+                                       mixer->fx.reverb, &mixer->fx.reverb_sleep,
+                                       fluid_mixer_reverb_processmix,
+                                       fluid_mixer_reverb_processreplace,
+                                       fluid_mixer_reverb_reset,
+                                       fluid_mixer_reverb_is_silent);
     fluid_profile(FLUID_PROF_ONE_BLOCK_REVERB, prof_ref);
   }
   
+  /* The chorus has no feedback, its delay line is empty by the time it
+     falls asleep. fluid_chorus_reset() would also restore default
+     parameters, so it is not used here. */
   if (mixer->fx.with_chorus) {
-    if (mixer->fx.mix_fx_to_out) {
-      for (i=0; i < mixer->current_blockcount * FLUID_BUFSIZE; i += FLUID_BUFSIZE)
-        fluid_chorus_processmix(mixer->fx.chorus, 
-                                &mixer->buffers.fx_left_buf[SYNTH_CHORUS_CHANNEL][i],
-			        &mixer->buffers.left_buf[0][i],
-				&mixer->buffers.right_buf[0][i]);
-    } 
-    else {
-      for (i=0; i < mixer->current_blockcount * FLUID_BUFSIZE; i += FLUID_BUFSIZE)
-        fluid_chorus_processreplace(mixer->fx.chorus, 
-                                &mixer->buffers.fx_left_buf[SYNTH_CHORUS_CHANNEL][i],
-				&mixer->buffers.fx_left_buf[SYNTH_CHORUS_CHANNEL][i],
-				&mixer->buffers.fx_right_buf[SYNTH_CHORUS_CHANNEL][i]);
-    }
+    fluid_rvoice_mixer_process_fx_unit(mixer, SYNTH_CHORUS_CHANNEL,
+                                       mixer->fx.chorus, &mixer->fx.chorus_sleep,
+                                       fluid_mixer_chorus_processmix,
+                                       fluid_mixer_chorus_processreplace,
+                                       NULL, NULL);
     fluid_profile(FLUID_PROF_ONE_BLOCK_CHORUS, prof_ref);
   }
   
@@ -199,14 +379,22 @@ static int
 fluid_mix_one(fluid_rvoice_t* rvoice, fluid_real_t** bufs, unsigned int bufcount, int blockcount)
 {
   int i, result = 0;
+  int channels = (rvoice->dsp.linked_sample != NULL) ? 2 : 1;
+  fluid_real_t* linked_buf = NULL;
 
-  FLUID_DECLARE_VLA(fluid_real_t, local_buf, FLUID_BUFSIZE*blockcount);
+  /* Linked stereo voices render their second channel behind the first */
+  FLUID_DECLARE_VLA(fluid_real_t, local_buf, FLUID_BUFSIZE*blockcount*channels);
+  if (channels == 2)
+    linked_buf = &local_buf[FLUID_BUFSIZE*blockcount];
 
   for (i=0; i < blockcount; i++) {
-    int s = fluid_rvoice_write(rvoice, &local_buf[FLUID_BUFSIZE*i]);
+    int s = fluid_rvoice_write(rvoice, &local_buf[FLUID_BUFSIZE*i],
+                               linked_buf ? &linked_buf[FLUID_BUFSIZE*i] : NULL);
     if (s == -1) {
       s = FLUID_BUFSIZE; /* Voice is quiet, TODO: optimize away memset/mix */
       FLUID_MEMSET(&local_buf[FLUID_BUFSIZE*i], 0, FLUID_BUFSIZE*sizeof(fluid_real_t));
+      if (linked_buf)
+        FLUID_MEMSET(&linked_buf[FLUID_BUFSIZE*i], 0, FLUID_BUFSIZE*sizeof(fluid_real_t));
     } 
     result += s;
     if (s < FLUID_BUFSIZE) {
@@ -214,10 +402,42 @@ fluid_mix_one(fluid_rvoice_t* rvoice, fluid_real_t** bufs, unsigned int bufcount
     }
   }
   fluid_rvoice_buffers_mix(&rvoice->buffers, local_buf, result, bufs, bufcount);
+  if (linked_buf)
+    fluid_rvoice_buffers_mix(&rvoice->linked_buffers, linked_buf, result, bufs, bufcount);
 
   return result;
 }
 
+#ifdef WITH_FIXED_POINT
+/**
+ * Synthesize one voice with the fixed point kernels and add to the
+ * accumulators, like fluid_mix_one.
+ * @return Number of samples written
+ */
+static int
+fluid_mix_one_fixed(fluid_rvoice_t* rvoice, fluid_fixed_acc_t** bufs, unsigned int bufcount, int blockcount)
+{
+  int i, result = 0;
+
+  FLUID_DECLARE_VLA(fluid_fixed_t, local_buf, FLUID_BUFSIZE*blockcount);
+
+  for (i=0; i < blockcount; i++) {
+    int s = fluid_rvoice_write_fixed(rvoice, &local_buf[FLUID_BUFSIZE*i]);
+    if (s == -1) {
+      s = FLUID_BUFSIZE; /* Voice is quiet */
+      FLUID_MEMSET(&local_buf[FLUID_BUFSIZE*i], 0, FLUID_BUFSIZE*sizeof(fluid_fixed_t));
+    }
+    result += s;
+    if (s < FLUID_BUFSIZE) {
+      break;
+    }
+  }
+  fluid_rvoice_buffers_mix_fixed(&rvoice->buffers, local_buf, result, bufs, bufcount);
+
+  return result;
+}
+#endif
+
 /**
  * Glue to get fluid_rvoice_buffers_mix what it wants
  * Note: Make sure outbufs has 2 * (buf_count + fx_buf_count) elements before calling
@@ -254,13 +474,53 @@ fluid_mixer_buffers_prepare(fluid_mixer_buffers_t* buffers, fluid_real_t** outbu
     outbufs[i*2] = buffers->left_buf[i];
     outbufs[i*2+1] = buffers->right_buf[i];
   }
+
+#ifdef WITH_FIXED_POINT
+  for (i = 0; i < buffers->fixed_buf_count; i++)
+    buffers->fixed_out[i] = (outbufs[i] != NULL) ? buffers->fixed_buf[i] : NULL;
+#endif
   return buffers->buf_count*2 + 2;
 }
 
+#ifdef WITH_FIXED_POINT
+/**
+ * Add the accumulators of the fixed point voices to the prepared buffers
+ * and clear them, once all voices of a block are mixed.
+ */
+static void
+fluid_mixer_buffers_flush_fixed(fluid_mixer_buffers_t* buffers, fluid_real_t** outbufs)
+{
+  const fluid_real_t scale = fluid_fixed_to_real(1, FLUID_FIXED_BLOCK_BITS + FLUID_FIXED_MIX_BITS);
+  int scount = buffers->mixer->current_blockcount * FLUID_BUFSIZE;
+  fluid_fixed_acc_t* acc;
+  fluid_real_t* buf;
+  int i, j;
+
+  if (buffers->fixed_voices == 0)
+    return;
+
+  for (i = 0; i < buffers->fixed_buf_count; i++) {
+    acc = buffers->fixed_out[i];
+    buf = outbufs[i];
+    if (acc == NULL)
+      continue;
+    for (j = 0; j < scount; j++) {
+      buf[j] += scale * (fluid_real_t) acc[j];
+      acc[j] = 0;
+    }
+  }
+  buffers->fixed_voices = 0;
+}
+#endif
+
 
 static FLUID_INLINE void
 fluid_finish_rvoice(fluid_mixer_buffers_t* buffers, fluid_rvoice_t* rvoice)
 {
+  if (rvoice->stream != NULL)
+    fluid_rvoice_stream_detach(rvoice->stream);
+  if (rvoice->memo.cache != NULL)
+    fluid_rvoice_memo_finish(rvoice);
   if (buffers->finished_voice_count < buffers->mixer->polyphony)
     buffers->finished_voices[buffers->finished_voice_count++] = rvoice;
   else
@@ -304,7 +564,20 @@ fluid_mixer_buffers_render_one(fluid_mixer_buffers_t* buffers,
 			       fluid_rvoice_t* voice, fluid_real_t** bufs, 
 			       unsigned int bufcount)
 {
-  int s = fluid_mix_one(voice, bufs, bufcount, buffers->mixer->current_blockcount);
+  int s;
+
+  if (buffers->mixer->cull_level > 0 && fluid_rvoice_cull(voice, buffers->mixer->cull_level))
+    fluid_atomic_int_inc(&buffers->mixer->culled_voices);
+
+#ifdef WITH_FIXED_POINT
+  if (buffers->mixer->fixed_point && fluid_rvoice_can_write_fixed(voice)) {
+    s = fluid_mix_one_fixed(voice, buffers->fixed_out, bufcount,
+                            buffers->mixer->current_blockcount);
+    buffers->fixed_voices++;
+  }
+  else
+#endif
+  s = fluid_mix_one(voice, bufs, bufcount, buffers->mixer->current_blockcount);
   if (s < buffers->mixer->current_blockcount * FLUID_BUFSIZE) {
     fluid_finish_rvoice(buffers, voice);
   }
@@ -332,6 +605,10 @@ fluid_rvoice_mixer_add_voice(fluid_rvoice_mixer_t* mixer, fluid_rvoice_t* voice)
 {
   int i;
 
+  fluid_iir_filter_set_denormal_offset(&voice->resonant_filter,
+                                       mixer->denormal_mode == FLUID_DENORMAL_OFFSET);
+  voice->mix_order = mixer->voices_added++;
+
   if (mixer->active_voices < mixer->polyphony) {
     mixer->rvoices[mixer->active_voices++] = voice;
     return FLUID_OK;
@@ -406,6 +683,71 @@ fluid_rvoice_mixer_set_polyphony(fluid_rvoice_mixer_t* handler, int value)
 }
 
 
+/* The sample a voice plays, for sorting. The samples of the library's
+ * loaders are told apart by their serial number. Other samples have none,
+ * they are told apart by their data and start. */
+typedef struct
+{
+  unsigned int serial;
+  const short* data;
+  unsigned int start;
+} fluid_rvoice_sort_key_t;
+
+static FLUID_INLINE void
+fluid_rvoice_mixer_sort_key(fluid_rvoice_t* voice, fluid_rvoice_sort_key_t* key)
+{
+  fluid_sample_t* sample = voice->dsp.sample;
+
+  key->serial = (sample != NULL) ? fluid_sample_get_serial(sample) : 0;
+  key->data = (sample != NULL && key->serial == 0) ? sample->data : NULL;
+  key->start = (sample != NULL && key->serial == 0) ? sample->start : 0;
+}
+
+/* Sort key of a voice: its sample, then the order the mixer got it in */
+static FLUID_INLINE int
+fluid_rvoice_mixer_voice_before(fluid_rvoice_t* a, const fluid_rvoice_sort_key_t* a_key,
+                                fluid_rvoice_t* b, const fluid_rvoice_sort_key_t* b_key)
+{
+  if (a_key->serial != b_key->serial)
+    return a_key->serial < b_key->serial;
+  if (a_key->data != b_key->data)
+    return a_key->data < b_key->data;
+  if (a_key->start != b_key->start)
+    return a_key->start < b_key->start;
+  return (int) (a->mix_order - b->mix_order) < 0;
+}
+
+/**
+ * Order the active voices by the sample they play, so that voices playing
+ * the same sample are rendered one after another while its data is still
+ * in cache. The samples of a font are numbered in the order they were
+ * loaded, so voices of nearby samples follow each other as well. As the
+ * key doesn't depend on where the samples of the library's loaders are
+ * allocated, the voices are mixed in the same order and the output is the
+ * same on every run. The order changes little between blocks, so an
+ * insertion sort is cheap.
+ */
+static void
+fluid_rvoice_mixer_sort_voices(fluid_rvoice_mixer_t* mixer)
+{
+  int i, j;
+  fluid_rvoice_sort_key_t key;
+  fluid_rvoice_t* voice;
+  FLUID_DECLARE_VLA(fluid_rvoice_sort_key_t, keys, mixer->active_voices);
+
+  for (i=0; i < mixer->active_voices; i++) {
+    voice = mixer->rvoices[i];
+    fluid_rvoice_mixer_sort_key(voice, &key);
+    for (j=i; j > 0 && fluid_rvoice_mixer_voice_before(voice, &key,
+                                                       mixer->rvoices[j-1], &keys[j-1]); j--) {
+      keys[j] = keys[j-1];
+      mixer->rvoices[j] = mixer->rvoices[j-1];
+    }
+    keys[j] = key;
+    mixer->rvoices[j] = voice;
+  }
+}
+
 static void 
 fluid_render_loop_singlethread(fluid_rvoice_mixer_t* mixer)
 {
@@ -415,10 +757,15 @@ fluid_render_loop_singlethread(fluid_rvoice_mixer_t* mixer)
   int bufcount = fluid_mixer_buffers_prepare(&mixer->buffers, bufs);
   fluid_profile_ref_var(prof_ref);
   for (i=0; i < mixer->active_voices; i++) {
+    if (i+1 < mixer->active_voices)
+      fluid_rvoice_prefetch(mixer->rvoices[i+1]);
     fluid_mixer_buffers_render_one(&mixer->buffers, mixer->rvoices[i], bufs, 
 				   bufcount);
     fluid_profile(FLUID_PROF_ONE_BLOCK_VOICE, prof_ref);
   }
+#ifdef WITH_FIXED_POINT
+  fluid_mixer_buffers_flush_fixed(&mixer->buffers, bufs);
+#endif
 }
 
 
@@ -499,6 +846,30 @@ fluid_mixer_buffers_init(fluid_mixer_buffers_t* buffers, fluid_rvoice_mixer_t* m
     }
   }
   
+#ifdef WITH_FIXED_POINT
+  /* One accumulator for each buffer fluid_mixer_buffers_prepare hands out */
+  buffers->fixed_buf_count = buffers->buf_count * 2 + 2;
+  buffers->fixed_voices = 0;
+  buffers->fixed_buf = FLUID_ARRAY(fluid_fixed_acc_t*, buffers->fixed_buf_count);
+  buffers->fixed_out = FLUID_ARRAY(fluid_fixed_acc_t*, buffers->fixed_buf_count);
+  if ((buffers->fixed_buf == NULL) || (buffers->fixed_out == NULL)) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return 0;
+  }
+
+  FLUID_MEMSET(buffers->fixed_buf, 0, buffers->fixed_buf_count * sizeof(fluid_fixed_acc_t*));
+  FLUID_MEMSET(buffers->fixed_out, 0, buffers->fixed_buf_count * sizeof(fluid_fixed_acc_t*));
+
+  for (i = 0; i < buffers->fixed_buf_count; i++) {
+    buffers->fixed_buf[i] = FLUID_ARRAY(fluid_fixed_acc_t, samplecount);
+    if (buffers->fixed_buf[i] == NULL) {
+      FLUID_LOG(FLUID_ERR, "Out of memory");
+      return 0;
+    }
+    FLUID_MEMSET(buffers->fixed_buf[i], 0, samplecount * sizeof(fluid_fixed_acc_t));
+  }
+#endif
+
   buffers->finished_voices = NULL;
   if (fluid_mixer_buffers_update_polyphony(buffers, mixer->polyphony) 
       == FLUID_FAILED) {
@@ -509,6 +880,12 @@ fluid_mixer_buffers_init(fluid_mixer_buffers_t* buffers, fluid_rvoice_mixer_t* m
   return 1;
 }
 
+static fluid_real_t
+fluid_mixer_peak_decay(fluid_real_t samplerate)
+{
+  return (fluid_real_t) pow(10.0, -CULL_PEAK_DECAY_DB / 20.0 * FLUID_BUFSIZE / samplerate);
+}
+
 /**
  * Note: Not hard real-time capable (calls malloc)
  */
@@ -521,6 +898,8 @@ fluid_rvoice_mixer_set_samplerate(fluid_rvoice_mixer_t* mixer, fluid_real_t samp
   mixer->fx.chorus = new_fluid_chorus(samplerate);
   if (mixer->fx.reverb)
 	  fluid_revmodel_samplerate_change(mixer->fx.reverb, samplerate);
+  mixer->fx.sleep_hold_samples = (int) (FX_SLEEP_HOLD_TIME * samplerate);
+  mixer->peak_decay = fluid_mixer_peak_decay(samplerate);
   for (i=0; i < mixer->active_voices; i++)
     fluid_rvoice_set_output_rate(mixer->rvoices[i], samplerate);
 }
@@ -542,10 +921,13 @@ new_fluid_rvoice_mixer(int buf_count, int fx_buf_count, fluid_real_t sample_rate
   mixer->buffers.buf_count = buf_count;
   mixer->buffers.fx_buf_count = fx_buf_count;
   mixer->buffers.buf_blocks = FLUID_MIXER_MAX_BUFFERS_DEFAULT;
+  mixer->rate_divider = 1;
   
   /* allocate the reverb module */
   mixer->fx.reverb = new_fluid_revmodel(sample_rate);
   mixer->fx.chorus = new_fluid_chorus(sample_rate);
+  mixer->fx.sleep_hold_samples = (int) (FX_SLEEP_HOLD_TIME * sample_rate);
+  mixer->peak_decay = fluid_mixer_peak_decay(sample_rate);
   if (mixer->fx.reverb == NULL) {
     FLUID_LOG(FLUID_ERR, "Out of memory");
     delete_fluid_rvoice_mixer(mixer);
@@ -615,6 +997,18 @@ fluid_mixer_buffers_free(fluid_mixer_buffers_t* buffers)
     }
     FLUID_FREE(buffers->fx_right_buf);
   }  
+
+#ifdef WITH_FIXED_POINT
+  if (buffers->fixed_buf != NULL) {
+    for (i = 0; i < buffers->fixed_buf_count; i++) {
+      if (buffers->fixed_buf[i] != NULL) {
+	FLUID_FREE(buffers->fixed_buf[i]);
+      }
+    }
+    FLUID_FREE(buffers->fixed_buf);
+  }
+  FLUID_FREE(buffers->fixed_out);
+#endif
 }
 
 void delete_fluid_rvoice_mixer(fluid_rvoice_mixer_t* mixer)
@@ -632,6 +1026,7 @@ void delete_fluid_rvoice_mixer(fluid_rvoice_mixer_t* mixer)
   if (mixer->wakeup_threads_m)
     delete_fluid_cond_mutex(mixer->wakeup_threads_m);
 #endif
+  fluid_rvoice_mixer_set_rate_divider(mixer, 1);
   fluid_mixer_buffers_free(&mixer->buffers);
   if (mixer->fx.reverb)
     delete_fluid_revmodel(mixer->fx.reverb);
@@ -694,24 +1089,194 @@ void fluid_rvoice_mixer_reset_chorus(fluid_rvoice_mixer_t* mixer)
   fluid_chorus_reset(mixer->fx.chorus);
 }
 
+/**
+ * Set how denormals are avoided in the rendering threads.
+ * Must be called before the mixer threads are started.
+ * @param mode One of #fluid_denormal_mode
+ */
+void fluid_rvoice_mixer_set_denormal_mode(fluid_rvoice_mixer_t* mixer, int mode)
+{
+  mixer->denormal_mode = mode;
+}
+
+/**
+ * Set the level below the output peak, at which released voices are culled.
+ * Call before any mixer thread is started.
+ * @param threshold Level in dB below the (slowly decaying) peak of the dry
+ * output, 0 to turn culling off
+ */
+void fluid_rvoice_mixer_set_cull_threshold(fluid_rvoice_mixer_t* mixer, 
+                                           fluid_real_t threshold)
+{
+  mixer->cull_factor = (threshold > 0) ? (fluid_real_t) pow(10.0, -threshold / 20.0) : 0;
+}
+
+/**
+ * Get the number of voices culled so far. Safe to call from any thread.
+ */
+int fluid_rvoice_mixer_get_culled_voices(fluid_rvoice_mixer_t* mixer)
+{
+  return fluid_atomic_int_get(&mixer->culled_voices);
+}
+
+/**
+ * Get the sleep state of the reverb unit. Safe to call from any thread.
+ * @param wakeups Location to store the number of wakeups to (may be NULL)
+ * @return TRUE if the reverb is currently bypassed, FALSE otherwise
+ */
+int fluid_rvoice_mixer_get_reverb_sleeping(fluid_rvoice_mixer_t* mixer, int* wakeups)
+{
+  if (wakeups)
+    *wakeups = fluid_atomic_int_get(&mixer->fx.reverb_sleep.wakeups);
+  return fluid_atomic_int_get(&mixer->fx.reverb_sleep.sleeping);
+}
+
+/**
+ * Get the sleep state of the chorus unit. Safe to call from any thread.
+ * @param wakeups Location to store the number of wakeups to (may be NULL)
+ * @return TRUE if the chorus is currently bypassed, FALSE otherwise
+ */
+int fluid_rvoice_mixer_get_chorus_sleeping(fluid_rvoice_mixer_t* mixer, int* wakeups)
+{
+  if (wakeups)
+    *wakeups = fluid_atomic_int_get(&mixer->fx.chorus_sleep.wakeups);
+  return fluid_atomic_int_get(&mixer->fx.chorus_sleep.sleeping);
+}
+
+/**
+ * Get the output buffers. With a rate divider above 1, each rendered
+ * block fills rate_divider blocks of them.
+ */
 int fluid_rvoice_mixer_get_bufs(fluid_rvoice_mixer_t* mixer, 
 				  fluid_real_t*** left, fluid_real_t*** right)
 {
+  if (mixer->rate_divider > 1) {
+    *left = mixer->out_left;
+    *right = mixer->out_right;
+    return mixer->buffers.buf_count;
+  }
   *left = mixer->buffers.left_buf;
   *right = mixer->buffers.right_buf;
   return mixer->buffers.buf_count;
 }
 
+/**
+ * Render at a fraction of the output rate: the rendered blocks are
+ * upsampled by the divider into the output buffers. The sample rate
+ * given to the mixer is the rendering rate.
+ * Note: Not hard real-time capable (calls malloc)
+ * @param divider Output samples per rendered sample, 1 to render at the
+ *   output rate
+ * @return FLUID_OK on success, FLUID_FAILED if out of memory (the divider
+ *   is 1 then)
+ */
+int
+fluid_rvoice_mixer_set_rate_divider(fluid_rvoice_mixer_t* mixer, int divider)
+{
+  int i, count = mixer->buffers.buf_count;
+  int samplecount = mixer->buffers.buf_blocks * FLUID_BUFSIZE;
+
+  if (mixer->upsamplers != NULL) {
+    for (i = 0; i < 2 * count; i++)
+      delete_fluid_upsampler(mixer->upsamplers[i]);
+    FLUID_FREE(mixer->upsamplers);
+    mixer->upsamplers = NULL;
+  }
+  if (mixer->out_left != NULL) {
+    for (i = 0; i < count; i++)
+      FLUID_FREE(mixer->out_left[i]);
+    FLUID_FREE(mixer->out_left);
+    mixer->out_left = NULL;
+  }
+  if (mixer->out_right != NULL) {
+    for (i = 0; i < count; i++)
+      FLUID_FREE(mixer->out_right[i]);
+    FLUID_FREE(mixer->out_right);
+    mixer->out_right = NULL;
+  }
+  mixer->rate_divider = 1;
+
+  if (divider <= 1)
+    return FLUID_OK;
+
+  mixer->upsamplers = FLUID_ARRAY(fluid_upsampler_t*, 2 * count);
+  mixer->out_left = FLUID_ARRAY(fluid_real_t*, count);
+  mixer->out_right = FLUID_ARRAY(fluid_real_t*, count);
+  if (mixer->upsamplers == NULL || mixer->out_left == NULL || mixer->out_right == NULL)
+    goto error_recovery;
+  FLUID_MEMSET(mixer->upsamplers, 0, 2 * count * sizeof(fluid_upsampler_t*));
+  FLUID_MEMSET(mixer->out_left, 0, count * sizeof(fluid_real_t*));
+  FLUID_MEMSET(mixer->out_right, 0, count * sizeof(fluid_real_t*));
+
+  for (i = 0; i < count; i++) {
+    mixer->out_left[i] = FLUID_ARRAY(fluid_real_t, samplecount);
+    mixer->out_right[i] = FLUID_ARRAY(fluid_real_t, samplecount);
+    mixer->upsamplers[2 * i] = new_fluid_upsampler(divider, samplecount / divider);
+    mixer->upsamplers[2 * i + 1] = new_fluid_upsampler(divider, samplecount / divider);
+    if (mixer->out_left[i] == NULL || mixer->out_right[i] == NULL
+        || mixer->upsamplers[2 * i] == NULL || mixer->upsamplers[2 * i + 1] == NULL)
+      goto error_recovery;
+  }
+  mixer->rate_divider = divider;
+  return FLUID_OK;
+
+error_recovery:
+  FLUID_LOG(FLUID_ERR, "Out of memory");
+  fluid_rvoice_mixer_set_rate_divider(mixer, 1);
+  return FLUID_FAILED;
+}
+
+#ifdef WITH_FIXED_POINT
+/**
+ * Synthesize the voices and the reverb with the fixed point kernels (see
+ * synth.fixed-point). Voices which can't be synthesized by them (see
+ * fluid_rvoice_can_write_fixed) and the chorus stay in floating point.
+ * The reverb is cleared.
+ */
+void
+fluid_rvoice_mixer_set_fixed_point(fluid_rvoice_mixer_t* mixer, int fixed_point)
+{
+  mixer->fixed_point = fixed_point;
+  if (mixer->fx.reverb)
+    fluid_revmodel_set_fixed_point(mixer->fx.reverb, fixed_point);
+}
+#endif
+
+/*
+ * Upsample the rendered blocks into the output buffers.
+ */
+static void
+fluid_rvoice_mixer_upsample(fluid_rvoice_mixer_t* mixer)
+{
+  int i, count = mixer->current_blockcount * FLUID_BUFSIZE;
+
+  for (i = 0; i < mixer->buffers.buf_count; i++) {
+    fluid_upsampler_process(mixer->upsamplers[2 * i], mixer->buffers.left_buf[i],
+                            count, mixer->out_left[i]);
+    fluid_upsampler_process(mixer->upsamplers[2 * i + 1], mixer->buffers.right_buf[i],
+                            count, mixer->out_right[i]);
+  }
+}
+
 
 #ifdef ENABLE_MIXER_THREADS
 
-static FLUID_INLINE fluid_rvoice_t* 
-fluid_mixer_get_mt_rvoice(fluid_rvoice_mixer_t* mixer)
+/**
+ * Claim the next run of up to VOICES_PER_CHUNK voices for rendering.
+ * @param first index of the first claimed voice
+ * @return number of voices claimed, 0 if all voices are taken
+ */
+static FLUID_INLINE int
+fluid_mixer_get_mt_rvoices(fluid_rvoice_mixer_t* mixer, int* first)
 {
-  int i = fluid_atomic_int_exchange_and_add(&mixer->current_rvoice, 1);
+  int i = fluid_atomic_int_exchange_and_add(&mixer->current_rvoice, 
+                                            VOICES_PER_CHUNK);
   if (i >= mixer->active_voices) 
-    return NULL;
-  return mixer->rvoices[i];
+    return 0;
+  *first = i;
+  if (i + VOICES_PER_CHUNK > mixer->active_voices)
+    return mixer->active_voices - i;
+  return VOICES_PER_CHUNK;
 }
 
 #define THREAD_BUF_PROCESSING 0
@@ -728,10 +1293,18 @@ fluid_mixer_thread_func (void* data)
   int hasValidData = 0;
   FLUID_DECLARE_VLA(fluid_real_t*, bufs, buffers->buf_count*2 + buffers->fx_buf_count*2);
   int bufcount = 0;
+  int i, first, count;
+
+  /* Own thread, the previous state doesn't need to be restored */
+  fluid_denormal_enter(mixer->denormal_mode);
   
   while (!fluid_atomic_int_get(&mixer->threads_should_terminate)) {
-    fluid_rvoice_t* rvoice = fluid_mixer_get_mt_rvoice(mixer);
-    if (rvoice == NULL) {
+    count = fluid_mixer_get_mt_rvoices(mixer, &first);
+    if (count == 0) {
+#ifdef WITH_FIXED_POINT
+      if (hasValidData)
+        fluid_mixer_buffers_flush_fixed(buffers, bufs);
+#endif
       // if no voices: signal rendered buffers, sleep
       fluid_atomic_int_set(&buffers->ready, hasValidData ? THREAD_BUF_VALID : THREAD_BUF_NODATA);
       fluid_cond_mutex_lock(mixer->thread_ready_m);
@@ -756,8 +1329,12 @@ fluid_mixer_thread_func (void* data)
 	bufcount = fluid_mixer_buffers_prepare(buffers, bufs);
 	hasValidData = 1;
       }
-      // then render voice to buffers
-      fluid_mixer_buffers_render_one(buffers, rvoice, bufs, bufcount);
+      // then render voices to buffers
+      for (i=first; i < first + count; i++) {
+        if (i+1 < first + count)
+          fluid_rvoice_prefetch(mixer->rvoices[i+1]);
+        fluid_mixer_buffers_render_one(buffers, mixer->rvoices[i], bufs, bufcount);
+      }
     }
   }
 
@@ -822,7 +1399,7 @@ fluid_mixer_mix_in(fluid_rvoice_mixer_t* mixer, int extra_threads)
 static void 
 fluid_render_loop_multithread(fluid_rvoice_mixer_t* mixer)
 {
-  int i, bufcount;
+  int i, bufcount, first, count;
   //int scount = mixer->current_blockcount * FLUID_BUFSIZE;
   FLUID_DECLARE_VLA(fluid_real_t*, bufs, 
 		    mixer->buffers.buf_count * 2 + mixer->buffers.fx_buf_count * 2);
@@ -849,12 +1426,17 @@ fluid_render_loop_multithread(fluid_rvoice_mixer_t* mixer)
   
   // If thread is finished, mix it in
   while (fluid_mixer_mix_in(mixer, extra_threads)) {
-    // Otherwise get a voice and render it
-    fluid_rvoice_t* rvoice = fluid_mixer_get_mt_rvoice(mixer);
-    if (rvoice != NULL) {
+    // Otherwise get some voices and render them
+    count = fluid_mixer_get_mt_rvoices(mixer, &first);
+    if (count > 0) {
       fluid_profile_ref_var(prof_ref);
-      fluid_mixer_buffers_render_one(&mixer->buffers, rvoice, bufs, bufcount);
-      fluid_profile(FLUID_PROF_ONE_BLOCK_VOICE, prof_ref);
+      for (i=first; i < first + count; i++) {
+        if (i+1 < first + count)
+          fluid_rvoice_prefetch(mixer->rvoices[i+1]);
+        fluid_mixer_buffers_render_one(&mixer->buffers, mixer->rvoices[i], 
+                                       bufs, bufcount);
+        fluid_profile(FLUID_PROF_ONE_BLOCK_VOICE, prof_ref);
+      }
       //test++;
     }
     else {
@@ -871,12 +1453,44 @@ fluid_render_loop_multithread(fluid_rvoice_mixer_t* mixer)
       fluid_cond_mutex_unlock(mixer->thread_ready_m);
     }
   }
+#ifdef WITH_FIXED_POINT
+  fluid_mixer_buffers_flush_fixed(&mixer->buffers, bufs);
+#endif
   //FLUID_LOG(FLUID_DBG, "Blockcount: %d, mixed %d of %d voices myself, waits = %d", 
   //	    mixer->current_blockcount, test, mixer->active_voices, waits);
 }
 
 #endif
 
+/**
+ * Follow the peak of the dry output, for culling voices masked by it. The
+ * peak decays by CULL_PEAK_DECAY_DB per second.
+ */
+static void
+fluid_mixer_update_peak(fluid_rvoice_mixer_t* mixer)
+{
+  int scount = mixer->current_blockcount * FLUID_BUFSIZE;
+  fluid_real_t peak = mixer->peak;
+  fluid_real_t* left, *right;
+  int i, j;
+
+  for (i=0; i < mixer->current_blockcount; i++)
+    peak *= mixer->peak_decay;
+  /* After a long silence the peak would decay into the denormal range */
+  if (peak < FLUID_DENORMAL_OFFSET_VALUE)
+    peak = 0;
+
+  for (i=0; i < mixer->buffers.buf_count; i++) {
+    left = mixer->buffers.left_buf[i];
+    right = mixer->buffers.right_buf[i];
+    for (j=0; j < scount; j++) {
+      if (fabs(left[j]) > peak) peak = fabs(left[j]);
+      if (fabs(right[j]) > peak) peak = fabs(right[j]);
+    }
+  }
+  mixer->peak = peak;
+}
+
 /**
  * Update amount of extra mixer threads. 
  * @param thread_count Number of extra mixer threads for multi-core rendering
@@ -946,14 +1560,24 @@ fluid_rvoice_mixer_set_threads(fluid_rvoice_mixer_t* mixer, int thread_count,
 int 
 fluid_rvoice_mixer_render(fluid_rvoice_mixer_t* mixer, int blockcount)
 {
+  unsigned int fpu_state;
   fluid_profile_ref_var(prof_ref);
+
+  fpu_state = fluid_denormal_enter(mixer->denormal_mode);
   
-  mixer->current_blockcount = blockcount > mixer->buffers.buf_blocks ? 
-      mixer->buffers.buf_blocks : blockcount;
+  mixer->current_blockcount = blockcount > mixer->buffers.buf_blocks / mixer->rate_divider ?
+      mixer->buffers.buf_blocks / mixer->rate_divider : blockcount;
 
   // Zero buffers
   fluid_mixer_buffers_zero(&mixer->buffers);
   fluid_profile(FLUID_PROF_ONE_BLOCK_CLEAR, prof_ref);
+
+  // Voices culled in this block, against the peak of the previous ones
+  mixer->cull_level = mixer->peak * mixer->cull_factor;
+
+  // Group voices by sample data before handing them out
+  if (mixer->active_voices > 1)
+    fluid_rvoice_mixer_sort_voices(mixer);
   
 #ifdef ENABLE_MIXER_THREADS
   if (mixer->thread_count > 0)
@@ -962,13 +1586,20 @@ fluid_rvoice_mixer_render(fluid_rvoice_mixer_t* mixer, int blockcount)
 #endif
     fluid_render_loop_singlethread(mixer);
   fluid_profile(FLUID_PROF_ONE_BLOCK_VOICES, prof_ref);
+
+  if (mixer->cull_factor > 0)
+    fluid_mixer_update_peak(mixer);
     
 
   // Process reverb & chorus
   fluid_rvoice_mixer_process_fx(mixer);
 
+  if (mixer->rate_divider > 1)
+    fluid_rvoice_mixer_upsample(mixer);
+
   // Call the callback and pack active voice array
   fluid_rvoice_mixer_process_finished_voices(mixer);
 
+  fluid_denormal_leave(mixer->denormal_mode, fpu_state);
   return mixer->current_blockcount;
 }
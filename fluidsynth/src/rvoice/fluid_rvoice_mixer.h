@@ -61,6 +61,16 @@ void fluid_rvoice_mixer_set_reverb_params(fluid_rvoice_mixer_t* mixer, int set,
 void fluid_rvoice_mixer_reset_fx(fluid_rvoice_mixer_t* mixer);
 void fluid_rvoice_mixer_reset_reverb(fluid_rvoice_mixer_t* mixer);
 void fluid_rvoice_mixer_reset_chorus(fluid_rvoice_mixer_t* mixer);
+void fluid_rvoice_mixer_set_denormal_mode(fluid_rvoice_mixer_t* mixer, int mode);
+void fluid_rvoice_mixer_set_cull_threshold(fluid_rvoice_mixer_t* mixer, 
+                                           fluid_real_t threshold);
+int fluid_rvoice_mixer_get_culled_voices(fluid_rvoice_mixer_t* mixer);
+int fluid_rvoice_mixer_set_rate_divider(fluid_rvoice_mixer_t* mixer, int divider);
+#ifdef WITH_FIXED_POINT
+void fluid_rvoice_mixer_set_fixed_point(fluid_rvoice_mixer_t* mixer, int fixed_point);
+#endif
+int fluid_rvoice_mixer_get_reverb_sleeping(fluid_rvoice_mixer_t* mixer, int* wakeups);
+int fluid_rvoice_mixer_get_chorus_sleeping(fluid_rvoice_mixer_t* mixer, int* wakeups);
 
 void fluid_rvoice_mixer_set_threads(fluid_rvoice_mixer_t* mixer, int thread_count, 
 				    int prio_level);
@@ -0,0 +1,542 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+/*
+ * Disk streaming of sample data.
+ *
+ * A streamed sample only has its first points resident in memory (see
+ * fluid_sample_stream_t). Every rvoice owns a stream, a window of
+ * sample points which slides along with the playhead. When a voice
+ * starts, it plays the resident points, while the I/O thread fills the
+ * window with the points from the end of the resident ones on, always
+ * serving the stream whose playhead will reach the end of its data
+ * first. The rendering thread never waits for the disk: if the data
+ * needed for a block isn't there yet, the voice plays silence for that
+ * block and the underrun is counted.
+ *
+ * The window is a ring buffer with a single writer, the I/O thread, and
+ * a single reader, the rendering thread, so neither waits for the other.
+ * Every point is stored twice, at its slot and FLUID_STREAM_SIZE points
+ * after it, so any FLUID_STREAM_SIZE points starting anywhere in the
+ * ring can be indexed contiguously by the interpolation. The rendering
+ * thread publishes the lowest point it still needs, the I/O thread the
+ * highest point written. Attaching a voice starts a new generation of
+ * the stream, whose parameters the I/O thread copies seqlock style. The
+ * voice plays its resident points until the I/O thread caught up with
+ * the new generation.
+ *
+ * The I/O thread sleeps on a condition when no stream needs data. The
+ * rendering thread only takes the mutex to wake it, which happens at
+ * most once per sleep.
+ */
+
+#include "fluid_rvoice_stream.h"
+#include "fluid_sfont.h"
+#include "fluid_sys.h"
+
+/* Sample points per stream window */
+#define FLUID_STREAM_SIZE 16384
+/* Points read from the file at once */
+#define FLUID_STREAM_CHUNK 4096
+/* Points kept before the playhead, the 7th order interpolation looks
+   back 3 points */
+#define FLUID_STREAM_HISTORY 8
+/* Most points a block may span. The ring starts this many points before
+   the end of the resident points, so the voice can switch over. */
+#define FLUID_STREAM_SPAN_MAX (FLUID_STREAM_SIZE / 2)
+/* Longest file name a stream can refer to */
+#define FLUID_STREAM_PATH_MAX 1024
+/* Number of SoundFont files the I/O thread keeps open */
+#define FLUID_STREAM_FILES 4
+
+struct _fluid_rvoice_stream_t
+{
+  fluid_rvoice_stream_t* next;         /* next stream of the streamer */
+  fluid_rvoice_streamer_t* streamer;
+
+  /* Written by the rendering thread between two increments of the
+     generation, which is odd while they're written (atomic) */
+  int generation;
+  int active;                /* TRUE if points are read from the file */
+  char filename[FLUID_STREAM_PATH_MAX];
+  fluid_long_long_t offset;  /* byte offset of sample point 0 in the file */
+  int length;                /* count of points in the sample */
+  int base;                  /* first point held in the ring */
+
+  /* Used by the rendering thread only */
+  short* resident_data;      /* the resident points of the sample */
+  int resident;              /* count of resident points */
+
+  /* Written by the rendering thread (atomic) */
+  int read_pos;              /* lowest point still needed */
+  int position;              /* playhead, as of the last rendered block */
+  float rate;                /* points the playhead advances per output sample */
+
+  /* Written by the I/O thread (atomic) */
+  int ready;                 /* generation of the ring contents */
+  int write_pos;             /* points below are in the ring, from 'base' on */
+
+  short* buf;                /* the ring, 2 * FLUID_STREAM_SIZE points */
+};
+
+struct _fluid_rvoice_streamer_t
+{
+  fluid_rvoice_stream_t* streams;      /* Atomic: list head, streams are only prepended */
+  fluid_thread_t* thread;
+  int quit;                            /* Atomic: TRUE when the I/O thread should terminate */
+  int underruns;                       /* Atomic: count of blocks played as silence */
+  int sleeping;                        /* Atomic: TRUE while the I/O thread may wait on cond */
+  fluid_cond_mutex_t* mutex;
+  fluid_cond_t* cond;
+
+  /* Used by the I/O thread only */
+  short chunk[FLUID_STREAM_CHUNK];
+  struct {
+    char* filename;
+    FILE* file;
+  } files[FLUID_STREAM_FILES];
+  int next_file;
+};
+
+/* A snapshot of a stream taken by the I/O thread */
+typedef struct
+{
+  int generation;
+  int active;
+  fluid_long_long_t offset;
+  int length;
+  int base;
+} fluid_rvoice_stream_params_t;
+
+/*
+ * Copy the parameters of a stream, FALSE if they're being written.
+ * The file name is only copied if 'filename' isn't NULL. I/O thread only.
+ */
+static int
+fluid_rvoice_stream_get_params(fluid_rvoice_stream_t* stream,
+                               fluid_rvoice_stream_params_t* params, char* filename)
+{
+  params->generation = fluid_atomic_int_get(&stream->generation);
+  if (params->generation & 1)
+    return FALSE;
+  params->active = stream->active;
+  params->offset = stream->offset;
+  params->length = stream->length;
+  params->base = stream->base;
+  if (filename != NULL && params->active)
+    FLUID_MEMCPY(filename, stream->filename, FLUID_STREAM_PATH_MAX);
+  return fluid_atomic_int_get(&stream->generation) == params->generation;
+}
+
+/*
+ * Wake up the I/O thread if it sleeps
+ */
+static void
+fluid_rvoice_streamer_wake(fluid_rvoice_streamer_t* streamer)
+{
+  if (fluid_atomic_int_compare_and_exchange(&streamer->sleeping, TRUE, FALSE)) {
+    fluid_cond_mutex_lock(streamer->mutex);
+    fluid_cond_signal(streamer->cond);
+    fluid_cond_mutex_unlock(streamer->mutex);
+  }
+}
+
+/*
+ * Get an open file handle for a SoundFont file. I/O thread only.
+ */
+static FILE*
+fluid_rvoice_streamer_open(fluid_rvoice_streamer_t* streamer, const char* filename)
+{
+  int i;
+
+  for (i = 0; i < FLUID_STREAM_FILES; i++) {
+    if (streamer->files[i].filename != NULL
+        && FLUID_STRCMP(streamer->files[i].filename, filename) == 0)
+      return streamer->files[i].file;
+  }
+
+  /* Replace the files round robin */
+  i = streamer->next_file;
+  streamer->next_file = (i + 1) % FLUID_STREAM_FILES;
+  if (streamer->files[i].file != NULL) {
+    FLUID_FCLOSE(streamer->files[i].file);
+    streamer->files[i].file = NULL;
+  }
+  FLUID_FREE(streamer->files[i].filename);
+  streamer->files[i].filename = FLUID_STRDUP(filename);
+  if (streamer->files[i].filename == NULL)
+    return NULL;
+
+  streamer->files[i].file = FLUID_FOPEN(filename, "rb");
+  if (streamer->files[i].file == NULL)
+    FLUID_LOG(FLUID_ERR, "Can't open %s for streaming sample data", filename);
+  return streamer->files[i].file;
+}
+
+/*
+ * Find the stream closest to an underrun. A stream of a generation the
+ * ring doesn't hold yet is started over. I/O thread only.
+ */
+static fluid_rvoice_stream_t*
+fluid_rvoice_streamer_pick(fluid_rvoice_streamer_t* streamer)
+{
+  fluid_rvoice_stream_t *stream, *best = NULL;
+  fluid_rvoice_stream_params_t params;
+  float rate, time, best_time = 0.0f;
+  int pos, room, count;
+
+  for (stream = fluid_atomic_pointer_get(&streamer->streams); stream; stream = stream->next) {
+    if (!fluid_rvoice_stream_get_params(stream, &params, NULL) || !params.active)
+      continue;
+
+    if (fluid_atomic_int_get(&stream->ready) != params.generation) {
+      fluid_atomic_int_set(&stream->write_pos, params.base);
+      fluid_atomic_int_set(&stream->ready, params.generation);
+    }
+
+    pos = fluid_atomic_int_get(&stream->write_pos);
+    room = fluid_atomic_int_get(&stream->read_pos) + FLUID_STREAM_SIZE - pos;
+    count = params.length - pos;
+    if (count > room)
+      count = room;
+
+    /* Read full chunks only, unless it's the end of the sample */
+    if (count > 0 && (count >= FLUID_STREAM_CHUNK || pos + count == params.length)) {
+      /* Output samples until the playhead runs out of data */
+      rate = fluid_atomic_float_get(&stream->rate);
+      time = (pos - fluid_atomic_int_get(&stream->position)) / (rate > 0.0f ? rate : 1.0f);
+      if (best == NULL || time < best_time) {
+        best = stream;
+        best_time = time;
+      }
+    }
+  }
+  return best;
+}
+
+/*
+ * Read the next chunk of the stream closest to an underrun.
+ * Returns TRUE if a stream was served, FALSE if none needs data.
+ */
+static int
+fluid_rvoice_streamer_fill(fluid_rvoice_streamer_t* streamer)
+{
+  fluid_rvoice_stream_t* best;
+  fluid_rvoice_stream_params_t params;
+  char filename[FLUID_STREAM_PATH_MAX];
+  int pos, room, count, slot, part;
+  FILE* file;
+
+  best = fluid_rvoice_streamer_pick(streamer);
+  if (best == NULL)
+    return FALSE;
+
+  /* The voice was restarted or stopped in the meantime */
+  if (!fluid_rvoice_stream_get_params(best, &params, filename)
+      || !params.active || fluid_atomic_int_get(&best->ready) != params.generation)
+    return TRUE;
+
+  pos = fluid_atomic_int_get(&best->write_pos);
+  room = fluid_atomic_int_get(&best->read_pos) + FLUID_STREAM_SIZE - pos;
+  count = params.length - pos;
+  if (count > room)
+    count = room;
+  if (count > FLUID_STREAM_CHUNK)
+    count = FLUID_STREAM_CHUNK;
+  if (count <= 0)
+    return TRUE;
+
+  file = fluid_rvoice_streamer_open(streamer, filename);
+  if (file == NULL
+      || FLUID_FSEEK(file, params.offset + 2 * (fluid_long_long_t) pos, SEEK_SET) != 0
+      || FLUID_FREAD(streamer->chunk, 2, count, file) != (size_t) count) {
+    /* Give the voice silence instead of retrying forever */
+    FLUID_MEMSET(streamer->chunk, 0, count * sizeof(short));
+  }
+
+  if (FLUID_IS_BIG_ENDIAN) {
+    unsigned char* p = (unsigned char*) streamer->chunk;
+    int i;
+    for (i = 0; i < count; i++)
+      streamer->chunk[i] = (short) (p[2 * i] | (p[2 * i + 1] << 8));
+  }
+
+  /* Only the points the rendering thread has given up are overwritten.
+     If the voice was restarted meanwhile, it doesn't read the ring until
+     it's started over. */
+  slot = pos % FLUID_STREAM_SIZE;
+  part = FLUID_STREAM_SIZE - slot;
+  if (part > count)
+    part = count;
+  FLUID_MEMCPY(best->buf + slot, streamer->chunk, part * sizeof(short));
+  FLUID_MEMCPY(best->buf + slot + FLUID_STREAM_SIZE, streamer->chunk, part * sizeof(short));
+  if (count > part) {
+    FLUID_MEMCPY(best->buf, streamer->chunk + part, (count - part) * sizeof(short));
+    FLUID_MEMCPY(best->buf + FLUID_STREAM_SIZE, streamer->chunk + part,
+                 (count - part) * sizeof(short));
+  }
+  fluid_atomic_int_set(&best->write_pos, pos + count);
+
+  return TRUE;
+}
+
+static void
+fluid_rvoice_streamer_run(void* data)
+{
+  fluid_rvoice_streamer_t* streamer = data;
+
+  while (!fluid_atomic_int_get(&streamer->quit)) {
+    if (fluid_rvoice_streamer_fill(streamer))
+      continue;
+
+    /* Announce the sleep before looking a last time, a stream needing
+       data after that wakes the thread */
+    fluid_cond_mutex_lock(streamer->mutex);
+    fluid_atomic_int_set(&streamer->sleeping, TRUE);
+    if (fluid_rvoice_streamer_pick(streamer) == NULL) {
+      while (fluid_atomic_int_get(&streamer->sleeping))
+        fluid_cond_wait(streamer->cond, streamer->mutex);
+    }
+    else fluid_atomic_int_set(&streamer->sleeping, FALSE);
+    fluid_cond_mutex_unlock(streamer->mutex);
+  }
+}
+
+fluid_rvoice_streamer_t*
+new_fluid_rvoice_streamer(void)
+{
+  fluid_rvoice_streamer_t* streamer = FLUID_NEW(fluid_rvoice_streamer_t);
+  if (streamer == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return NULL;
+  }
+  FLUID_MEMSET(streamer, 0, sizeof(fluid_rvoice_streamer_t));
+
+  streamer->mutex = new_fluid_cond_mutex();
+  streamer->cond = new_fluid_cond();
+  if (streamer->mutex == NULL || streamer->cond == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    goto error_recovery;
+  }
+
+  streamer->thread = new_fluid_thread("stream", fluid_rvoice_streamer_run,
+                                      streamer, 0, FALSE);
+  if (streamer->thread == NULL)
+    goto error_recovery;
+  return streamer;
+
+error_recovery:
+  if (streamer->cond)
+    delete_fluid_cond(streamer->cond);
+  if (streamer->mutex)
+    delete_fluid_cond_mutex(streamer->mutex);
+  FLUID_FREE(streamer);
+  return NULL;
+}
+
+/*
+ * Stop the I/O thread and free all streams. The rvoices using the
+ * streams must not be rendered anymore.
+ */
+void
+delete_fluid_rvoice_streamer(fluid_rvoice_streamer_t* streamer)
+{
+  fluid_rvoice_stream_t* stream;
+  int i;
+
+  if (streamer == NULL)
+    return;
+
+  fluid_atomic_int_set(&streamer->quit, TRUE);
+  fluid_cond_mutex_lock(streamer->mutex);
+  fluid_atomic_int_set(&streamer->sleeping, FALSE);
+  fluid_cond_signal(streamer->cond);
+  fluid_cond_mutex_unlock(streamer->mutex);
+  fluid_thread_join(streamer->thread);
+  delete_fluid_thread(streamer->thread);
+  delete_fluid_cond(streamer->cond);
+  delete_fluid_cond_mutex(streamer->mutex);
+
+  while (streamer->streams != NULL) {
+    stream = streamer->streams;
+    streamer->streams = stream->next;
+    FLUID_FREE(stream->buf);
+    FLUID_FREE(stream);
+  }
+
+  for (i = 0; i < FLUID_STREAM_FILES; i++) {
+    if (streamer->files[i].file != NULL)
+      FLUID_FCLOSE(streamer->files[i].file);
+    FLUID_FREE(streamer->files[i].filename);
+  }
+  FLUID_FREE(streamer);
+}
+
+/*
+ * Create a stream for an rvoice. Must not be called concurrently,
+ * the I/O thread may already be serving the other streams though.
+ */
+fluid_rvoice_stream_t*
+fluid_rvoice_streamer_new_stream(fluid_rvoice_streamer_t* streamer)
+{
+  fluid_rvoice_stream_t* stream = FLUID_NEW(fluid_rvoice_stream_t);
+  if (stream == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return NULL;
+  }
+  FLUID_MEMSET(stream, 0, sizeof(fluid_rvoice_stream_t));
+
+  stream->buf = FLUID_ARRAY(short, 2 * FLUID_STREAM_SIZE);
+  if (stream->buf == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    FLUID_FREE(stream);
+    return NULL;
+  }
+  stream->streamer = streamer;
+  stream->next = streamer->streams;
+  fluid_atomic_pointer_set(&streamer->streams, stream);
+  return stream;
+}
+
+/*
+ * Get the number of rendered blocks in which a voice had to play
+ * silence, because the I/O thread didn't deliver its data in time.
+ */
+int
+fluid_rvoice_streamer_get_underruns(fluid_rvoice_streamer_t* streamer)
+{
+  return fluid_atomic_int_get(&streamer->underruns);
+}
+
+/*
+ * Start streaming a sample, beginning at sample point 'start'.
+ * If the sample isn't streamed only its resident points are played.
+ */
+void
+fluid_rvoice_stream_attach(fluid_rvoice_stream_t* stream, fluid_sample_t* sample, int start)
+{
+  fluid_sample_stream_t* info = fluid_sample_get_stream(sample);
+  int base;
+
+  stream->resident_data = sample->data;
+  stream->resident = info ? (int) info->resident : (int) sample->end + 1;
+
+  fluid_atomic_int_inc(&stream->generation);
+  stream->active = (info != NULL
+                    && FLUID_STRLEN(info->filename) < FLUID_STREAM_PATH_MAX);
+  if (stream->active) {
+    if (FLUID_STRCMP(stream->filename, info->filename) != 0)
+      FLUID_STRCPY(stream->filename, info->filename);
+    stream->offset = info->offset;
+    stream->length = sample->end + 1;
+
+    /* The resident points before the span of the last resident block
+       aren't needed in the ring */
+    base = start - FLUID_STREAM_HISTORY;
+    if (base < stream->resident - FLUID_STREAM_SPAN_MAX)
+      base = stream->resident - FLUID_STREAM_SPAN_MAX;
+    if (base < 0)
+      base = 0;
+    stream->base = base;
+    fluid_atomic_int_set(&stream->read_pos, base);
+    fluid_atomic_int_set(&stream->position, start);
+    fluid_atomic_float_set(&stream->rate, 1.0f);
+  }
+  fluid_atomic_int_inc(&stream->generation);
+
+  if (stream->active)
+    fluid_rvoice_streamer_wake(stream->streamer);
+}
+
+/*
+ * Stop reading data for a finished voice.
+ */
+void
+fluid_rvoice_stream_detach(fluid_rvoice_stream_t* stream)
+{
+  fluid_atomic_int_inc(&stream->generation);
+  stream->active = FALSE;
+  fluid_atomic_int_inc(&stream->generation);
+}
+
+/*
+ * Get the sample data for the next block of a voice.
+ *
+ * @param index Current playhead
+ * @param incr Points the playhead advances per output sample
+ * @param needed Highest sample point the block may read
+ * @param first Location to store the lowest valid sample point to
+ * @param last Location to store the highest valid sample point to
+ * @return Sample data to be indexed with sample point numbers, or NULL
+ *   if the block can't be played yet. If it never can, because the block
+ *   spans more points than the window holds, 'first' is set to -1.
+ */
+short*
+fluid_rvoice_stream_window(fluid_rvoice_stream_t* stream, int index,
+                           fluid_real_t incr, int needed, int* first, int* last)
+{
+  int read_pos, write_pos;
+
+  if (!stream->active) {
+    *first = 0;
+    *last = stream->resident - 1;
+    return stream->resident_data;
+  }
+
+  if (needed - index + FLUID_STREAM_HISTORY > FLUID_STREAM_SPAN_MAX) {
+    *first = *last = -1;
+    return NULL;
+  }
+
+  read_pos = index - FLUID_STREAM_HISTORY;
+  if (read_pos > fluid_atomic_int_get(&stream->read_pos))
+    fluid_atomic_int_set(&stream->read_pos, read_pos);
+  else read_pos = fluid_atomic_int_get(&stream->read_pos);
+  fluid_atomic_int_set(&stream->position, index);
+  fluid_atomic_float_set(&stream->rate, incr);
+
+  if (fluid_atomic_int_get(&stream->ready) != stream->generation) {
+    write_pos = stream->base;
+    fluid_rvoice_streamer_wake(stream->streamer);
+  }
+  else {
+    write_pos = fluid_atomic_int_get(&stream->write_pos);
+    /* Room for a chunk, or the rest of the sample */
+    if (write_pos < stream->length
+        && (read_pos + FLUID_STREAM_SIZE - write_pos >= FLUID_STREAM_CHUNK
+            || read_pos + FLUID_STREAM_SIZE >= stream->length))
+      fluid_rvoice_streamer_wake(stream->streamer);
+  }
+
+  /* Play the resident points as long as they last */
+  if (needed < stream->resident) {
+    *first = 0;
+    *last = stream->resident - 1;
+    return stream->resident_data;
+  }
+
+  *first = read_pos;
+  *last = write_pos - 1;
+  if (needed > *last) {
+    fluid_atomic_int_inc(&stream->streamer->underruns);
+    return NULL;
+  }
+  return stream->buf + (read_pos % FLUID_STREAM_SIZE) - read_pos;
+}
@@ -0,0 +1,43 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+
+#ifndef _FLUID_RVOICE_STREAM_H
+#define _FLUID_RVOICE_STREAM_H
+
+#include "fluidsynth_priv.h"
+
+typedef struct _fluid_rvoice_streamer_t fluid_rvoice_streamer_t;
+typedef struct _fluid_rvoice_stream_t fluid_rvoice_stream_t;
+
+/* Owned by the synth, one I/O thread feeding all streams */
+fluid_rvoice_streamer_t* new_fluid_rvoice_streamer(void);
+void delete_fluid_rvoice_streamer(fluid_rvoice_streamer_t* streamer);
+fluid_rvoice_stream_t* fluid_rvoice_streamer_new_stream(fluid_rvoice_streamer_t* streamer);
+int fluid_rvoice_streamer_get_underruns(fluid_rvoice_streamer_t* streamer);
+
+/* Called from the rendering thread of the rvoice owning the stream */
+void fluid_rvoice_stream_attach(fluid_rvoice_stream_t* stream, fluid_sample_t* sample, int start);
+void fluid_rvoice_stream_detach(fluid_rvoice_stream_t* stream);
+short* fluid_rvoice_stream_window(fluid_rvoice_stream_t* stream, int index,
+                                  fluid_real_t incr, int needed,
+                                  int* first, int* last);
+
+#endif
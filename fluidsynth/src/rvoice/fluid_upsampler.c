@@ -0,0 +1,173 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+/*
+ * Polyphase upsampler, for running the synthesis at a fraction of the
+ * output rate (synth.internal-rate-divider).
+ *
+ * Upsampling by an integer factor inserts factor-1 zeros after every
+ * input sample and removes the images of the spectrum this creates with
+ * a lowpass filter. The filter is a Kaiser windowed sinc, which is split
+ * into one short filter per output phase, so that the zeros are never
+ * multiplied. Every output sample costs FLUID_UPSAMPLER_TAPS multiplies.
+ *
+ * The passband (flat within 0.1 dB) ends at 39% of the input rate, the
+ * stopband (80 dB down) starts at 54%, so the images of anything the
+ * voices render below 46% of the input rate are removed. The delay of the
+ * filter is just under FLUID_UPSAMPLER_TAPS / 2 input samples.
+ */
+
+#include "fluid_upsampler.h"
+#include "fluid_sys.h"
+
+/* Filter taps per output phase */
+#define FLUID_UPSAMPLER_TAPS 32
+/* Cutoff frequency, relative to the input rate */
+#define FLUID_UPSAMPLER_CUTOFF 0.45
+/* Kaiser window shape (stopband attenuation of about 80 dB) */
+#define FLUID_UPSAMPLER_BETA 8.0
+
+struct _fluid_upsampler_t
+{
+  int factor;
+  int max_count;          /* most input samples per call */
+  fluid_real_t* coeffs;   /* FLUID_UPSAMPLER_TAPS per phase, oldest input first */
+  fluid_real_t* line;     /* FLUID_UPSAMPLER_TAPS-1 previous input samples, then the input */
+};
+
+/* Zeroth order modified Bessel function of the first kind */
+static double
+fluid_upsampler_bessel_i0(double x)
+{
+  double sum = 1.0, term = 1.0;
+  int k;
+
+  for (k = 1; k < 50 && term > sum * 1e-12; k++) {
+    term *= (x / (2 * k)) * (x / (2 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+/*
+ * Create an upsampler for one channel.
+ * @param factor Count of output samples per input sample
+ * @param max_count Most input samples processed at once
+ */
+fluid_upsampler_t*
+new_fluid_upsampler(int factor, int max_count)
+{
+  fluid_upsampler_t* upsampler;
+  int length = FLUID_UPSAMPLER_TAPS * factor;
+  double center = (length - 1) / 2.0;
+  double cutoff = FLUID_UPSAMPLER_CUTOFF / factor;   /* relative to the output rate */
+  double norm = fluid_upsampler_bessel_i0(FLUID_UPSAMPLER_BETA);
+  double t, w, h;
+  int m, phase, tap;
+
+  upsampler = FLUID_NEW(fluid_upsampler_t);
+  if (upsampler == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return NULL;
+  }
+  upsampler->factor = factor;
+  upsampler->max_count = max_count;
+  upsampler->coeffs = FLUID_ARRAY(fluid_real_t, length);
+  upsampler->line = FLUID_ARRAY(fluid_real_t, FLUID_UPSAMPLER_TAPS - 1 + max_count);
+  if (upsampler->coeffs == NULL || upsampler->line == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    delete_fluid_upsampler(upsampler);
+    return NULL;
+  }
+
+  /* Output phase p uses the taps p, p+factor, p+2*factor... of the
+   * prototype filter. The gain of factor makes up for the zeros. */
+  for (m = 0; m < length; m++) {
+    t = m - center;
+    h = 2.0 * cutoff * ((t == 0.0) ? 1.0 : sin(2.0 * M_PI * cutoff * t) / (2.0 * M_PI * cutoff * t));
+    w = 2.0 * t / (length - 1);
+    w = fluid_upsampler_bessel_i0(FLUID_UPSAMPLER_BETA * sqrt(1.0 - w * w)) / norm;
+
+    phase = m % factor;
+    tap = m / factor;
+    upsampler->coeffs[phase * FLUID_UPSAMPLER_TAPS + FLUID_UPSAMPLER_TAPS - 1 - tap] =
+      (fluid_real_t) (factor * h * w);
+  }
+
+  fluid_upsampler_reset(upsampler);
+  return upsampler;
+}
+
+void
+delete_fluid_upsampler(fluid_upsampler_t* upsampler)
+{
+  if (upsampler == NULL)
+    return;
+  FLUID_FREE(upsampler->coeffs);
+  FLUID_FREE(upsampler->line);
+  FLUID_FREE(upsampler);
+}
+
+/*
+ * Clear the filter history.
+ */
+void
+fluid_upsampler_reset(fluid_upsampler_t* upsampler)
+{
+  FLUID_MEMSET(upsampler->line, 0, (FLUID_UPSAMPLER_TAPS - 1) * sizeof(fluid_real_t));
+}
+
+/*
+ * Upsample a buffer.
+ * @param in Input samples
+ * @param count Count of input samples, at most the max_count given on creation
+ * @param out Buffer for count * factor output samples, may not be 'in'
+ */
+void
+fluid_upsampler_process(fluid_upsampler_t* upsampler,
+                        const fluid_real_t* in, int count,
+                        fluid_real_t* out)
+{
+  fluid_real_t* line = upsampler->line;
+  int factor = upsampler->factor;
+  const fluid_real_t* coeffs;
+  const fluid_real_t* x;
+  fluid_real_t sum;
+  int n, phase, k;
+
+  if (count > upsampler->max_count)
+    count = upsampler->max_count;
+
+  FLUID_MEMCPY(line + FLUID_UPSAMPLER_TAPS - 1, in, count * sizeof(fluid_real_t));
+
+  for (n = 0; n < count; n++) {
+    x = line + n;
+    for (phase = 0; phase < factor; phase++) {
+      coeffs = upsampler->coeffs + phase * FLUID_UPSAMPLER_TAPS;
+      sum = 0;
+      for (k = 0; k < FLUID_UPSAMPLER_TAPS; k++)
+        sum += coeffs[k] * x[k];
+      *out++ = sum;
+    }
+  }
+
+  /* Keep the newest input samples for the next call */
+  FLUID_MEMMOVE(line, line + count, (FLUID_UPSAMPLER_TAPS - 1) * sizeof(fluid_real_t));
+}
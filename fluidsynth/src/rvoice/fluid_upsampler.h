@@ -0,0 +1,36 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+
+#ifndef _FLUID_UPSAMPLER_H
+#define _FLUID_UPSAMPLER_H
+
+#include "fluidsynth_priv.h"
+
+typedef struct _fluid_upsampler_t fluid_upsampler_t;
+
+fluid_upsampler_t* new_fluid_upsampler(int factor, int max_count);
+void delete_fluid_upsampler(fluid_upsampler_t* upsampler);
+void fluid_upsampler_reset(fluid_upsampler_t* upsampler);
+void fluid_upsampler_process(fluid_upsampler_t* upsampler,
+                             const fluid_real_t* in, int count,
+                             fluid_real_t* out);
+
+#endif
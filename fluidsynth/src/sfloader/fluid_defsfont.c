@@ -25,6 +25,14 @@
 #include "fluid_defsfont.h"
 /* Todo: Get rid of that 'include' */
 #include "fluid_sys.h"
+#include "fluid_sfont.h"
+#include "fluid_sfcache.h"
+#include "fluid_hash.h"
+#include "fluid_voice.h"
+
+#if LIBSNDFILE_HASVORBIS
+#include <sndfile.h>
+#endif
 #if ANDROID
 #include "android/asset_manager.h"
 #include "android/asset_manager_jni.h"
@@ -36,6 +44,139 @@
  *              GENERIC STREAM LOADER AND FILE LOADER
  */
 
+/*
+ * The stream loaders of the library. The methods of the public loader
+ * take int offsets, so these keep 64 bit methods and an optional map
+ * method of their own. Their public methods are thunks to them, which
+ * also tell them apart from other loaders (see fluid_stream_length and
+ * the following functions, through which all streams are accessed).
+ */
+typedef struct
+{
+  fluid_stream_loader_t loader;
+  fluid_long_long_t (*length)(fluid_stream_loader_t* loader);
+  fluid_long_long_t (*position)(fluid_stream_loader_t* loader);
+  int (*safe_seek_by)(fluid_stream_loader_t* loader, fluid_long_long_t position);
+  const void* (*map)(fluid_stream_loader_t* loader, fluid_long_long_t offset, fluid_long_long_t size);
+} fluid_stream_loader_ext_t;
+
+#define EXT_LOADER(loader) ((fluid_stream_loader_ext_t*) (loader))
+
+static int fluid_stream_loader_ext_length(fluid_stream_loader_t* loader)
+{
+  fluid_long_long_t length = EXT_LOADER(loader)->length(loader);
+
+  if (length > INT_MAX) {
+    FLUID_LOG(FLUID_ERR, "The stream is too large for its length method");
+    return -1;
+  }
+  return (int) length;
+}
+
+static int fluid_stream_loader_ext_position(fluid_stream_loader_t* loader)
+{
+  fluid_long_long_t position = EXT_LOADER(loader)->position(loader);
+
+  if (position > INT_MAX) {
+    FLUID_LOG(FLUID_ERR, "The stream position is too large for its position method");
+    return -1;
+  }
+  return (int) position;
+}
+
+static int fluid_stream_loader_ext_safe_seek_by(fluid_stream_loader_t* loader, int position)
+{
+  return EXT_LOADER(loader)->safe_seek_by(loader, position);
+}
+
+static fluid_stream_loader_t*
+new_fluid_stream_loader_ext(fluid_long_long_t (*length)(fluid_stream_loader_t* loader),
+                            fluid_long_long_t (*position)(fluid_stream_loader_t* loader),
+                            int (*safe_seek_by)(fluid_stream_loader_t* loader, fluid_long_long_t position),
+                            const void* (*map)(fluid_stream_loader_t* loader,
+                                               fluid_long_long_t offset, fluid_long_long_t size))
+{
+  fluid_stream_loader_ext_t* ext;
+
+  ext = FLUID_NEW(fluid_stream_loader_ext_t);
+  if (ext == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return NULL;
+  }
+  FLUID_MEMSET(ext, 0, sizeof(fluid_stream_loader_ext_t));
+
+  ext->length = length;
+  ext->position = position;
+  ext->safe_seek_by = safe_seek_by;
+  ext->map = map;
+  ext->loader.length = fluid_stream_loader_ext_length;
+  ext->loader.position = fluid_stream_loader_ext_position;
+  ext->loader.safe_seek_by = fluid_stream_loader_ext_safe_seek_by;
+  return &ext->loader;
+}
+
+static fluid_long_long_t fluid_stream_length(fluid_stream_loader_t* stream)
+{
+  if (stream->length == fluid_stream_loader_ext_length)
+    return EXT_LOADER(stream)->length(stream);
+  return stream->length(stream);
+}
+
+static fluid_long_long_t fluid_stream_position(fluid_stream_loader_t* stream)
+{
+  if (stream->position == fluid_stream_loader_ext_position)
+    return EXT_LOADER(stream)->position(stream);
+  return stream->position(stream);
+}
+
+static int fluid_stream_seek_by(fluid_stream_loader_t* stream, fluid_long_long_t position)
+{
+  if (stream->safe_seek_by == fluid_stream_loader_ext_safe_seek_by)
+    return EXT_LOADER(stream)->safe_seek_by(stream, position);
+  if (position > INT_MAX || position < INT_MIN) {
+    FLUID_LOG (FLUID_ERR, _("File seek failed with offset = %lld"), (long long) position);
+    return FAIL;
+  }
+  return stream->safe_seek_by(stream, (int) position);
+}
+
+/*
+ * Get a pointer to the stream's data if it's held in memory, NULL if
+ * it has to be read.
+ */
+static const void* fluid_stream_map(fluid_stream_loader_t* stream,
+                                    fluid_long_long_t offset, fluid_long_long_t size)
+{
+  if (stream->length != fluid_stream_loader_ext_length || EXT_LOADER(stream)->map == NULL)
+    return NULL;
+  return EXT_LOADER(stream)->map(stream, offset, size);
+}
+
+#undef EXT_LOADER
+
+/*
+ * The file loader reads the file through a large buffer of its own. The
+ * hydra chunks are parsed with many small reads and seeks, which are
+ * served from the buffer instead of each going through stdio.
+ */
+#define FLUID_FILE_STREAM_BUFSIZE  (64 * 1024)
+
+/* Sample chunks of files are mapped instead of read where possible */
+#if defined(HAVE_SYS_MMAN_H) && !defined(__OS2__) && !defined(WIN32)
+#define DEFSFONT_USE_MMAP 1
+#endif
+
+typedef struct
+{
+  FILE* file;
+  fluid_long_long_t pos;        /* position of the stream */
+  fluid_long_long_t buf_start;  /* file position of buf[0] */
+  int buf_fill;                 /* valid bytes in buf */
+  char buf[FLUID_FILE_STREAM_BUFSIZE];
+} fluid_file_stream_t;
+
+#define FSTREAM(loader) ((fluid_file_stream_t*) (loader)->data)
+
 int free_fluid_file_stream_loader(fluid_stream_loader_t* loader)
 {
   if (loader) {
@@ -47,7 +188,8 @@ int free_fluid_file_stream_loader(fluid_stream_loader_t* loader)
 int fluid_file_stream_loader_close(fluid_stream_loader_t* loader)
 {
   if (loader->data) {
-    fclose((FILE*) loader->data);
+    fclose(FSTREAM(loader)->file);
+    FLUID_FREE(loader->data);
     loader->data = NULL;
   }
   return FLUID_OK;
@@ -55,15 +197,29 @@ int fluid_file_stream_loader_close(fluid_stream_loader_t* loader)
 
 int fluid_file_stream_loader_open(fluid_stream_loader_t* loader, const char* filename)
 {
+  fluid_file_stream_t* fstream;
+
   if (loader->data) {
     FLUID_LOG(FLUID_ERR, "File or Stream is already open");
     return -1;
   }
-  loader->data = fopen(filename, "rb");
-  if (!loader->data) {
+  fstream = FLUID_NEW(fluid_file_stream_t);
+  if (fstream == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return -1;
+  }
+  fstream->file = fopen(filename, "rb");
+  if (!fstream->file) {
     FLUID_LOG(FLUID_ERR, "Failed to open File or Stream: %s", filename);
+    FLUID_FREE(fstream);
     return -1;
   }
+  /* stdio buffering would only copy the data once more */
+  setvbuf(fstream->file, NULL, _IONBF, 0);
+  fstream->pos = 0;
+  fstream->buf_start = 0;
+  fstream->buf_fill = 0;
+  loader->data = fstream;
   return FLUID_OK;
 }
 
@@ -72,85 +228,152 @@ int fluid_file_stream_loader_is_open(fluid_stream_loader_t* loader)
   return loader->data ? 1 : 0;
 }
 
-int fluid_file_stream_loader_length(fluid_stream_loader_t* loader)
+fluid_long_long_t fluid_file_stream_loader_length(fluid_stream_loader_t* loader)
 {
-  long current, ret;
+  fluid_long_long_t ret;
   FILE *fd;
-  int err;
-  
-  fd = (FILE*) loader->data;
-  if (!loader->data) 
-    {
-	  err = TRUE;
-      FLUID_LOG(FLUID_ERR, "File or Stream is not open");
-    }
-  else if ((current = ftell (fd)) == -1)
-    {
-      err = TRUE;
-      FLUID_LOG (FLUID_ERR, _("Get current file position failed"));
-    }
 
-  else if (fseek (fd, 0L, SEEK_END) == -1)
-    {				/* seek to end of file */
-      err = TRUE;
-      FLUID_LOG (FLUID_ERR, _("Seek to end of file failed"));
-    }
-  else if ((ret = ftell (fd)) == -1)
-    {				/* position = size */
-      err = TRUE;
-      FLUID_LOG (FLUID_ERR, _("Get end of file position failed"));
-    }
-  else if (fseek (fd, current, SEEK_SET) == -1)
-    {
-      err = TRUE;
-      FLUID_LOG (FLUID_ERR, _("Seek to the original file position failed"));
-    }
-  if (!err)
-    rewind (fd);
+  if (!loader->data) {
+    FLUID_LOG(FLUID_ERR, "File or Stream is not open");
+    return -1;
+  }
+  fd = FSTREAM(loader)->file;
 
-  return (int) ret;
+  /* The file position doesn't matter, every read seeks first */
+  if (FLUID_FSEEK (fd, 0, SEEK_END) == -1) {
+    FLUID_LOG (FLUID_ERR, _("Seek to end of file failed"));
+    return -1;
+  }
+  if ((ret = FLUID_FTELL (fd)) == -1) {
+    FLUID_LOG (FLUID_ERR, _("Get end of file position failed"));
+    return -1;
+  }
+  return ret;
 }
 
-int fluid_file_stream_loader_position(fluid_stream_loader_t* loader)
+fluid_long_long_t fluid_file_stream_loader_position(fluid_stream_loader_t* loader)
 {
-  int ret;
   if (!loader->data) {
     FLUID_LOG(FLUID_ERR, "File or Stream is not open");
     return -1;
   }
-  return ftell((FILE*) loader->data);
+  return FSTREAM(loader)->pos;
 }
 
-int fluid_file_stream_loader_safe_seek_by(fluid_stream_loader_t* loader, int position)
+int fluid_file_stream_loader_safe_seek_by(fluid_stream_loader_t* loader, fluid_long_long_t position)
 {
-  int ret;
   if (!loader->data) {
     FLUID_LOG(FLUID_ERR, "File or Stream is not open");
     return -1;
   }
-  return safe_fseek((FILE*) loader->data, position, SEEK_CUR);
+  if (FSTREAM(loader)->pos + position < 0) {
+    FLUID_LOG (FLUID_ERR, _("File seek failed with offset = %lld"), (long long) position);
+    return FAIL;
+  }
+  FSTREAM(loader)->pos += position;
+  return OK;
 }
 
-int fluid_file_stream_loader_safe_read(fluid_stream_loader_t* loader, void* buffer, int size)
+int fluid_file_stream_loader_read(fluid_stream_loader_t* loader, void* buffer, int size)
 {
-  int ret;
-  if (!loader->data) {
+  fluid_file_stream_t* fstream = FSTREAM(loader);
+  char* dest = (char*) buffer;
+  int count, done = 0;
+
+  if (!fstream) {
     FLUID_LOG(FLUID_ERR, "File or Stream is not open");
     return -1;
   }
-  return safe_fread(buffer, size, (FILE*) loader->data);
+
+  while (done < size) {
+    /* Copy what the buffer holds */
+    if (fstream->pos >= fstream->buf_start
+        && fstream->pos < fstream->buf_start + fstream->buf_fill) {
+      count = (int) (fstream->buf_start + fstream->buf_fill - fstream->pos);
+      if (count > size - done)
+        count = size - done;
+      FLUID_MEMCPY(dest + done, fstream->buf + (fstream->pos - fstream->buf_start), count);
+      fstream->pos += count;
+      done += count;
+      continue;
+    }
+
+    if (FLUID_FSEEK(fstream->file, fstream->pos, SEEK_SET) == -1)
+      break;
+
+    /* Large reads, like the sample data, bypass the buffer */
+    if (size - done >= FLUID_FILE_STREAM_BUFSIZE) {
+      count = (int) FLUID_FREAD(dest + done, 1, size - done, fstream->file);
+      fstream->pos += count;
+      done += count;
+      break;
+    }
+
+    fstream->buf_start = fstream->pos;
+    fstream->buf_fill = (int) FLUID_FREAD(fstream->buf, 1, FLUID_FILE_STREAM_BUFSIZE, fstream->file);
+    if (fstream->buf_fill == 0)
+      break;
+  }
+  return done;
 }
 
-int fluid_file_stream_loader_read(fluid_stream_loader_t* loader, void* buffer, int size)
+int fluid_file_stream_loader_safe_read(fluid_stream_loader_t* loader, void* buffer, int size)
 {
-  int ret;
   if (!loader->data) {
     FLUID_LOG(FLUID_ERR, "File or Stream is not open");
     return -1;
   }
-  return fread(buffer, 1, size, (FILE*) loader->data);
+  if (fluid_file_stream_loader_read(loader, buffer, size) != size) {
+    if (feof (FSTREAM(loader)->file))
+      gerr (ErrEof, _("EOF while attemping to read %d bytes"), size);
+    else
+      FLUID_LOG (FLUID_ERR, _("File read failed"));
+    return FAIL;
+  }
+  return OK;
+}
+
+#ifdef DEFSFONT_USE_MMAP
+/*
+ * Get the descriptor of the file a stream reads, so the sample data can
+ * be mapped (see fluid_cached_sampledata_mmap). Only streams of the file
+ * loader read a file, -1 is returned for the others: they decide where
+ * the data comes from, it's read through their read method.
+ */
+static int fluid_file_stream_loader_fileno(fluid_stream_loader_t* loader)
+{
+  if (loader->open != fluid_file_stream_loader_open || !loader->data)
+    return -1;
+  return fileno(FSTREAM(loader)->file);
+}
+#endif
+
+/*
+ * Identify the version of the file an open stream reads, for the index
+ * cache (see fluid_sfcache.c). Only streams of the file loader can be
+ * identified, the names other loaders get needn't refer to a file.
+ */
+static int fluid_file_stream_loader_get_key(fluid_stream_loader_t* loader, fluid_sfcache_key_t* key)
+{
+#ifdef HAVE_SYS_STAT_H
+  struct stat st;
+
+  if (loader->open != fluid_file_stream_loader_open || !loader->data
+      || fstat(fileno(FSTREAM(loader)->file), &st) != 0)
+    return FLUID_FAILED;
+
+  key->size = (fluid_long_long_t) st.st_size;
+  key->mtime = (fluid_long_long_t) st.st_mtime;
+  key->dev = (fluid_long_long_t) st.st_dev;
+  key->ino = (fluid_long_long_t) st.st_ino;
+  return FLUID_OK;
+#else
+  return FLUID_FAILED;
+#endif
 }
 
+#undef FSTREAM
+
 static int fluid_get_file_modification_time(fluid_stream_loader_t * stream, char *filename, time_t *modification_time)
 {
 #if defined(WIN32) || defined(__OS2__)
@@ -172,20 +395,18 @@ fluid_stream_loader_t* new_fluid_file_stream_loader()
 {
   fluid_stream_loader_t* loader;
 
-  loader = FLUID_NEW(fluid_stream_loader_t);
-  if (loader == NULL) {
-    FLUID_LOG(FLUID_ERR, "Out of memory");
+  loader = new_fluid_stream_loader_ext(fluid_file_stream_loader_length,
+                                       fluid_file_stream_loader_position,
+                                       fluid_file_stream_loader_safe_seek_by,
+                                       NULL);
+  if (loader == NULL)
     return NULL;
-  }
 
   loader->data = NULL;
   loader->free = free_fluid_file_stream_loader;
   loader->open = fluid_file_stream_loader_open;
   loader->is_open = fluid_file_stream_loader_is_open;
   loader->close = fluid_file_stream_loader_close;
-  loader->length = fluid_file_stream_loader_length;
-  loader->position = fluid_file_stream_loader_position;
-  loader->safe_seek_by = fluid_file_stream_loader_safe_seek_by;
   loader->read = fluid_file_stream_loader_read;
   loader->safe_read = fluid_file_stream_loader_safe_read;
   loader->get_modtime = fluid_get_file_modification_time;
@@ -194,6 +415,157 @@ fluid_stream_loader_t* new_fluid_file_stream_loader()
 }
 
 
+/***************************************************************
+ *
+ *                      MEMORY STREAM LOADER
+ */
+
+/*
+ * Reads a SoundFont held in memory by the caller. The memory isn't
+ * copied: the sample data is used in place (see fluid_cached_sampledata_load),
+ * so it has to stay valid as long as SoundFonts loaded from it are in use.
+ */
+typedef struct
+{
+  const char* data;
+  fluid_long_long_t size;
+  fluid_long_long_t pos;
+  int is_open;
+} fluid_memory_stream_t;
+
+#define MSTREAM(loader) ((fluid_memory_stream_t*) (loader)->data)
+
+static int free_fluid_memory_stream_loader(fluid_stream_loader_t* loader)
+{
+  if (loader) {
+    FLUID_FREE(loader->data);
+    FLUID_FREE(loader);
+  }
+  return FLUID_OK;
+}
+
+static int fluid_memory_stream_loader_open(fluid_stream_loader_t* loader, const char* filename)
+{
+  if (MSTREAM(loader)->is_open) {
+    FLUID_LOG(FLUID_ERR, "File or Stream is already open");
+    return -1;
+  }
+  MSTREAM(loader)->is_open = TRUE;
+  MSTREAM(loader)->pos = 0;
+  return FLUID_OK;
+}
+
+static int fluid_memory_stream_loader_close(fluid_stream_loader_t* loader)
+{
+  MSTREAM(loader)->is_open = FALSE;
+  return FLUID_OK;
+}
+
+static int fluid_memory_stream_loader_is_open(fluid_stream_loader_t* loader)
+{
+  return MSTREAM(loader)->is_open;
+}
+
+static fluid_long_long_t fluid_memory_stream_loader_length(fluid_stream_loader_t* loader)
+{
+  return MSTREAM(loader)->size;
+}
+
+static fluid_long_long_t fluid_memory_stream_loader_position(fluid_stream_loader_t* loader)
+{
+  return MSTREAM(loader)->pos;
+}
+
+static int fluid_memory_stream_loader_safe_seek_by(fluid_stream_loader_t* loader, fluid_long_long_t position)
+{
+  fluid_long_long_t pos = MSTREAM(loader)->pos + position;
+
+  if (pos < 0 || pos > MSTREAM(loader)->size) {
+    FLUID_LOG (FLUID_ERR, _("File seek failed with offset = %lld"), (long long) position);
+    return FAIL;
+  }
+  MSTREAM(loader)->pos = pos;
+  return OK;
+}
+
+static int fluid_memory_stream_loader_read(fluid_stream_loader_t* loader, void* buffer, int size)
+{
+  fluid_memory_stream_t* mstream = MSTREAM(loader);
+
+  if (size > mstream->size - mstream->pos)
+    size = (int) (mstream->size - mstream->pos);
+  if (size <= 0)
+    return 0;
+  FLUID_MEMCPY(buffer, mstream->data + mstream->pos, size);
+  mstream->pos += size;
+  return size;
+}
+
+static int fluid_memory_stream_loader_safe_read(fluid_stream_loader_t* loader, void* buffer, int size)
+{
+  if (fluid_memory_stream_loader_read(loader, buffer, size) != size) {
+    gerr (ErrEof, _("EOF while attemping to read %d bytes"), size);
+    return FAIL;
+  }
+  return OK;
+}
+
+/* Not used by the sample cache, which never looks up data of memory
+   streams by name (see fluid_cached_sampledata_load) */
+static int fluid_memory_stream_loader_get_modtime(fluid_stream_loader_t* loader, char *filename,
+  time_t *modification_time)
+{
+  *modification_time = 0;
+  return FLUID_OK;
+}
+
+static const void* fluid_memory_stream_loader_map(fluid_stream_loader_t* loader,
+  fluid_long_long_t offset, fluid_long_long_t size)
+{
+  if (offset < 0 || size < 0 || offset + size > MSTREAM(loader)->size)
+    return NULL;
+  return MSTREAM(loader)->data + offset;
+}
+
+#undef MSTREAM
+
+fluid_stream_loader_t* new_fluid_memory_stream_loader(const void* data, fluid_long_long_t size)
+{
+  fluid_stream_loader_t* loader;
+  fluid_memory_stream_t* mstream;
+
+  mstream = FLUID_NEW(fluid_memory_stream_t);
+  if (mstream == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return NULL;
+  }
+  loader = new_fluid_stream_loader_ext(fluid_memory_stream_loader_length,
+                                       fluid_memory_stream_loader_position,
+                                       fluid_memory_stream_loader_safe_seek_by,
+                                       fluid_memory_stream_loader_map);
+  if (loader == NULL) {
+    FLUID_FREE(mstream);
+    return NULL;
+  }
+
+  mstream->data = (const char*) data;
+  mstream->size = size;
+  mstream->pos = 0;
+  mstream->is_open = FALSE;
+
+  loader->data = mstream;
+  loader->free = free_fluid_memory_stream_loader;
+  loader->open = fluid_memory_stream_loader_open;
+  loader->is_open = fluid_memory_stream_loader_is_open;
+  loader->close = fluid_memory_stream_loader_close;
+  loader->read = fluid_memory_stream_loader_read;
+  loader->safe_read = fluid_memory_stream_loader_safe_read;
+  loader->get_modtime = fluid_memory_stream_loader_get_modtime;
+
+  return loader;
+}
+
+
 /***************************************************************
  *
  *          ANDROID ASSET STREAM LOADER AND FILE LOADER
@@ -252,33 +624,33 @@ int fluid_android_asset_stream_loader_is_open(fluid_stream_loader_t* loader)
   return ASSET(loader) ? 1 : 0;
 }
 
-int fluid_android_asset_stream_loader_length(fluid_stream_loader_t* loader)
+fluid_long_long_t fluid_android_asset_stream_loader_length(fluid_stream_loader_t* loader)
 {
   if (!ASSET(loader)) {
     FLUID_LOG(FLUID_ERR, "Asset Stream is not open");
     return -1;
   }
-  return (int) AAsset_getLength(ASSET(loader));
+  return AAsset_getLength64(ASSET(loader));
 }
 
-int fluid_android_asset_stream_loader_position(fluid_stream_loader_t* loader)
+fluid_long_long_t fluid_android_asset_stream_loader_position(fluid_stream_loader_t* loader)
 {
   int ret;
   if (!ASSET(loader)) {
     FLUID_LOG(FLUID_ERR, "Asset Stream is not open");
     return -1;
   }
-  return AAsset_seek(ASSET(loader), 0, SEEK_CUR);
+  return AAsset_seek64(ASSET(loader), 0, SEEK_CUR);
 }
 
-int fluid_android_asset_stream_loader_safe_seek_by(fluid_stream_loader_t* loader, int position)
+int fluid_android_asset_stream_loader_safe_seek_by(fluid_stream_loader_t* loader, fluid_long_long_t position)
 {
   int ret;
   if (!ASSET(loader)) {
     FLUID_LOG(FLUID_ERR, "Asset Stream is not open");
     return -1;
   }
-  return AAsset_seek(ASSET(loader), position, SEEK_CUR);
+  return AAsset_seek64(ASSET(loader), position, SEEK_CUR);
 }
 
 int fluid_android_asset_stream_loader_safe_read(fluid_stream_loader_t* loader, void* buffer, int size)
@@ -313,11 +685,12 @@ fluid_stream_loader_t* new_fluid_android_asset_stream_loader(void* jniEnv, void*
   fluid_stream_loader_t* loader;
   android_stream_loader_data_t* data;
 
-  loader = FLUID_NEW(fluid_stream_loader_t);
-  if (loader == NULL) {
-    FLUID_LOG(FLUID_ERR, "Out of memory");
+  loader = new_fluid_stream_loader_ext(fluid_android_asset_stream_loader_length,
+                                       fluid_android_asset_stream_loader_position,
+                                       fluid_android_asset_stream_loader_safe_seek_by,
+                                       NULL);
+  if (loader == NULL)
     return NULL;
-  }
   
   data = FLUID_NEW(android_stream_loader_data_t);
   if (data == NULL) {
@@ -333,9 +706,6 @@ fluid_stream_loader_t* new_fluid_android_asset_stream_loader(void* jniEnv, void*
   loader->open = fluid_android_asset_stream_loader_open;
   loader->is_open = fluid_android_asset_stream_loader_is_open;
   loader->close = fluid_android_asset_stream_loader_close;
-  loader->length = fluid_android_asset_stream_loader_length;
-  loader->position = fluid_android_asset_stream_loader_position;
-  loader->safe_seek_by = fluid_android_asset_stream_loader_safe_seek_by;
   loader->read = fluid_android_asset_stream_loader_read;
   loader->safe_read = fluid_android_asset_stream_loader_safe_read;
   loader->get_modtime = fluid_get_android_asset_modification_time;
@@ -356,12 +726,14 @@ fluid_stream_loader_t* new_fluid_android_asset_stream_loader(void* jniEnv, void*
 typedef struct _defsfloader_data_t {
 	fluid_settings_t* settings;
 	fluid_stream_loader_t* stream;
+	fluid_sample_pool_t* pool;
 } defsfloader_data_t;
 
 fluid_sfloader_t* new_fluid_defsfloader(fluid_settings_t* settings, fluid_stream_loader_t* stream)
 {
   fluid_sfloader_t* loader;
   defsfloader_data_t* data;
+  int budget = 0;
   
   if (stream == NULL) {
     FLUID_LOG(FLUID_ERR, "Null stream loader");
@@ -377,13 +749,21 @@ fluid_sfloader_t* new_fluid_defsfloader(fluid_settings_t* settings, fluid_stream
   data->settings = settings;
   data->stream = stream;
 
+  /* The SoundFonts of a loader share the sample memory budget */
+  fluid_settings_getint(settings, "synth.sample-cache-budget", &budget);
+  data->pool = new_fluid_sample_pool(budget * 1048576.0);
+
   loader = FLUID_NEW(fluid_sfloader_t);
-  if (loader == NULL) {
+  if (loader == NULL || data->pool == NULL) {
     FLUID_LOG(FLUID_ERR, "Out of memory");
     if (stream)
 	  FLUID_FREE(stream);
+    if (data->pool)
+	  fluid_sample_pool_unref(data->pool);
     if (data)
 	  FLUID_FREE(data);
+    if (loader)
+	  FLUID_FREE(loader);
     return NULL;
   }
 
@@ -396,7 +776,14 @@ fluid_sfloader_t* new_fluid_defsfloader(fluid_settings_t* settings, fluid_stream
 
 int delete_fluid_defsfloader(fluid_sfloader_t* loader)
 {
+  defsfloader_data_t* data;
+
   if (loader) {
+    data = (defsfloader_data_t*) loader->data;
+    if (data) {
+      fluid_sample_pool_unref(data->pool);
+      FLUID_FREE(data);
+    }
     FLUID_FREE(loader);
   }
   return FLUID_OK;
@@ -415,6 +802,12 @@ fluid_sfont_t* fluid_defsfloader_load(fluid_sfloader_t* loader, const char* file
     return NULL;
   }
 
+  defsfont->pool = stream_data->pool;
+  fluid_sample_pool_ref(defsfont->pool);
+  /* A budget only works if the samples can be unloaded again */
+  if (fluid_sample_pool_get_budget(defsfont->pool) > 0.0)
+    defsfont->dynamic_samples = TRUE;
+
   if (fluid_defsfont_load(defsfont, stream_data->stream, filename) == FLUID_FAILED) {
     delete_fluid_defsfont(defsfont);
     return NULL;
@@ -494,7 +887,7 @@ fluid_defsfont_sfont_get_preset(fluid_sfont_t* sfont, unsigned int bank, unsigne
   preset->get_banknum = fluid_defpreset_preset_get_banknum;
   preset->get_num = fluid_defpreset_preset_get_num;
   preset->noteon = fluid_defpreset_preset_noteon;
-  preset->notify = NULL;
+  preset->notify = defsfont->dynamic_samples ? fluid_defpreset_preset_notify : NULL;
 
   return preset;
 }
@@ -560,52 +953,246 @@ int fluid_defpreset_preset_noteon(fluid_preset_t* preset, fluid_synth_t* synth,
  *                    CACHED SAMPLEDATA LOADER
  */
 
+#define FLUID_STREAM_READ_MAX  (1 << 30)   /* largest single read from a stream */
+
+/* Points read after the end of each sample, the SoundFont spec demands
+   at least 46 zero valued points there. The interpolation only needs a few. */
+#define DYNAMIC_SAMPLE_GUARD_POINTS 8
+
 typedef struct _fluid_cached_sampledata_t {
+  /* next entry of all_cached_sampledata, or of the shared samples with
+     the same content hash */
   struct _fluid_cached_sampledata_t *next;
 
-  char* filename;
+  char* filename;           /* NULL for the points of a single shared sample */
+  unsigned int hash;        /* content hash of a shared sample */
   time_t modification_time;
   int num_references;
   int mlock;
 
   const short* sampledata;
   unsigned int samplesize;
+  float* float_sampledata;  /* sampledata converted to float, NULL until requested */
+
+  void* map_addr;           /* start of the file mapping, NULL if sampledata was read */
+  size_t map_size;          /* length of the file mapping */
+  int borrowed;             /* sampledata is the memory of a stream, not owned by the cache */
+  int unnamed;              /* read from memory, the file name doesn't identify the data */
 } fluid_cached_sampledata_t;
 
-static fluid_cached_sampledata_t* all_cached_sampledata = NULL;
+static fluid_cached_sampledata_t* all_cached_sampledata = NULL;  /* sample chunks of files */
+static fluid_hashtable_t* shared_sampledata = NULL;   /* content hash -> shared samples */
+static fluid_hashtable_t* cached_sampledata_by_data = NULL;  /* sampledata -> any entry */
 static fluid_mutex_t cached_sampledata_mutex = FLUID_MUTEX_INIT;
+static double cached_sampledata_shared_bytes = 0;  /* bytes saved by shared samples */
 
-static int fluid_cached_sampledata_load(fluid_stream_loader_t * stream, char *filename, unsigned int samplepos,
-  unsigned int samplesize, short **sampledata, int try_mlock)
+/*
+ * Convert little endian sample data as stored in the file to host byte order
+ */
+static void fluid_sampledata_from_le(short *sampledata, size_t samplesize)
 {
-  int original_position;
-  short *loaded_sampledata = NULL;
-  fluid_cached_sampledata_t* cached_sampledata = NULL;
-  time_t modification_time;
+  unsigned char* cbuf;
+  unsigned char hi, lo;
+  size_t i, j;
+  short s;
+  cbuf = (unsigned char*)sampledata;
+  for (i = 0, j = 0; j < samplesize; i++) {
+    lo = cbuf[j++];
+    hi = cbuf[j++];
+    s = (hi << 8) | lo;
+    sampledata[i] = s;
+  }
+}
 
-  fluid_mutex_lock(cached_sampledata_mutex);
+/*
+ * Create the lookup tables of the cache when the first entry is added.
+ * Called with the cache mutex held.
+ */
+static int fluid_cached_sampledata_init_tables(void)
+{
+  if (cached_sampledata_by_data == NULL)
+    cached_sampledata_by_data = new_fluid_hashtable(fluid_direct_hash, NULL);
+  if (shared_sampledata == NULL)
+    shared_sampledata = new_fluid_hashtable(fluid_direct_hash, NULL);
+  if (cached_sampledata_by_data == NULL || shared_sampledata == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return FLUID_FAILED;
+  }
+  return FLUID_OK;
+}
 
-  if (stream->get_modtime(stream, filename, &modification_time) == FLUID_FAILED) {
-    FLUID_LOG(FLUID_WARN, "Unable to read modificaton time of soundfont file.");
-    modification_time = 0;
+/*
+ * Create the float copy of a cached sample chunk, it's shared by all
+ * SoundFonts using the chunk. Called with the cache mutex held.
+ */
+static void fluid_cached_sampledata_make_float(fluid_cached_sampledata_t* cached_sampledata)
+{
+  size_t i, count = cached_sampledata->samplesize / 2;
+  float* data;
+
+  if (cached_sampledata->float_sampledata != NULL)
+    return;
+
+  data = FLUID_ARRAY(float, count);
+  if (data == NULL) {
+    FLUID_LOG(FLUID_WARN, "Out of memory for the float sample data, using 16 bit samples");
+    return;
   }
 
-  for (cached_sampledata = all_cached_sampledata; cached_sampledata; cached_sampledata = cached_sampledata->next) {
-    if (strcmp(filename, cached_sampledata->filename))
-      continue;
-    if (cached_sampledata->modification_time != modification_time)
-      continue;
-    if (cached_sampledata->samplesize != samplesize) {
-      FLUID_LOG(FLUID_ERR, "Cached size of soundfont doesn't match actual size of soundfont (cached: %u. actual: %u)",
-        cached_sampledata->samplesize, samplesize);
-      continue;
-    }
+  for (i = 0; i < count; i++)
+    data[i] = (float) cached_sampledata->sampledata[i];
 
-    if (try_mlock && !cached_sampledata->mlock) {
+  if (cached_sampledata->mlock && fluid_mlock(data, count * sizeof(float)) != 0)
+    FLUID_LOG(FLUID_WARN, "Failed to pin the sample data to RAM; swapping is possible.");
+
+  cached_sampledata->float_sampledata = data;
+}
+
+#ifdef DEFSFONT_USE_MMAP
+/*
+ * Map the sample chunk of a soundfont file read-only. The pages are
+ * backed by the page cache, so they are shared between all processes
+ * using the same file and only read from disk when first touched.
+ * The file is the one the stream reads, only streams of the file loader
+ * reading a regular file can be mapped. Returns NULL if the stream can't
+ * be mapped, the caller then falls back to reading the samples.
+ */
+static short* fluid_cached_sampledata_mmap(fluid_stream_loader_t* stream, char *filename,
+  fluid_long_long_t samplepos, unsigned int samplesize, int prefetch,
+  void **map_addr, size_t *map_size)
+{
+  struct stat buf;
+  long pagesize;
+  off_t offset;
+  void* addr = MAP_FAILED;
+  int fd, opened = FALSE;
+
+  /* The samples are used in place, this only works for little endian
+     16 bit data at an aligned position */
+  if (FLUID_IS_BIG_ENDIAN || (samplepos & 1))
+    return NULL;
+
+  pagesize = sysconf(_SC_PAGESIZE);
+  if (pagesize <= 0 || stream->open != fluid_file_stream_loader_open)
+    return NULL;
+
+  if (!stream->is_open(stream)) {
+    if (stream->open(stream, filename) != FLUID_OK)
+      return NULL;
+    opened = TRUE;
+  }
+
+  fd = fluid_file_stream_loader_fileno(stream);
+
+  /* Pipes and devices can't be mapped. Touching a mapped page past the
+     end of the file raises SIGBUS. */
+  if (fd == -1 || fstat(fd, &buf) == -1 || !S_ISREG(buf.st_mode)
+      || buf.st_size < (off_t) samplepos + (off_t) samplesize) {
+    FLUID_LOG(FLUID_DBG, "Can't map soundfont file %s, reading it instead", filename);
+    goto exit;
+  }
+
+  offset = samplepos - (samplepos % pagesize);
+  *map_size = samplesize + (samplepos - offset);
+  /* the mapping keeps its own reference to the file */
+  addr = mmap(NULL, *map_size, PROT_READ, MAP_SHARED, fd, offset);
+
+  if (addr == MAP_FAILED) {
+    FLUID_LOG(FLUID_WARN, "Failed to map the sample data of %s, reading it instead", filename);
+    goto exit;
+  }
+
+#ifdef MADV_WILLNEED
+  /* Start readahead of the whole chunk in the background */
+  if (prefetch)
+    madvise(addr, *map_size, MADV_WILLNEED);
+#endif
+
+ exit:
+  if (opened)
+    stream->close(stream);
+  if (addr == MAP_FAILED)
+    return NULL;
+  *map_addr = addr;
+  return (short*) ((char*) addr + (samplepos - offset));
+}
+#endif
+
+/*
+ * Read 'size' bytes from a stream, in pieces small enough for the int
+ * size of the read method
+ */
+static int fluid_stream_read_all(fluid_stream_loader_t* stream, void* buffer, fluid_long_long_t size)
+{
+  char* p = (char*) buffer;
+  int count;
+
+  while (size > 0) {
+    count = size < FLUID_STREAM_READ_MAX ? (int) size : FLUID_STREAM_READ_MAX;
+    if (stream->read(stream, p, count) < count)
+      return FLUID_FAILED;
+    p += count;
+    size -= count;
+  }
+  return FLUID_OK;
+}
+
+static int fluid_cached_sampledata_load(fluid_stream_loader_t * stream, char *filename, fluid_long_long_t samplepos,
+  unsigned int samplesize, short **sampledata, float **float_sampledata,
+  int try_mlock, int try_mmap, int mmap_prefetch)
+{
+  void* map_addr = NULL;
+  size_t map_size = 0;
+  fluid_long_long_t original_position;
+  short *loaded_sampledata = NULL;
+  fluid_cached_sampledata_t* cached_sampledata = NULL;
+  time_t modification_time = 0;
+  int borrowed = FALSE, unnamed;
+
+  fluid_mutex_lock(cached_sampledata_mutex);
+
+  if (fluid_cached_sampledata_init_tables() != FLUID_OK)
+    goto error_exit;
+
+  /* Memory backed streams hand out the sample data in place. The cache
+     doesn't share these entries, the memory belongs to the stream. The
+     data they can't hand out is copied, but not shared either: the name
+     of a SoundFont in memory needn't be unique, and there's no
+     modification time to tell two of them apart. */
+  loaded_sampledata = (short*) fluid_stream_map(stream, samplepos, samplesize);
+  unnamed = (loaded_sampledata != NULL);
+  if (unnamed && !FLUID_IS_BIG_ENDIAN && ((size_t) loaded_sampledata & 1) == 0) {
+    borrowed = TRUE;
+    goto loaded;
+  }
+  loaded_sampledata = NULL;
+
+  if (!unnamed && stream->get_modtime(stream, filename, &modification_time) == FLUID_FAILED) {
+    FLUID_LOG(FLUID_WARN, "Unable to read modificaton time of soundfont file.");
+    modification_time = 0;
+  }
+
+  for (cached_sampledata = all_cached_sampledata; !unnamed && cached_sampledata;
+       cached_sampledata = cached_sampledata->next) {
+    if (cached_sampledata->filename == NULL || cached_sampledata->unnamed
+        || strcmp(filename, cached_sampledata->filename))
+      continue;
+    if (cached_sampledata->modification_time != modification_time)
+      continue;
+    if (cached_sampledata->samplesize != samplesize) {
+      FLUID_LOG(FLUID_ERR, "Cached size of soundfont doesn't match actual size of soundfont (cached: %u. actual: %u)",
+        cached_sampledata->samplesize, samplesize);
+      continue;
+    }
+
+    if (try_mlock && !cached_sampledata->mlock) {
       if (fluid_mlock(cached_sampledata->sampledata, samplesize) != 0)
         FLUID_LOG(FLUID_WARN, "Failed to pin the sample data to RAM; swapping is possible.");
-      else
+      else {
         cached_sampledata->mlock = try_mlock;
+        if (cached_sampledata->float_sampledata != NULL)
+          fluid_mlock(cached_sampledata->float_sampledata, (size_t) samplesize * 2);
+      }
     }
 
     cached_sampledata->num_references++;
@@ -613,154 +1200,1743 @@ static int fluid_cached_sampledata_load(fluid_stream_loader_t * stream, char *fi
     goto success_exit;
   }
 
-  original_position = stream->is_open(stream) ? stream->position(stream) : -1;
+#ifdef DEFSFONT_USE_MMAP
+  if (try_mmap) {
+    loaded_sampledata = fluid_cached_sampledata_mmap(stream, filename, samplepos, samplesize,
+                                                     mmap_prefetch, &map_addr, &map_size);
+    if (loaded_sampledata != NULL)
+      goto loaded;
+  }
+#endif
+
+  original_position = stream->is_open(stream) ? fluid_stream_position(stream) : -1;
   if (original_position < 0) {
     if (stream->open(stream, filename) != FLUID_OK) {
       FLUID_LOG(FLUID_ERR, "Can't open soundfont file");
       goto error_exit;
     }
   }
-  else
-    stream->safe_seek_by(stream, -original_position); /* go to initial position */
+  else
+    fluid_stream_seek_by(stream, -original_position); /* go to initial position */
+
+  if (fluid_stream_seek_by(stream, samplepos) == -1) {
+    perror("error");
+    FLUID_LOG(FLUID_ERR, "Failed to seek position in data file");
+    goto error_exit;
+  }
+
+
+  loaded_sampledata = (short*) FLUID_MALLOC(samplesize);
+  if (loaded_sampledata == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    goto error_exit;
+  }
+
+  if (fluid_stream_read_all(stream, loaded_sampledata, samplesize) != FLUID_OK) {
+    FLUID_LOG(FLUID_ERR, "Failed to read sample data");
+    goto error_exit;
+  }
+
+  if (original_position < 0)
+    stream->close(stream);
+  else
+    fluid_stream_seek_by(stream, original_position - fluid_stream_position(stream)); /* go back to the original position */
+
+ loaded:
+  cached_sampledata = (fluid_cached_sampledata_t*) FLUID_MALLOC(sizeof(fluid_cached_sampledata_t));
+  if (cached_sampledata == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory.");
+    goto error_exit;
+  }
+
+  /* Lock the memory to disable paging. It's okay if this fails. It
+     probably means that the user doesn't have to required permission.  */
+  cached_sampledata->mlock = 0;
+  if (try_mlock && !borrowed) {
+    if (fluid_mlock(loaded_sampledata, samplesize) != 0)
+      FLUID_LOG(FLUID_WARN, "Failed to pin the sample data to RAM; swapping is possible.");
+    else
+      cached_sampledata->mlock = try_mlock;
+  }
+
+  /* If this machine is big endian, the sample have to byte swapped  */
+  if (FLUID_IS_BIG_ENDIAN && map_addr == NULL && !borrowed)
+    fluid_sampledata_from_le(loaded_sampledata, samplesize);
+
+  cached_sampledata->filename = (char*) FLUID_MALLOC(strlen(filename) + 1);
+  if (cached_sampledata->filename == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory.");
+    goto error_exit;
+  }
+
+  sprintf(cached_sampledata->filename, "%s", filename);
+  cached_sampledata->hash = 0;
+  cached_sampledata->modification_time = modification_time;
+  cached_sampledata->num_references = 1;
+  cached_sampledata->sampledata = loaded_sampledata;
+  cached_sampledata->samplesize = samplesize;
+  cached_sampledata->float_sampledata = NULL;
+  cached_sampledata->map_addr = map_addr;
+  cached_sampledata->map_size = map_size;
+  cached_sampledata->borrowed = borrowed;
+  cached_sampledata->unnamed = unnamed;
+
+  cached_sampledata->next = all_cached_sampledata;
+  all_cached_sampledata = cached_sampledata;
+  fluid_hashtable_insert(cached_sampledata_by_data, (void*) loaded_sampledata, cached_sampledata);
+
+
+ success_exit:
+  if (float_sampledata != NULL) {
+    fluid_cached_sampledata_make_float(cached_sampledata);
+    *float_sampledata = cached_sampledata->float_sampledata;
+  }
+  fluid_mutex_unlock(cached_sampledata_mutex);
+  *sampledata = loaded_sampledata;
+  return FLUID_OK;
+
+ error_exit:
+  stream->close(stream);
+  if (borrowed)
+    loaded_sampledata = NULL;
+#ifdef DEFSFONT_USE_MMAP
+  if (map_addr != NULL) {
+    if (cached_sampledata != NULL && cached_sampledata->mlock)
+      fluid_munlock(loaded_sampledata, samplesize);
+    munmap(map_addr, map_size);
+  }
+  else
+#endif
+  if (loaded_sampledata != NULL) {
+    FLUID_FREE(loaded_sampledata);
+  }
+
+  if (cached_sampledata != NULL) {
+    if (cached_sampledata->filename != NULL) {
+      FLUID_FREE(cached_sampledata->filename);
+    }
+    FLUID_FREE(cached_sampledata);
+  }
+
+  fluid_mutex_unlock(cached_sampledata_mutex);
+  *sampledata = NULL;
+  return FLUID_FAILED;
+}
+
+static int fluid_cached_sampledata_unload(const short *sampledata)
+{
+  fluid_cached_sampledata_t* cached_sampledata = NULL;
+  fluid_cached_sampledata_t *head, **prev;
+  void* key;
+
+  fluid_mutex_lock(cached_sampledata_mutex);
+
+  if (cached_sampledata_by_data != NULL)
+    cached_sampledata = fluid_hashtable_lookup(cached_sampledata_by_data, sampledata);
+
+  if (cached_sampledata == NULL) {
+    FLUID_LOG(FLUID_ERR, "Trying to free sampledata not found in cache.");
+    fluid_mutex_unlock(cached_sampledata_mutex);
+    return FLUID_FAILED;
+  }
+
+  if (cached_sampledata->filename == NULL && cached_sampledata->num_references > 1)
+    cached_sampledata_shared_bytes -= cached_sampledata->samplesize;
+  cached_sampledata->num_references--;
+
+  if (cached_sampledata->num_references == 0) {
+    /* Unlink from the file list or the chain of its content hash */
+    if (cached_sampledata->filename != NULL) {
+      prev = &all_cached_sampledata;
+      while (*prev != cached_sampledata)
+        prev = &(*prev)->next;
+      *prev = cached_sampledata->next;
+    }
+    else {
+      key = FLUID_UINT_TO_POINTER(cached_sampledata->hash);
+      head = fluid_hashtable_lookup(shared_sampledata, key);
+      if (head == cached_sampledata) {
+        if (head->next != NULL)
+          fluid_hashtable_replace(shared_sampledata, key, head->next);
+        else
+          fluid_hashtable_remove(shared_sampledata, key);
+      }
+      else {
+        prev = &head->next;
+        while (*prev != cached_sampledata)
+          prev = &(*prev)->next;
+        *prev = cached_sampledata->next;
+      }
+    }
+    fluid_hashtable_remove(cached_sampledata_by_data, sampledata);
+
+    if (cached_sampledata->mlock)
+      fluid_munlock(cached_sampledata->sampledata, cached_sampledata->samplesize);
+#ifdef DEFSFONT_USE_MMAP
+    if (cached_sampledata->map_addr != NULL)
+      munmap(cached_sampledata->map_addr, cached_sampledata->map_size);
+    else
+#endif
+    if (!cached_sampledata->borrowed)
+      FLUID_FREE((short*) cached_sampledata->sampledata);
+    if (cached_sampledata->float_sampledata != NULL) {
+      if (cached_sampledata->mlock)
+        fluid_munlock(cached_sampledata->float_sampledata, (size_t) cached_sampledata->samplesize * 2);
+      FLUID_FREE(cached_sampledata->float_sampledata);
+    }
+    FLUID_FREE(cached_sampledata->filename);
+    FLUID_FREE(cached_sampledata);
+
+    /* The tables go with the last entry */
+    if (fluid_hashtable_size(cached_sampledata_by_data) == 0) {
+      delete_fluid_hashtable(cached_sampledata_by_data);
+      delete_fluid_hashtable(shared_sampledata);
+      cached_sampledata_by_data = NULL;
+      shared_sampledata = NULL;
+    }
+  }
+
+  fluid_mutex_unlock(cached_sampledata_mutex);
+  return FLUID_OK;
+}
+
+/*
+ * Share the points of a sample with the identical samples of all loaded
+ * SoundFonts. 'data' holds the 'count' points from the start to the end
+ * of the sample. The returned copy is a cache entry of its own, keyed by
+ * the content of the points, with zero guard points rebuilt after them.
+ * It's released with fluid_cached_sampledata_unload().
+ */
+static short* fluid_cached_sampledata_share(const short* data, unsigned int count,
+  int try_mlock, float** float_sampledata)
+{
+  fluid_cached_sampledata_t *cached_sampledata, *head;
+  const unsigned char* p = (const unsigned char*) data;
+  unsigned int size = (count + DYNAMIC_SAMPLE_GUARD_POINTS) * sizeof(short);
+  unsigned int hash = 2166136261u;
+  unsigned int i;
+  short* copy;
+
+  /* 32 bit FNV-1a, equal hashes are confirmed by comparing the points */
+  for (i = 0; i < count * sizeof(short); i++)
+    hash = (hash ^ p[i]) * 16777619u;
+
+  fluid_mutex_lock(cached_sampledata_mutex);
+
+  if (fluid_cached_sampledata_init_tables() != FLUID_OK) {
+    fluid_mutex_unlock(cached_sampledata_mutex);
+    return NULL;
+  }
+
+  head = fluid_hashtable_lookup(shared_sampledata, FLUID_UINT_TO_POINTER(hash));
+  for (cached_sampledata = head; cached_sampledata; cached_sampledata = cached_sampledata->next) {
+    if (cached_sampledata->samplesize == size
+        && FLUID_MEMCMP(cached_sampledata->sampledata, data, count * sizeof(short)) == 0) {
+      cached_sampledata->num_references++;
+      cached_sampledata_shared_bytes += size;
+      goto success_exit;
+    }
+  }
+
+  cached_sampledata = FLUID_NEW(fluid_cached_sampledata_t);
+  copy = FLUID_MALLOC(size);
+  if (cached_sampledata == NULL || copy == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    FLUID_FREE(cached_sampledata);
+    FLUID_FREE(copy);
+    fluid_mutex_unlock(cached_sampledata_mutex);
+    return NULL;
+  }
+  FLUID_MEMCPY(copy, data, count * sizeof(short));
+  FLUID_MEMSET(copy + count, 0, DYNAMIC_SAMPLE_GUARD_POINTS * sizeof(short));
+
+  FLUID_MEMSET(cached_sampledata, 0, sizeof(fluid_cached_sampledata_t));
+  cached_sampledata->hash = hash;
+  cached_sampledata->num_references = 1;
+  cached_sampledata->sampledata = copy;
+  cached_sampledata->samplesize = size;
+  if (try_mlock && fluid_mlock(copy, size) == 0)
+    cached_sampledata->mlock = try_mlock;
+
+  cached_sampledata->next = head;
+  fluid_hashtable_replace(shared_sampledata, FLUID_UINT_TO_POINTER(hash), cached_sampledata);
+  fluid_hashtable_insert(cached_sampledata_by_data, copy, cached_sampledata);
+
+ success_exit:
+  if (float_sampledata != NULL) {
+    fluid_cached_sampledata_make_float(cached_sampledata);
+    *float_sampledata = cached_sampledata->float_sampledata;
+  }
+  fluid_mutex_unlock(cached_sampledata_mutex);
+  return (short*) cached_sampledata->sampledata;
+}
+
+/**
+ * Get the amount of sample memory saved by sharing identical samples.
+ * @return Number of bytes of sample data which would be loaded more than
+ *   once without the synth.sample-dedup setting. Samples are shared by
+ *   the SoundFonts of all synthesizers in the process, so the count
+ *   covers all of them.
+ * @since 1.1.7
+ */
+double fluid_get_shared_sample_bytes(void)
+{
+  double bytes;
+
+  fluid_mutex_lock(cached_sampledata_mutex);
+  bytes = cached_sampledata_shared_bytes;
+  fluid_mutex_unlock(cached_sampledata_mutex);
+  return bytes;
+}
+
+
+
+
+/***************************************************************
+ *
+ *                    COMPRESSED SAMPLES
+ *
+ * SoundFonts of version 3 (SF3) store samples as Ogg Vorbis streams,
+ * one per sample, flagged with FLUID_SAMPLETYPE_OGG_VORBIS. The start
+ * and end of such a sample are byte positions in the sample chunk, its
+ * loop points are relative to the start of the decoded sample. Samples
+ * are decoded to 16 bit points with libsndfile, all at load time on
+ * synth.cpu-cores threads, or one by one by the loader thread with
+ * dynamic sample loading, which keeps unused samples compressed.
+ */
+
+/* Zero points after the end of a decoded sample, for the interpolation */
+#define COMPRESSED_SAMPLE_GUARD_POINTS 8
+
+#if LIBSNDFILE_HASVORBIS
+
+typedef struct {
+  const char* data;
+  sf_count_t size;
+  sf_count_t pos;
+} fluid_vorbis_data_t;
+
+static sf_count_t fluid_vorbis_get_filelen(void* user_data)
+{
+  return ((fluid_vorbis_data_t*) user_data)->size;
+}
+
+static sf_count_t fluid_vorbis_seek(sf_count_t offset, int whence, void* user_data)
+{
+  fluid_vorbis_data_t* vdata = user_data;
+
+  switch (whence) {
+  case SEEK_SET: break;
+  case SEEK_CUR: offset += vdata->pos; break;
+  case SEEK_END: offset += vdata->size; break;
+  default: return -1;
+  }
+
+  if (offset < 0 || offset > vdata->size)
+    return -1;
+  vdata->pos = offset;
+  return offset;
+}
+
+static sf_count_t fluid_vorbis_read(void* ptr, sf_count_t count, void* user_data)
+{
+  fluid_vorbis_data_t* vdata = user_data;
+
+  if (count > vdata->size - vdata->pos)
+    count = vdata->size - vdata->pos;
+  FLUID_MEMCPY(ptr, vdata->data + vdata->pos, count);
+  vdata->pos += count;
+  return count;
+}
+
+static sf_count_t fluid_vorbis_tell(void* user_data)
+{
+  return ((fluid_vorbis_data_t*) user_data)->pos;
+}
+
+/*
+ * Decode an Ogg Vorbis compressed sample of 'size' bytes. Returns a new
+ * buffer of 16 bit points followed by guard points, or NULL on errors.
+ */
+static short* fluid_compressed_sample_decode(const char* name, const void* data,
+  unsigned int size, unsigned int* frames)
+{
+  SF_VIRTUAL_IO sfvio = {
+    fluid_vorbis_get_filelen,
+    fluid_vorbis_seek,
+    fluid_vorbis_read,
+    NULL,
+    fluid_vorbis_tell
+  };
+  fluid_vorbis_data_t vdata;
+  SNDFILE* sndfile;
+  SF_INFO info;
+  short* decoded;
+
+  vdata.data = data;
+  vdata.size = size;
+  vdata.pos = 0;
+  FLUID_MEMSET(&info, 0, sizeof(info));
+
+  sndfile = sf_open_virtual(&sfvio, SFM_READ, &info, &vdata);
+  if (sndfile == NULL) {
+    FLUID_LOG(FLUID_ERR, "Failed to open compressed sample %s: %s", name, sf_strerror(NULL));
+    return NULL;
+  }
+
+  if (info.channels != 1 || info.frames < 8 || info.frames > 0x7fffffff - COMPRESSED_SAMPLE_GUARD_POINTS) {
+    FLUID_LOG(FLUID_ERR, "Compressed sample %s isn't a mono sample", name);
+    sf_close(sndfile);
+    return NULL;
+  }
+
+  decoded = FLUID_ARRAY(short, info.frames + COMPRESSED_SAMPLE_GUARD_POINTS);
+  if (decoded == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    sf_close(sndfile);
+    return NULL;
+  }
+  FLUID_MEMSET(decoded + info.frames, 0, COMPRESSED_SAMPLE_GUARD_POINTS * sizeof(short));
+
+  if (sf_readf_short(sndfile, decoded, info.frames) < info.frames) {
+    FLUID_LOG(FLUID_ERR, "Failed to decode compressed sample %s", name);
+    sf_close(sndfile);
+    FLUID_FREE(decoded);
+    return NULL;
+  }
+
+  sf_close(sndfile);
+  *frames = (unsigned int) info.frames;
+  return decoded;
+}
+
+#endif /* LIBSNDFILE_HASVORBIS */
+
+/*
+ * Decode the compressed bytes of a sample. The sample's positions are
+ * made relative to the returned buffer, they're only touched while no
+ * voice can use the sample (its data pointer is NULL).
+ */
+static short* fluid_compressed_sample_read(fluid_sample_t* sample, const void* data,
+  unsigned int size)
+{
+#if LIBSNDFILE_HASVORBIS
+  unsigned int frames;
+  short* decoded;
+
+  decoded = fluid_compressed_sample_decode(sample->name, data, size, &frames);
+  if (decoded == NULL)
+    return NULL;
+
+  sample->start = 0;
+  sample->end = frames - 1;
+
+  /* The loop was only checked against the compressed size */
+  if (sample->loopend > frames || sample->loopstart >= sample->loopend) {
+    if (frames >= 20) {
+      sample->loopstart = 8;
+      sample->loopend = frames - 8;
+    } else {
+      sample->loopstart = 1;
+      sample->loopend = frames - 1;
+    }
+  }
+  return decoded;
+#else
+  return NULL;
+#endif
+}
+
+typedef struct {
+  fluid_defsfont_t* sfont;
+  fluid_sample_t** samples;
+  int count;
+  int next;            /* index of the next sample to decode */
+} fluid_sample_decoder_t;
+
+static void fluid_sample_decoder_thread(void* data)
+{
+  fluid_sample_decoder_t* decoder = data;
+  fluid_defsfont_t* sfont = decoder->sfont;
+  fluid_sample_t* sample;
+  unsigned int size;
+  short* decoded;
+  int i;
+
+  while ((i = fluid_atomic_int_exchange_and_add(&decoder->next, 1)) < decoder->count) {
+    sample = decoder->samples[i];
+
+    /* The end position is the last byte of the compressed sample */
+    size = sample->end + 1 - sample->start;
+    if (sample->start + size > sfont->samplesize)
+      size = sfont->samplesize - sample->start;
+
+    decoded = fluid_compressed_sample_read(sample,
+                                           (const char*) sfont->sampledata + sample->start, size);
+    if (decoded == NULL) {
+      sample->valid = 0;
+      continue;
+    }
+
+    sample->data = decoded;
+    fluid_voice_optimize_sample(sample);
+  }
+}
+
+/*
+ * Decode all compressed samples of a SoundFont whose sample chunk is
+ * loaded. The samples are spread over synth.cpu-cores threads, the
+ * calling thread being one of them.
+ */
+static int fluid_defsfont_decode_samples(fluid_defsfont_t* sfont)
+{
+  fluid_sample_decoder_t decoder;
+  fluid_thread_t** threads;
+  fluid_sample_t* sample;
+  fluid_list_t* list;
+  int i, nthreads;
+
+  decoder.sfont = sfont;
+  decoder.count = 0;
+  decoder.next = 0;
+  for (list = sfont->sample; list; list = fluid_list_next(list)) {
+    sample = fluid_list_get(list);
+    if ((sample->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS) && sample->valid)
+      decoder.count++;
+  }
+  if (decoder.count == 0)
+    return FLUID_OK;
+
+  decoder.samples = FLUID_ARRAY(fluid_sample_t*, decoder.count);
+  if (decoder.samples == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return FLUID_FAILED;
+  }
+  i = 0;
+  for (list = sfont->sample; list; list = fluid_list_next(list)) {
+    sample = fluid_list_get(list);
+    if ((sample->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS) && sample->valid)
+      decoder.samples[i++] = sample;
+  }
+
+  nthreads = sfont->cpu_cores - 1;
+  if (nthreads > decoder.count - 1)
+    nthreads = decoder.count - 1;
+
+  threads = nthreads > 0 ? FLUID_ARRAY(fluid_thread_t*, nthreads) : NULL;
+  if (threads == NULL)
+    nthreads = 0;
+  for (i = 0; i < nthreads; i++) {
+    threads[i] = new_fluid_thread("sfdecode", fluid_sample_decoder_thread, &decoder, 0, FALSE);
+    if (threads[i] == NULL)
+      break;
+  }
+  nthreads = i;
+
+  fluid_sample_decoder_thread(&decoder);
+
+  for (i = 0; i < nthreads; i++) {
+    fluid_thread_join(threads[i]);
+    delete_fluid_thread(threads[i]);
+  }
+
+  FLUID_FREE(threads);
+  FLUID_FREE(decoder.samples);
+  return FLUID_OK;
+}
+
+
+/***************************************************************
+ *
+ *                    DYNAMIC SAMPLE LOADER
+ *
+ * With synth.dynamic-sample-loading, no sample data is loaded with the
+ * SoundFont. Selecting a preset on a channel marks its samples as needed,
+ * and a loader thread reads them in the background. A sample's data
+ * pointer stays NULL until it is resident, and noteon skips such zones,
+ * so a preset is silent (not ready) until all of its samples are loaded.
+ * Samples no longer used by any selected preset or playing voice are
+ * unloaded again by the same thread.
+ *
+ * Presets are selected in the synthesis context, which must not wait for
+ * the loader thread. The preset references of a sample are counted
+ * atomically, and samples whose state may have changed are pushed to a
+ * lock-free queue of their SoundFont's loader thread, which only looks
+ * at the queued samples. The loader thread only takes loader_mutex to go
+ * to sleep, so it's only locked to wake up a sleeping thread. To unload
+ * a sample, the loader thread atomically flags it as unloading while no
+ * preset uses it, noteon skips flagged samples.
+ *
+ * With synth.sample-cache-budget, unused samples are kept in memory, so
+ * selecting their presets again is instant. Only when the SoundFonts of a
+ * loader hold more sample data than the budget, the samples which are
+ * unused for the longest time are unloaded (see fluid_sample_pool_reclaim).
+ * The loader threads keep the unused samples in the LRU list of the pool.
+ */
+
+/* Added to the preset references of a sample while it's being unloaded */
+#define DYNAMIC_SAMPLE_UNLOADING  (1 << 24)
+
+struct _fluid_dynamic_sample_t {
+  fluid_defsfont_t* sfont;
+  fluid_sample_t* sample;
+  unsigned int offset;  /* position of the first sample point in the sample chunk */
+  unsigned int size;    /* bytes of a compressed sample, 0 if not compressed */
+  int preset_refs;      /* number of channels having a preset selected which uses the sample (atomic) */
+  int failed;           /* TRUE if the sample data could not be read */
+  int bytes;            /* size of the loaded sample data */
+  int evict;            /* set by fluid_sample_pool_reclaim() to request unloading (atomic) */
+  int queued;           /* TRUE while in the queue of the loader thread (atomic) */
+  fluid_dynamic_sample_t* next;  /* next sample in the queue */
+  int unused;           /* TRUE while in the LRU list of the pool */
+  fluid_dynamic_sample_t* lru_prev;  /* LRU list, protected by the pool mutex */
+  fluid_dynamic_sample_t* lru_next;
+};
+
+/* The sample is used by a voice. Voices take their references in the
+   synthesis context, the loader thread only reads the count. */
+#define fluid_dynamic_sample_in_use(_sample) \
+  (fluid_atomic_int_get((int*) &(_sample)->refcount) != 0)
+
+/*
+ * Wake up the loader thread of a SoundFont if it sleeps. The thread
+ * announces its sleep before checking its queue a last time, so a sample
+ * queued before that is seen without signal.
+ */
+static void fluid_defsfont_wake_loader(fluid_defsfont_t* sfont)
+{
+  if (fluid_atomic_int_get(&sfont->loader_sleeping)) {
+    fluid_cond_mutex_lock(sfont->loader_mutex);
+    fluid_cond_signal(sfont->loader_cond);
+    fluid_cond_mutex_unlock(sfont->loader_mutex);
+  }
+}
+
+/*
+ * Push a sample to the queue of its SoundFont's loader thread, unless
+ * it's queued already. Lock-free, the thread has to be woken up with
+ * fluid_defsfont_wake_loader() afterwards.
+ */
+static void fluid_dynamic_sample_queue(fluid_dynamic_sample_t* dsample)
+{
+  fluid_defsfont_t* sfont = dsample->sfont;
+  fluid_dynamic_sample_t* head;
+
+  if (!fluid_atomic_int_compare_and_exchange(&dsample->queued, FALSE, TRUE))
+    return;
+
+  do {
+    head = fluid_atomic_pointer_get(&sfont->loader_queue);
+    dsample->next = head;
+  } while (!fluid_atomic_pointer_compare_and_exchange(&sfont->loader_queue, head, dsample));
+}
+
+/*
+ * Take all queued samples of a SoundFont. Called by its loader thread.
+ */
+static fluid_dynamic_sample_t* fluid_defsfont_take_queue(fluid_defsfont_t* sfont)
+{
+  fluid_dynamic_sample_t* head;
+
+  do {
+    head = fluid_atomic_pointer_get(&sfont->loader_queue);
+  } while (head != NULL
+           && !fluid_atomic_pointer_compare_and_exchange(&sfont->loader_queue, head, NULL));
+  return head;
+}
+
+/*
+ * The sample memory shared by the SoundFonts of one loader
+ */
+struct _fluid_sample_pool_t {
+  fluid_mutex_t mutex;     /* protects the fields below, taken before any loader_mutex */
+  int refcount;
+  double budget;           /* bytes, 0 if unlimited */
+  double used;             /* bytes of loaded dynamic samples */
+  double evicting;         /* bytes of samples marked for unloading */
+  fluid_dynamic_sample_t* lru_head;  /* loaded unused samples, least recently used first */
+  fluid_dynamic_sample_t* lru_tail;
+};
+
+fluid_sample_pool_t* new_fluid_sample_pool(double budget)
+{
+  fluid_sample_pool_t* pool = FLUID_NEW(fluid_sample_pool_t);
+  if (pool == NULL)
+    return NULL;
+
+  fluid_mutex_init(pool->mutex);
+  pool->refcount = 1;
+  pool->budget = budget;
+  pool->used = 0.0;
+  pool->evicting = 0.0;
+  pool->lru_head = NULL;
+  pool->lru_tail = NULL;
+  return pool;
+}
+
+void fluid_sample_pool_ref(fluid_sample_pool_t* pool)
+{
+  if (pool != NULL)
+    fluid_atomic_int_inc(&pool->refcount);
+}
+
+void fluid_sample_pool_unref(fluid_sample_pool_t* pool)
+{
+  if (pool != NULL && fluid_atomic_int_dec_and_test(&pool->refcount)) {
+    fluid_mutex_destroy(pool->mutex);
+    FLUID_FREE(pool);
+  }
+}
+
+double fluid_sample_pool_get_budget(fluid_sample_pool_t* pool)
+{
+  return pool != NULL ? pool->budget : 0.0;
+}
+
+static void fluid_sample_pool_add_bytes(fluid_sample_pool_t* pool, double bytes)
+{
+  if (pool == NULL)
+    return;
+  fluid_mutex_lock(pool->mutex);
+  pool->used += bytes;
+  fluid_mutex_unlock(pool->mutex);
+}
+
+/* Pool mutex held */
+static void fluid_sample_pool_unlink(fluid_sample_pool_t* pool, fluid_dynamic_sample_t* dsample)
+{
+  if (!dsample->unused)
+    return;
+  if (dsample->lru_prev) dsample->lru_prev->lru_next = dsample->lru_next;
+  else pool->lru_head = dsample->lru_next;
+  if (dsample->lru_next) dsample->lru_next->lru_prev = dsample->lru_prev;
+  else pool->lru_tail = dsample->lru_prev;
+  dsample->lru_prev = dsample->lru_next = NULL;
+  dsample->unused = FALSE;
+}
+
+/* Pool mutex held */
+static void fluid_sample_pool_clear_evict(fluid_sample_pool_t* pool, fluid_dynamic_sample_t* dsample)
+{
+  if (fluid_atomic_int_get(&dsample->evict)) {
+    fluid_atomic_int_set(&dsample->evict, FALSE);
+    pool->evicting -= dsample->bytes;
+  }
+}
+
+/*
+ * A loaded sample is used again (or unloaded), take it off the LRU list
+ * and drop a pending eviction. Called by loader threads.
+ */
+static void fluid_sample_pool_acquire(fluid_sample_pool_t* pool, fluid_dynamic_sample_t* dsample)
+{
+  if (pool == NULL)
+    return;
+  fluid_mutex_lock(pool->mutex);
+  fluid_sample_pool_unlink(pool, dsample);
+  fluid_sample_pool_clear_evict(pool, dsample);
+  fluid_mutex_unlock(pool->mutex);
+}
+
+/*
+ * A loaded sample is no longer used, make it the most recently used one
+ * of the LRU list. Called by loader threads.
+ */
+static void fluid_sample_pool_release(fluid_sample_pool_t* pool, fluid_dynamic_sample_t* dsample)
+{
+  if (pool == NULL)
+    return;
+  fluid_mutex_lock(pool->mutex);
+  fluid_sample_pool_unlink(pool, dsample);
+  dsample->lru_prev = pool->lru_tail;
+  if (pool->lru_tail) pool->lru_tail->lru_next = dsample;
+  else pool->lru_head = dsample;
+  pool->lru_tail = dsample;
+  dsample->unused = TRUE;
+  fluid_mutex_unlock(pool->mutex);
+}
+
+/*
+ * Request unloading of the least recently used samples until the pool
+ * is back within its budget. The samples are only marked and queued to
+ * the loader thread of their SoundFont, which unloads them (or clears
+ * the mark if the sample got used again). Samples used since they were
+ * released are just dropped from the list, the loader thread releases
+ * them again when they're unused. Called by loader threads.
+ */
+static void fluid_sample_pool_reclaim(fluid_sample_pool_t* pool)
+{
+  fluid_dynamic_sample_t* dsample;
+  double excess;
+
+  if (pool == NULL || pool->budget <= 0.0)
+    return;
+
+  fluid_mutex_lock(pool->mutex);
+  excess = pool->used - pool->evicting - pool->budget;
+
+  while (excess > 0.0 && pool->lru_head != NULL) {
+    dsample = pool->lru_head;
+    fluid_sample_pool_unlink(pool, dsample);
+    if (fluid_atomic_int_get(&dsample->preset_refs) != 0
+        || fluid_dynamic_sample_in_use(dsample->sample))
+      continue;
+
+    fluid_atomic_int_set(&dsample->evict, TRUE);
+    pool->evicting += dsample->bytes;
+    excess -= dsample->bytes;
+
+    fluid_dynamic_sample_queue(dsample);
+    fluid_defsfont_wake_loader(dsample->sfont);
+  }
+  fluid_mutex_unlock(pool->mutex);
+}
+
+/*
+ * Forget the samples of a SoundFont whose loader thread is stopped
+ */
+static void fluid_sample_pool_remove_sfont(fluid_sample_pool_t* pool, fluid_defsfont_t* sfont)
+{
+  fluid_list_t* list;
+  fluid_sample_t* sample;
+
+  if (pool == NULL || !sfont->dynamic_samples)
+    return;
+  fluid_mutex_lock(pool->mutex);
+  for (list = sfont->sample; list; list = fluid_list_next(list)) {
+    sample = fluid_list_get(list);
+    if (sample->userdata != NULL) {
+      fluid_sample_pool_unlink(pool, sample->userdata);
+      fluid_sample_pool_clear_evict(pool, sample->userdata);
+    }
+  }
+  fluid_mutex_unlock(pool->mutex);
+}
+
+static int fluid_dynamic_sample_notify(fluid_sample_t* sample, int reason)
+{
+  fluid_dynamic_sample_t* dsample = sample->userdata;
+  fluid_defsfont_t* sfont = dsample->sfont;
+
+  /* The last voice using the sample is gone, it may be unloaded now.
+     Also while the loader thread unloads it, it may have seen the voice. */
+  if (reason == FLUID_SAMPLE_DONE
+      && fluid_atomic_int_get(&dsample->preset_refs) % DYNAMIC_SAMPLE_UNLOADING == 0) {
+    fluid_dynamic_sample_queue(dsample);
+    fluid_defsfont_wake_loader(sfont);
+  }
+  return FLUID_OK;
+}
+
+/*
+ * Can a voice start on the sample? Dynamic samples being unloaded can't,
+ * even while their data is still there.
+ */
+static int fluid_dynamic_sample_is_resident(fluid_sample_t* sample)
+{
+  fluid_dynamic_sample_t* dsample;
+
+  if (fluid_atomic_pointer_get(&sample->data) == NULL)
+    return FALSE;
+  if (!fluid_sample_is_ext(sample)
+      || fluid_sample_ext(sample)->notify != fluid_dynamic_sample_notify)
+    return TRUE;
+  dsample = sample->userdata;
+  return fluid_atomic_int_get(&dsample->preset_refs) < DYNAMIC_SAMPLE_UNLOADING;
+}
+
+/*
+ * Take a reference to a sample a voice is about to start on, FALSE if it
+ * can't play. fluid_synth_start() plays presets that no channel has
+ * selected, so the preset references don't keep the sample loaded. The
+ * reference is taken before checking that the sample is resident, and the
+ * loader thread checks the references after flagging the sample as
+ * unloading, so one of them sees the other. Release it with
+ * fluid_sample_decr_ref() once the voice holds its own.
+ */
+static int fluid_dynamic_sample_acquire(fluid_sample_t* sample)
+{
+  if (!fluid_sample_is_ext(sample)
+      || fluid_sample_ext(sample)->notify != fluid_dynamic_sample_notify) {
+    if (sample->data == NULL)
+      return FALSE;
+    fluid_sample_incr_ref(sample);
+    return TRUE;
+  }
+
+  fluid_atomic_int_inc((int*) &sample->refcount);
+  if (fluid_dynamic_sample_is_resident(sample))
+    return TRUE;
+
+  /* Queues the sample again if the loader thread saw the reference */
+  fluid_sample_decr_ref(sample);
+  return FALSE;
+}
+
+/*
+ * Prepare a freshly imported sample for dynamic loading. The sample
+ * positions are made relative to the sample's own data buffer.
+ */
+static int fluid_dynamic_sample_init(fluid_defsfont_t* sfont, fluid_sample_t* sample)
+{
+  fluid_dynamic_sample_t* dsample = FLUID_NEW(fluid_dynamic_sample_t);
+  if (dsample == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return FLUID_FAILED;
+  }
+
+  dsample->sfont = sfont;
+  dsample->sample = sample;
+  dsample->offset = sample->start;
+  dsample->size = 0;
+  dsample->preset_refs = 0;
+  dsample->failed = FALSE;
+  dsample->bytes = 0;
+  dsample->evict = FALSE;
+  dsample->queued = FALSE;
+  dsample->next = NULL;
+  dsample->unused = FALSE;
+  dsample->lru_prev = NULL;
+  dsample->lru_next = NULL;
+
+  /* Compressed samples get their positions when decoded */
+  if (sample->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS) {
+    dsample->size = sample->end + 1 - sample->start;
+    sample->start = 0;
+    sample->end = 0;
+    sample->data = NULL;
+    sample->userdata = dsample;
+    fluid_sample_ext(sample)->notify = fluid_dynamic_sample_notify;
+    return FLUID_OK;
+  }
+
+  sample->end -= sample->start;
+  sample->loopstart -= sample->start;
+  sample->loopend -= sample->start;
+  sample->start = 0;
+  sample->data = NULL;
+  sample->userdata = dsample;
+  fluid_sample_ext(sample)->notify = fluid_dynamic_sample_notify;
+  return FLUID_OK;
+}
+
+/*
+ * Read the first points of a sample into a new buffer of 'size' points.
+ * 'offset' is the position of the sample in the sample chunk.
+ */
+static short* fluid_defsfont_read_sample(fluid_defsfont_t* sfont, fluid_stream_loader_t* stream,
+  fluid_sample_t* sample, unsigned int offset, unsigned int size)
+{
+  unsigned int count = sfont->samplesize / 2 - offset;
+  fluid_long_long_t pos = sfont->samplepos + 2 * (fluid_long_long_t) offset;
+  short* data;
+
+  /* The last sample of the chunk may lack the guard points */
+  if (count > size)
+    count = size;
+
+  data = FLUID_ARRAY(short, size);
+  if (data == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return NULL;
+  }
+  FLUID_MEMSET(data, 0, size * sizeof(short));
+
+  if (fluid_stream_seek_by(stream, pos - fluid_stream_position(stream)) == -1
+      || fluid_stream_read_all(stream, data, 2 * (fluid_long_long_t) count) != FLUID_OK) {
+    FLUID_LOG(FLUID_ERR, "Failed to read data of sample %s", sample->name);
+    FLUID_FREE(data);
+    return NULL;
+  }
+
+  if (FLUID_IS_BIG_ENDIAN)
+    fluid_sampledata_from_le(data, count * 2);
+
+  return data;
+}
+
+/*
+ * With synth.sample-dedup, move the points of a sample out of the sample
+ * chunk to a cache entry shared with identical samples of other
+ * SoundFonts. Only the points from the start to the end of the sample
+ * are compared, whatever follows them in the chunk. The sample positions
+ * are made relative to that entry, which has guard points after the end
+ * of the sample.
+ */
+static int fluid_defsfont_share_sample(fluid_defsfont_t* sfont, fluid_sample_t* sample)
+{
+  unsigned int count, avail;
+  float* float_data = NULL;
+  short *block = NULL, *shared;
+
+  if (!sample->valid) {
+    sample->data = NULL;
+    fluid_sample_ext(sample)->float_data = NULL;
+    return FLUID_OK;
+  }
+
+  count = sample->end + 1 - sample->start;
+  avail = (sample->start < sfont->samplesize / 2) ? sfont->samplesize / 2 - sample->start : 0;
+
+  /* Points past the end of the chunk read as zero */
+  if (count > avail) {
+    block = FLUID_ARRAY(short, count);
+    if (block == NULL) {
+      FLUID_LOG(FLUID_ERR, "Out of memory");
+      return FLUID_FAILED;
+    }
+    FLUID_MEMSET(block, 0, count * sizeof(short));
+    FLUID_MEMCPY(block, sfont->sampledata + sample->start, avail * sizeof(short));
+  }
+
+  shared = fluid_cached_sampledata_share(block ? block : sfont->sampledata + sample->start,
+                                         count, sfont->mlock,
+                                         sfont->float_samples ? &float_data : NULL);
+  if (block != NULL)
+    FLUID_FREE(block);
+  if (shared == NULL)
+    return FLUID_FAILED;
+
+  sample->data = shared;
+  fluid_sample_ext(sample)->float_data = float_data;
+  sample->end -= sample->start;
+  sample->loopstart -= sample->start;
+  sample->loopend -= sample->start;
+  sample->start = 0;
+  return FLUID_OK;
+}
+
+/*
+ * Band-limited resampling of sample points, for the copies of
+ * synth.sample-mipmaps and synth.resample-samples. The zero crossings of
+ * the low-pass filter on either side of a point, the resolution of the
+ * filter table and the cutoff relative to the lower of the two rates.
+ */
+#define RESAMPLE_FILTER_ZEROS  6
+#define RESAMPLE_FILTER_RES    256
+#define RESAMPLE_CUTOFF        0.45
+
+/*
+ * Fill the low-pass filter table, a Hann windowed sinc in points of the
+ * lower rate, sampled RESAMPLE_FILTER_RES times per point.
+ */
+static double* fluid_resample_filter_new(int* size)
+{
+  double width = RESAMPLE_FILTER_ZEROS / (2.0 * RESAMPLE_CUTOFF);
+  double* filter;
+  double v, x;
+  int i;
+
+  *size = (int) (width * RESAMPLE_FILTER_RES) + 2;
+  filter = FLUID_ARRAY(double, *size);
+  if (filter == NULL)
+    return NULL;
+
+  for (i = 0; i < *size; i++) {
+    v = (double) i / RESAMPLE_FILTER_RES;
+    if (v >= width) {
+      filter[i] = 0.0;
+      continue;
+    }
+    x = 2.0 * RESAMPLE_CUTOFF * v * M_PI;
+    filter[i] = (i == 0) ? 1.0 : sin(x) / x;
+    filter[i] *= 0.5 * (1.0 + cos(M_PI * v / width));
+  }
+  return filter;
+}
+
+/*
+ * Compute count points of a sample at ratio times its rate. Point i is
+ * at anchor + (i - anchor_index) / ratio in the sample. The points from
+ * loop_first to loop_last are filtered from the repeated sample loop, so
+ * that they loop seamlessly, pass loop_last < loop_first for none.
+ * float_data may be NULL.
+ */
+static void fluid_resample_points(const fluid_sample_t* sample, double ratio,
+                                  int anchor, int anchor_index, int loop_first, int loop_last,
+                                  const double* filter, int filter_size,
+                                  short* data, float* float_data, int count)
+{
+  int looplen = sample->loopend - sample->loopstart;
+  double scale = (ratio < 1.0) ? ratio : 1.0;
+  double width = RESAMPLE_FILTER_ZEROS / (2.0 * RESAMPLE_CUTOFF) / scale;
+  double x, v, f, w, sum, norm;
+  int i, t, p, first, last;
+
+  for (i = 0; i < count; i++) {
+    x = anchor + (i - anchor_index) / ratio;
+    v = ceil(x - width);
+    first = (int) v;
+    v = floor(x + width);
+    last = (int) v;
+    sum = norm = 0.0;
+
+    for (t = first; t <= last; t++) {
+      /* filter value, linearly interpolated from the table */
+      f = fabs(x - t) * scale * RESAMPLE_FILTER_RES;
+      p = (int) f;
+      if (p >= filter_size - 1)
+        continue;
+      w = filter[p] + (f - p) * (filter[p + 1] - filter[p]);
+      norm += w;
+
+      p = t;
+      if (i >= loop_first && i <= loop_last) {
+        p = (t - (int) sample->loopstart) % looplen;
+        if (p < 0) p += looplen;
+        p += sample->loopstart;
+      }
+      if (p >= (int) sample->start && p <= (int) sample->end)
+        sum += w * sample->data[p];
+    }
+
+    v = (norm > 0.0) ? sum / norm : 0.0;
+    if (float_data != NULL)
+      float_data[i] = (float) v;
+    v = floor(v + 0.5);
+    data[i] = (short) ((v > 32767.0) ? 32767 : (v < -32768.0) ? -32768 : v);
+  }
+}
+
+/* The loop of a sample lies within the sample? */
+#define fluid_sample_loop_is_valid(_s) \
+  ((_s)->loopstart >= (_s)->start && (_s)->loopend <= (_s)->end + 1 \
+   && (_s)->loopend > (_s)->loopstart)
+
+/*
+ * With synth.resample-samples, replace the points of a sample by a copy
+ * at the synthesizer rate, so that voices at the root key play it with a
+ * phase increment of exactly one point (see fluid_rvoice_dsp_copy). A
+ * looped sample is only resampled if its loop points fall on whole
+ * points at the new rate, its loop would be detuned otherwise. Samples
+ * of zones with address offsets ('moved') are kept, the offsets count
+ * points at the original rate. The copy is a shared cache entry like the
+ * samples of synth.sample-dedup.
+ */
+static int fluid_defsfont_resample_sample(fluid_defsfont_t* sfont, fluid_sample_t* sample,
+                                          int looped, int moved,
+                                          const double* filter, int filter_size)
+{
+  long long rate = (long long) sfont->resample_rate;
+  long long loopstart, loopend, end;
+  unsigned int count;
+  float* float_data = NULL;
+  short *data, *shared;
+  int loop_valid;
+
+  if (!sample->valid || sample->data == NULL || sample->samplerate == 0 || moved
+      || sample->samplerate == rate || (sample->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS))
+    return FLUID_OK;
+
+  loopstart = ((long long) sample->loopstart - sample->start) * rate;
+  loopend = ((long long) sample->loopend - sample->start) * rate;
+  /* the last point before the one following the end of the sample */
+  end = (((long long) sample->end + 1 - sample->start) * rate - 1) / sample->samplerate;
+  loop_valid = fluid_sample_loop_is_valid(sample);
+  if (looped && loop_valid
+      && (loopstart % sample->samplerate != 0 || loopend % sample->samplerate != 0))
+    return FLUID_OK;
+
+  /* the loop points of samples not played looped are rounded */
+  loopstart = (loopstart + sample->samplerate / 2) / sample->samplerate;
+  loopend = (loopend + sample->samplerate / 2) / sample->samplerate;
+  if (loopstart < 0) loopstart = 0;
+  if (loopend < 0) loopend = 0;
+
+  count = (unsigned int) end + 1 + DYNAMIC_SAMPLE_GUARD_POINTS;
+  data = FLUID_ARRAY(short, count);
+  if (data == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return FLUID_FAILED;
+  }
+  FLUID_MEMSET(data, 0, count * sizeof(short));
+  fluid_resample_points(sample, (double) rate / sample->samplerate, sample->start, 0,
+                        (int) loopstart, loop_valid ? (int) loopend - 1 : -1,
+                        filter, filter_size, data, NULL, (int) end + 1);
+
+  shared = fluid_cached_sampledata_share(data, (unsigned int) end + 1, sfont->mlock,
+                                         sfont->float_samples ? &float_data : NULL);
+  FLUID_FREE(data);
+  if (shared == NULL)
+    return FLUID_FAILED;
+
+  /* a sample shared with synth.sample-dedup is released */
+  if (sample->data != sfont->sampledata)
+    fluid_cached_sampledata_unload(sample->data);
+
+  sample->data = shared;
+  fluid_sample_ext(sample)->float_data = float_data;
+  sample->start = 0;
+  sample->end = (unsigned int) end;
+  sample->loopstart = (unsigned int) loopstart;
+  sample->loopend = (unsigned int) loopend;
+  sample->samplerate = (unsigned int) rate;
+  return FLUID_OK;
+}
+
+/*
+ * With synth.sample-mipmaps, looped samples get band-limited copies at
+ * half and a quarter of their rate, which voices pitched up by an octave
+ * or more play instead (see fluid_rvoice_write). The loop of a copy is
+ * rounded to whole points and the copy's rate is chosen to match, so the
+ * loop keeps its exact pitch. Positions map linearly between a sample
+ * and its copies, with the loop start as anchor.
+ */
+
+/* Levels of copies and the shortest loop of a copy */
+#define MIPMAP_LEVELS          2
+#define MIPMAP_MIN_LOOP        8
+
+/*
+ * Make the copy of a sample at 1/2^level of its rate. Returns NULL if
+ * the loop is too short or out of memory.
+ */
+static fluid_sample_t* fluid_defsfont_make_mipmap(fluid_defsfont_t* sfont, fluid_sample_t* sample,
+                                                  const double* filter, int filter_size, int level)
+{
+  fluid_sample_t* mip;
+  float* float_data = NULL;
+  int looplen = sample->loopend - sample->loopstart;
+  int mip_looplen, count;
+  double ratio, x;
+
+  mip_looplen = (int) (looplen / (double) (1 << level) + 0.5);
+  if (mip_looplen < MIPMAP_MIN_LOOP)
+    return NULL;
+  ratio = (double) mip_looplen / looplen;
+
+  mip = new_fluid_sample();
+  if (mip == NULL) {
+    FLUID_LOG(FLUID_WARN, "Out of memory for the copies of sample %s at lower rates", sample->name);
+    return NULL;
+  }
+
+  FLUID_STRCPY(mip->name, sample->name);
+  x = ceil((sample->loopstart - sample->start) * ratio);
+  mip->start = 0;
+  mip->loopstart = (unsigned int) x;
+  mip->loopend = mip->loopstart + mip_looplen;
+  x = floor((sample->end - sample->loopstart) * ratio);
+  mip->end = mip->loopstart + (unsigned int) x;
+  mip->samplerate = (unsigned int) (sample->samplerate * ratio + 0.5);
+  mip->origpitch = sample->origpitch;
+  mip->pitchadj = sample->pitchadj;
+  mip->sampletype = sample->sampletype;
+  mip->amplitude_that_reaches_noise_floor = sample->amplitude_that_reaches_noise_floor;
+  mip->amplitude_that_reaches_noise_floor_is_valid = sample->amplitude_that_reaches_noise_floor_is_valid;
+
+  count = mip->end + 1 + DYNAMIC_SAMPLE_GUARD_POINTS;
+  mip->data = FLUID_ARRAY(short, count);
+  if (sfont->float_samples)
+    float_data = FLUID_ARRAY(float, count);
+  if (mip->data == NULL || (sfont->float_samples && float_data == NULL)) {
+    FLUID_LOG(FLUID_WARN, "Out of memory for the copies of sample %s at lower rates", sample->name);
+    FLUID_FREE(mip->data);
+    FLUID_FREE(float_data);
+    delete_fluid_sample(mip);
+    return NULL;
+  }
+  FLUID_MEMSET(mip->data, 0, count * sizeof(short));
+  if (float_data != NULL)
+    FLUID_MEMSET(float_data, 0, count * sizeof(float));
+  fluid_sample_ext(mip)->float_data = float_data;
+
+  fluid_resample_points(sample, ratio, sample->loopstart, mip->loopstart,
+                        mip->loopstart, mip->loopend - 1, filter, filter_size,
+                        mip->data, float_data, mip->end + 1);
+  return mip;
+}
+
+/*
+ * Make the copies of a sample at lower rates, if its loop allows.
+ */
+static void fluid_defsfont_make_mipmaps(fluid_defsfont_t* sfont, fluid_sample_t* sample,
+                                        const double* filter, int filter_size)
+{
+  fluid_sample_t** next = &fluid_sample_ext(sample)->mipmap;
+  int level;
+
+  if (!sample->valid || sample->data == NULL || !fluid_sample_loop_is_valid(sample))
+    return;
+
+  for (level = 1; level <= MIPMAP_LEVELS; level++) {
+    *next = fluid_defsfont_make_mipmap(sfont, sample, filter, filter_size, level);
+    if (*next == NULL)
+      return;
+    next = &fluid_sample_ext(*next)->mipmap;
+  }
+}
+
+/*
+ * Free the copies of a sample at lower rates.
+ */
+static void fluid_defsfont_free_mipmaps(fluid_sample_t* sample)
+{
+  fluid_sample_t* mip = fluid_sample_ext(sample)->mipmap;
+  fluid_sample_t* next;
+
+  while (mip != NULL) {
+    next = fluid_sample_ext(mip)->mipmap;
+    FLUID_FREE(mip->data);
+    FLUID_FREE(fluid_sample_ext(mip)->float_data);
+    delete_fluid_sample(mip);
+    mip = next;
+  }
+  fluid_sample_ext(sample)->mipmap = NULL;
+}
+
+/*
+ * Read the data of one sample. Called from the loader thread only.
+ */
+static short* fluid_dynamic_sample_read(fluid_defsfont_t* sfont, fluid_stream_loader_t* stream,
+  fluid_sample_t* sample)
+{
+  fluid_dynamic_sample_t* dsample = sample->userdata;
+  unsigned int size = dsample->size;
+  char* compressed;
+  short* data;
+
+  if (size == 0)
+    return fluid_defsfont_read_sample(sfont, stream, sample, dsample->offset,
+                                      sample->end + 1 + DYNAMIC_SAMPLE_GUARD_POINTS);
+
+  /* Compressed samples are read as is and decoded */
+  if (dsample->offset + size > sfont->samplesize)
+    size = sfont->samplesize - dsample->offset;
+
+  compressed = FLUID_MALLOC(size);
+  if (compressed == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return NULL;
+  }
+
+  if (fluid_stream_seek_by(stream, sfont->samplepos + dsample->offset - fluid_stream_position(stream)) == -1
+      || stream->read(stream, compressed, size) < (int) size) {
+    FLUID_LOG(FLUID_ERR, "Failed to read data of sample %s", sample->name);
+    FLUID_FREE(compressed);
+    return NULL;
+  }
+
+  data = fluid_compressed_sample_read(sample, compressed, size);
+  FLUID_FREE(compressed);
+  return data;
+}
+
+/*
+ * Load or unload a queued sample, as its preset references demand.
+ * Called from the loader thread only.
+ */
+static void fluid_dynamic_sample_update(fluid_defsfont_t* sfont, fluid_stream_loader_t* stream,
+  fluid_dynamic_sample_t* dsample)
+{
+  fluid_sample_t *sample = dsample->sample, tmp;
+  short* sampledata;
+
+  if (!sample->valid || dsample->failed)
+    return;
+
+  if (fluid_atomic_int_get(&dsample->preset_refs) > 0) {
+    /* selected again before it was unloaded */
+    fluid_sample_pool_acquire(sfont->pool, dsample);
+    if (sample->data != NULL)
+      return;
+
+    sampledata = fluid_dynamic_sample_read(sfont, stream, sample);
+    if (sampledata == NULL) {
+      dsample->failed = TRUE;
+      return;
+    }
+    if (!sample->amplitude_that_reaches_noise_floor_is_valid) {
+      tmp = *sample;
+      tmp.data = sampledata;
+      tmp.notify = NULL;     /* not an extended sample */
+      fluid_voice_optimize_sample(&tmp);
+      sample->amplitude_that_reaches_noise_floor = tmp.amplitude_that_reaches_noise_floor;
+      sample->amplitude_that_reaches_noise_floor_is_valid = tmp.amplitude_that_reaches_noise_floor_is_valid;
+    }
+    dsample->bytes = (sample->end + 1 + DYNAMIC_SAMPLE_GUARD_POINTS) * sizeof(short);
+    fluid_atomic_pointer_set(&sample->data, sampledata);
+
+    fluid_sample_pool_add_bytes(sfont->pool, dsample->bytes);
+    fluid_sample_pool_reclaim(sfont->pool);
+    return;
+  }
+
+  if (sample->data == NULL)
+    return;
+
+  /* With a budget, unused samples stay until they're evicted */
+  if (!fluid_atomic_int_get(&dsample->evict) && fluid_sample_pool_get_budget(sfont->pool) > 0.0) {
+    fluid_sample_pool_release(sfont->pool, dsample);
+    return;
+  }
+  if (fluid_dynamic_sample_in_use(sample))
+    return;
+
+  /* A preset selected from now on doesn't play the sample (see
+     fluid_dynamic_sample_is_resident), and queues it to be loaded again */
+  if (!fluid_atomic_int_compare_and_exchange(&dsample->preset_refs, 0, DYNAMIC_SAMPLE_UNLOADING))
+    return;
+
+  /* A voice starting from now on sees the flag and doesn't play the
+     sample (see fluid_dynamic_sample_acquire). Still playing voices
+     queue the sample when done. */
+  if (!fluid_dynamic_sample_in_use(sample)) {
+    sampledata = sample->data;
+    fluid_atomic_pointer_set(&sample->data, NULL);
+    FLUID_FREE(sampledata);
+    fluid_sample_pool_add_bytes(sfont->pool, -dsample->bytes);
+    FLUID_LOG(FLUID_DBG, "Unloaded the data of sample %s", sample->name);
+  }
+  fluid_sample_pool_acquire(sfont->pool, dsample);
+  fluid_atomic_int_add(&dsample->preset_refs, -DYNAMIC_SAMPLE_UNLOADING);
+}
+
+static void fluid_defsfont_loader_thread(void* data)
+{
+  fluid_defsfont_t* sfont = data;
+  fluid_stream_loader_t* stream;
+  fluid_dynamic_sample_t *dsample, *next;
+
+  stream = new_fluid_file_stream_loader();
+  if (stream == NULL)
+    return;
+
+  if (stream->open(stream, sfont->filename) != FLUID_OK) {
+    stream->free(stream);
+    return;
+  }
+
+  fluid_cond_mutex_lock(sfont->loader_mutex);
+  while (!sfont->loader_quit) {
+
+    if (fluid_atomic_pointer_get(&sfont->loader_queue) == NULL) {
+      /* Announce the sleep first, a sample queued after the check below
+         signals the condition */
+      fluid_atomic_int_set(&sfont->loader_sleeping, TRUE);
+      if (fluid_atomic_pointer_get(&sfont->loader_queue) == NULL)
+        fluid_cond_wait(sfont->loader_cond, sfont->loader_mutex);
+      fluid_atomic_int_set(&sfont->loader_sleeping, FALSE);
+      continue;
+    }
+    fluid_cond_mutex_unlock(sfont->loader_mutex);
+
+    /* A sample changing again after being taken is queued anew */
+    for (dsample = fluid_defsfont_take_queue(sfont); dsample; dsample = next) {
+      next = dsample->next;
+      fluid_atomic_int_set(&dsample->queued, FALSE);
+      fluid_dynamic_sample_update(sfont, stream, dsample);
+    }
+
+    fluid_cond_mutex_lock(sfont->loader_mutex);
+  }
+  fluid_cond_mutex_unlock(sfont->loader_mutex);
+
+  stream->close(stream);
+  stream->free(stream);
+}
+
+/*
+ * Start the loader thread of a SoundFont loaded with dynamic samples
+ */
+static int fluid_defsfont_start_loader(fluid_defsfont_t* sfont)
+{
+  sfont->loader_quit = FALSE;
+  sfont->loader_sleeping = FALSE;
+  sfont->loader_queue = NULL;
+  sfont->loader_mutex = new_fluid_cond_mutex();
+  sfont->loader_cond = new_fluid_cond();
+  if (sfont->loader_mutex == NULL || sfont->loader_cond == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return FLUID_FAILED;
+  }
+
+  sfont->loader_thread = new_fluid_thread("sfloader", fluid_defsfont_loader_thread,
+                                          sfont, 0, FALSE);
+  if (sfont->loader_thread == NULL)
+    return FLUID_FAILED;
+
+  return FLUID_OK;
+}
+
+static void fluid_defsfont_stop_loader(fluid_defsfont_t* sfont)
+{
+  if (sfont->loader_thread) {
+    fluid_cond_mutex_lock(sfont->loader_mutex);
+    sfont->loader_quit = TRUE;
+    fluid_cond_signal(sfont->loader_cond);
+    fluid_cond_mutex_unlock(sfont->loader_mutex);
+    fluid_thread_join(sfont->loader_thread);
+    delete_fluid_thread(sfont->loader_thread);
+    sfont->loader_thread = NULL;
+  }
+  /* Other loader threads may still wake this one while it's listed */
+  fluid_sample_pool_remove_sfont(sfont->pool, sfont);
+  if (sfont->loader_cond) {
+    delete_fluid_cond(sfont->loader_cond);
+    sfont->loader_cond = NULL;
+  }
+  if (sfont->loader_mutex) {
+    delete_fluid_cond_mutex(sfont->loader_mutex);
+    sfont->loader_mutex = NULL;
+  }
+}
 
-  if (stream->safe_seek_by(stream, samplepos) == -1) {
-    perror("error");
-    FLUID_LOG(FLUID_ERR, "Failed to seek position in data file");
-    goto error_exit;
+/*
+ * Mark the samples of a preset as needed (or no longer needed) and wake
+ * up the loader thread. Called in the synthesis context, it doesn't wait
+ * for the loader thread.
+ */
+int fluid_defpreset_preset_notify(fluid_preset_t* preset, int reason, int chan)
+{
+  fluid_defpreset_t* defpreset = preset->data;
+  fluid_defsfont_t* sfont = defpreset->sfont;
+  fluid_preset_zone_t* preset_zone;
+  fluid_inst_zone_t* inst_zone;
+  fluid_sample_t* sample;
+  fluid_dynamic_sample_t* dsample;
+  int delta, refs, queued = FALSE;
+
+  if (reason == FLUID_PRESET_SELECTED) delta = 1;
+  else if (reason == FLUID_PRESET_UNSELECTED) delta = -1;
+  else return FLUID_OK;
+
+  for (preset_zone = fluid_defpreset_get_zone(defpreset); preset_zone;
+       preset_zone = fluid_preset_zone_next(preset_zone)) {
+    inst_zone = fluid_inst_get_zone(fluid_preset_zone_get_inst(preset_zone));
+    for (; inst_zone; inst_zone = fluid_inst_zone_next(inst_zone)) {
+      sample = fluid_inst_zone_get_sample(inst_zone);
+      if (sample == NULL || sample->userdata == NULL)
+        continue;
+      dsample = sample->userdata;
+      refs = fluid_atomic_int_exchange_and_add(&dsample->preset_refs, delta) + delta;
+
+      /* Queue the samples to load, and the ones which may go */
+      if ((delta > 0 && (fluid_atomic_pointer_get(&sample->data) == NULL
+                         || refs >= DYNAMIC_SAMPLE_UNLOADING
+                         || fluid_atomic_int_get(&dsample->evict)))
+          || (delta < 0 && refs == 0)) {
+        fluid_dynamic_sample_queue(dsample);
+        queued = TRUE;
+      }
+    }
   }
+  if (queued)
+    fluid_defsfont_wake_loader(sfont);
 
+  return FLUID_OK;
+}
 
-  loaded_sampledata = (short*) FLUID_MALLOC(samplesize);
-  if (loaded_sampledata == NULL) {
-    FLUID_LOG(FLUID_ERR, "Out of memory");
-    goto error_exit;
-  }
 
-  if (stream->read(stream, loaded_sampledata, samplesize) < samplesize) {
-    FLUID_LOG(FLUID_ERR, "Failed to read sample data");
-    goto error_exit;
-  }
 
-  if (original_position < 0)
-    stream->close(stream);
-  else
-    stream->safe_seek_by(stream, original_position - stream->position(stream)); /* go back to the original position */
 
-  cached_sampledata = (fluid_cached_sampledata_t*) FLUID_MALLOC(sizeof(fluid_cached_sampledata_t));
-  if (cached_sampledata == NULL) {
-    FLUID_LOG(FLUID_ERR, "Out of memory.");
-    goto error_exit;
-  }
+/***************************************************************
+ *
+ *                       STREAMED SAMPLES
+ *
+ * With synth.streaming, only the first synth.stream-preload milliseconds
+ * of each sample are loaded with the SoundFont. The synth reads the rest
+ * from the file while a voice plays the sample (see fluid_rvoice_stream.c).
+ * Samples looped by any instrument zone are loaded completely, since the
+ * loop is played over and over again.
+ */
 
-  /* Lock the memory to disable paging. It's okay if this fails. It
-     probably means that the user doesn't have to required permission.  */
-  cached_sampledata->mlock = 0;
-  if (try_mlock) {
-    if (fluid_mlock(loaded_sampledata, samplesize) != 0)
-      FLUID_LOG(FLUID_WARN, "Failed to pin the sample data to RAM; swapping is possible.");
-    else
-      cached_sampledata->mlock = try_mlock;
+/*
+ * Prepare a freshly imported sample for streaming. The sample positions
+ * are made relative to the sample's own data buffer.
+ */
+static int fluid_streamed_sample_init(fluid_defsfont_t* sfont, fluid_sample_t* sample)
+{
+  fluid_sample_stream_t* info = FLUID_NEW(fluid_sample_stream_t);
+  if (info == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return FLUID_FAILED;
   }
 
-  /* If this machine is big endian, the sample have to byte swapped  */
-  if (FLUID_IS_BIG_ENDIAN) {
-    unsigned char* cbuf;
-    unsigned char hi, lo;
-    unsigned int i, j;
-    short s;
-    cbuf = (unsigned char*)loaded_sampledata;
-    for (i = 0, j = 0; j < samplesize; i++) {
-      lo = cbuf[j++];
-      hi = cbuf[j++];
-      s = (hi << 8) | lo;
-      loaded_sampledata[i] = s;
-    }
-  }
+  info->filename = sfont->filename;
+  info->offset = sfont->samplepos + 2 * (fluid_long_long_t) sample->start;
+  info->resident = 0;
 
-  cached_sampledata->filename = (char*) FLUID_MALLOC(strlen(filename) + 1);
-  if (cached_sampledata->filename == NULL) {
-    FLUID_LOG(FLUID_ERR, "Out of memory.");
-    goto error_exit;
+  sample->end -= sample->start;
+  sample->loopstart -= sample->start;
+  sample->loopend -= sample->start;
+  sample->start = 0;
+  sample->data = NULL;
+  fluid_sample_ext(sample)->stream = info;
+  return FLUID_OK;
+}
+
+/* Is a generator one of the sample address offsets? */
+static int fluid_is_addr_offset_gen(int gen)
+{
+  switch (gen) {
+  case GEN_STARTADDROFS:
+  case GEN_ENDADDROFS:
+  case GEN_STARTLOOPADDROFS:
+  case GEN_ENDLOOPADDROFS:
+  case GEN_STARTADDRCOARSEOFS:
+  case GEN_ENDADDRCOARSEOFS:
+  case GEN_STARTLOOPADDRCOARSEOFS:
+  case GEN_ENDLOOPADDRCOARSEOFS:
+    return TRUE;
+  default:
+    return FALSE;
   }
+}
 
-  sprintf(cached_sampledata->filename, "%s", filename);
-  cached_sampledata->modification_time = modification_time;
-  cached_sampledata->num_references = 1;
-  cached_sampledata->sampledata = loaded_sampledata;
-  cached_sampledata->samplesize = samplesize;
+/* Does a modulator of the list move the sample address points? */
+static int fluid_mods_move_addrs(fluid_mod_t* mod)
+{
+  for (; mod; mod = mod->next) {
+    if (fluid_is_addr_offset_gen(mod->dest))
+      return TRUE;
+  }
+  return FALSE;
+}
 
-  cached_sampledata->next = all_cached_sampledata;
-  all_cached_sampledata = cached_sampledata;
+/*
+ * Does an instrument zone, with the global zone of its instrument, move
+ * the address points of its sample away from the ones in the sample
+ * header? Preset zones may not set the offsets, but their modulators
+ * can, so the preset zones are checked too.
+ */
+static int fluid_zone_moves_addrs(fluid_preset_zone_t* preset_global_zone,
+                                  fluid_preset_zone_t* preset_zone,
+                                  fluid_inst_zone_t* global_zone,
+                                  fluid_inst_zone_t* inst_zone)
+{
+  int i;
 
+  for (i = 0; i < GEN_LAST; i++) {
+    if (!fluid_is_addr_offset_gen(i))
+      continue;
+    if (inst_zone->gen[i].flags ? inst_zone->gen[i].val != 0
+        : (global_zone != NULL && global_zone->gen[i].flags && global_zone->gen[i].val != 0))
+      return TRUE;
+  }
+  return fluid_mods_move_addrs(inst_zone->mod)
+    || (global_zone != NULL && fluid_mods_move_addrs(global_zone->mod))
+    || fluid_mods_move_addrs(preset_zone->mod)
+    || (preset_global_zone != NULL && fluid_mods_move_addrs(preset_global_zone->mod));
+}
 
- success_exit:
-  fluid_mutex_unlock(cached_sampledata_mutex);
-  *sampledata = loaded_sampledata;
-  return FLUID_OK;
+/*
+ * Get the samples looped by an instrument zone (sample modes 1 and 3),
+ * as a hash table with the samples as keys. NULL if out of memory.
+ * If 'moved' isn't NULL, the samples of zones which move their address
+ * points (see fluid_zone_moves_addrs) are added to it.
+ */
+static fluid_hashtable_t* fluid_defsfont_get_looped_samples(fluid_defsfont_t* sfont,
+                                                            fluid_hashtable_t* moved)
+{
+  fluid_hashtable_t* looped;
+  fluid_defpreset_t* preset;
+  fluid_preset_zone_t *preset_global_zone, *preset_zone;
+  fluid_inst_zone_t *global_zone, *inst_zone;
+  fluid_sample_t* sample;
+  int mode;
 
- error_exit:
-  stream->close(stream);
-  if (loaded_sampledata != NULL) {
-    FLUID_FREE(loaded_sampledata);
+  looped = new_fluid_hashtable(NULL, NULL);
+  if (looped == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return NULL;
   }
 
-  if (cached_sampledata != NULL) {
-    if (cached_sampledata->filename != NULL) {
-      FLUID_FREE(cached_sampledata->filename);
+  for (preset = sfont->preset; preset; preset = fluid_defpreset_next(preset)) {
+    preset_global_zone = fluid_defpreset_get_global_zone(preset);
+    for (preset_zone = fluid_defpreset_get_zone(preset); preset_zone;
+         preset_zone = fluid_preset_zone_next(preset_zone)) {
+      global_zone = fluid_inst_get_global_zone(fluid_preset_zone_get_inst(preset_zone));
+      inst_zone = fluid_inst_get_zone(fluid_preset_zone_get_inst(preset_zone));
+      for (; inst_zone; inst_zone = fluid_inst_zone_next(inst_zone)) {
+        sample = fluid_inst_zone_get_sample(inst_zone);
+        if (sample == NULL)
+          continue;
+
+        /* The sample modes 1 and 3 loop the sample */
+        if (inst_zone->gen[GEN_SAMPLEMODE].flags)
+          mode = (int) inst_zone->gen[GEN_SAMPLEMODE].val;
+        else if (global_zone != NULL && global_zone->gen[GEN_SAMPLEMODE].flags)
+          mode = (int) global_zone->gen[GEN_SAMPLEMODE].val;
+        else mode = 0;
+
+        if (mode & 1)
+          fluid_hashtable_insert(looped, sample, sample);
+        if (moved != NULL
+            && fluid_zone_moves_addrs(preset_global_zone, preset_zone, global_zone, inst_zone))
+          fluid_hashtable_insert(moved, sample, sample);
+      }
     }
-    FLUID_FREE(cached_sampledata);
   }
-
-  fluid_mutex_unlock(cached_sampledata_mutex);
-  *sampledata = NULL;
-  return FLUID_FAILED;
+  return looped;
 }
 
-static int fluid_cached_sampledata_unload(const short *sampledata)
+/*
+ * Make the samples looped by an instrument zone fully resident
+ */
+static int fluid_defsfont_keep_looped_samples(fluid_defsfont_t* sfont)
 {
-  fluid_cached_sampledata_t* prev = NULL;
-  fluid_cached_sampledata_t* cached_sampledata;
+  fluid_hashtable_t* looped;
+  fluid_list_t *list;
+  fluid_sample_t* sample;
+  fluid_sample_stream_t* info;
 
-  fluid_mutex_lock(cached_sampledata_mutex);
-  cached_sampledata = all_cached_sampledata;
+  looped = fluid_defsfont_get_looped_samples(sfont, NULL);
+  if (looped == NULL)
+    return FLUID_FAILED;
+
+  for (list = sfont->sample; list; list = fluid_list_next(list)) {
+    sample = fluid_list_get(list);
+    info = fluid_sample_get_stream(sample);
+    if (info != NULL && fluid_hashtable_lookup(looped, sample) != NULL)
+      info->resident = sample->end + 1;
+  }
 
-  while (cached_sampledata != NULL) {
-    if (sampledata == cached_sampledata->sampledata) {
+  delete_fluid_hashtable(looped);
+  return FLUID_OK;
+}
 
-      cached_sampledata->num_references--;
+/*
+ * Load the resident part of all samples. Samples which are resident
+ * completely become ordinary samples.
+ */
+static int fluid_defsfont_load_streamed_samples(fluid_defsfont_t* sfont,
+  fluid_stream_loader_t* stream)
+{
+  fluid_list_t *list;
+  fluid_sample_t* sample;
+  fluid_sample_stream_t* info;
+  unsigned int length;
 
-      if (cached_sampledata->num_references == 0) {
-        if (cached_sampledata->mlock)
-          fluid_munlock(cached_sampledata->sampledata, cached_sampledata->samplesize);
-        FLUID_FREE((short*) cached_sampledata->sampledata);
-        FLUID_FREE(cached_sampledata->filename);
+  if (fluid_defsfont_keep_looped_samples(sfont) != FLUID_OK)
+    return FLUID_FAILED;
 
-        if (prev != NULL) {
-          prev->next = cached_sampledata->next;
-        } else {
-          all_cached_sampledata = cached_sampledata->next;
-        }
+  for (list = sfont->sample; list; list = fluid_list_next(list)) {
+    sample = fluid_list_get(list);
+    info = fluid_sample_get_stream(sample);
+    if (info == NULL || !sample->valid)
+      continue;
 
-        FLUID_FREE(cached_sampledata);
-      }
+    length = sample->end + 1;
+    if (info->resident == 0)
+      info->resident = (unsigned int) ((double) sfont->stream_preload
+                                       * sample->samplerate / 1000.0);
+    if (info->resident > length)
+      info->resident = length;
+
+    sample->data = fluid_defsfont_read_sample(sfont, stream, sample,
+                                              (info->offset - sfont->samplepos) / 2,
+                                              info->resident + DYNAMIC_SAMPLE_GUARD_POINTS);
+    if (sample->data == NULL)
+      return FLUID_FAILED;
 
-      goto success_exit;
+    if (info->resident == length) {
+      fluid_sample_ext(sample)->stream = NULL;
+      FLUID_FREE(info);
+      fluid_voice_optimize_sample(sample);
     }
-
-    prev = cached_sampledata;
-    cached_sampledata = cached_sampledata->next;
   }
-
-  FLUID_LOG(FLUID_ERR, "Trying to free sampledata not found in cache.");
-  goto error_exit;
-  
- success_exit:
-  fluid_mutex_unlock(cached_sampledata_mutex);
   return FLUID_OK;
-
- error_exit:
-  fluid_mutex_unlock(cached_sampledata_mutex);
-  return FLUID_FAILED;
 }
 
 
@@ -771,13 +2947,63 @@ static int fluid_cached_sampledata_unload(const short *sampledata)
  *                           SFONT
  */
 
+/*
+ * Resample the samples to the synthesizer rate and make their copies at
+ * lower rates, as far as enabled. Needs the presets for the sample modes.
+ */
+static int fluid_defsfont_resample_samples(fluid_defsfont_t* sfont)
+{
+  fluid_hashtable_t *looped = NULL, *moved = NULL;
+  fluid_list_t *list;
+  fluid_sample_t* sample;
+  double* filter;
+  int filter_size, ret = FLUID_OK;
+
+  filter = fluid_resample_filter_new(&filter_size);
+  if (filter == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return FLUID_FAILED;
+  }
+
+  if (sfont->resample_samples) {
+    moved = new_fluid_hashtable(NULL, NULL);
+    looped = (moved != NULL) ? fluid_defsfont_get_looped_samples(sfont, moved) : NULL;
+    if (looped == NULL) {
+      if (moved == NULL)
+        FLUID_LOG(FLUID_ERR, "Out of memory");
+      else
+        delete_fluid_hashtable(moved);
+      FLUID_FREE(filter);
+      return FLUID_FAILED;
+    }
+  }
+
+  for (list = sfont->sample; list && ret == FLUID_OK; list = fluid_list_next(list)) {
+    sample = fluid_list_get(list);
+    if (sfont->resample_samples)
+      ret = fluid_defsfont_resample_sample(sfont, sample,
+                                           fluid_hashtable_lookup(looped, sample) != NULL,
+                                           fluid_hashtable_lookup(moved, sample) != NULL,
+                                           filter, filter_size);
+    if (sfont->mipmap_samples)
+      fluid_defsfont_make_mipmaps(sfont, sample, filter, filter_size);
+  }
+
+  if (looped != NULL)
+    delete_fluid_hashtable(looped);
+  if (moved != NULL)
+    delete_fluid_hashtable(moved);
+  FLUID_FREE(filter);
+  return ret;
+}
+
 /*
  * new_fluid_defsfont
  */
 fluid_defsfont_t* new_fluid_defsfont(fluid_settings_t* settings)
 {
   fluid_defsfont_t* sfont;
-  int i;
+  int i, divider;
 
   sfont = FLUID_NEW(fluid_defsfont_t);
   if (sfont == NULL) {
@@ -790,8 +3016,34 @@ fluid_defsfont_t* new_fluid_defsfont(fluid_settings_t* settings)
   sfont->samplesize = 0;
   sfont->sample = NULL;
   sfont->sampledata = NULL;
+  sfont->float_sampledata = NULL;
   sfont->preset = NULL;
   fluid_settings_getint(settings, "synth.lock-memory", &sfont->mlock);
+  fluid_settings_getint(settings, "synth.mmap-samples", &sfont->mmap);
+  fluid_settings_getint(settings, "synth.mmap-prefetch", &sfont->mmap_prefetch);
+  fluid_settings_getint(settings, "synth.dynamic-sample-loading", &sfont->dynamic_samples);
+  fluid_settings_getint(settings, "synth.streaming", &sfont->streaming);
+  fluid_settings_getint(settings, "synth.stream-preload", &sfont->stream_preload);
+  sfont->float_samples = fluid_settings_str_equal(settings, "synth.sample-format", "float");
+  fluid_settings_getint(settings, "synth.sample-dedup", &sfont->dedup_samples);
+  fluid_settings_getint(settings, "synth.sample-mipmaps", &sfont->mipmap_samples);
+  fluid_settings_getint(settings, "synth.resample-samples", &sfont->resample_samples);
+  fluid_settings_getint(settings, "synth.stereo-voices", &sfont->stereo_voices);
+  fluid_settings_getnum(settings, "synth.sample-rate", &sfont->resample_rate);
+  /* Samples are played at the internal rate */
+  if (fluid_settings_getint(settings, "synth.internal-rate-divider", &divider))
+    sfont->resample_rate /= divider;
+  fluid_settings_getint(settings, "synth.cpu-cores", &sfont->cpu_cores);
+  sfont->index_cache_dir = NULL;
+  fluid_settings_dupstr(settings, "synth.index-cache-dir", &sfont->index_cache_dir);
+  if (sfont->index_cache_dir != NULL && sfont->index_cache_dir[0] == 0) {
+    FLUID_FREE(sfont->index_cache_dir);
+    sfont->index_cache_dir = NULL;
+  }
+  sfont->loader_thread = NULL;
+  sfont->loader_cond = NULL;
+  sfont->loader_mutex = NULL;
+  sfont->pool = NULL;
 
   /* Initialise preset cache, so we don't have to call malloc on program changes.
      Usually, we have at most one preset per channel plus one temporarily used,
@@ -802,6 +3054,8 @@ fluid_defsfont_t* new_fluid_defsfont(fluid_settings_t* settings)
   sfont->preset_stack = FLUID_ARRAY(fluid_preset_t*, sfont->preset_stack_capacity);
   if (!sfont->preset_stack) {
     FLUID_LOG(FLUID_ERR, "Out of memory");
+    if (sfont->index_cache_dir != NULL)
+      FLUID_FREE(sfont->index_cache_dir);
     FLUID_FREE(sfont);
     return NULL;
   }
@@ -836,12 +3090,39 @@ int delete_fluid_defsfont(fluid_defsfont_t* sfont)
     }
   }
 
+  fluid_defsfont_stop_loader(sfont);
+
   if (sfont->filename != NULL) {
     FLUID_FREE(sfont->filename);
   }
 
+  if (sfont->index_cache_dir != NULL) {
+    FLUID_FREE(sfont->index_cache_dir);
+  }
+
   for (list = sfont->sample; list; list = fluid_list_next(list)) {
-    delete_fluid_sample((fluid_sample_t*) fluid_list_get(list));
+    sample = (fluid_sample_t*) fluid_list_get(list);
+    if (sfont->dynamic_samples && sample->userdata != NULL) {
+      if (sample->data != NULL) {
+        FLUID_FREE(sample->data);
+        fluid_sample_pool_add_bytes(sfont->pool,
+                                    -((fluid_dynamic_sample_t*) sample->userdata)->bytes);
+      }
+      FLUID_FREE(sample->userdata);
+    }
+    else if (sfont->streaming) {
+      FLUID_FREE(sample->data);
+      FLUID_FREE(fluid_sample_ext(sample)->stream);
+    }
+    else if ((sample->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS) && sample->data != NULL) {
+      FLUID_FREE(sample->data);
+    }
+    else if ((sfont->dedup_samples || sfont->resample_samples)
+             && sample->data != NULL && sample->data != sfont->sampledata) {
+      fluid_cached_sampledata_unload(sample->data);
+    }
+    fluid_defsfont_free_mipmaps(sample);
+    delete_fluid_sample(sample);
   }
 
   if (sfont->sample) {
@@ -863,6 +3144,7 @@ int delete_fluid_defsfont(fluid_defsfont_t* sfont)
     preset = sfont->preset;
   }
 
+  fluid_sample_pool_unref(sfont->pool);
   FLUID_FREE(sfont);
   return FLUID_OK;
 }
@@ -887,6 +3169,8 @@ int fluid_defsfont_load(fluid_defsfont_t* sfont, fluid_stream_loader_t* stream,
   SFSample* sfsample;
   fluid_sample_t* sample;
   fluid_defpreset_t* preset = NULL;
+  fluid_sfcache_key_t key;
+  int compressed;
 
   sfont->filename = FLUID_MALLOC(1 + FLUID_STRLEN(file));
   if (sfont->filename == NULL) {
@@ -895,11 +3179,32 @@ int fluid_defsfont_load(fluid_defsfont_t* sfont, fluid_stream_loader_t* stream,
   }
   FLUID_STRCPY(sfont->filename, file);
 
-  /* The actual loading is done in the sfont and sffile files */
-  sfdata = sfload_file(file, stream);
+  /* Use the cached index if there is an up to date one. It's looked up
+     by the file the stream opened, the stream stays open for the sample
+     data. */
+  sfdata = NULL;
+  if (sfont->index_cache_dir != NULL && stream->open == fluid_file_stream_loader_open) {
+    if (stream->open(stream, file) != FLUID_OK) {
+      FLUID_LOG(FLUID_ERR, "Unable to open file \"%s\"", file);
+      return FLUID_FAILED;
+    }
+    if (fluid_file_stream_loader_get_key(stream, &key) == FLUID_OK)
+      sfdata = fluid_sfcache_load(sfont->index_cache_dir, file, &key);
+    if (sfdata == NULL)
+      stream->close(stream);
+  }
+
   if (sfdata == NULL) {
-    FLUID_LOG(FLUID_ERR, "Couldn't load soundfont file: %s", file);
-    return FLUID_FAILED;
+    /* The actual loading is done in the sfont and sffile files */
+    sfdata = sfload_file(file, stream);
+    if (sfdata == NULL) {
+      FLUID_LOG(FLUID_ERR, "Couldn't load soundfont file: %s", file);
+      return FLUID_FAILED;
+    }
+
+    if (sfont->index_cache_dir != NULL
+        && fluid_file_stream_loader_get_key(stream, &key) == FLUID_OK)
+      fluid_sfcache_save(sfont->index_cache_dir, file, &key, sfdata);
   }
 
   /* Keep track of the position and size of the sample data because
@@ -907,8 +3212,49 @@ int fluid_defsfont_load(fluid_defsfont_t* sfont, fluid_stream_loader_t* stream,
   sfont->samplepos = sfdata->samplepos;
   sfont->samplesize = sfdata->samplesize;
 
+  /* Samples can only be loaded in the background from plain files */
+  if (sfont->streaming && stream->open != fluid_file_stream_loader_open) {
+    FLUID_LOG(FLUID_WARN, "Streaming needs the file stream loader, loading all samples");
+    sfont->streaming = FALSE;
+  }
+  if (sfont->dynamic_samples && sfont->streaming) {
+    FLUID_LOG(FLUID_WARN, "Dynamic sample loading can't be combined with streaming, streaming samples");
+    sfont->dynamic_samples = FALSE;
+  }
+  if (sfont->dynamic_samples && stream->open != fluid_file_stream_loader_open) {
+    FLUID_LOG(FLUID_WARN, "Dynamic sample loading needs the file stream loader, loading all samples");
+    sfont->dynamic_samples = FALSE;
+  }
+  /* Compressed (SF3) samples have to be decoded as a whole */
+  compressed = FALSE;
+  for (p = sfdata->sample; p != NULL; p = fluid_list_next(p)) {
+    if (((SFSample *) p->data)->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS)
+      compressed = TRUE;
+  }
+  if (sfont->streaming && compressed) {
+    FLUID_LOG(FLUID_WARN, "Compressed samples can't be streamed, loading all samples");
+    sfont->streaming = FALSE;
+  }
+  if (sfont->float_samples && (sfont->dynamic_samples || sfont->streaming)) {
+    FLUID_LOG(FLUID_WARN, "Float samples need all sample data loaded, using 16 bit samples");
+    sfont->float_samples = FALSE;
+  }
+  if (sfont->mipmap_samples && (sfont->dynamic_samples || sfont->streaming)) {
+    FLUID_LOG(FLUID_WARN, "Sample mipmaps need all sample data loaded, not making them");
+    sfont->mipmap_samples = FALSE;
+  }
+  if (sfont->resample_samples && (sfont->dynamic_samples || sfont->streaming)) {
+    FLUID_LOG(FLUID_WARN, "Resampling needs all sample data loaded, keeping the sample rates");
+    sfont->resample_samples = FALSE;
+  }
+  if (sfont->float_samples && compressed) {
+    FLUID_LOG(FLUID_WARN, "Float samples can't be used with compressed samples, using 16 bit samples");
+    sfont->float_samples = FALSE;
+  }
+
   /* load sample data in one block */
-  if (fluid_defsfont_load_sampledata(stream, sfont) != FLUID_OK)
+  if (!sfont->dynamic_samples && !sfont->streaming
+      && fluid_defsfont_load_sampledata(stream, sfont) != FLUID_OK)
     goto err_exit;
 
   /* Create all the sample headers */
@@ -926,10 +3272,33 @@ int fluid_defsfont_load(fluid_defsfont_t* sfont, fluid_stream_loader_t* stream,
     sfsample->fluid_sample = sample;
 
     fluid_defsfont_add_sample(sfont, sample);
-    fluid_voice_optimize_sample(sample);
+    if (sfont->dynamic_samples) {
+      if (fluid_dynamic_sample_init(sfont, sample) != FLUID_OK)
+        goto err_exit;
+    }
+    else if (sfont->streaming) {
+      if (fluid_streamed_sample_init(sfont, sample) != FLUID_OK)
+        goto err_exit;
+    }
+    else if (!(sample->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS)) {
+      if (sfont->dedup_samples && fluid_defsfont_share_sample(sfont, sample) != FLUID_OK)
+        goto err_exit;
+      fluid_voice_optimize_sample(sample);
+    }
     p = fluid_list_next(p);
   }
 
+  if (compressed && !sfont->dynamic_samples
+      && fluid_defsfont_decode_samples(sfont) != FLUID_OK)
+    goto err_exit;
+
+  /* The shared samples hold their own copy of their points now */
+  if (sfont->dedup_samples && sfont->sampledata != NULL) {
+    fluid_cached_sampledata_unload(sfont->sampledata);
+    sfont->sampledata = NULL;
+    sfont->float_sampledata = NULL;
+  }
+
   /* Load all the presets */
   p = sfdata->preset;
   while (p != NULL) {
@@ -943,8 +3312,22 @@ int fluid_defsfont_load(fluid_defsfont_t* sfont, fluid_stream_loader_t* stream,
     fluid_defsfont_add_preset(sfont, preset);
     p = fluid_list_next(p);
   }
+
+  /* The sample modes of the instruments are known now */
+  if (sfont->streaming && fluid_defsfont_load_streamed_samples(sfont, stream) != FLUID_OK) {
+    preset = NULL;
+    goto err_exit;
+  }
+  if ((sfont->resample_samples || sfont->mipmap_samples)
+      && fluid_defsfont_resample_samples(sfont) != FLUID_OK) {
+    preset = NULL;
+    goto err_exit;
+  }
   sfont_close (sfdata, stream);
 
+  if (sfont->dynamic_samples && fluid_defsfont_start_loader(sfont) != FLUID_OK)
+    return FLUID_FAILED;
+
   return FLUID_OK;
 
 err_exit:
@@ -1006,7 +3389,9 @@ int
 fluid_defsfont_load_sampledata(fluid_stream_loader_t* stream, fluid_defsfont_t* sfont)
 {
   return fluid_cached_sampledata_load(stream, sfont->filename, sfont->samplepos,
-    sfont->samplesize, &sfont->sampledata, sfont->mlock);
+    sfont->samplesize, &sfont->sampledata,
+    (sfont->float_samples && !sfont->dedup_samples) ? &sfont->float_sampledata : NULL,
+    sfont->mlock, sfont->mmap, sfont->mmap_prefetch);
 }
 
 /*
@@ -1126,6 +3511,96 @@ fluid_defpreset_next(fluid_defpreset_t* preset)
 }
 
 
+/*
+ * The generator of an instrument zone, taken from the global zone if the
+ * zone doesn't set it. NULL if neither sets it.
+ */
+static fluid_gen_t*
+fluid_inst_zone_get_gen(fluid_inst_zone_t* zone, fluid_inst_zone_t* global_zone, int gen)
+{
+  if (zone->gen[gen].flags)
+    return &zone->gen[gen];
+  if ((global_zone != NULL) && global_zone->gen[gen].flags)
+    return &global_zone->gen[gen];
+  return NULL;
+}
+
+/*
+ * Find the zone holding the other channel of a stereo sample, so that one
+ * voice can play both (see synth.stereo-voices). That is the next zone of
+ * the instrument playing the note, if its sample is the opposite channel,
+ * is laid out like the zone's sample and is played with the same
+ * generators and modulators, apart from the pan. The sample link itself
+ * is not kept by the loader. Returns NULL if there is no such zone.
+ */
+static fluid_inst_zone_t*
+fluid_inst_zone_get_linked(fluid_inst_zone_t* zone, fluid_inst_zone_t* global_zone,
+                           int key, int vel)
+{
+  fluid_inst_zone_t* linked;
+  fluid_sample_t* sample = zone->sample;
+  fluid_sample_t* other;
+  fluid_gen_t *gen, *linked_gen;
+  fluid_mod_t *mod, *linked_mod;
+  int i;
+
+  if (!(sample->sampletype & (FLUID_SAMPLETYPE_LEFT | FLUID_SAMPLETYPE_RIGHT))
+      || (fluid_sample_get_stream(sample) != NULL))
+    return NULL;
+
+  for (linked = zone->next; linked != NULL; linked = linked->next) {
+    if (fluid_inst_zone_inside_range(linked, key, vel))
+      break;
+  }
+  if (linked == NULL)
+    return NULL;
+
+  other = linked->sample;
+  if ((other == NULL) || fluid_sample_in_rom(other) || (fluid_sample_get_stream(other) != NULL)
+      || !fluid_dynamic_sample_is_resident(other))
+    return NULL;
+
+  /* One left and one right channel */
+  if (!((sample->sampletype & FLUID_SAMPLETYPE_LEFT) && (other->sampletype & FLUID_SAMPLETYPE_RIGHT))
+      && !((sample->sampletype & FLUID_SAMPLETYPE_RIGHT) && (other->sampletype & FLUID_SAMPLETYPE_LEFT)))
+    return NULL;
+
+  /* Laid out alike, so that both channels play from one phase */
+  if ((other->end - other->start != sample->end - sample->start)
+      || (other->loopstart - other->start != sample->loopstart - sample->start)
+      || (other->loopend - other->start != sample->loopend - sample->start)
+      || (other->samplerate != sample->samplerate)
+      || (other->origpitch != sample->origpitch)
+      || (other->pitchadj != sample->pitchadj))
+    return NULL;
+
+  /* The preset zone is the same for both, compare the instrument zones */
+  for (i = 0; i < GEN_LAST; i++) {
+    if ((i == GEN_PAN) || (i == GEN_SAMPLEID) || (i == GEN_KEYRANGE) || (i == GEN_VELRANGE))
+      continue;
+    gen = fluid_inst_zone_get_gen(zone, global_zone, i);
+    linked_gen = fluid_inst_zone_get_gen(linked, global_zone, i);
+    if ((gen == NULL) != (linked_gen == NULL))
+      return NULL;
+    if ((gen != NULL) && (gen->val != linked_gen->val))
+      return NULL;
+  }
+
+  /* The global modulators are shared as well */
+  mod = zone->mod;
+  linked_mod = linked->mod;
+  while ((mod != NULL) && (linked_mod != NULL)) {
+    if (!fluid_mod_test_identity(mod, linked_mod) || (mod->amount != linked_mod->amount))
+      return NULL;
+    mod = mod->next;
+    linked_mod = linked_mod->next;
+  }
+  if ((mod != NULL) || (linked_mod != NULL))
+    return NULL;
+
+  return linked;
+}
+
 /*
  * fluid_defpreset_noteon
  */
@@ -1134,7 +3609,8 @@ fluid_defpreset_noteon(fluid_defpreset_t* preset, fluid_synth_t* synth, int chan
 {
   fluid_preset_zone_t *preset_zone, *global_preset_zone;
   fluid_inst_t* inst;
-  fluid_inst_zone_t *inst_zone, *global_inst_zone;
+  fluid_inst_zone_t *inst_zone, *global_inst_zone, *linked_zone;
+  fluid_gen_t *pan, *linked_pan;
   fluid_sample_t* sample;
   fluid_voice_t* voice;
   fluid_mod_t * mod;
@@ -1157,11 +3633,19 @@ fluid_defpreset_noteon(fluid_defpreset_t* preset, fluid_synth_t* synth, int chan
 
       /* run thru all the zones of this instrument */
       inst_zone = fluid_inst_get_zone(inst);
+      linked_zone = NULL;
 	  while (inst_zone != NULL) {
 
+	/* skip the other channel of a stereo voice, it's playing already */
+	if (inst_zone == linked_zone) {
+	  inst_zone = fluid_inst_zone_next(inst_zone);
+	  continue;
+	}
+
 	/* make sure this instrument zone has a valid sample */
 	sample = fluid_inst_zone_get_sample(inst_zone);
-	if ((sample == NULL) || fluid_sample_in_rom(sample)) {
+	if ((sample == NULL) || fluid_sample_in_rom(sample)
+	    || !fluid_dynamic_sample_is_resident(sample)) {
 	  inst_zone = fluid_inst_zone_next(inst_zone);
 	  continue;
 	}
@@ -1169,12 +3653,14 @@ fluid_defpreset_noteon(fluid_defpreset_t* preset, fluid_synth_t* synth, int chan
 	/* check if the note falls into the key and velocity range of this
 	   instrument */
 
-	if (fluid_inst_zone_inside_range(inst_zone, key, vel) && (sample != NULL)) {
+	if (fluid_inst_zone_inside_range(inst_zone, key, vel)
+	    && fluid_dynamic_sample_acquire(sample)) {
 
 	  /* this is a good zone. allocate a new synthesis process and
-             initialize it */
+             initialize it. The voice takes its own reference. */
 
 	  voice = fluid_synth_alloc_voice(synth, sample, chan, key, vel);
+	  fluid_sample_decr_ref(sample);
 	  if (voice == NULL) {
 	    return FLUID_FAILED;
 	  }
@@ -1332,6 +3818,22 @@ fluid_defpreset_noteon(fluid_defpreset_t* preset, fluid_synth_t* synth, int chan
 	    }
 	  }
 
+	  /* Play the other channel of a stereo sample with the same voice */
+	  if (preset->sfont->stereo_voices
+	      && (linked_zone = fluid_inst_zone_get_linked(inst_zone, global_inst_zone,
+	                                                   key, vel)) != NULL) {
+	    if (fluid_dynamic_sample_acquire(linked_zone->sample)) {
+	      pan = fluid_inst_zone_get_gen(inst_zone, global_inst_zone, GEN_PAN);
+	      linked_pan = fluid_inst_zone_get_gen(linked_zone, global_inst_zone, GEN_PAN);
+	      fluid_voice_set_linked_sample(voice, linked_zone->sample,
+	                                    (linked_pan ? linked_pan->val : 0.0)
+	                                    - (pan ? pan->val : 0.0));
+	      fluid_sample_decr_ref(linked_zone->sample);
+	    } else {
+	      linked_zone = NULL;
+	    }
+	  }
+
 	  /* add the synthesis process to the synthesis loop. */
 	  fluid_synth_start_voice(synth, voice);
 
@@ -2111,24 +4613,45 @@ fluid_inst_zone_inside_range(fluid_inst_zone_t* zone, int key, int vel)
  *                           SAMPLE
  */
 
+/* Serial number of the last sample made */
+static int fluid_sample_last_serial = 0;
+
 /*
  * new_fluid_sample
  */
 fluid_sample_t*
 new_fluid_sample()
 {
-  fluid_sample_t* sample = NULL;
+  fluid_sample_ext_t* ext = NULL;
 
-  sample = FLUID_NEW(fluid_sample_t);
-  if (sample == NULL) {
+  ext = FLUID_NEW(fluid_sample_ext_t);
+  if (ext == NULL) {
     FLUID_LOG(FLUID_ERR, "Out of memory");
     return NULL;
   }
 
-  memset(sample, 0, sizeof(fluid_sample_t));
-  sample->valid = 1;
+  memset(ext, 0, sizeof(fluid_sample_ext_t));
+  ext->sample.valid = 1;
+  ext->sample.notify = fluid_sample_ext_notify;
+  ext->serial = (unsigned int) fluid_atomic_int_exchange_and_add(&fluid_sample_last_serial, 1) + 1;
+
+  return &ext->sample;
+}
+
+/*
+ * fluid_sample_ext_notify
+ *
+ * The notify method of the samples made by new_fluid_sample, which marks
+ * them as extended (see fluid_sfont.h).
+ */
+int
+fluid_sample_ext_notify(fluid_sample_t* sample, int reason)
+{
+  fluid_sample_ext_t* ext = fluid_sample_ext(sample);
 
-  return sample;
+  if (ext->notify != NULL)
+    return (*ext->notify)(sample, reason);
+  return FLUID_OK;
 }
 
 /*
@@ -2158,6 +4681,7 @@ fluid_sample_import_sfont(fluid_sample_t* sample, SFSample* sfsample, fluid_defs
 {
   FLUID_STRCPY(sample->name, sfsample->name);
   sample->data = sfont->sampledata;
+  fluid_sample_ext(sample)->float_data = sfont->float_sampledata;
   sample->start = sfsample->start;
   sample->end = sfsample->start + sfsample->end;
   sample->loopstart = sfsample->start + sfsample->loopstart;
@@ -2167,6 +4691,19 @@ fluid_sample_import_sfont(fluid_sample_t* sample, SFSample* sfsample, fluid_defs
   sample->pitchadj = sfsample->pitchadj;
   sample->sampletype = sfsample->sampletype;
 
+  /* Compressed samples keep their byte positions in the sample chunk
+     until they are decoded, their loop is relative to the sample */
+  if (sample->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS) {
+    sample->data = NULL;
+    fluid_sample_ext(sample)->float_data = NULL;
+    sample->loopstart = sfsample->loopstart;
+    sample->loopend = sfsample->loopend;
+#if !LIBSNDFILE_HASVORBIS
+    sample->valid = 0;
+    FLUID_LOG(FLUID_WARN, "Ignoring sample %s: no support for compressed samples", sample->name);
+#endif
+  }
+
   if (sample->sampletype & FLUID_SAMPLETYPE_ROM) {
     sample->valid = 0;
     FLUID_LOG(FLUID_WARN, "Ignoring sample %s: can't use ROM samples", sample->name);
@@ -2271,12 +4808,12 @@ fluid_sample_import_sfont(fluid_sample_t* sample, SFSample* sfsample, fluid_defs
 } G_STMT_END
 
 #define FSKIP(size,stream)		G_STMT_START {		\
-    if (!stream->safe_seek_by(stream, size))		\
+    if (!fluid_stream_seek_by(stream, size))		\
 	return(FAIL);					\
 } G_STMT_END
 
 #define FSKIPW(stream)		G_STMT_START {		\
-    if (!stream->safe_seek_by(stream, 2))			\
+    if (!fluid_stream_seek_by(stream, 2))			\
 	return(FAIL);					\
 } G_STMT_END
 
@@ -2289,7 +4826,7 @@ fluid_sample_import_sfont(fluid_sample_t* sample, SFSample* sfsample, fluid_defs
 } G_STMT_END
 
 static int chunkid (unsigned int id);
-static int load_body (unsigned int size, SFData * sf, fluid_stream_loader_t * stream);
+static int load_body (fluid_long_long_t size, SFData * sf, fluid_stream_loader_t * stream);
 static int read_listchunk (SFChunk * chunk, fluid_stream_loader_t * stream);
 static int process_info (int size, SFData * sf, fluid_stream_loader_t * stream);
 static int process_sdta (unsigned int size, SFData * sf, fluid_stream_loader_t * stream);
@@ -2335,7 +4872,7 @@ SFData *
 sfload_file (const char * fname, fluid_stream_loader_t * stream)
 {
   SFData *sf = NULL;
-  int fsize = 0;
+  fluid_long_long_t fsize = 0;
   int err = FALSE;
 
   if (stream->open (stream, fname) != FLUID_OK)
@@ -2358,7 +4895,7 @@ sfload_file (const char * fname, fluid_stream_loader_t * stream)
     }
 
   /* get size of file */
-  if (!(fsize = stream->length (stream)))
+  if (!(fsize = fluid_stream_length(stream)))
     {
       FLUID_LOG(FLUID_ERR, "Could not get file size.");
       err = TRUE;
@@ -2380,7 +4917,7 @@ sfload_file (const char * fname, fluid_stream_loader_t * stream)
 }
 
 static int
-load_body (unsigned int size, SFData * sf, fluid_stream_loader_t * stream)
+load_body (fluid_long_long_t size, SFData * sf, fluid_stream_loader_t * stream)
 {
   SFChunk chunk;
 
@@ -2487,7 +5024,12 @@ process_info (int size, SFData * sf, fluid_stream_loader_t * stream)
 	    return (FAIL);
 	  }
 
+#if LIBSNDFILE_HASVORBIS
+	  /* Version 3 (SF3) adds compressed samples */
+	  if (sf->version.major > 3) {
+#else
 	  if (sf->version.major > 2) {
+#endif
 	    FLUID_LOG (FLUID_WARN,
 		      _("Sound font version is %d.%d which is newer than"
 			" what this version of FLUID Synth was designed for (v2.0x)"),
@@ -2566,7 +5108,7 @@ process_sdta (unsigned int size, SFData * sf, fluid_stream_loader_t * stream)
     return (gerr (ErrCorr, _("SDTA chunk size mismatch")));
 
   /* sample data follows */
-  sf->samplepos = stream->position (stream);
+  sf->samplepos = fluid_stream_position(stream);
 
   /* used in fixup_sample() to check validity of sample headers */
   sdtachunk_size = chunk.size;
@@ -3508,6 +6050,14 @@ fixup_sample (SFData * sf)
 
 	  return (OK);
 	}
+      else if (sam->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS)
+	{
+	  /* byte positions of compressed data, the loop is relative to
+	     the decoded sample and checked when decoding */
+	  sam->end -= sam->start + 1;
+	  p = fluid_list_next (p);
+	  continue;
+	}
       else if (sam->loopend > sam->end || sam->loopstart >= sam->loopend
 	|| sam->loopstart <= sam->start)
 	{			/* loop is fowled?? (cluck cluck :) */
@@ -3750,10 +6300,10 @@ safe_fread (void *buf, int count, FILE * fd)
 }
 
 int
-safe_fseek (FILE * fd, long ofs, int whence)
+safe_fseek (FILE * fd, fluid_long_long_t ofs, int whence)
 {
-  if (fseek (fd, ofs, whence) == -1) {
-    FLUID_LOG (FLUID_ERR, _("File seek failed with offset = %ld and whence = %d"), ofs, whence);
+  if (FLUID_FSEEK (fd, ofs, whence) == -1) {
+    FLUID_LOG (FLUID_ERR, _("File seek failed with offset = %lld and whence = %d"), (long long) ofs, whence);
     return (FAIL);
   }
   return (OK);
@@ -28,6 +28,7 @@
 #include "fluidsynth.h"
 #include "fluidsynth_priv.h"
 #include "fluid_list.h"
+#include "fluid_sys.h"
 
 
 
@@ -140,7 +141,7 @@ typedef struct _SFData
 {				/* Sound font data structure */
   SFVersion version;		/* sound font version */
   SFVersion romver;		/* ROM version */
-  unsigned int samplepos;		/* position within sffd of the sample chunk */
+  fluid_long_long_t samplepos;		/* position within sffd of the sample chunk */
   unsigned int samplesize;		/* length within sffd of the sample chunk */
   char *fname;			/* file name */
   FILE *sffd;			/* Deprecated: It used to point to the loaded sfont file descriptor, but to support arbitrary stream, this FILE* is gone. */
@@ -347,7 +348,7 @@ enum
 int gerr (int ev, char * fmt, ...);
 int safe_fread (void *buf, int count, FILE * fd);
 int safe_fwrite (void *buf, int count, FILE * fd);
-int safe_fseek (FILE * fd, long ofs, int whence);
+int safe_fseek (FILE * fd, fluid_long_long_t ofs, int whence);
 
 
 /********************************************************************************/
@@ -374,7 +375,16 @@ typedef struct _fluid_inst_zone_t fluid_inst_zone_t;
 
  */
 
+typedef struct _fluid_sample_pool_t fluid_sample_pool_t;
+typedef struct _fluid_dynamic_sample_t fluid_dynamic_sample_t;
+
+fluid_sample_pool_t* new_fluid_sample_pool(double budget);
+void fluid_sample_pool_ref(fluid_sample_pool_t* pool);
+void fluid_sample_pool_unref(fluid_sample_pool_t* pool);
+double fluid_sample_pool_get_budget(fluid_sample_pool_t* pool);
+
 fluid_stream_loader_t* new_fluid_file_stream_loader();
+fluid_stream_loader_t* new_fluid_memory_stream_loader(const void* data, fluid_long_long_t size);
 #if ANDROID
 fluid_stream_loader_t* new_fluid_android_asset_stream_loader(void* jniEnv, void* assetManager);
 void delete_fluid_android_asset_stream_loader(fluid_stream_loader_t* loader);
@@ -396,6 +406,7 @@ char* fluid_defpreset_preset_get_name(fluid_preset_t* preset);
 int fluid_defpreset_preset_get_banknum(fluid_preset_t* preset);
 int fluid_defpreset_preset_get_num(fluid_preset_t* preset);
 int fluid_defpreset_preset_noteon(fluid_preset_t* preset, fluid_synth_t* synth, int chan, int key, int vel);
+int fluid_defpreset_preset_notify(fluid_preset_t* preset, int reason, int chan);
 
 
 /*
@@ -404,12 +415,34 @@ int fluid_defpreset_preset_noteon(fluid_preset_t* preset, fluid_synth_t* synth,
 struct _fluid_defsfont_t
 {
   char* filename;           /* the filename of this soundfont */
-  unsigned int samplepos;   /* the position in the file at which the sample data starts */
+  fluid_long_long_t samplepos; /* the position in the file at which the sample data starts */
   unsigned int samplesize;  /* the size of the sample data */
   short* sampledata;        /* the sample data, loaded in ram */
+  float* float_sampledata;  /* the sample data converted to float, NULL if not used */
   fluid_list_t* sample;      /* the samples in this soundfont */
   fluid_defpreset_t* preset; /* the presets of this soundfont */
   int mlock;                 /* Should we try memlock (avoid swapping)? */
+  int mmap;                  /* Should we map the sample data instead of reading it? */
+  int mmap_prefetch;         /* Should the mapped sample data be read ahead? */
+  int dynamic_samples;       /* Load sample data only for selected presets? */
+  int streaming;             /* Load only the start of the samples and stream the rest? */
+  int stream_preload;        /* Length of the resident start of streamed samples (ms) */
+  int float_samples;         /* Should the sample data be converted to float? */
+  int cpu_cores;             /* Number of threads decoding compressed samples */
+  int dedup_samples;         /* Share identical samples with other SoundFonts? */
+  int mipmap_samples;        /* Make copies of the samples at lower rates? */
+  int resample_samples;      /* Resample the samples to the synthesizer rate? */
+  double resample_rate;      /* The synthesizer rate */
+  int stereo_voices;         /* Play both channels of stereo samples with one voice? */
+  char* index_cache_dir;     /* Directory of the parsed index cache, NULL if disabled */
+
+  fluid_thread_t* loader_thread;      /* Loads and unloads dynamic samples in the background */
+  fluid_cond_t* loader_cond;          /* Signalled when the loader thread may have work to do */
+  fluid_cond_mutex_t* loader_mutex;   /* Taken by the loader thread to sleep on loader_cond */
+  int loader_quit;                    /* Set to TRUE when the loader thread should terminate */
+  int loader_sleeping;                /* TRUE while the loader thread may wait on loader_cond (atomic) */
+  struct _fluid_dynamic_sample_t* loader_queue;  /* Samples to look at, pushed lock-free */
+  fluid_sample_pool_t* pool;          /* Sample memory budget shared with the loader's other SoundFonts */
 
   fluid_preset_t iter_preset;        /* preset interface used in the iteration */
   fluid_defpreset_t* iter_cur;       /* the current preset in the iteration */
@@ -0,0 +1,781 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+/*
+ * The SoundFont index cache stores the parsed and fixed up hydra (the
+ * preset, instrument and sample headers with their zones) of a SoundFont
+ * in a flat file: a header followed by tables of fixed size records.
+ * Links between the records are resolved to table indices. Loading maps
+ * (or reads) the file in one go and rebuilds the SFData lists from the
+ * tables in a single pass, without touching the RIFF structure of the
+ * SoundFont again. This replaces the parsing and fixing up of the hydra
+ * only: the presets are then imported from the SFData like those of a
+ * parsed SoundFont.
+ *
+ * A cache file is only used when the device, inode, size and modification
+ * time of the opened SoundFont match the ones recorded when it was
+ * written, and when the checksum of its tables is right. Cache files use
+ * the native byte order and record sizes, the header rejects foreign ones.
+ */
+
+#include "fluid_sfcache.h"
+#include "fluid_hash.h"
+
+/* Cache files are mapped where possible */
+#if defined(HAVE_SYS_MMAN_H) && !defined(__OS2__) && !defined(WIN32)
+#define SFCACHE_USE_MMAP 1
+#endif
+
+/* Cache files are written under a unique temporary name where possible */
+#if defined(HAVE_UNISTD_H) && !defined(__OS2__) && !defined(WIN32)
+#define SFCACHE_USE_MKSTEMP 1
+#endif
+
+#define FLUID_SFCACHE_MAGIC    0x4346534c   /* "LSFC" in little endian */
+#define FLUID_SFCACHE_VERSION  3
+#define FLUID_SFCACHE_NAMELEN  21           /* size of the header names */
+
+/* Tables start at multiples of 8 bytes */
+#define FLUID_SFCACHE_ALIGN(_size)  (((_size) + 7) & ~(fluid_long_long_t) 7)
+
+typedef struct
+{
+  unsigned int magic;
+  unsigned int version;
+  unsigned int checksum;     /* FNV-1a of the bytes after the header */
+  unsigned int size;         /* count of bytes after the header */
+  unsigned int record_sizes; /* sizes of the raw SFGen and SFMod records */
+  unsigned int path_len;     /* the path of the SoundFont, to detect hash collisions */
+  fluid_sfcache_key_t key;
+  SFVersion version_;
+  SFVersion romver;
+  fluid_long_long_t samplepos;
+  unsigned int samplesize;
+  unsigned int nsamples;
+  unsigned int ninsts;
+  unsigned int npresets;
+  unsigned int nzones;
+  unsigned int ngens;
+  unsigned int nmods;
+} fluid_sfcache_header_t;
+
+typedef struct
+{
+  char name[24];
+  unsigned int start;
+  unsigned int end;
+  unsigned int loopstart;
+  unsigned int loopend;
+  unsigned int samplerate;
+  unsigned char origpitch;
+  signed char pitchadj;
+  unsigned short sampletype;
+} fluid_sfcache_sample_t;
+
+typedef struct
+{
+  char name[24];
+  unsigned int zone;         /* first zone in the zone table */
+  unsigned int nzones;
+} fluid_sfcache_inst_t;
+
+typedef struct
+{
+  char name[24];
+  unsigned short prenum;
+  unsigned short bank;
+  unsigned int libr;
+  unsigned int genre;
+  unsigned int morph;
+  unsigned int zone;         /* first zone in the zone table */
+  unsigned int nzones;
+} fluid_sfcache_preset_t;
+
+typedef struct
+{
+  unsigned int target;       /* index + 1 of the instrument or sample, 0 for global zones */
+  unsigned int gen;          /* first generator in the generator table */
+  unsigned int ngens;
+  unsigned int mod;          /* first modulator in the modulator table */
+  unsigned int nmods;
+} fluid_sfcache_zone_t;
+
+/* Byte offsets of the tables after the header, and their end */
+typedef struct
+{
+  fluid_long_long_t path;
+  fluid_long_long_t samples;
+  fluid_long_long_t insts;
+  fluid_long_long_t presets;
+  fluid_long_long_t zones;
+  fluid_long_long_t gens;
+  fluid_long_long_t mods;
+  fluid_long_long_t end;
+} fluid_sfcache_layout_t;
+
+static void
+fluid_sfcache_layout(const fluid_sfcache_header_t* hdr, fluid_sfcache_layout_t* layout)
+{
+  layout->path = 0;
+  layout->samples = FLUID_SFCACHE_ALIGN(layout->path + hdr->path_len);
+  layout->insts = FLUID_SFCACHE_ALIGN(layout->samples
+                                      + (fluid_long_long_t) hdr->nsamples * sizeof(fluid_sfcache_sample_t));
+  layout->presets = FLUID_SFCACHE_ALIGN(layout->insts
+                                        + (fluid_long_long_t) hdr->ninsts * sizeof(fluid_sfcache_inst_t));
+  layout->zones = FLUID_SFCACHE_ALIGN(layout->presets
+                                      + (fluid_long_long_t) hdr->npresets * sizeof(fluid_sfcache_preset_t));
+  layout->gens = FLUID_SFCACHE_ALIGN(layout->zones
+                                     + (fluid_long_long_t) hdr->nzones * sizeof(fluid_sfcache_zone_t));
+  layout->mods = FLUID_SFCACHE_ALIGN(layout->gens + (fluid_long_long_t) hdr->ngens * sizeof(SFGen));
+  layout->end = FLUID_SFCACHE_ALIGN(layout->mods + (fluid_long_long_t) hdr->nmods * sizeof(SFMod));
+}
+
+/* 32 bit FNV-1a */
+static unsigned int
+fluid_sfcache_hash(unsigned int hash, const unsigned char* data, fluid_long_long_t size)
+{
+  fluid_long_long_t i;
+
+  for (i = 0; i < size; i++) {
+    hash = (hash ^ data[i]) * 16777619u;
+  }
+  return hash;
+}
+
+#define FLUID_SFCACHE_HASH_INIT  2166136261u
+
+/* Appends data to a list in constant time, 'last' tracks the list's tail */
+static fluid_list_t*
+fluid_sfcache_append(fluid_list_t* list, fluid_list_t** last, void* data, int* error)
+{
+  fluid_list_t* node;
+
+  node = new_fluid_list();
+  if (node == NULL) {
+    FLUID_FREE(data);
+    *error = TRUE;
+    return list;
+  }
+  node->data = data;
+
+  if (*last != NULL) {
+    (*last)->next = node;
+  } else {
+    list = node;
+  }
+  *last = node;
+  return list;
+}
+
+
+/*
+ * Cache file naming
+ */
+
+/* The cache file of a SoundFont is named after a hash of its path */
+static char*
+fluid_sfcache_filename(const char* dir, const char* fname)
+{
+  unsigned int hash;
+  char* name;
+
+  hash = fluid_sfcache_hash(FLUID_SFCACHE_HASH_INIT, (const unsigned char*) fname,
+                            FLUID_STRLEN(fname));
+
+  name = FLUID_MALLOC(FLUID_STRLEN(dir) + 32);
+  if (name == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return NULL;
+  }
+  FLUID_SPRINTF(name, "%s/fluidsynth-%08x.idx", dir, hash);
+  return name;
+}
+
+
+/*
+ * Writing
+ */
+
+/* Fills a zone table from a zone list, 'targets' maps the instsamp nodes
+   to their index + 1 */
+static void
+fluid_sfcache_put_zones(fluid_list_t* zones, fluid_hashtable_t* targets,
+                        fluid_sfcache_zone_t* table, unsigned int* nzones,
+                        SFGen* gens, unsigned int* ngens,
+                        SFMod* mods, unsigned int* nmods)
+{
+  fluid_sfcache_zone_t* rec;
+  fluid_list_t *p, *q;
+  SFZone* zone;
+
+  for (p = zones; p != NULL; p = fluid_list_next(p)) {
+    zone = (SFZone*) fluid_list_get(p);
+    rec = &table[(*nzones)++];
+
+    rec->target = (zone->instsamp != NULL)
+      ? FLUID_POINTER_TO_INT(fluid_hashtable_lookup(targets, zone->instsamp)) : 0;
+
+    rec->gen = *ngens;
+    for (q = zone->gen; q != NULL; q = fluid_list_next(q)) {
+      FLUID_MEMCPY(&gens[(*ngens)++], fluid_list_get(q), sizeof(SFGen));
+    }
+    rec->ngens = *ngens - rec->gen;
+
+    rec->mod = *nmods;
+    for (q = zone->mod; q != NULL; q = fluid_list_next(q)) {
+      FLUID_MEMCPY(&mods[(*nmods)++], fluid_list_get(q), sizeof(SFMod));
+    }
+    rec->nmods = *nmods - rec->mod;
+  }
+}
+
+/* Counts the zones, generators and modulators of a zone list */
+static void
+fluid_sfcache_count_zones(fluid_list_t* zones, fluid_sfcache_header_t* hdr)
+{
+  fluid_list_t* p;
+  SFZone* zone;
+
+  for (p = zones; p != NULL; p = fluid_list_next(p)) {
+    zone = (SFZone*) fluid_list_get(p);
+    hdr->nzones++;
+    hdr->ngens += fluid_list_size(zone->gen);
+    hdr->nmods += fluid_list_size(zone->mod);
+  }
+}
+
+/* Maps the nodes of a list to their index + 1 */
+static fluid_hashtable_t*
+fluid_sfcache_index_nodes(fluid_list_t* list)
+{
+  fluid_hashtable_t* table;
+  unsigned int i;
+
+  table = new_fluid_hashtable(fluid_direct_hash, fluid_direct_equal);
+  if (table == NULL) {
+    return NULL;
+  }
+  for (i = 1; list != NULL; list = fluid_list_next(list), i++) {
+    fluid_hashtable_insert(table, list, FLUID_INT_TO_POINTER(i));
+  }
+  return table;
+}
+
+/* Creates the temporary file the index is written to before it's renamed */
+static FILE*
+fluid_sfcache_create_temp(const char* name, char** tmpname)
+{
+  FILE* file = NULL;
+
+  *tmpname = FLUID_MALLOC(FLUID_STRLEN(name) + 8);
+  if (*tmpname == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return NULL;
+  }
+
+#ifdef SFCACHE_USE_MKSTEMP
+  {
+    int fd;
+
+    /* In the same directory, so the rename doesn't cross file systems */
+    FLUID_SPRINTF(*tmpname, "%s.XXXXXX", name);
+    fd = mkstemp(*tmpname);
+    if (fd != -1) {
+      file = fdopen(fd, "wb");
+      if (file == NULL) {
+        close(fd);
+        remove(*tmpname);
+      }
+    }
+  }
+#else
+  /* No unique names, concurrent writers may clobber each other's file;
+     the checksum rejects the result */
+  FLUID_SPRINTF(*tmpname, "%s.tmp", name);
+  file = FLUID_FOPEN(*tmpname, "wb");
+#endif
+
+  if (file == NULL) {
+    FLUID_LOG(FLUID_WARN, "Can't create a SoundFont index cache file for '%s'", name);
+    FLUID_FREE(*tmpname);
+    *tmpname = NULL;
+  }
+  return file;
+}
+
+/*
+ * Writes the index of a freshly parsed SoundFont to the cache directory.
+ * The file is written under a unique temporary name and renamed when
+ * complete, so concurrent readers never see a partial index.
+ */
+int
+fluid_sfcache_save(const char* dir, const char* fname, const fluid_sfcache_key_t* key, SFData* sf)
+{
+  fluid_sfcache_header_t hdr;
+  fluid_sfcache_layout_t layout;
+  fluid_sfcache_sample_t* samples;
+  fluid_sfcache_inst_t* insts;
+  fluid_sfcache_preset_t* presets;
+  fluid_sfcache_zone_t* zones;
+  fluid_hashtable_t* sample_index = NULL;
+  fluid_hashtable_t* inst_index = NULL;
+  unsigned int nzones = 0, ngens = 0, nmods = 0, i;
+  unsigned char* data = NULL;
+  fluid_list_t* p;
+  SFSample* sample;
+  SFInst* inst;
+  SFPreset* preset;
+  char* name = NULL;
+  char* tmpname = NULL;
+  FILE* file = NULL;
+  int result = FLUID_FAILED;
+
+  FLUID_MEMSET(&hdr, 0, sizeof(hdr));
+  hdr.magic = FLUID_SFCACHE_MAGIC;
+  hdr.version = FLUID_SFCACHE_VERSION;
+  hdr.record_sizes = (sizeof(SFGen) << 16) | sizeof(SFMod);
+  hdr.path_len = FLUID_STRLEN(fname);
+  hdr.key = *key;
+  hdr.version_ = sf->version;
+  hdr.romver = sf->romver;
+  hdr.samplepos = sf->samplepos;
+  hdr.samplesize = sf->samplesize;
+  hdr.nsamples = fluid_list_size(sf->sample);
+  hdr.ninsts = fluid_list_size(sf->inst);
+  hdr.npresets = fluid_list_size(sf->preset);
+  for (p = sf->inst; p != NULL; p = fluid_list_next(p)) {
+    fluid_sfcache_count_zones(((SFInst*) fluid_list_get(p))->zone, &hdr);
+  }
+  for (p = sf->preset; p != NULL; p = fluid_list_next(p)) {
+    fluid_sfcache_count_zones(((SFPreset*) fluid_list_get(p))->zone, &hdr);
+  }
+
+  fluid_sfcache_layout(&hdr, &layout);
+  if (layout.end > 0x7fffffff) {
+    FLUID_LOG(FLUID_WARN, "The index of '%s' is too big to be cached", fname);
+    return FLUID_FAILED;
+  }
+  hdr.size = (unsigned int) layout.end;
+
+  /* zeroed, so the padding is written deterministically */
+  data = FLUID_MALLOC(hdr.size);
+  sample_index = fluid_sfcache_index_nodes(sf->sample);
+  inst_index = fluid_sfcache_index_nodes(sf->inst);
+  if (data == NULL || sample_index == NULL || inst_index == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    goto done;
+  }
+  FLUID_MEMSET(data, 0, hdr.size);
+
+  samples = (fluid_sfcache_sample_t*) (data + layout.samples);
+  insts = (fluid_sfcache_inst_t*) (data + layout.insts);
+  presets = (fluid_sfcache_preset_t*) (data + layout.presets);
+  zones = (fluid_sfcache_zone_t*) (data + layout.zones);
+
+  FLUID_MEMCPY(data + layout.path, fname, hdr.path_len);
+
+  for (p = sf->sample, i = 0; p != NULL; p = fluid_list_next(p), i++) {
+    sample = (SFSample*) fluid_list_get(p);
+    FLUID_MEMCPY(samples[i].name, sample->name, FLUID_SFCACHE_NAMELEN);
+    samples[i].start = sample->start;
+    samples[i].end = sample->end;
+    samples[i].loopstart = sample->loopstart;
+    samples[i].loopend = sample->loopend;
+    samples[i].samplerate = sample->samplerate;
+    samples[i].origpitch = sample->origpitch;
+    samples[i].pitchadj = sample->pitchadj;
+    samples[i].sampletype = sample->sampletype;
+  }
+
+  for (p = sf->inst, i = 0; p != NULL; p = fluid_list_next(p), i++) {
+    inst = (SFInst*) fluid_list_get(p);
+    FLUID_MEMCPY(insts[i].name, inst->name, FLUID_SFCACHE_NAMELEN);
+    insts[i].zone = nzones;
+    fluid_sfcache_put_zones(inst->zone, sample_index, zones, &nzones,
+                            (SFGen*) (data + layout.gens), &ngens,
+                            (SFMod*) (data + layout.mods), &nmods);
+    insts[i].nzones = nzones - insts[i].zone;
+  }
+
+  for (p = sf->preset, i = 0; p != NULL; p = fluid_list_next(p), i++) {
+    preset = (SFPreset*) fluid_list_get(p);
+    FLUID_MEMCPY(presets[i].name, preset->name, FLUID_SFCACHE_NAMELEN);
+    presets[i].prenum = preset->prenum;
+    presets[i].bank = preset->bank;
+    presets[i].libr = preset->libr;
+    presets[i].genre = preset->genre;
+    presets[i].morph = preset->morph;
+    presets[i].zone = nzones;
+    fluid_sfcache_put_zones(preset->zone, inst_index, zones, &nzones,
+                            (SFGen*) (data + layout.gens), &ngens,
+                            (SFMod*) (data + layout.mods), &nmods);
+    presets[i].nzones = nzones - presets[i].zone;
+  }
+
+  hdr.checksum = fluid_sfcache_hash(FLUID_SFCACHE_HASH_INIT, data, hdr.size);
+
+  name = fluid_sfcache_filename(dir, fname);
+  if (name == NULL) {
+    goto done;
+  }
+  file = fluid_sfcache_create_temp(name, &tmpname);
+  if (file == NULL) {
+    goto done;
+  }
+  if (fwrite(&hdr, 1, sizeof(hdr), file) != sizeof(hdr)
+      || fwrite(data, 1, hdr.size, file) != hdr.size) {
+    FLUID_LOG(FLUID_WARN, "Failed to write the SoundFont index cache file '%s'", tmpname);
+    FLUID_FCLOSE(file);
+    remove(tmpname);
+    goto done;
+  }
+  if (FLUID_FCLOSE(file) != 0) {
+    FLUID_LOG(FLUID_WARN, "Failed to write the SoundFont index cache file '%s'", tmpname);
+    remove(tmpname);
+    goto done;
+  }
+
+  if (rename(tmpname, name) != 0) {
+    FLUID_LOG(FLUID_WARN, "Failed to rename the SoundFont index cache file '%s'", tmpname);
+    remove(tmpname);
+    goto done;
+  }
+
+  FLUID_LOG(FLUID_DBG, "Saved the index of '%s' to '%s'", fname, name);
+  result = FLUID_OK;
+
+ done:
+  if (sample_index != NULL) {
+    delete_fluid_hashtable(sample_index);
+  }
+  if (inst_index != NULL) {
+    delete_fluid_hashtable(inst_index);
+  }
+  FLUID_FREE(data);
+  FLUID_FREE(name);
+  FLUID_FREE(tmpname);
+  return result;
+}
+
+
+/*
+ * Reading
+ */
+
+/* Copies a name field, making sure it is terminated */
+static void
+fluid_sfcache_get_name(char* name, const char* data)
+{
+  FLUID_MEMCPY(name, data, FLUID_SFCACHE_NAMELEN);
+  name[FLUID_SFCACHE_NAMELEN - 1] = 0;
+}
+
+/* Builds a list of raw records (generators or modulators) */
+static fluid_list_t*
+fluid_sfcache_get_records(const unsigned char* table, unsigned int count,
+                          unsigned int size, int* error)
+{
+  fluid_list_t* list = NULL;
+  fluid_list_t* last = NULL;
+  unsigned int i;
+  void* record;
+
+  for (i = 0; i < count && !*error; i++) {
+    record = FLUID_MALLOC(size);
+    if (record == NULL) {
+      *error = TRUE;
+      break;
+    }
+    FLUID_MEMCPY(record, table + (fluid_long_long_t) i * size, size);
+    list = fluid_sfcache_append(list, &last, record, error);
+  }
+  return list;
+}
+
+/* Builds the zones of an instrument or preset, linking them to 'targets' */
+static fluid_list_t*
+fluid_sfcache_get_zones(const fluid_sfcache_header_t* hdr, const unsigned char* data,
+                        const fluid_sfcache_layout_t* layout,
+                        unsigned int first, unsigned int count,
+                        fluid_list_t** targets, unsigned int ntargets, int* error)
+{
+  const fluid_sfcache_zone_t* zones = (const fluid_sfcache_zone_t*) (data + layout->zones);
+  const fluid_sfcache_zone_t* rec;
+  fluid_list_t* list = NULL;
+  fluid_list_t* last = NULL;
+  unsigned int i;
+  SFZone* zone;
+
+  if (first > hdr->nzones || count > hdr->nzones - first) {
+    *error = TRUE;
+    return NULL;
+  }
+
+  for (i = 0; i < count && !*error; i++) {
+    rec = &zones[first + i];
+    if (rec->target > ntargets
+        || rec->gen > hdr->ngens || rec->ngens > hdr->ngens - rec->gen
+        || rec->mod > hdr->nmods || rec->nmods > hdr->nmods - rec->mod) {
+      *error = TRUE;
+      break;
+    }
+
+    zone = FLUID_NEW(SFZone);
+    if (zone == NULL) {
+      *error = TRUE;
+      break;
+    }
+    FLUID_MEMSET(zone, 0, sizeof(SFZone));
+
+    /* link the zone first, so it's freed along with the SFData on errors */
+    list = fluid_sfcache_append(list, &last, zone, error);
+    if (*error) {
+      break;
+    }
+
+    zone->instsamp = (rec->target > 0) ? targets[rec->target - 1] : NULL;
+    zone->gen = fluid_sfcache_get_records(data + layout->gens + (fluid_long_long_t) rec->gen * sizeof(SFGen),
+                                          rec->ngens, sizeof(SFGen), error);
+    zone->mod = fluid_sfcache_get_records(data + layout->mods + (fluid_long_long_t) rec->mod * sizeof(SFMod),
+                                          rec->nmods, sizeof(SFMod), error);
+  }
+  return list;
+}
+
+/* Checks a cache file header against the opened SoundFont */
+static int
+fluid_sfcache_check_header(const fluid_sfcache_header_t* hdr, fluid_long_long_t size,
+                           const char* fname, const fluid_sfcache_key_t* key)
+{
+  return hdr->magic == FLUID_SFCACHE_MAGIC
+    && hdr->version == FLUID_SFCACHE_VERSION
+    && hdr->record_sizes == ((sizeof(SFGen) << 16) | sizeof(SFMod))
+    && hdr->size == size - (fluid_long_long_t) sizeof(*hdr)
+    && hdr->path_len == FLUID_STRLEN(fname)
+    && hdr->key.size == key->size
+    && hdr->key.mtime == key->mtime
+    && hdr->key.dev == key->dev
+    && hdr->key.ino == key->ino;
+}
+
+/* Maps or reads a whole cache file, NULL if there's none */
+static unsigned char*
+fluid_sfcache_map(const char* name, fluid_long_long_t* size, int* mapped)
+{
+  unsigned char* data = NULL;
+  FILE* file;
+  long len;
+
+  *mapped = FALSE;
+  file = FLUID_FOPEN(name, "rb");
+  if (file == NULL) {
+    return NULL;
+  }
+
+  if (FLUID_FSEEK(file, 0, SEEK_END) != 0 || (len = ftell(file)) < (long) sizeof(fluid_sfcache_header_t)
+      || FLUID_FSEEK(file, 0, SEEK_SET) != 0) {
+    FLUID_FCLOSE(file);
+    return NULL;
+  }
+  *size = len;
+
+#ifdef SFCACHE_USE_MMAP
+  data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+  if (data != MAP_FAILED) {
+    *mapped = TRUE;
+    FLUID_FCLOSE(file);
+    return data;
+  }
+  data = NULL;
+#endif
+
+  data = FLUID_MALLOC(len);
+  if (data != NULL && FLUID_FREAD(data, 1, len, file) != (size_t) len) {
+    FLUID_FREE(data);
+    data = NULL;
+  }
+  FLUID_FCLOSE(file);
+  return data;
+}
+
+static void
+fluid_sfcache_unmap(unsigned char* data, fluid_long_long_t size, int mapped)
+{
+#ifdef SFCACHE_USE_MMAP
+  if (mapped) {
+    munmap(data, size);
+    return;
+  }
+#endif
+  FLUID_FREE(data);
+}
+
+/*
+ * Loads the index of a SoundFont from the cache directory. Returns NULL
+ * if there's no usable cache file, the caller then parses the SoundFont.
+ * The returned SFData is the same as the one sfload_file() returns.
+ */
+SFData*
+fluid_sfcache_load(const char* dir, const char* fname, const fluid_sfcache_key_t* key)
+{
+  fluid_sfcache_header_t hdr;
+  fluid_sfcache_layout_t layout;
+  const fluid_sfcache_sample_t* samples;
+  const fluid_sfcache_inst_t* insts;
+  const fluid_sfcache_preset_t* presets;
+  fluid_list_t** sample_nodes = NULL;
+  fluid_list_t** inst_nodes = NULL;
+  fluid_list_t* last;
+  unsigned char* file_data;
+  const unsigned char* data;
+  fluid_long_long_t size;
+  unsigned int i;
+  int mapped, error = FALSE;
+  SFSample* sample;
+  SFInst* inst;
+  SFPreset* preset;
+  SFData* sf = NULL;
+  char* name;
+
+  name = fluid_sfcache_filename(dir, fname);
+  if (name == NULL) {
+    return NULL;
+  }
+
+  file_data = fluid_sfcache_map(name, &size, &mapped);
+  if (file_data == NULL) {
+    FLUID_FREE(name);
+    return NULL;
+  }
+
+  FLUID_MEMCPY(&hdr, file_data, sizeof(hdr));
+  data = file_data + sizeof(hdr);
+  if (!fluid_sfcache_check_header(&hdr, size, fname, key)) {
+    FLUID_LOG(FLUID_DBG, "The index cache '%s' doesn't match '%s'", name, fname);
+    goto done;
+  }
+
+  fluid_sfcache_layout(&hdr, &layout);
+  if (layout.end != hdr.size
+      || fluid_sfcache_hash(FLUID_SFCACHE_HASH_INIT, data, hdr.size) != hdr.checksum) {
+    FLUID_LOG(FLUID_WARN, "The index cache '%s' is corrupt, ignoring it", name);
+    goto done;
+  }
+  if (FLUID_STRNCMP((const char*) data + layout.path, fname, hdr.path_len) != 0) {
+    FLUID_LOG(FLUID_DBG, "The index cache '%s' doesn't match '%s'", name, fname);
+    goto done;
+  }
+
+  samples = (const fluid_sfcache_sample_t*) (data + layout.samples);
+  insts = (const fluid_sfcache_inst_t*) (data + layout.insts);
+  presets = (const fluid_sfcache_preset_t*) (data + layout.presets);
+
+  sf = FLUID_NEW(SFData);
+  sample_nodes = FLUID_ARRAY(fluid_list_t*, hdr.nsamples + 1);
+  inst_nodes = FLUID_ARRAY(fluid_list_t*, hdr.ninsts + 1);
+  if (sf == NULL || sample_nodes == NULL || inst_nodes == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    FLUID_FREE(sf);
+    sf = NULL;
+    goto done;
+  }
+  FLUID_MEMSET(sf, 0, sizeof(SFData));
+  sf->fname = FLUID_STRDUP(fname);
+  sf->version = hdr.version_;
+  sf->romver = hdr.romver;
+  sf->samplepos = hdr.samplepos;
+  sf->samplesize = hdr.samplesize;
+
+  /* samples */
+  last = NULL;
+  for (i = 0; i < hdr.nsamples && !error; i++) {
+    sample = FLUID_NEW(SFSample);
+    if (sample == NULL) {
+      error = TRUE;
+      break;
+    }
+    FLUID_MEMSET(sample, 0, sizeof(SFSample));
+    sf->sample = fluid_sfcache_append(sf->sample, &last, sample, &error);
+    sample_nodes[i] = last;
+
+    fluid_sfcache_get_name(sample->name, samples[i].name);
+    sample->start = samples[i].start;
+    sample->end = samples[i].end;
+    sample->loopstart = samples[i].loopstart;
+    sample->loopend = samples[i].loopend;
+    sample->samplerate = samples[i].samplerate;
+    sample->origpitch = samples[i].origpitch;
+    sample->pitchadj = samples[i].pitchadj;
+    sample->sampletype = samples[i].sampletype;
+  }
+
+  /* instruments */
+  last = NULL;
+  for (i = 0; i < hdr.ninsts && !error; i++) {
+    inst = FLUID_NEW(SFInst);
+    if (inst == NULL) {
+      error = TRUE;
+      break;
+    }
+    FLUID_MEMSET(inst, 0, sizeof(SFInst));
+    sf->inst = fluid_sfcache_append(sf->inst, &last, inst, &error);
+    inst_nodes[i] = last;
+
+    fluid_sfcache_get_name(inst->name, insts[i].name);
+    inst->zone = fluid_sfcache_get_zones(&hdr, data, &layout, insts[i].zone, insts[i].nzones,
+                                         sample_nodes, hdr.nsamples, &error);
+  }
+
+  /* presets */
+  last = NULL;
+  for (i = 0; i < hdr.npresets && !error; i++) {
+    preset = FLUID_NEW(SFPreset);
+    if (preset == NULL) {
+      error = TRUE;
+      break;
+    }
+    FLUID_MEMSET(preset, 0, sizeof(SFPreset));
+    sf->preset = fluid_sfcache_append(sf->preset, &last, preset, &error);
+
+    fluid_sfcache_get_name(preset->name, presets[i].name);
+    preset->prenum = presets[i].prenum;
+    preset->bank = presets[i].bank;
+    preset->libr = presets[i].libr;
+    preset->genre = presets[i].genre;
+    preset->morph = presets[i].morph;
+    preset->zone = fluid_sfcache_get_zones(&hdr, data, &layout, presets[i].zone, presets[i].nzones,
+                                           inst_nodes, hdr.ninsts, &error);
+  }
+
+  if (error || sf->fname == NULL) {
+    FLUID_LOG(FLUID_WARN, "The index cache '%s' is corrupt, ignoring it", name);
+    sfont_close(sf, NULL);
+    sf = NULL;
+  } else {
+    FLUID_LOG(FLUID_DBG, "Loaded the index of '%s' from '%s'", fname, name);
+  }
+
+ done:
+  FLUID_FREE(sample_nodes);
+  FLUID_FREE(inst_nodes);
+  fluid_sfcache_unmap(file_data, size, mapped);
+  FLUID_FREE(name);
+  return sf;
+}
@@ -0,0 +1,39 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+
+#ifndef _FLUID_SFCACHE_H
+#define _FLUID_SFCACHE_H
+
+#include "fluid_defsfont.h"
+
+/* Identifies the version of an opened SoundFont file */
+typedef struct
+{
+  fluid_long_long_t size;
+  fluid_long_long_t mtime;
+  fluid_long_long_t dev;
+  fluid_long_long_t ino;
+} fluid_sfcache_key_t;
+
+SFData* fluid_sfcache_load(const char* dir, const char* fname, const fluid_sfcache_key_t* key);
+int fluid_sfcache_save(const char* dir, const char* fname, const fluid_sfcache_key_t* key, SFData* sf);
+
+#endif
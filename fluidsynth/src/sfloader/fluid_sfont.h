@@ -56,6 +56,49 @@
   { if ((_preset) && (_preset)->notify) { (*(_preset)->notify)(_preset,_reason,_chan); }}
 
 
+/*
+ * Location of the data of a streamed sample (see fluid_rvoice_stream.c).
+ * Only the first 'resident' points are held in sample->data.
+ */
+typedef struct _fluid_sample_stream_t
+{
+  const char* filename;   /* file holding the sample data, 16 bit little endian */
+  fluid_long_long_t offset; /* byte offset of sample point 0 in the file */
+  unsigned int resident;  /* count of points held in sample->data */
+} fluid_sample_stream_t;
+
+
+/*
+ * The samples of the SoundFont loaders of the library (see new_fluid_sample).
+ * The public fluid_sample_t keeps its layout, the data only the library
+ * uses follows it. Such samples are told apart by their notify method,
+ * which passes the notifications on to 'notify'. Other samples, like
+ * those of the RAM SoundFont, have none of the extra data.
+ */
+typedef struct _fluid_sample_ext_t
+{
+  fluid_sample_t sample;
+  fluid_sample_stream_t* stream; /* set if only the start of the data is in sample.data */
+  float* float_data;        /* optional copy of the data converted to float */
+  fluid_sample_t* mipmap;   /* optional copy at about half the rate, and so on */
+  unsigned int serial;      /* numbers the samples in the order they were made */
+  int (*notify)(fluid_sample_t* sample, int reason);
+} fluid_sample_ext_t;
+
+int fluid_sample_ext_notify(fluid_sample_t* sample, int reason);
+
+#define fluid_sample_is_ext(_sample) ((_sample)->notify == fluid_sample_ext_notify)
+#define fluid_sample_ext(_sample) ((fluid_sample_ext_t*) (_sample))
+#define fluid_sample_get_stream(_sample) \
+  (fluid_sample_is_ext(_sample) ? fluid_sample_ext(_sample)->stream : NULL)
+#define fluid_sample_get_float_data(_sample) \
+  (fluid_sample_is_ext(_sample) ? fluid_sample_ext(_sample)->float_data : NULL)
+#define fluid_sample_get_mipmap(_sample) \
+  (fluid_sample_is_ext(_sample) ? fluid_sample_ext(_sample)->mipmap : NULL)
+#define fluid_sample_get_serial(_sample) \
+  (fluid_sample_is_ext(_sample) ? fluid_sample_ext(_sample)->serial : 0)
+
+
 #define fluid_sample_incr_ref(_sample) { (_sample)->refcount++; }
 
 #define fluid_sample_decr_ref(_sample) \
@@ -54,6 +54,7 @@ new_fluid_channel(fluid_synth_t* synth, int num)
   chan->channum = num;
   chan->preset = NULL;
   chan->tuning = NULL;
+  chan->polyphony = synth->channel_polyphony;
 
   fluid_channel_init(chan);
   fluid_channel_init_ctrl(chan, 0);
@@ -54,6 +54,7 @@ struct _fluid_channel_t
    */
   unsigned int  sostenuto_orderid;
   int interp_method;                    /**< Interpolation method (enum fluid_interp) */
+  int polyphony;                        /**< Maximum number of voices, 0 for no limit */
   fluid_tuning_t* tuning;               /**< Micro tuning */
   int tuning_bank;                      /**< Current tuning bank number */
   int tuning_prog;                      /**< Current tuning program number */
@@ -70,6 +70,14 @@ fluid_synth_get_preset_by_sfont_name(fluid_synth_t* synth, const char *sfontname
                                      unsigned int banknum, unsigned int prognum);
 
 static void fluid_synth_update_presets(fluid_synth_t* synth);
+
+/* Seconds of audio between updates of the quality governor */
+#define FLUID_GOVERNOR_INTERVAL   0.05
+/* Restore voices once the CPU load is below this part of the limit */
+#define FLUID_GOVERNOR_HYSTERESIS 0.75f
+
+static void fluid_synth_update_quality_LOCAL(fluid_synth_t* synth);
+static int fluid_synth_governor_timer(void* data, unsigned int msec);
 static int fluid_synth_update_sample_rate(fluid_synth_t* synth,
                                    char* name, double value);
 static int fluid_synth_update_gain(fluid_synth_t* synth,
@@ -85,6 +93,9 @@ static int fluid_synth_render_blocks(fluid_synth_t* synth, int blockcount);
 //static FLUID_INLINE void fluid_synth_process_event_queue_LOCAL
 //  (fluid_synth_t *synth, fluid_event_queue_t *queue);
 static fluid_voice_t* fluid_synth_free_voice_by_kill_LOCAL(fluid_synth_t* synth);
+static int fluid_synth_free_voice_in_scope_LOCAL(fluid_synth_t* synth,
+                                                 fluid_channel_t* channel,
+                                                 fluid_voice_t** voice);
 static void fluid_synth_kill_by_exclusive_class_LOCAL(fluid_synth_t* synth,
                                                       fluid_voice_t* new_voice);
 static fluid_sfont_info_t *new_fluid_sfont_info (fluid_synth_t *synth,
@@ -186,6 +197,36 @@ void fluid_synth_settings(fluid_settings_t* settings)
                               FLUID_HINT_TOGGLED, NULL, NULL);
   fluid_settings_register_int(settings, "synth.lock-memory", 1, 0, 1,
                               FLUID_HINT_TOGGLED, NULL, NULL);
+  fluid_settings_register_int(settings, "synth.mmap-samples", 0, 0, 1,
+                              FLUID_HINT_TOGGLED, NULL, NULL);
+  fluid_settings_register_int(settings, "synth.mmap-prefetch", 0, 0, 1,
+                              FLUID_HINT_TOGGLED, NULL, NULL);
+  fluid_settings_register_int(settings, "synth.dynamic-sample-loading", 0, 0, 1,
+                              FLUID_HINT_TOGGLED, NULL, NULL);
+  fluid_settings_register_int(settings, "synth.streaming", 0, 0, 1,
+                              FLUID_HINT_TOGGLED, NULL, NULL);
+  fluid_settings_register_int(settings, "synth.stream-preload", 100, 10, 10000, 0, NULL, NULL);
+  fluid_settings_register_int(settings, "synth.sample-dedup", 0, 0, 1,
+                              FLUID_HINT_TOGGLED, NULL, NULL);
+  fluid_settings_register_int(settings, "synth.sample-cache-budget", 0, 0, 1048576, 0, NULL, NULL);
+  fluid_settings_register_int(settings, "synth.sample-mipmaps", 0, 0, 1,
+                              FLUID_HINT_TOGGLED, NULL, NULL);
+  fluid_settings_register_int(settings, "synth.resample-samples", 0, 0, 1,
+                              FLUID_HINT_TOGGLED, NULL, NULL);
+  fluid_settings_register_int(settings, "synth.stereo-voices", 0, 0, 1,
+                              FLUID_HINT_TOGGLED, NULL, NULL);
+  fluid_settings_register_int(settings, "synth.filter-bypass", 0, 0, 1,
+                              FLUID_HINT_TOGGLED, NULL, NULL);
+  fluid_settings_register_int(settings, "synth.fixed-point", 0, 0, 1,
+                              FLUID_HINT_TOGGLED, NULL, NULL);
+  fluid_settings_register_num(settings, "synth.cull-threshold", 0.0f, 0.0f, 144.0f,
+                              0, NULL, NULL);
+  fluid_settings_register_num(settings, "synth.cpu-load-limit", 0.0f, 0.0f, 100.0f,
+                              0, NULL, NULL);
+  fluid_settings_register_int(settings, "synth.channel-polyphony", 0, 0, 65535, 0, NULL, NULL);
+  fluid_settings_register_int(settings, "synth.preset-polyphony", 0, 0, 65535, 0, NULL, NULL);
+  fluid_settings_register_int(settings, "synth.render-cache-budget", 0, 0, 4096, 0, NULL, NULL);
+  fluid_settings_register_int(settings, "synth.internal-rate-divider", 1, 1, 4, 0, NULL, NULL);
   fluid_settings_register_str(settings, "midi.portname", "", 0, NULL, NULL);
 
   fluid_settings_register_str(settings, "synth.default-soundfont",
@@ -226,6 +267,17 @@ void fluid_synth_settings(fluid_settings_t* settings)
   fluid_settings_add_option(settings, "synth.midi-bank-select", "xg");
   fluid_settings_add_option(settings, "synth.midi-bank-select", "mma");
   
+  fluid_settings_register_str(settings, "synth.denormal-mode", "ftz", 0, NULL, NULL);
+  fluid_settings_add_option(settings, "synth.denormal-mode", "off");
+  fluid_settings_add_option(settings, "synth.denormal-mode", "ftz");
+  fluid_settings_add_option(settings, "synth.denormal-mode", "offset");
+
+  fluid_settings_register_str(settings, "synth.index-cache-dir", "", 0, NULL, NULL);
+
+  fluid_settings_register_str(settings, "synth.sample-format", "int16", 0, NULL, NULL);
+  fluid_settings_add_option(settings, "synth.sample-format", "int16");
+  fluid_settings_add_option(settings, "synth.sample-format", "float");
+
 }
 
 /**
@@ -554,7 +606,7 @@ new_fluid_synth(fluid_settings_t *settings)
   fluid_synth_t* synth;
   fluid_stream_loader_t* stream;
   fluid_sfloader_t* loader;
-  double gain;
+  double gain, d;
   int i, nbuf;
 
   /* initialize all the conversion tables and other stuff */
@@ -580,9 +632,14 @@ new_fluid_synth(fluid_settings_t *settings)
   fluid_settings_getint(settings, "synth.chorus.active", &synth->with_chorus);
   fluid_settings_getint(settings, "synth.verbose", &synth->verbose);
   fluid_settings_getint(settings, "synth.dump", &synth->dump);
+  fluid_settings_getint(settings, "synth.filter-bypass", &synth->filter_bypass);
+  fluid_settings_getint(settings, "synth.channel-polyphony", &synth->channel_polyphony);
+  fluid_settings_getint(settings, "synth.preset-polyphony", &synth->preset_polyphony);
 
   fluid_settings_getint(settings, "synth.polyphony", &synth->polyphony);
   fluid_settings_getnum(settings, "synth.sample-rate", &synth->sample_rate);
+  fluid_settings_getint(settings, "synth.internal-rate-divider", &synth->rate_divider);
+  synth->sample_rate /= synth->rate_divider;
   fluid_settings_getint(settings, "synth.midi-channels", &synth->midi_channels);
   fluid_settings_getint(settings, "synth.audio-channels", &synth->audio_channels);
   fluid_settings_getint(settings, "synth.audio-groups", &synth->audio_groups);
@@ -673,6 +730,54 @@ new_fluid_synth(fluid_settings_t *settings)
   if (synth->eventhandler == NULL)
     goto error_recovery; 
 
+  /* Render at a fraction of the output rate and upsample the output */
+  if (fluid_rvoice_mixer_set_rate_divider(synth->eventhandler->mixer,
+                                          synth->rate_divider) != FLUID_OK)
+    goto error_recovery;
+
+  /* Integer voice and reverb kernels for targets without a fast FPU */
+  fluid_settings_getint(settings, "synth.fixed-point", &i);
+  if (i) {
+#ifdef WITH_FIXED_POINT
+    fluid_rvoice_mixer_set_fixed_point(synth->eventhandler->mixer, 1);
+#else
+    FLUID_LOG(FLUID_WARN, "synth.fixed-point ignored, fixed point support not compiled in");
+#endif
+  }
+
+  /* Configure denormal handling before any mixer thread is started */
+  i = FLUID_DENORMAL_FTZ;
+  if (fluid_settings_str_equal (settings, "synth.denormal-mode", "off") == 1)
+    i = FLUID_DENORMAL_OFF;
+  else if (fluid_settings_str_equal (settings, "synth.denormal-mode", "offset") == 1)
+    i = FLUID_DENORMAL_OFFSET;
+  if (i == FLUID_DENORMAL_FTZ && !fluid_denormal_ftz_available()) {
+    FLUID_LOG(FLUID_INFO, "Flush-to-zero not supported, using an anti-denormal offset");
+    i = FLUID_DENORMAL_OFFSET;
+  }
+  fluid_rvoice_mixer_set_denormal_mode(synth->eventhandler->mixer, i);
+
+  fluid_settings_getnum(settings, "synth.cull-threshold", &d);
+  fluid_rvoice_mixer_set_cull_threshold(synth->eventhandler->mixer, d);
+  fluid_settings_getnum(settings, "synth.cpu-load-limit", &d);
+  synth->cpu_load_limit = d;
+
+  /* Streamed samples need an I/O thread feeding the voices */
+  fluid_settings_getint(settings, "synth.streaming", &i);
+  if (i) {
+    synth->streamer = new_fluid_rvoice_streamer();
+    if (synth->streamer == NULL)
+      goto error_recovery;
+  }
+
+  /* One-shot voices replay the blocks of earlier, identical voices */
+  fluid_settings_getint(settings, "synth.render-cache-budget", &i);
+  if (i > 0) {
+    synth->render_cache = new_fluid_render_cache(i);
+    if (synth->render_cache == NULL)
+      goto error_recovery;
+  }
+
 #ifdef LADSPA
   /* Create and initialize the Fx unit.*/
   synth->LADSPA_FxUnit = new_fluid_LADSPA_FxUnit(synth);
@@ -705,7 +810,8 @@ new_fluid_synth(fluid_settings_t *settings)
   /* allocate all synthesis processes */
   synth->nvoice = synth->polyphony;
   synth->voice = FLUID_ARRAY(fluid_voice_t*, synth->nvoice);
-  if (synth->voice == NULL) {
+  synth->voice_rank = FLUID_ARRAY(fluid_voice_rank_t, synth->nvoice);
+  if (synth->voice == NULL || synth->voice_rank == NULL) {
     goto error_recovery;
   }
   for (i = 0; i < synth->nvoice; i++) {
@@ -713,9 +819,15 @@ new_fluid_synth(fluid_settings_t *settings)
     if (synth->voice[i] == NULL) {
       goto error_recovery;
     }
+    if (synth->streamer != NULL
+        && fluid_voice_add_streams(synth->voice[i], synth->streamer) != FLUID_OK) {
+      goto error_recovery;
+    }
+    if (synth->render_cache != NULL)
+      fluid_voice_set_render_cache(synth->voice[i], synth->render_cache);
   }
 
-  fluid_synth_set_sample_rate(synth, synth->sample_rate);
+  fluid_synth_set_sample_rate(synth, synth->sample_rate * synth->rate_divider);
   
   fluid_synth_update_overflow(synth, "", 0.0f);
   fluid_synth_update_mixer(synth, fluid_rvoice_mixer_set_polyphony, 
@@ -763,6 +875,17 @@ new_fluid_synth(fluid_settings_t *settings)
   /* FIXME */
   synth->start = fluid_curtime();
 
+  /* The governor runs when the API is entered. It must not run in the
+     rendering thread, so a timer enters the API while it's idle. */
+  if (synth->cpu_load_limit > 0.0f && synth->use_mutex
+      && synth->eventhandler->is_threadsafe) {
+    synth->governor_timer = new_fluid_timer((int) (FLUID_GOVERNOR_INTERVAL * 1000),
+                                            fluid_synth_governor_timer, synth,
+                                            TRUE, FALSE, FALSE);
+    if (synth->governor_timer == NULL)
+      goto error_recovery;
+  }
+
   return synth;
 
  error_recovery:
@@ -794,6 +917,9 @@ delete_fluid_synth(fluid_synth_t* synth)
 
   fluid_profiling_print();
 
+  if (synth->governor_timer != NULL)
+    delete_fluid_timer(synth->governor_timer);
+
   /* turn off all voices, needed to unload SoundFont data */
   if (synth->voice != NULL) {
     for (i = 0; i < synth->nvoice; i++) {
@@ -816,6 +942,8 @@ delete_fluid_synth(fluid_synth_t* synth)
   if (synth->eventhandler)
     delete_fluid_rvoice_eventhandler(synth->eventhandler);
 
+  delete_fluid_rvoice_streamer(synth->streamer);
+
   /* delete all the SoundFonts */
   for (list = synth->sfont_info; list; list = fluid_list_next (list)) {
     sfont_info = (fluid_sfont_info_t *)fluid_list_get (list);
@@ -825,6 +953,7 @@ delete_fluid_synth(fluid_synth_t* synth)
 
   delete_fluid_list(synth->sfont_info);
 
+  delete_fluid_render_cache(synth->render_cache);
 
   /* Delete the SoundFont info hash */
   if (synth->sfont_hash) delete_fluid_hashtable (synth->sfont_hash);
@@ -857,6 +986,9 @@ delete_fluid_synth(fluid_synth_t* synth)
     }
     FLUID_FREE(synth->voice);
   }
+  if (synth->voice_rank != NULL) {
+    FLUID_FREE(synth->voice_rank);
+  }
 
 
   /* free the tunings, if any */
@@ -2203,6 +2335,9 @@ fluid_synth_update_sample_rate(fluid_synth_t* synth, char* name, double value)
  * @param synth FluidSynth instance
  * @param sample_rate New sample rate (Hz)
  * @since 1.1.2
+ *
+ * With synth.internal-rate-divider above 1, this is the output rate, voices
+ * and effects are rendered at the rate divided by it.
  */
 void 
 fluid_synth_set_sample_rate(fluid_synth_t* synth, float sample_rate)
@@ -2211,6 +2346,7 @@ fluid_synth_set_sample_rate(fluid_synth_t* synth, float sample_rate)
   fluid_return_if_fail (synth != NULL);
   fluid_synth_api_enter(synth);
   fluid_clip (sample_rate, 8000.0f, 96000.0f);
+  sample_rate /= synth->rate_divider;
   synth->sample_rate = sample_rate;
   
   fluid_settings_getint(synth->settings, "synth.min-note-length", &i);
@@ -2324,13 +2460,24 @@ fluid_synth_update_polyphony_LOCAL(fluid_synth_t* synth, int new_polyphony)
     /* Create more voices */
     fluid_voice_t** new_voices = FLUID_REALLOC(synth->voice, 
 					       sizeof(fluid_voice_t*) * new_polyphony);
+    fluid_voice_rank_t* new_rank;
     if (new_voices == NULL) 
       return FLUID_FAILED;
     synth->voice = new_voices;
+    new_rank = FLUID_REALLOC(synth->voice_rank,
+                             sizeof(fluid_voice_rank_t) * new_polyphony);
+    if (new_rank == NULL)
+      return FLUID_FAILED;
+    synth->voice_rank = new_rank;
     for (i = synth->nvoice; i < new_polyphony; i++) {
       synth->voice[i] = new_fluid_voice(synth->sample_rate);
       if (synth->voice[i] == NULL) 
 	return FLUID_FAILED;
+      if (synth->streamer != NULL
+          && fluid_voice_add_streams(synth->voice[i], synth->streamer) != FLUID_OK)
+	return FLUID_FAILED;
+      if (synth->render_cache != NULL)
+        fluid_voice_set_render_cache(synth->voice[i], synth->render_cache);
     }
     synth->nvoice = new_polyphony;
   }
@@ -2388,6 +2535,71 @@ fluid_synth_get_active_voice_count(fluid_synth_t* synth)
   FLUID_API_RETURN(result);
 }
 
+/**
+ * Set the maximum number of voices a MIDI channel may play.
+ * @param synth FluidSynth instance
+ * @param chan MIDI channel number (0 to MIDI channel count - 1)
+ * @param polyphony Maximum number of voices, 0 for no limit
+ * @return FLUID_OK on success, FLUID_FAILED otherwise
+ * @since 1.1.7
+ *
+ * A new voice beyond the limit replaces the least important voice of the
+ * channel, ranked like voices to be stolen when the total polyphony is
+ * exceeded, or isn't played if none can be replaced. The limit starts at
+ * the synth.channel-polyphony setting and is kept by a system reset.
+ */
+int
+fluid_synth_set_channel_polyphony(fluid_synth_t* synth, int chan, int polyphony)
+{
+  fluid_return_val_if_fail (polyphony >= 0 && polyphony <= 65535, FLUID_FAILED);
+  FLUID_API_ENTRY_CHAN(FLUID_FAILED);
+
+  synth->channel[chan]->polyphony = polyphony;
+
+  FLUID_API_RETURN(FLUID_OK);
+}
+
+/**
+ * Get the maximum number of voices a MIDI channel may play.
+ * @param synth FluidSynth instance
+ * @param chan MIDI channel number (0 to MIDI channel count - 1)
+ * @return Maximum number of voices, 0 for no limit, FLUID_FAILED on error
+ * @since 1.1.7
+ */
+int
+fluid_synth_get_channel_polyphony(fluid_synth_t* synth, int chan)
+{
+  int result;
+  FLUID_API_ENTRY_CHAN(FLUID_FAILED);
+
+  result = synth->channel[chan]->polyphony;
+
+  FLUID_API_RETURN(result);
+}
+
+/**
+ * Get the number of voices playing on a MIDI channel.
+ * @param synth FluidSynth instance
+ * @param chan MIDI channel number (0 to MIDI channel count - 1)
+ * @return Number of voices of the channel, which are playing or releasing,
+ *   FLUID_FAILED on error
+ * @since 1.1.7
+ */
+int
+fluid_synth_get_channel_voice_count(fluid_synth_t* synth, int chan)
+{
+  int i, result = 0;
+  FLUID_API_ENTRY_CHAN(FLUID_FAILED);
+
+  for (i = 0; i < synth->polyphony; i++) {
+    if (_PLAYING(synth->voice[i]) && synth->voice[i]->chan == chan) {
+      result++;
+    }
+  }
+
+  FLUID_API_RETURN(result);
+}
+
 /**
  * Get the internal synthesis buffer size value.
  * @param synth FluidSynth instance
@@ -2454,8 +2666,8 @@ fluid_synth_nwrite_float(fluid_synth_t* synth, int len,
   /* First, take what's still available in the buffer */
   count = 0;
   num = synth->cur;
-  if (synth->cur < FLUID_BUFSIZE) {
-    available = FLUID_BUFSIZE - synth->cur;
+  if (synth->cur < synth->curmax) {
+    available = synth->curmax - synth->cur;
     fluid_rvoice_mixer_get_bufs(synth->eventhandler->mixer, &left_in, &right_in);
 
     num = (available > len)? len : available;
@@ -2482,10 +2694,10 @@ fluid_synth_nwrite_float(fluid_synth_t* synth, int len,
   /* Then, run one_block() and copy till we have 'len' samples  */
   while (count < len) {
     fluid_rvoice_mixer_set_mix_fx(synth->eventhandler->mixer, 0);
-    fluid_synth_render_blocks(synth, 1); // TODO: 
+    synth->curmax = FLUID_BUFSIZE * fluid_synth_render_blocks(synth, 1);
     fluid_rvoice_mixer_get_bufs(synth->eventhandler->mixer, &left_in, &right_in);
 
-    num = (FLUID_BUFSIZE > len - count)? len - count : FLUID_BUFSIZE;
+    num = (synth->curmax > len - count)? len - count : synth->curmax;
 #ifdef WITH_FLOAT
     bytes = num * sizeof(float);
 #endif
@@ -2509,7 +2721,7 @@ fluid_synth_nwrite_float(fluid_synth_t* synth, int len,
   synth->cur = num;
 
   time = fluid_utime() - time;
-  cpu_load = 0.5 * (synth->cpu_load + time * synth->sample_rate / len / 10000.0);
+  cpu_load = 0.5 * (synth->cpu_load + time * synth->sample_rate * synth->rate_divider / len / 10000.0);
   fluid_atomic_float_set (&synth->cpu_load, cpu_load);
 
   if (!synth->eventhandler->is_threadsafe)
@@ -2612,7 +2824,7 @@ fluid_synth_write_float(fluid_synth_t* synth, int len,
   synth->cur = l;
 
   time = fluid_utime() - time;
-  cpu_load = 0.5 * (synth->cpu_load + time * synth->sample_rate / len / 10000.0);
+  cpu_load = 0.5 * (synth->cpu_load + time * synth->sample_rate * synth->rate_divider / len / 10000.0);
   fluid_atomic_float_set (&synth->cpu_load, cpu_load);
 
   if (!synth->eventhandler->is_threadsafe)
@@ -2736,7 +2948,7 @@ fluid_synth_write_s16(fluid_synth_t* synth, int len,
   fluid_profile(FLUID_PROF_WRITE, prof_ref);
 
   time = fluid_utime() - time;
-  cpu_load = 0.5 * (synth->cpu_load + time * synth->sample_rate / len / 10000.0);
+  cpu_load = 0.5 * (synth->cpu_load + time * synth->sample_rate * synth->rate_divider / len / 10000.0);
   fluid_atomic_float_set (&synth->cpu_load, cpu_load);
 
   if (!synth->eventhandler->is_threadsafe)
@@ -2819,6 +3031,91 @@ fluid_synth_check_finished_voices(fluid_synth_t* synth)
   }
 }
 
+static int
+fluid_voice_rank_compare(const void* a, const void* b)
+{
+  fluid_real_t pa = ((const fluid_voice_rank_t*) a)->prio;
+  fluid_real_t pb = ((const fluid_voice_rank_t*) b)->prio;
+
+  return (pa > pb) - (pa < pb);
+}
+
+static FLUID_INLINE int
+fluid_synth_quality_update_due(fluid_synth_t* synth)
+{
+  return synth->cpu_load_limit > 0.0f
+    && fluid_synth_get_ticks(synth) - synth->governor_ticks
+       >= FLUID_GOVERNOR_INTERVAL * synth->sample_rate;
+}
+
+/*
+ * The quality governor: while the CPU load is above synth.cpu-load-limit,
+ * degrade (see fluid_voice_set_degraded) a growing number of the least
+ * important voices, ranked like voices to be stolen. Once the load has
+ * fallen clearly below the limit, restore them step by step. Runs at most
+ * every FLUID_GOVERNOR_INTERVAL seconds of audio, when the public API is
+ * entered, since it touches the voices. The voices pass the changes on
+ * to the renderer as rvoice events.
+ */
+static void
+fluid_synth_update_quality_LOCAL(fluid_synth_t* synth)
+{
+  fluid_voice_t* voice;
+  unsigned int ticks;
+  float load;
+  int i, count, step, degraded;
+
+  if (!fluid_synth_quality_update_due(synth))
+    return;
+  ticks = fluid_synth_get_ticks(synth);
+  synth->governor_ticks = ticks;
+
+  count = 0;
+  for (i = 0; i < synth->polyphony; i++) {
+    voice = synth->voice[i];
+    if (!_PLAYING(voice))
+      continue;
+    synth->voice_rank[count].prio = fluid_voice_get_overflow_prio(voice, &synth->overflow, ticks);
+    /* Voices being stolen can't be updated, they fade out anyway */
+    if (synth->voice_rank[count].prio >= OVERFLOW_PRIO_CANNOT_KILL)
+      continue;
+    synth->voice_rank[count++].voice = voice;
+  }
+
+  /* Adjust by an eighth of the voices, with hysteresis */
+  step = count / 8 + 1;
+  degraded = synth->degraded_voices;
+  load = fluid_atomic_float_get(&synth->cpu_load);
+  if (load > synth->cpu_load_limit)
+    degraded += step;
+  else if (load < FLUID_GOVERNOR_HYSTERESIS * synth->cpu_load_limit)
+    degraded -= step;
+  if (degraded > count)
+    degraded = count;
+  if (degraded < 0)
+    degraded = 0;
+
+  if (degraded > 0 && degraded < count)
+    qsort(synth->voice_rank, count, sizeof(fluid_voice_rank_t), fluid_voice_rank_compare);
+  for (i = 0; i < count; i++)
+    fluid_voice_set_degraded(synth->voice_rank[i].voice, i < degraded);
+
+  fluid_atomic_int_set(&synth->degraded_voices, degraded);
+}
+
+/*
+ * Runs the quality governor while no other thread enters the API
+ */
+static int
+fluid_synth_governor_timer(void* data, unsigned int msec)
+{
+  fluid_synth_t* synth = data;
+
+  fluid_synth_api_enter(synth);
+  fluid_synth_api_exit(synth);
+  return 1;
+}
+
 /**
  * Process all waiting events in the rvoice queue.
  * Make sure no (other) rendering is running in parallel when
@@ -2845,8 +3142,12 @@ fluid_synth_render_blocks(fluid_synth_t* synth, int blockcount)
 //  synth->synth_thread_id = fluid_thread_get_id ();
 
   fluid_check_fpe("??? Just starting up ???");
-  
+
   fluid_rvoice_eventhandler_dispatch_all(synth->eventhandler);
+
+  /* With a reduced internal rate, each rendered block gives rate_divider
+   * output blocks */
+  blockcount = (blockcount + synth->rate_divider - 1) / synth->rate_divider;
   
   for (i=0; i < blockcount; i++) {
     fluid_sample_timer_process(synth);
@@ -2868,7 +3169,7 @@ fluid_synth_render_blocks(fluid_synth_t* synth, int blockcount)
 #endif
   fluid_check_fpe("??? Remainder of synth_one_block ???");
   fluid_profile(FLUID_PROF_ONE_BLOCK, prof_ref);
-  return blockcount;
+  return blockcount * synth->rate_divider;
 }
 
 
@@ -2934,6 +3235,110 @@ fluid_synth_free_voice_by_kill_LOCAL(fluid_synth_t* synth)
   return voice;
 }
 
+static void
+fluid_synth_kill_voice_in_scope_LOCAL(fluid_synth_t* synth, int index)
+{
+  fluid_voice_t* voice = synth->voice[index];
+
+  FLUID_LOG(FLUID_DBG, "Killing voice %d, index %d, chan %d, key %d (channel or preset polyphony exceeded)",
+	    voice->id, index, voice->chan, voice->key);
+  fluid_voice_off(voice);
+}
+
+/*
+ * Selects a voice for killing, if the channel of a new voice or the preset
+ * it plays already have as many voices as their polyphony limit allows.
+ * Only voices of that channel, or of that preset on any channel, compete,
+ * ranked like in fluid_synth_free_voice_by_kill_LOCAL. If both limits are
+ * reached, a voice of that preset on that channel makes room in both,
+ * otherwise one voice of each is killed. Other voices of the note being
+ * started are spared, as are voices which were killed during the current
+ * block already. Stores a killed voice in 'voice', NULL if there's room.
+ * Returns FLUID_FAILED, if a limit is reached and no voice can be killed,
+ * then the new voice must not be started.
+ */
+static int
+fluid_synth_free_voice_in_scope_LOCAL(fluid_synth_t* synth, fluid_channel_t* channel,
+                                      fluid_voice_t** voice)
+{
+  int i, in_chan, in_preset, can_kill;
+  int chan_count = 0, chan_best = -1;
+  int preset_count = 0, preset_best = -1;
+  int both_best = -1, chan_full, preset_full;
+  fluid_real_t chan_prio = 0, preset_prio = 0, both_prio = 0;
+  fluid_real_t this_voice_prio;
+  fluid_voice_t* v;
+  unsigned int ticks;
+
+  *voice = NULL;
+  if (channel->polyphony <= 0 && synth->preset_polyphony <= 0) {
+    return FLUID_OK;
+  }
+  ticks = fluid_synth_get_ticks(synth);
+
+  for (i = 0; i < synth->polyphony; i++) {
+    v = synth->voice[i];
+    if (!_PLAYING(v)) {
+      continue;
+    }
+    in_chan = (v->chan == channel->channum);
+    in_preset = (v->sfont_bank_prog == channel->sfont_bank_prog);
+    if (!in_chan && !in_preset) {
+      continue;
+    }
+
+    /* Unlike in fluid_synth_free_voice_by_kill_LOCAL, voices which have
+     * just been started may be killed, the limit is kept within a chord */
+    this_voice_prio = fluid_voice_get_overflow_prio(v, &synth->overflow,
+                                                    ticks);
+    can_kill = (v->id != synth->storeid
+                && this_voice_prio != OVERFLOW_PRIO_CANNOT_KILL);
+    if (in_chan) {
+      chan_count++;
+      if (can_kill && (chan_best < 0 || this_voice_prio < chan_prio)) {
+        chan_best = i;
+        chan_prio = this_voice_prio;
+      }
+    }
+    if (in_preset) {
+      preset_count++;
+      if (can_kill && (preset_best < 0 || this_voice_prio < preset_prio)) {
+        preset_best = i;
+        preset_prio = this_voice_prio;
+      }
+    }
+    if (in_chan && in_preset) {
+      if (can_kill && (both_best < 0 || this_voice_prio < both_prio)) {
+        both_best = i;
+        both_prio = this_voice_prio;
+      }
+    }
+  }
+
+  chan_full = (channel->polyphony > 0 && chan_count >= channel->polyphony);
+  preset_full = (synth->preset_polyphony > 0 && preset_count >= synth->preset_polyphony);
+
+  if (chan_full && preset_full && both_best >= 0) {
+    chan_best = both_best;
+    preset_full = FALSE;
+  }
+  if ((chan_full && chan_best < 0) || (preset_full && preset_best < 0)) {
+    return FLUID_FAILED;
+  }
+
+  if (chan_full) {
+    fluid_synth_kill_voice_in_scope_LOCAL(synth, chan_best);
+    *voice = synth->voice[chan_best];
+  }
+  if (preset_full) {
+    fluid_synth_kill_voice_in_scope_LOCAL(synth, preset_best);
+    if (*voice == NULL) {
+      *voice = synth->voice[preset_best];
+    }
+  }
+
+  return FLUID_OK;
+}
 
 /**
  * Allocate a synthesis voice.
@@ -2962,8 +3367,14 @@ fluid_synth_alloc_voice(fluid_synth_t* synth, fluid_sample_t* sample, int chan,
   fluid_return_val_if_fail (sample != NULL, NULL);
   FLUID_API_ENTRY_CHAN(NULL);
 
+  /* Keep the channel and its preset within their own polyphony */
+  if (fluid_synth_free_voice_in_scope_LOCAL(synth, synth->channel[chan], &voice) != FLUID_OK) {
+    FLUID_LOG(FLUID_DBG, "Channel or preset polyphony exceeded. (chan=%d,key=%d)", chan, key);
+    FLUID_API_RETURN(NULL);
+  }
+
   /* check if there's an available synthesis process */
-  for (i = 0; i < synth->polyphony; i++) {
+  for (i = 0; voice == NULL && i < synth->polyphony; i++) {
     if (_AVAILABLE(synth->voice[i])) {
       voice = synth->voice[i];
       break;
@@ -3252,6 +3663,13 @@ fluid_synth_sfont_unref (fluid_synth_t *synth, fluid_sfont_t *sfont)
 
   if (refcount == 0)                    /* No more references? - Attempt delete */
   {
+    /* Cached blocks refer to the samples by address, forget them before
+     * the samples can go. No voice can start on the SoundFont anymore and
+     * the ones still recording don't publish, so the timer below doesn't
+     * need to flush again. */
+    if (synth->render_cache != NULL)
+      fluid_render_cache_flush (synth->render_cache);
+
     if (delete_fluid_sfont (sfont_info->sfont) == 0)    /* SoundFont loader can block SoundFont unload */
     {
       FLUID_FREE (sfont_info);
@@ -3786,6 +4204,23 @@ fluid_synth_get_reverb_width(fluid_synth_t* synth)
   FLUID_API_RETURN(result);
 }
 
+/**
+ * Check whether the reverb unit is currently asleep. The reverb is bypassed
+ * while its send input and its decaying tail are inaudible, and wakes up
+ * again as soon as a voice feeds it.
+ * @param synth FluidSynth instance
+ * @param wakeups Location to store the number of times the reverb woke up
+ *   since the synth was created (may be NULL)
+ * @return TRUE if the reverb is sleeping, FALSE otherwise
+ * @since 1.1.7
+ */
+int
+fluid_synth_get_reverb_sleeping(fluid_synth_t* synth, int* wakeups)
+{
+  fluid_return_val_if_fail (synth != NULL, FALSE);
+  return fluid_rvoice_mixer_get_reverb_sleeping(synth->eventhandler->mixer, wakeups);
+}
+
 /**
  * Enable or disable chorus effect.
  * @param synth FluidSynth instance
@@ -3949,6 +4384,23 @@ fluid_synth_get_chorus_type(fluid_synth_t* synth)
   FLUID_API_RETURN(result);
 }
 
+/**
+ * Check whether the chorus unit is currently asleep. The chorus is bypassed
+ * while its send input and its output are inaudible, and wakes up again as
+ * soon as a voice feeds it.
+ * @param synth FluidSynth instance
+ * @param wakeups Location to store the number of times the chorus woke up
+ *   since the synth was created (may be NULL)
+ * @return TRUE if the chorus is sleeping, FALSE otherwise
+ * @since 1.1.7
+ */
+int
+fluid_synth_get_chorus_sleeping(fluid_synth_t* synth, int* wakeups)
+{
+  fluid_return_val_if_fail (synth != NULL, FALSE);
+  return fluid_rvoice_mixer_get_chorus_sleeping(synth->eventhandler->mixer, wakeups);
+}
+
 /*
  * If the same note is hit twice on the same channel, then the older
  * voice process is advanced to the release stage.  Using a mechanical
@@ -4090,6 +4542,74 @@ fluid_synth_get_cpu_load(fluid_synth_t* synth)
   return fluid_atomic_float_get (&synth->cpu_load);
 }
 
+/**
+ * Get the number of voices culled early.
+ * @param synth FluidSynth instance
+ * @return Count of released voices, which were faded out because they had
+ *   fallen synth.cull-threshold dB below the output peak, 0 if that setting
+ *   is 0
+ * @since 1.1.7
+ */
+int
+fluid_synth_get_culled_voices(fluid_synth_t* synth)
+{
+  fluid_return_val_if_fail (synth != NULL, 0);
+  return fluid_rvoice_mixer_get_culled_voices (synth->eventhandler->mixer);
+}
+
+/**
+ * Get the number of voices playing at reduced quality.
+ * @param synth FluidSynth instance
+ * @return Count of the least important voices, whose interpolation order
+ *   was lowered because the CPU load exceeded synth.cpu-load-limit, 0 if
+ *   that setting is 0
+ * @since 1.1.7
+ */
+int
+fluid_synth_get_degraded_voices(fluid_synth_t* synth)
+{
+  fluid_return_val_if_fail (synth != NULL, 0);
+  return fluid_atomic_int_get (&synth->degraded_voices);
+}
+
+/**
+ * Get the number of blocks replayed from the render cache.
+ * @param synth FluidSynth instance
+ * @param misses Location to store the count of blocks which one-shot
+ *   voices had to render themselves, or NULL
+ * @return Count of voice blocks which were replayed from the blocks of an
+ *   earlier voice instead of being rendered, 0 if the
+ *   synth.render-cache-budget setting is 0
+ * @since 1.1.7
+ */
+int
+fluid_synth_get_render_cache_hits(fluid_synth_t* synth, int* misses)
+{
+  if (misses)
+    *misses = 0;
+  fluid_return_val_if_fail (synth != NULL, 0);
+  if (synth->render_cache == NULL)
+    return 0;
+  return fluid_render_cache_get_hits (synth->render_cache, misses);
+}
+
+/**
+ * Get the number of disk streaming underruns.
+ * @param synth FluidSynth instance
+ * @return Count of rendered blocks in which a voice played silence because
+ *   its streamed sample data wasn't read from disk in time, 0 if the
+ *   synth.streaming setting is off
+ * @since 1.1.7
+ */
+int
+fluid_synth_get_stream_underruns(fluid_synth_t* synth)
+{
+  fluid_return_val_if_fail (synth != NULL, 0);
+  if (synth->streamer == NULL)
+    return 0;
+  return fluid_rvoice_streamer_get_underruns (synth->streamer);
+}
+
 /* Get tuning for a given bank:program */
 static fluid_tuning_t *
 fluid_synth_get_tuning(fluid_synth_t* synth, int bank, int prog)
@@ -5017,6 +5537,7 @@ fluid_synth_api_enter(fluid_synth_t* synth)
   }
   if (!synth->public_api_count) {
     fluid_synth_check_finished_voices(synth);
+    fluid_synth_update_quality_LOCAL(synth);
   }
   synth->public_api_count++;
 }
@@ -5074,6 +5595,22 @@ void fluid_synth_delete_stream_sfloader(fluid_sfloader_t* loader)
   delete_fluid_defsfloader(loader);
 }
 
+/**
+ * Creates a stream loader reading a SoundFont from memory. Use it with
+ * fluid_synth_new_stream_sfloader() to load SoundFonts which are already
+ * in memory. The sample data isn't copied but used in place, so \a data
+ * has to stay valid until the SoundFonts loaded from it are unloaded.
+ * The filename passed to fluid_synth_sfload() only names the SoundFont.
+ * @param data SoundFont file contents
+ * @param size Size of \a data in bytes
+ * @return New stream loader, free it with its free method
+ * @since 1.1.7
+ */
+fluid_stream_loader_t* fluid_synth_new_memory_stream_loader(const void* data, fluid_long_long_t size)
+{
+  return new_fluid_memory_stream_loader(data, size);
+}
+
 fluid_stream_loader_t* fluid_synth_new_asset_stream_loader(void* jniEnv, void* assetManager)
 {
   return new_fluid_android_asset_stream_loader(jniEnv, assetManager);
@@ -102,6 +102,18 @@ typedef struct _fluid_sfont_info_t {
   int bankofs;          /**< Bank offset */
 } fluid_sfont_info_t;
 
+/*
+ * fluid_voice_rank_t
+ *
+ * A playing voice and its overflow priority, used to find the least
+ * important voices when the CPU load is too high.
+ */
+typedef struct _fluid_voice_rank_t
+{
+  fluid_real_t prio;    /**< Overflow priority of the voice */
+  fluid_voice_t* voice; /**< The voice */
+} fluid_voice_rank_t;
+
 /*
  * fluid_synth_t
  *
@@ -112,6 +124,7 @@ typedef struct _fluid_sfont_info_t {
  *
  * ticks_since_start - atomic, set by rendering thread only
  * cpu_load - atomic, set by rendering thread only
+ * degraded_voices - atomic, set by public API thread only
  * cur, curmax, dither_index - used by rendering thread only
  * LADSPA_FxUnit - same instance copied in rendering thread. Synchronising handled internally (I think...?).
  *
@@ -130,7 +143,11 @@ struct _fluid_synth_t
   int with_chorus;                   /**< Should the synth use the built-in chorus unit? */
   int verbose;                       /**< Turn verbose mode on? */
   int dump;                          /**< Dump events to stdout to hook up a user interface? */
-  double sample_rate;                /**< The sample rate */
+  int filter_bypass;                 /**< Bypass the voice filter while it is wide open? */
+  int channel_polyphony;             /**< Initial maximum number of voices per channel, 0 for no limit */
+  int preset_polyphony;              /**< Maximum number of voices per preset, 0 for no limit */
+  double sample_rate;                /**< The sample rate voices and effects are rendered at */
+  int rate_divider;                  /**< Output samples per rendered sample (synth.internal-rate-divider) */
   int midi_channels;                 /**< the number of MIDI channels (>= 16) */
   int bank_select;                   /**< the style of Bank Select MIDI messages */
   int audio_channels;                /**< the number of audio channels (1 channel=left+right) */
@@ -155,6 +172,8 @@ struct _fluid_synth_t
   unsigned int noteid;               /**< the id is incremented for every new note. it's used for noteoff's  */
   unsigned int storeid;
   fluid_rvoice_eventhandler_t* eventhandler;
+  fluid_rvoice_streamer_t* streamer; /**< Reads streamed sample data, NULL if synth.streaming is off */
+  fluid_render_cache_t* render_cache; /**< Blocks replayed by one-shot voices, NULL if synth.render-cache-budget is 0 */
 
   float reverb_roomsize;             /**< Shadow of reverb roomsize */
   float reverb_damping;              /**< Shadow of reverb damping */
@@ -173,6 +192,11 @@ struct _fluid_synth_t
 
   char outbuf[256];                  /**< buffer for message output */
   float cpu_load;                    /**< CPU load in percent (CPU time required / audio synthesized time * 100) */
+  float cpu_load_limit;              /**< Degrade the least important voices above this CPU load, 0 for never */
+  unsigned int governor_ticks;       /**< Tick count of the last quality governor update */
+  int degraded_voices;               /**< Number of voices playing at reduced quality */
+  fluid_voice_rank_t* voice_rank;    /**< Scratch array of nvoice ranks for the quality governor */
+  fluid_timer_t* governor_timer;     /**< Runs the quality governor while the API is idle */
 
   fluid_tuning_t*** tuning;          /**< 128 banks of 128 programs for the tunings */
   fluid_private_t tuning_iter;       /**< Tuning iterators per each thread */
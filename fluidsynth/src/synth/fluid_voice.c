@@ -101,6 +101,7 @@ fluid_voice_get_lower_boundary_for_attenuation(fluid_voice_t* voice);
 
 #define UPDATE_RVOICE2(proc, iarg, rarg) UPDATE_RVOICE_GENERIC_IR(proc, voice->rvoice, iarg, rarg)
 #define UPDATE_RVOICE_BUFFERS2(proc, iarg, rarg) UPDATE_RVOICE_GENERIC_IR(proc, &voice->rvoice->buffers, iarg, rarg)
+#define UPDATE_RVOICE_LINKED_BUFFERS2(proc, iarg, rarg) UPDATE_RVOICE_GENERIC_IR(proc, &voice->rvoice->linked_buffers, iarg, rarg)
 #define UPDATE_RVOICE_ENVLFO_R1(proc, envp, rarg) UPDATE_RVOICE_GENERIC_R1(proc, &voice->rvoice->envlfo.envp, rarg) 
 #define UPDATE_RVOICE_ENVLFO_I1(proc, envp, iarg) UPDATE_RVOICE_GENERIC_I1(proc, &voice->rvoice->envlfo.envp, iarg) 
 
@@ -201,6 +202,7 @@ new_fluid_voice(fluid_real_t output_rate)
   voice->vel = 0;
   voice->channel = NULL;
   voice->sample = NULL;
+  voice->linked_sample = NULL;
 
   /* Initialize both the rvoice and overflow_rvoice */
   voice->can_access_rvoice = 1; 
@@ -233,6 +235,31 @@ delete_fluid_voice(fluid_voice_t* voice)
   return FLUID_OK;
 }
 
+/*
+ * Give both rvoices of a voice a disk stream for streamed samples.
+ * Must be called before the voice is used.
+ */
+int
+fluid_voice_add_streams(fluid_voice_t* voice, fluid_rvoice_streamer_t* streamer)
+{
+  voice->rvoice->stream = fluid_rvoice_streamer_new_stream(streamer);
+  voice->overflow_rvoice->stream = fluid_rvoice_streamer_new_stream(streamer);
+  if (voice->rvoice->stream == NULL || voice->overflow_rvoice->stream == NULL)
+    return FLUID_FAILED;
+  return FLUID_OK;
+}
+
+/*
+ * Let both rvoices of a voice replay and record blocks of the render
+ * cache. Must be called before the voice is used.
+ */
+void
+fluid_voice_set_render_cache(fluid_voice_t* voice, fluid_render_cache_t* cache)
+{
+  voice->rvoice->memo.cache = cache;
+  voice->overflow_rvoice->memo.cache = cache;
+}
+
 /* fluid_voice_init
  *
  * Initialize the synthesis process
@@ -266,10 +293,12 @@ fluid_voice_init(fluid_voice_t* voice, fluid_sample_t* sample,
   voice->key = (unsigned char) key;
   voice->vel = (unsigned char) vel;
   voice->channel = channel;
+  voice->sfont_bank_prog = channel->sfont_bank_prog;
   voice->mod_count = 0;
   voice->start_time = start_time;
   voice->debug = 0;
   voice->has_noteoff = 0;
+  voice->degraded = 0;
   UPDATE_RVOICE0(fluid_rvoice_reset);
 
   /* Increment the reference count of the sample to prevent the
@@ -282,6 +311,8 @@ fluid_voice_init(fluid_voice_t* voice, fluid_sample_t* sample,
 
   i = fluid_channel_get_interp_method(channel);
   UPDATE_RVOICE_I1(fluid_rvoice_set_interp_method, i);
+  UPDATE_RVOICE_GENERIC_I1(fluid_iir_filter_set_bypass, &voice->rvoice->resonant_filter,
+                           channel->synth->filter_bypass);
 
   /* Set all the generators to their default value, according to SF
    * 2.01 section 8.1.3 (page 48). The value of NRPN messages are
@@ -310,6 +341,66 @@ fluid_voice_init(fluid_voice_t* voice, fluid_sample_t* sample,
   return FLUID_OK;
 }
 
+/*
+ * Let the voice also play the other channel of a linked stereo sample,
+ * with the same phase, envelopes and modulators (see
+ * fluid_defpreset_noteon). The sample must have the length and the loop
+ * of the voice's sample. 'pan' is the pan of the linked channel relative
+ * to the pan of the voice, the pan modulators move both channels.
+ * Call after fluid_voice_init and before the voice is started.
+ */
+int
+fluid_voice_set_linked_sample(fluid_voice_t* voice, fluid_sample_t* sample,
+                              fluid_real_t pan)
+{
+  int i;
+
+  /* Referenced like the voice's sample, see fluid_voice_init */
+  fluid_sample_incr_ref(sample);
+  UPDATE_RVOICE_PTR(fluid_rvoice_set_linked_sample, sample);
+  fluid_sample_incr_ref(sample);
+  voice->linked_sample = sample;
+  voice->linked_pan = pan;
+
+  /* Same buffer mapping as the voice's sample */
+  i = voice->channel->synth->audio_groups;
+  UPDATE_RVOICE_LINKED_BUFFERS2(fluid_rvoice_buffers_set_mapping, 2, i*2 + SYNTH_REVERB_CHANNEL);
+  UPDATE_RVOICE_LINKED_BUFFERS2(fluid_rvoice_buffers_set_mapping, 3, i*2 + SYNTH_CHORUS_CHANNEL);
+  i = 2 * (voice->chan % i);
+  UPDATE_RVOICE_LINKED_BUFFERS2(fluid_rvoice_buffers_set_mapping, 0, i);
+  UPDATE_RVOICE_LINKED_BUFFERS2(fluid_rvoice_buffers_set_mapping, 1, i+1);
+
+  return FLUID_OK;
+}
+
+/*
+ * Play the voice at reduced quality, or restore the quality set for its
+ * channel. A degraded voice interpolates one order lower (7th order
+ * becomes 4th order, 4th order becomes linear) and bypasses its filter
+ * while it is wide open. Used by the synth when the CPU load exceeds
+ * synth.cpu-load-limit.
+ */
+void
+fluid_voice_set_degraded(fluid_voice_t* voice, int degraded)
+{
+  int interp;
+
+  if (voice->degraded == degraded)
+    return;
+  voice->degraded = degraded;
+
+  interp = fluid_channel_get_interp_method(voice->channel);
+  if (degraded) {
+    if (interp >= FLUID_INTERP_7THORDER)
+      interp = FLUID_INTERP_4THORDER;
+    else if (interp >= FLUID_INTERP_4THORDER)
+      interp = FLUID_INTERP_LINEAR;
+  }
+  UPDATE_RVOICE_I1(fluid_rvoice_set_interp_method, interp);
+  UPDATE_RVOICE_GENERIC_I1(fluid_iir_filter_set_bypass, &voice->rvoice->resonant_filter,
+                           degraded || voice->channel->synth->filter_bypass);
+}
+
 
 /**
  * Update sample rate. 
@@ -390,19 +481,24 @@ fluid_real_t fluid_voice_gen_value(fluid_voice_t* voice, int num)
  *
  * @param voice Voice to synthesize
  * @param dsp_buf Audio buffer to synthesize to (#FLUID_BUFSIZE in length)
+ * @param linked_buf Audio buffer to synthesize the linked channel of a
+ *   stereo sample to (#FLUID_BUFSIZE in length), may only be NULL if the
+ *   voice has no linked sample
  * @return Count of samples written to dsp_buf (can be 0)
  *
  * Panning, reverb and chorus are processed separately. The dsp interpolation
  * routine is in (fluid_dsp_float.c).
  */
 int
-fluid_voice_write (fluid_voice_t* voice, fluid_real_t *dsp_buf)
+fluid_voice_write (fluid_voice_t* voice, fluid_real_t *dsp_buf,
+                   fluid_real_t *linked_buf)
 {
   int result;
   if (!voice->can_access_rvoice) 
     return 0;
 
-  result = fluid_rvoice_write(voice->rvoice, dsp_buf);
+  fluid_return_val_if_fail (linked_buf != NULL || voice->linked_sample == NULL, 0);
+  result = fluid_rvoice_write(voice->rvoice, dsp_buf, linked_buf);
 
   if (result == -1)
     return 0;
@@ -418,6 +514,8 @@ fluid_voice_write (fluid_voice_t* voice, fluid_real_t *dsp_buf)
  * Mix voice data to left/right (panning), reverb and chorus buffers.
  * @param count Number of samples
  * @param dsp_buf Source buffer
+ * @param linked_buf Source buffer of the linked channel, as written by
+ *   fluid_voice_write(), NULL if the voice has no linked sample
  * @param voice Voice to mix
  * @param left_buf Left audio buffer
  * @param right_buf Right audio buffer
@@ -427,12 +525,14 @@ fluid_voice_write (fluid_voice_t* voice, fluid_real_t *dsp_buf)
  */
 void
 fluid_voice_mix (fluid_voice_t *voice, int count, fluid_real_t* dsp_buf,
+		 fluid_real_t* linked_buf,
 		 fluid_real_t* left_buf, fluid_real_t* right_buf,
 		 fluid_real_t* reverb_buf, fluid_real_t* chorus_buf)
 {
   fluid_rvoice_buffers_t buffers;
   fluid_real_t* dest_buf[4] = {left_buf, right_buf, reverb_buf, chorus_buf};
 
+  buffers.count = 0;
   fluid_rvoice_buffers_set_amp(&buffers, 0, voice->amp_left);
   fluid_rvoice_buffers_set_amp(&buffers, 1, voice->amp_right);
   fluid_rvoice_buffers_set_amp(&buffers, 2, voice->amp_reverb);
@@ -440,6 +540,13 @@ fluid_voice_mix (fluid_voice_t *voice, int count, fluid_real_t* dsp_buf,
  
   fluid_rvoice_buffers_mix(&buffers, dsp_buf, count, dest_buf, 4);
 
+  /* The linked channel has its own panning */
+  if (linked_buf != NULL && voice->linked_sample != NULL) {
+    fluid_rvoice_buffers_set_amp(&buffers, 0, voice->linked_amp_left);
+    fluid_rvoice_buffers_set_amp(&buffers, 1, voice->linked_amp_right);
+    fluid_rvoice_buffers_mix(&buffers, linked_buf, count, dest_buf, 4);
+  }
+
   fluid_check_fpe ("voice_mix");
 }
 
@@ -714,6 +821,12 @@ fluid_voice_update_param(fluid_voice_t* voice, int gen)
     voice->amp_right = fluid_pan(voice->pan, 0) * voice->synth_gain / 32768.0f;
     UPDATE_RVOICE_BUFFERS2(fluid_rvoice_buffers_set_amp, 0, voice->amp_left);
     UPDATE_RVOICE_BUFFERS2(fluid_rvoice_buffers_set_amp, 1, voice->amp_right);
+    if (voice->linked_sample != NULL) {
+      voice->linked_amp_left = fluid_pan(voice->pan + voice->linked_pan, 1) * voice->synth_gain / 32768.0f;
+      voice->linked_amp_right = fluid_pan(voice->pan + voice->linked_pan, 0) * voice->synth_gain / 32768.0f;
+      UPDATE_RVOICE_LINKED_BUFFERS2(fluid_rvoice_buffers_set_amp, 0, voice->linked_amp_left);
+      UPDATE_RVOICE_LINKED_BUFFERS2(fluid_rvoice_buffers_set_amp, 1, voice->linked_amp_right);
+    }
     break;
 
   case GEN_ATTENUATION:
@@ -746,6 +859,8 @@ fluid_voice_update_param(fluid_voice_t* voice, int gen)
     fluid_clip(voice->reverb_send, 0.0, 1.0);
     voice->amp_reverb = voice->reverb_send * voice->synth_gain / 32768.0f;
     UPDATE_RVOICE_BUFFERS2(fluid_rvoice_buffers_set_amp, 2, voice->amp_reverb);
+    if (voice->linked_sample != NULL)
+      UPDATE_RVOICE_LINKED_BUFFERS2(fluid_rvoice_buffers_set_amp, 2, voice->amp_reverb);
     break;
 
   case GEN_CHORUSSEND:
@@ -754,6 +869,8 @@ fluid_voice_update_param(fluid_voice_t* voice, int gen)
     fluid_clip(voice->chorus_send, 0.0, 1.0);
     voice->amp_chorus = voice->chorus_send * voice->synth_gain / 32768.0f;
     UPDATE_RVOICE_BUFFERS2(fluid_rvoice_buffers_set_amp, 3, voice->amp_chorus);
+    if (voice->linked_sample != NULL)
+      UPDATE_RVOICE_LINKED_BUFFERS2(fluid_rvoice_buffers_set_amp, 3, voice->amp_chorus);
     break;
 
   case GEN_OVERRIDEROOTKEY:
@@ -1275,6 +1392,7 @@ void fluid_voice_overflow_rvoice_finished(fluid_voice_t* voice)
 {
   voice->can_access_overflow_rvoice = 1;
   fluid_sample_null_ptr(&voice->overflow_rvoice->dsp.sample);
+  fluid_sample_null_ptr(&voice->overflow_rvoice->dsp.linked_sample);
 }
 
 
@@ -1293,14 +1411,17 @@ fluid_voice_off(fluid_voice_t* voice)
   voice->chan = NO_CHANNEL;
   UPDATE_RVOICE0(fluid_rvoice_voiceoff);
   
-  if (voice->can_access_rvoice)
+  if (voice->can_access_rvoice) {
     fluid_sample_null_ptr(&voice->rvoice->dsp.sample);
+    fluid_sample_null_ptr(&voice->rvoice->dsp.linked_sample);
+  }
 
   voice->status = FLUID_VOICE_OFF;
   voice->has_noteoff = 1;
 
   /* Decrement the reference count of the sample. */
   fluid_sample_null_ptr(&voice->sample);
+  fluid_sample_null_ptr(&voice->linked_sample);
 
   /* Decrement voice count */
   voice->channel->synth->active_voice_count--;
@@ -1494,6 +1615,15 @@ int fluid_voice_set_gain(fluid_voice_t* voice, fluid_real_t gain)
   UPDATE_RVOICE_BUFFERS2(fluid_rvoice_buffers_set_amp, 2, voice->amp_reverb);
   UPDATE_RVOICE_BUFFERS2(fluid_rvoice_buffers_set_amp, 3, voice->amp_chorus);
 
+  if (voice->linked_sample != NULL) {
+    voice->linked_amp_left = fluid_pan(voice->pan + voice->linked_pan, 1) * gain / 32768.0f;
+    voice->linked_amp_right = fluid_pan(voice->pan + voice->linked_pan, 0) * gain / 32768.0f;
+    UPDATE_RVOICE_LINKED_BUFFERS2(fluid_rvoice_buffers_set_amp, 0, voice->linked_amp_left);
+    UPDATE_RVOICE_LINKED_BUFFERS2(fluid_rvoice_buffers_set_amp, 1, voice->linked_amp_right);
+    UPDATE_RVOICE_LINKED_BUFFERS2(fluid_rvoice_buffers_set_amp, 2, voice->amp_reverb);
+    UPDATE_RVOICE_LINKED_BUFFERS2(fluid_rvoice_buffers_set_amp, 3, voice->amp_chorus);
+  }
+
   return FLUID_OK;
 }
 
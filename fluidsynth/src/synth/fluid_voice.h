@@ -70,8 +70,11 @@ struct _fluid_voice_t
 	fluid_mod_t mod[FLUID_NUM_MOD];
 	int mod_count;
 	fluid_sample_t* sample;         /* Pointer to sample (dupe in rvoice) */
+	fluid_sample_t* linked_sample;  /* Other channel of a linked stereo sample (dupe in rvoice) */
 
 	int has_noteoff;                /* Flag set when noteoff has been sent */
+	int degraded;                   /* Flag set while the voice plays at reduced quality */
+	int sfont_bank_prog;            /* Preset of the channel when the voice started, see fluid_channel_t */
 
 	/* basic parameters */
 	fluid_real_t output_rate;        /* the sample rate of the synthesizer (dupe in rvoice) */
@@ -91,6 +94,9 @@ struct _fluid_voice_t
 	fluid_real_t pan;
 	fluid_real_t amp_left;
 	fluid_real_t amp_right;
+	fluid_real_t linked_pan;         /* pan of the linked channel, relative to pan */
+	fluid_real_t linked_amp_left;
+	fluid_real_t linked_amp_right;
 
 	/* reverb */
 	fluid_real_t reverb_send;
@@ -114,15 +120,22 @@ struct _fluid_voice_t
 
 fluid_voice_t* new_fluid_voice(fluid_real_t output_rate);
 int delete_fluid_voice(fluid_voice_t* voice);
+int fluid_voice_add_streams(fluid_voice_t* voice, fluid_rvoice_streamer_t* streamer);
+void fluid_voice_set_render_cache(fluid_voice_t* voice, fluid_render_cache_t* cache);
 
 void fluid_voice_start(fluid_voice_t* voice);
 void  fluid_voice_calculate_gen_pitch(fluid_voice_t* voice);
 
-int fluid_voice_write (fluid_voice_t* voice, fluid_real_t *dsp_buf);
+int fluid_voice_write (fluid_voice_t* voice, fluid_real_t *dsp_buf,
+                       fluid_real_t *linked_buf);
 
 int fluid_voice_init(fluid_voice_t* voice, fluid_sample_t* sample,
 		     fluid_channel_t* channel, int key, int vel,
 		     unsigned int id, unsigned int time, fluid_real_t gain);
+int fluid_voice_set_linked_sample(fluid_voice_t* voice, fluid_sample_t* sample,
+                                  fluid_real_t pan);
+
+void fluid_voice_set_degraded(fluid_voice_t* voice, int degraded);
 
 int fluid_voice_modulate(fluid_voice_t* voice, int cc, int ctrl);
 int fluid_voice_modulate_all(fluid_voice_t* voice);
@@ -154,7 +167,7 @@ int fluid_voice_noteoff(fluid_voice_t* voice);
 int fluid_voice_off(fluid_voice_t* voice);
 void fluid_voice_overflow_rvoice_finished(fluid_voice_t* voice);
 void fluid_voice_mix (fluid_voice_t *voice, int count, fluid_real_t* dsp_buf,
-		 fluid_real_t* left_buf, fluid_real_t* right_buf,
+		 fluid_real_t* linked_buf, fluid_real_t* left_buf, fluid_real_t* right_buf,
 		 fluid_real_t* reverb_buf, fluid_real_t* chorus_buf);
 
 int fluid_voice_kill_excl(fluid_voice_t* voice);
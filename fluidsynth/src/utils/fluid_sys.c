@@ -544,6 +544,96 @@ void fluid_clear_fpe_i386 (void)
 #endif	// #else    (its POSIX)
 
 
+/***************************************************************
+ *
+ *               Denormal handling
+ *
+ *  Denormal numbers show up in decaying reverb tails, filter histories
+ *  and delay lines, and are extremely slow to compute on most CPUs.
+ *  The flush-to-zero (FTZ) and denormals-are-zero (DAZ) modes of the
+ *  floating point unit are thread specific, so every thread which
+ *  renders audio has to enable them.
+ */
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FLUID_DENORMAL_MXCSR_FTZ  0x8000
+/* DAZ is not available on the very first SSE processors */
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FLUID_DENORMAL_MXCSR_DAZ  0x0040
+#else
+#define FLUID_DENORMAL_MXCSR_DAZ  0
+#endif
+#define fluid_denormal_get_state()       _mm_getcsr()
+#define fluid_denormal_set_state(_s)     _mm_setcsr(_s)
+#define FLUID_DENORMAL_FTZ_BITS   (FLUID_DENORMAL_MXCSR_FTZ | FLUID_DENORMAL_MXCSR_DAZ)
+
+#elif defined(__aarch64__) && defined(__GNUC__)
+static FLUID_INLINE unsigned int fluid_denormal_get_state(void)
+{
+  unsigned long fpcr;
+  __asm__ __volatile__ ("mrs %0, fpcr" : "=r" (fpcr));
+  return (unsigned int) fpcr;
+}
+static FLUID_INLINE void fluid_denormal_set_state(unsigned int state)
+{
+  unsigned long fpcr = state;
+  __asm__ __volatile__ ("msr fpcr, %0" : : "r" (fpcr));
+}
+#define FLUID_DENORMAL_FTZ_BITS   (1 << 24)   /* FPCR.FZ */
+#endif
+
+/**
+ * Check if flush-to-zero can be enabled on this platform.
+ * @return TRUE if #FLUID_DENORMAL_FTZ is supported, FALSE otherwise
+ */
+int
+fluid_denormal_ftz_available(void)
+{
+#ifdef FLUID_DENORMAL_FTZ_BITS
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
+/**
+ * Apply a denormal mode to the floating point unit of the calling thread.
+ * @param mode One of #fluid_denormal_mode
+ * @return Previous floating point state, to be passed to fluid_denormal_leave()
+ */
+unsigned int
+fluid_denormal_enter(int mode)
+{
+#ifdef FLUID_DENORMAL_FTZ_BITS
+  unsigned int state;
+  if (mode != FLUID_DENORMAL_FTZ)
+    return 0;
+  state = fluid_denormal_get_state();
+  if ((state & FLUID_DENORMAL_FTZ_BITS) != FLUID_DENORMAL_FTZ_BITS)
+    fluid_denormal_set_state(state | FLUID_DENORMAL_FTZ_BITS);
+  return state;
+#else
+  return 0;
+#endif
+}
+
+/**
+ * Restore the floating point state saved by fluid_denormal_enter().
+ * @param mode Same mode as passed to fluid_denormal_enter()
+ * @param state Value returned by fluid_denormal_enter()
+ */
+void
+fluid_denormal_leave(int mode, unsigned int state)
+{
+#ifdef FLUID_DENORMAL_FTZ_BITS
+  if (mode == FLUID_DENORMAL_FTZ
+      && (state & FLUID_DENORMAL_FTZ_BITS) != FLUID_DENORMAL_FTZ_BITS)
+    fluid_denormal_set_state(state);
+#endif
+}
+
+
 /***************************************************************
  *
  *               Profiling (Linux, i586 only)
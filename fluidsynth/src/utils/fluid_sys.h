@@ -103,6 +103,7 @@ typedef int socklen_t;
 
 unsigned int fluid_curtime(void);
 double fluid_utime(void);
+#define fluid_msleep(_ms) g_usleep((_ms) * 1000)
 
 
 /**
@@ -445,4 +446,27 @@ extern fluid_profile_data_t fluid_profile_data[];
 unsigned int fluid_check_fpe_i386(char * explanation_in_case_of_fpe);
 void fluid_clear_fpe_i386(void);
 
+
+/**
+
+    Denormal handling
+
+    fluid_denormal_enter() switches the calling thread's floating point
+    unit to the given mode, fluid_denormal_leave() restores the state
+    it had before.
+*/
+enum fluid_denormal_mode {
+  FLUID_DENORMAL_OFF = 0,       /**< Leave the floating point unit alone */
+  FLUID_DENORMAL_FTZ,           /**< Flush denormals to zero (FTZ/DAZ) */
+  FLUID_DENORMAL_OFFSET         /**< Add an inaudible offset to effect sends and voice filters */
+};
+
+/** Offset added to signals in #FLUID_DENORMAL_OFFSET mode, far above the
+    denormal range of single precision floats but far below audibility */
+#define FLUID_DENORMAL_OFFSET_VALUE  1e-20
+
+int fluid_denormal_ftz_available(void);
+unsigned int fluid_denormal_enter(int mode);
+void fluid_denormal_leave(int mode, unsigned int state);
+
 #endif /* _FLUID_SYS_H */
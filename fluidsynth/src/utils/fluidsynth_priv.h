@@ -226,8 +226,16 @@ typedef FILE*  fluid_file;
 #define FLUID_FOPEN(_f,_m)           fopen(_f,_m)
 #define FLUID_FCLOSE(_f)             fclose(_f)
 #define FLUID_FREAD(_p,_s,_n,_f)     fread(_p,_s,_n,_f)
-#define FLUID_FSEEK(_f,_n,_set)      fseek(_f,_n,_set)
+#if defined(WIN32) && !defined(MINGW32)
+#define FLUID_FSEEK(_f,_n,_set)      _fseeki64(_f,_n,_set)
+#define FLUID_FTELL(_f)              _ftelli64(_f)
+#else
+#define FLUID_FSEEK(_f,_n,_set)      fseeko(_f,_n,_set)
+#define FLUID_FTELL(_f)              ftello(_f)
+#endif
 #define FLUID_MEMCPY(_dst,_src,_n)   memcpy(_dst,_src,_n)
+#define FLUID_MEMMOVE(_dst,_src,_n)  memmove(_dst,_src,_n)
+#define FLUID_MEMCMP(_s1,_s2,_n)     memcmp(_s1,_s2,_n)
 #define FLUID_MEMSET(_s,_c,_n)       memset(_s,_c,_n)
 #define FLUID_STRLEN(_s)             strlen(_s)
 #define FLUID_STRCMP(_s,_t)          strcmp(_s,_t)
@@ -244,6 +252,13 @@ typedef FILE*  fluid_file;
 #define FLUID_SPRINTF                sprintf
 #define FLUID_FPRINTF                fprintf
 
+/* Ask the CPU to load the cache line at _p ahead of its use */
+#if defined(__GNUC__)
+#define FLUID_PREFETCH(_p)           __builtin_prefetch(_p)
+#else
+#define FLUID_PREFETCH(_p)
+#endif
+
 #define fluid_clip(_val, _min, _max) \
 { (_val) = ((_val) < (_min))? (_min) : (((_val) > (_max))? (_max) : (_val)); }
 
@@ -0,0 +1,155 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+/*
+ * Decaying tails (synth.denormal-mode). Chords with a long release are
+ * played into a resonant filter and a large reverb, then released and
+ * rendered until the tails have decayed far below audibility. In the ftz
+ * and offset modes, the output must not hold a single subnormal value,
+ * and the last second of the tails must be exact zeros. The subnormals of
+ * every mode are counted and printed, those of the off mode only for
+ * comparison.
+ */
+
+#include <float.h>
+#include <fluidsynth.h>
+#include "test_sfont.h"
+
+#define SAMPLE_RATE     44100
+#define BLOCK           512
+#define SUSTAIN_SECONDS 2
+#define TAIL_SECONDS    20
+#define VOICES          64
+#define CHANNELS        8       /* melodic channels only */
+#define FILTER_FC       -8500.0 /* cents, from the open 13500 to about 150 Hz */
+#define FILTER_Q        300.0   /* cB of resonance */
+
+/* A non-zero value below the smallest normal float */
+#define is_subnormal(_x) ((_x) != 0.0f && fabs(_x) < FLT_MIN)
+
+/*
+ * Renders 'seconds' of audio, returns the count of subnormal output
+ * values, and the peak in 'peak'.
+ */
+static int
+render(fluid_synth_t* synth, int seconds, double* peak)
+{
+  static float left[BLOCK], right[BLOCK];
+  int i, k, subnormals = 0;
+
+  *peak = 0.0;
+  for (i = 0; i < seconds * SAMPLE_RATE / BLOCK; i++) {
+    if (fluid_synth_write_float(synth, BLOCK, left, 0, 1, right, 0, 1) != FLUID_OK)
+      TEST_FAIL("fluid_synth_write_float failed");
+    for (k = 0; k < BLOCK; k++) {
+      if (left[k] != left[k] || right[k] != right[k])
+        TEST_FAIL("Rendered NaN");
+      subnormals += is_subnormal(left[k]) + is_subnormal(right[k]);
+      if (fabs(left[k]) > *peak) *peak = fabs(left[k]);
+      if (fabs(right[k]) > *peak) *peak = fabs(right[k]);
+    }
+  }
+  return subnormals;
+}
+
+static int
+run_mode(const char* sfont, const char* mode)
+{
+  fluid_settings_t* settings = new_fluid_settings();
+  fluid_synth_t* synth;
+  double peak;
+  int i, subnormals = 0, failed = 0;
+
+  fluid_settings_setstr(settings, "synth.denormal-mode", mode);
+  fluid_settings_setnum(settings, "synth.sample-rate", SAMPLE_RATE);
+  fluid_settings_setint(settings, "synth.polyphony", VOICES * 2);
+  synth = new_fluid_synth(settings);
+  if (synth == NULL || fluid_synth_sfload(synth, sfont, 1) == FLUID_FAILED)
+    TEST_FAIL("Can't create the synth");
+
+  /* The default modulators of 1.1 don't map CC 71 and 74 to the filter,
+     the generators of the channels are offset instead */
+  fluid_synth_set_reverb(synth, 0.8, 0.0, 1.0, 1.0);
+  for (i = 0; i < CHANNELS; i++) {
+    fluid_synth_cc(synth, i, 91, 127);     /* reverb send */
+    fluid_synth_set_gen(synth, i, GEN_FILTERFC, FILTER_FC);
+    fluid_synth_set_gen(synth, i, GEN_FILTERQ, FILTER_Q);
+  }
+  for (i = 0; i < VOICES; i++)
+    fluid_synth_noteon(synth, i % CHANNELS, 36 + (i * 7) % 60, 127);
+
+  subnormals = render(synth, SUSTAIN_SECONDS, &peak);
+  if (peak < 1e-3)
+    TEST_FAIL("%s: no sound", mode);
+
+  for (i = 0; i < VOICES; i++)
+    fluid_synth_noteoff(synth, i % CHANNELS, 36 + (i * 7) % 60);
+  for (i = 0; i < TAIL_SECONDS; i++)
+    subnormals += render(synth, 1, &peak);
+  printf("%-6s %d subnormal values, last peak %g\n", mode, subnormals, peak);
+
+  /* The tails must have decayed */
+  if (peak > 1e-4)
+    TEST_FAIL("%s: tail hasn't decayed", mode);
+
+  if (strcmp(mode, "off") != 0 && subnormals > 0) {
+    fprintf(stderr, "%s: %d subnormal values in the output\n", mode, subnormals);
+    failed = 1;
+  }
+  if (strcmp(mode, "off") != 0 && peak != 0.0) {
+    fprintf(stderr, "%s: the tail doesn't end in silence\n", mode);
+    failed = 1;
+  }
+
+  delete_fluid_synth(synth);
+  delete_fluid_settings(settings);
+  return failed;
+}
+
+int
+main(int argc, char** argv)
+{
+  const char* filename = "test_denormal_tails.sf2";
+  static short data[4410];
+  test_sample_t s;
+  int failed = 0;
+
+  if (!test_is_little_endian())
+    return 77;
+
+  /* A looped sine at 441 Hz, released over about 4 s */
+  memset(&s, 0, sizeof(s));
+  test_make_sine(data, 4410, 100.0, 16000.0);
+  s.data = data;
+  s.count = 4410;
+  s.loopstart = 100;
+  s.loopend = 4400;
+  s.rate = SAMPLE_RATE;
+  s.root_key = 69;
+  s.release = 2400;
+  test_write_sfont(filename, &s);
+
+  failed |= run_mode(filename, "off");
+  failed |= run_mode(filename, "ftz");
+  failed |= run_mode(filename, "offset");
+
+  remove(filename);
+  return failed;
+}
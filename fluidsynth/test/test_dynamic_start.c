@@ -0,0 +1,174 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+/*
+ * Voices started with fluid_synth_start() on a preset that no channel
+ * has selected, with dynamic sample loading. The sample is loaded by
+ * selecting the preset, then the preset is unselected, which hands the
+ * sample to the loader thread to be unloaded, and a note of it is
+ * started right away, racing the loader thread. Either the voice starts
+ * and keeps the sample until it's done, so the note renders like without
+ * dynamic loading, or the sample is gone already and the note is silent.
+ * A voice playing freed sample data trips a memory checker, or renders
+ * garbage.
+ */
+
+#include <fluidsynth.h>
+#include "test_sfont.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#define test_msleep(_ms) Sleep(_ms)
+#else
+#include <unistd.h>
+#define test_msleep(_ms) usleep((_ms) * 1000)
+#endif
+
+#define SAMPLE_RATE     44100
+#define POINTS          4410
+#define FRAMES          2048
+#define BLOCK           64
+#define ROUNDS          100
+#define SPIN            1000    /* busy loop iterations per round */
+#define FILENAME        "test_dynamic_start.sf2"
+
+/* The effects are off, so only the note is heard */
+static fluid_settings_t*
+test_settings(int dynamic)
+{
+  fluid_settings_t* settings = new_fluid_settings();
+  fluid_settings_setnum(settings, "synth.sample-rate", SAMPLE_RATE);
+  fluid_settings_setint(settings, "synth.reverb.active", 0);
+  fluid_settings_setint(settings, "synth.chorus.active", 0);
+  fluid_settings_setint(settings, "synth.lock-memory", 0);
+  fluid_settings_setint(settings, "synth.dynamic-sample-loading", dynamic);
+  return settings;
+}
+
+/* Renders the note started with fluid_synth_start(), a block at a time */
+static void
+render(fluid_synth_t* synth, fluid_preset_t* preset, int sleep, float* out)
+{
+  int i;
+
+  if (fluid_synth_start(synth, 1, preset, 0, 0, 60, 100) != FLUID_OK)
+    TEST_FAIL("fluid_synth_start failed");
+  for (i = 0; i < FRAMES; i += BLOCK) {
+    if (fluid_synth_write_float(synth, BLOCK, out, 2 * i, 2, out, 2 * i + 1, 2) != FLUID_OK)
+      TEST_FAIL("fluid_synth_write_float failed");
+    /* leave the loader thread time to unload the sample */
+    if (sleep && i == 0)
+      test_msleep(1);
+  }
+  fluid_synth_stop(synth, 1);
+  fluid_synth_write_float(synth, BLOCK, out, 0, 0, out, 0, 0);
+}
+
+/* Waits until the loader thread has loaded the sample of channel 0 */
+static void
+wait_for_sample(fluid_synth_t* synth)
+{
+  static float buf[2 * BLOCK];
+  int i, k, heard = 0;
+
+  for (i = 0; i < 5000 && !heard; i++) {
+    fluid_synth_noteon(synth, 0, 60, 100);
+    fluid_synth_write_float(synth, BLOCK, buf, 0, 2, buf, 1, 2);
+    for (k = 0; k < 2 * BLOCK; k++) {
+      if (buf[k] != 0.0f)
+        heard = 1;
+    }
+    /* the block after this lets the voice go. A reset would select the
+       preset on all channels. */
+    fluid_synth_all_sounds_off(synth, 0);
+    fluid_synth_write_float(synth, BLOCK, buf, 0, 2, buf, 1, 2);
+    if (!heard)
+      test_msleep(1);
+  }
+  if (!heard)
+    TEST_FAIL("The sample wasn't loaded");
+}
+
+int
+main(int argc, char** argv)
+{
+  static short data[POINTS];
+  static float ref[2 * FRAMES], out[2 * FRAMES];
+  fluid_settings_t* settings;
+  fluid_synth_t* synth;
+  fluid_sfont_t* sfont;
+  fluid_preset_t* preset;
+  test_sample_t s;
+  volatile int spin;
+  int id, dynamic, round, i, silent, played = 0;
+
+  if (!test_is_little_endian())
+    return 77;
+
+  memset(&s, 0, sizeof(s));
+  test_make_sine(data, POINTS, 100.0, 16000.0);
+  s.data = data;
+  s.count = POINTS;
+  s.loopstart = 100;
+  s.loopend = 4400;
+  s.rate = SAMPLE_RATE;
+  s.root_key = 60;
+  test_write_sfont(FILENAME, &s);
+
+  for (dynamic = 0; dynamic <= 1; dynamic++) {
+    settings = test_settings(dynamic);
+    synth = new_fluid_synth(settings);
+    if (synth == NULL)
+      TEST_FAIL("Can't create the synth");
+    id = fluid_synth_sfload(synth, FILENAME, 0);
+    sfont = fluid_synth_get_sfont_by_id(synth, id);
+    if (sfont == NULL || (preset = sfont->get_preset(sfont, 0, 0)) == NULL)
+      TEST_FAIL("Can't load %s", FILENAME);
+
+    if (!dynamic)
+      render(synth, preset, 0, ref);
+
+    for (round = 0; dynamic && round < ROUNDS; round++) {
+      fluid_synth_program_select(synth, 0, id, 0, 0);
+      wait_for_sample(synth);
+      fluid_synth_unset_program(synth, 0);
+      /* start a little later each round, the loader thread catches up */
+      for (spin = 0; spin < round * SPIN; spin++);
+      render(synth, preset, 1, out);
+
+      silent = 1;
+      for (i = 0; i < 2 * FRAMES; i++) {
+        if (out[i] != 0.0f)
+          silent = 0;
+      }
+      if (!silent && memcmp(ref, out, sizeof(ref)) != 0)
+        TEST_FAIL("Round %d renders differently with dynamic loading", round);
+      played += !silent;
+    }
+
+    preset->free(preset);
+    delete_fluid_synth(synth);
+    delete_fluid_settings(settings);
+  }
+  printf("played %d of %d notes\n", played, ROUNDS);
+
+  remove(FILENAME);
+  return 0;
+}
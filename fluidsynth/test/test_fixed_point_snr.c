@@ -0,0 +1,144 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+/*
+ * Accuracy of the fixed point kernels (synth.fixed-point). The same chords
+ * are rendered with the floating point and the fixed point kernels, for
+ * each interpolation method, dry and through the reverb. The test fails
+ * if the signal to noise ratio of the fixed point rendering against the
+ * floating point one drops below the threshold of the method.
+ */
+
+#include <fluidsynth.h>
+#include "test_sfont.h"
+
+#define SAMPLE_RATE     44100
+#define SECONDS         2
+#define NOTES           24
+#define CHANNELS        8       /* melodic channels only */
+#define FRAMES          (SAMPLE_RATE * SECONDS)
+
+typedef struct {
+  int interp;                   /* interpolation method */
+  double dry_snr;               /* minimum SNR in dB without effects */
+  double wet_snr;               /* minimum SNR in dB with the reverb */
+} snr_limit_t;
+
+/* About 10 dB below the measured ratios */
+static const snr_limit_t limits[] = {
+  { FLUID_INTERP_NONE,      105.0, 90.0 },
+  { FLUID_INTERP_LINEAR,    105.0, 90.0 },
+  { FLUID_INTERP_4THORDER,   85.0, 80.0 },
+  { FLUID_INTERP_7THORDER,   80.0, 75.0 }
+};
+
+/* Renders the chords interleaved to 'out' (FRAMES * 2 points) */
+static void
+render(const char* sfont, int fixed, int interp, int reverb, float* out)
+{
+  fluid_settings_t* settings = new_fluid_settings();
+  fluid_synth_t* synth;
+  int i;
+
+  fluid_settings_setnum(settings, "synth.sample-rate", SAMPLE_RATE);
+  fluid_settings_setint(settings, "synth.fixed-point", fixed);
+  fluid_settings_setint(settings, "synth.reverb.active", reverb);
+  fluid_settings_setint(settings, "synth.chorus.active", 0);
+  synth = new_fluid_synth(settings);
+  if (synth == NULL || fluid_synth_sfload(synth, sfont, 1) == FLUID_FAILED)
+    TEST_FAIL("Can't create the synth");
+
+  fluid_synth_set_interp_method(synth, -1, interp);
+  for (i = 0; i < CHANNELS; i++)
+    fluid_synth_cc(synth, i, 91, reverb ? 127 : 0);
+
+  /* Keys far from the root key, so the interpolation matters */
+  for (i = 0; i < NOTES; i++)
+    fluid_synth_noteon(synth, i % CHANNELS, 30 + (i * 5) % 70, 60 + i);
+
+  if (fluid_synth_write_float(synth, FRAMES / 2, out, 0, 2, out, 1, 2) != FLUID_OK)
+    TEST_FAIL("fluid_synth_write_float failed");
+  for (i = 0; i < NOTES; i++)
+    fluid_synth_noteoff(synth, i % CHANNELS, 30 + (i * 5) % 70);
+  if (fluid_synth_write_float(synth, FRAMES - FRAMES / 2, out + FRAMES / 2 * 2, 0, 2,
+                              out + FRAMES / 2 * 2, 1, 2) != FLUID_OK)
+    TEST_FAIL("fluid_synth_write_float failed");
+
+  delete_fluid_synth(synth);
+  delete_fluid_settings(settings);
+}
+
+static int
+check(const char* sfont, const snr_limit_t* limit, int reverb, float* ref, float* test)
+{
+  double snr, min = reverb ? limit->wet_snr : limit->dry_snr;
+
+  render(sfont, 0, limit->interp, reverb, ref);
+  render(sfont, 1, limit->interp, reverb, test);
+  snr = test_snr(ref, test, FRAMES * 2);
+
+  printf("interpolation %d, %s: %.1f dB (minimum %.1f dB)\n",
+         limit->interp, reverb ? "reverb" : "dry", snr, min);
+  return snr < min;
+}
+
+int
+main(int argc, char** argv)
+{
+  const char* filename = "test_fixed_point_snr.sf2";
+  static short data[8820];
+  float* ref, *test;
+  test_sample_t s;
+  unsigned int i;
+  int k, failed = 0;
+
+  if (!test_is_little_endian())
+    return 77;
+
+  /* A looped tone at 441 Hz with some harmonics */
+  memset(&s, 0, sizeof(s));
+  for (i = 0; i < 8820; i++)
+    data[i] = (short) floor(12000.0 * sin(2.0 * M_PI * i / 100.0)
+                            + 4000.0 * sin(2.0 * M_PI * i * 3 / 100.0)
+                            + 2000.0 * sin(2.0 * M_PI * i * 7 / 100.0) + 0.5);
+  s.data = data;
+  s.count = 8820;
+  s.loopstart = 100;
+  s.loopend = 8800;
+  s.rate = SAMPLE_RATE;
+  s.root_key = 69;
+  s.release = 0;
+  test_write_sfont(filename, &s);
+
+  ref = malloc(FRAMES * 2 * sizeof(float));
+  test = malloc(FRAMES * 2 * sizeof(float));
+  if (ref == NULL || test == NULL)
+    TEST_FAIL("Out of memory");
+
+  for (k = 0; k < (int) (sizeof(limits) / sizeof(limits[0])); k++) {
+    failed |= check(filename, &limits[k], 0, ref, test);
+    failed |= check(filename, &limits[k], 1, ref, test);
+  }
+
+  free(ref);
+  free(test);
+  remove(filename);
+  return failed;
+}
@@ -0,0 +1,129 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+/*
+ * Sleeping reverb and chorus. A note is played into both effects and
+ * released, until both have fallen asleep. Then a second note must wake
+ * them up, and render like on a new synth, whose effects have only ever
+ * processed that note. The chorus depth is 0, as a sleeping chorus
+ * doesn't advance its modulation.
+ */
+
+#include <fluidsynth.h>
+#include "test_sfont.h"
+
+#define SAMPLE_RATE     44100
+#define POINTS          4410
+#define BLOCK           64
+#define NOTE_FRAMES     (344 * BLOCK)
+#define SILENCE_MAX     (60 * SAMPLE_RATE)  /* frames until the effects must sleep */
+#define FILENAME        "test_fx_sleep.sf2"
+
+static fluid_synth_t*
+new_test_synth(fluid_settings_t* settings)
+{
+  fluid_synth_t* synth = new_fluid_synth(settings);
+
+  if (synth == NULL || fluid_synth_sfload(synth, FILENAME, 1) == FLUID_FAILED)
+    TEST_FAIL("Can't create the synth");
+  fluid_synth_set_chorus(synth, FLUID_CHORUS_DEFAULT_N, FLUID_CHORUS_DEFAULT_LEVEL,
+                         FLUID_CHORUS_DEFAULT_SPEED, 0.0, FLUID_CHORUS_DEFAULT_TYPE);
+  fluid_synth_cc(synth, 0, 91, 127);     /* reverb send */
+  fluid_synth_cc(synth, 0, 93, 127);     /* chorus send */
+  return synth;
+}
+
+/* Renders a note held for NOTE_FRAMES and released */
+static void
+render_note(fluid_synth_t* synth, float* out)
+{
+  int i;
+
+  fluid_synth_noteon(synth, 0, 60, 127);
+  for (i = 0; i < NOTE_FRAMES; i += BLOCK) {
+    if (fluid_synth_write_float(synth, BLOCK, out, 2 * i, 2, out, 2 * i + 1, 2) != FLUID_OK)
+      TEST_FAIL("fluid_synth_write_float failed");
+  }
+  fluid_synth_noteoff(synth, 0, 60);
+}
+
+int
+main(int argc, char** argv)
+{
+  static short data[POINTS];
+  static float ref[2 * NOTE_FRAMES], out[2 * NOTE_FRAMES], rest[2 * BLOCK];
+  fluid_settings_t* settings;
+  fluid_synth_t* synth;
+  test_sample_t s;
+  int i, reverb_wakeups, chorus_wakeups, wakeups;
+
+  if (!test_is_little_endian())
+    return 77;
+
+  /* A looped sine, released over about 0.3 s */
+  memset(&s, 0, sizeof(s));
+  test_make_sine(data, POINTS, 100.0, 16000.0);
+  s.data = data;
+  s.count = POINTS;
+  s.loopstart = 100;
+  s.loopend = 4400;
+  s.rate = SAMPLE_RATE;
+  s.root_key = 60;
+  s.release = -2000;
+  test_write_sfont(FILENAME, &s);
+
+  settings = new_fluid_settings();
+  fluid_settings_setnum(settings, "synth.sample-rate", SAMPLE_RATE);
+
+  /* The effects of a new synth haven't processed anything else */
+  synth = new_test_synth(settings);
+  render_note(synth, ref);
+  delete_fluid_synth(synth);
+
+  synth = new_test_synth(settings);
+  render_note(synth, out);
+  for (i = 0; i < SILENCE_MAX; i += BLOCK) {
+    if (fluid_synth_get_reverb_sleeping(synth, &reverb_wakeups)
+        && fluid_synth_get_chorus_sleeping(synth, &chorus_wakeups))
+      break;
+    fluid_synth_write_float(synth, BLOCK, rest, 0, 2, rest, 1, 2);
+  }
+  if (i >= SILENCE_MAX)
+    TEST_FAIL("The effects don't fall asleep after the note");
+  printf("asleep after %d frames\n", i);
+
+  render_note(synth, out);
+  if (fluid_synth_get_reverb_sleeping(synth, &wakeups) || wakeups != reverb_wakeups + 1)
+    TEST_FAIL("The reverb didn't wake up (%d wakeups before, %d after)",
+              reverb_wakeups, wakeups);
+  if (fluid_synth_get_chorus_sleeping(synth, &wakeups) || wakeups != chorus_wakeups + 1)
+    TEST_FAIL("The chorus didn't wake up (%d wakeups before, %d after)",
+              chorus_wakeups, wakeups);
+  for (i = 0; i < 2 * NOTE_FRAMES; i++) {
+    if (out[i] != ref[i])
+      TEST_FAIL("Frame %d renders %g after the effects slept, %g on a new synth",
+                i / 2, out[i], ref[i]);
+  }
+
+  delete_fluid_synth(synth);
+  delete_fluid_settings(settings);
+  remove(FILENAME);
+  return 0;
+}
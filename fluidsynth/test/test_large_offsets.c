@@ -0,0 +1,229 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+/*
+ * SoundFonts with sample data past the 2 GB an int offset reaches. The
+ * RIFF chunk sizes are 32 bit, so a SoundFont ends before 4 GB: a sparse
+ * file puts the sample in the last MB before that. The sample is read
+ * through the stream loader with dynamic sample loading, streamed from
+ * the file with synth.streaming, and mapped with synth.mmap-samples. It
+ * must render like the same sample at the start of the file.
+ *
+ * The streamer never waits for the disk, an underrun delays the rest of
+ * the note. So the sample is also streamed with all of its points
+ * preloaded, which always renders the whole note, and when streamed
+ * from the file the blocks before the first underrun are compared.
+ */
+
+#include <fluidsynth.h>
+#include "test_sfont.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#define test_msleep(_ms) Sleep(_ms)
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#define test_msleep(_ms) usleep((_ms) * 1000)
+#endif
+
+#define SAMPLE_RATE     44100
+#define POINTS          44100   /* not looped, so the sample can be streamed */
+#define FRAMES          8192
+#define BLOCK           64
+#define GAP             0xfff00000LL    /* 4 GB less 1 MB in front of the sample */
+
+#define SMALL_FILE      "test_large_offsets_small.sf2"
+#define LARGE_FILE      "test_large_offsets_large.sf2"
+
+enum { LOAD_ALL, LOAD_DYNAMIC, LOAD_PRELOADED, LOAD_STREAMING, LOAD_MMAP, LOAD_COUNT };
+
+static const char* load_names[LOAD_COUNT] = {
+  "all", "dynamic", "preloaded", "streaming", "mmap"
+};
+
+static void
+remove_files(void)
+{
+  remove(SMALL_FILE);
+  remove(LARGE_FILE);
+}
+
+/* Can a file with a hole of GAP bytes be made here, without using the space? */
+static int
+can_make_sparse_file(void)
+{
+  FILE* f = fopen(LARGE_FILE, "wb");
+  int ok;
+
+  if (f == NULL)
+    return 0;
+#ifdef _WIN32
+  ok = _fseeki64(f, GAP, SEEK_SET) == 0;
+#else
+  ok = fseeko(f, (off_t) GAP, SEEK_SET) == 0;
+#endif
+  ok = ok && fputc(0, f) != EOF;
+  ok = (fclose(f) == 0) && ok;
+#ifndef _WIN32
+  if (ok) {
+    struct stat st;
+    ok = stat(LARGE_FILE, &st) == 0 && (long long) st.st_blocks * 512 < GAP / 16;
+  }
+#endif
+  remove(LARGE_FILE);
+  return ok;
+}
+
+/* The effects are off, so only the note is heard */
+static fluid_settings_t*
+test_settings(int load)
+{
+  fluid_settings_t* settings = new_fluid_settings();
+  fluid_settings_setnum(settings, "synth.sample-rate", SAMPLE_RATE);
+  fluid_settings_setint(settings, "synth.reverb.active", 0);
+  fluid_settings_setint(settings, "synth.chorus.active", 0);
+  fluid_settings_setint(settings, "synth.lock-memory", 0);
+  if (load == LOAD_DYNAMIC)
+    fluid_settings_setint(settings, "synth.dynamic-sample-loading", 1);
+  else if (load == LOAD_PRELOADED) {
+    fluid_settings_setint(settings, "synth.streaming", 1);
+    fluid_settings_setint(settings, "synth.stream-preload", 2 * POINTS * 1000 / SAMPLE_RATE);
+  }
+  else if (load == LOAD_STREAMING) {
+    fluid_settings_setint(settings, "synth.streaming", 1);
+    fluid_settings_setint(settings, "synth.stream-preload", 10);
+  }
+  else if (load == LOAD_MMAP)
+    fluid_settings_setint(settings, "synth.mmap-samples", 1);
+  return settings;
+}
+
+/* Wait until the loader thread has loaded the sample of the selected preset */
+static void
+wait_for_sample(fluid_synth_t* synth)
+{
+  static float buf[2 * BLOCK];
+  int i, k, heard = 0;
+
+  for (i = 0; i < 5000 && !heard; i++) {
+    fluid_synth_noteon(synth, 0, 60, 100);
+    fluid_synth_write_float(synth, BLOCK, buf, 0, 2, buf, 1, 2);
+    for (k = 0; k < 2 * BLOCK; k++) {
+      if (buf[k] != 0.0f)
+        heard = 1;
+    }
+    /* the block after the reset lets the voice go */
+    fluid_synth_system_reset(synth);
+    fluid_synth_write_float(synth, BLOCK, buf, 0, 2, buf, 1, 2);
+    if (!heard)
+      test_msleep(1);
+  }
+  if (!heard)
+    TEST_FAIL("The sample wasn't loaded");
+}
+
+/*
+ * Render a note of the SoundFont, a block at a time. Returns the count
+ * of frames rendered before the first stream underrun.
+ */
+static int
+render(const char* filename, int load, float* out)
+{
+  fluid_settings_t* settings = test_settings(load);
+  fluid_synth_t* synth;
+  int id, i, frames = FRAMES;
+
+  synth = new_fluid_synth(settings);
+  if (synth == NULL)
+    TEST_FAIL("Can't create the synth");
+  id = fluid_synth_sfload(synth, filename, 0);
+  if (id == FLUID_FAILED)
+    TEST_FAIL("Can't load %s (%s)", filename, load_names[load]);
+  fluid_synth_program_select(synth, 0, id, 0, 0);
+  if (load == LOAD_DYNAMIC)
+    wait_for_sample(synth);
+
+  fluid_synth_noteon(synth, 0, 60, 100);
+  for (i = 0; i < FRAMES; i += BLOCK) {
+    if (fluid_synth_write_float(synth, BLOCK, out, 2 * i, 2, out, 2 * i + 1, 2) != FLUID_OK)
+      TEST_FAIL("fluid_synth_write_float failed");
+    if (frames == FRAMES && fluid_synth_get_stream_underruns(synth) > 0)
+      frames = i;
+    /* leave the streamer time to read ahead */
+    if (load == LOAD_STREAMING)
+      test_msleep(1);
+  }
+
+  delete_fluid_synth(synth);
+  delete_fluid_settings(settings);
+  return frames;
+}
+
+int
+main(int argc, char** argv)
+{
+  static short data[POINTS];
+  static float ref[FRAMES * 2], out[FRAMES * 2];
+  test_sample_t s;
+  long long offset;
+  int load, frames, i;
+
+  if (!test_is_little_endian())
+    return 77;
+  if (!can_make_sparse_file()) {
+    printf("Can't make sparse files here, skipping\n");
+    return 77;
+  }
+  atexit(remove_files);
+
+  memset(&s, 0, sizeof(s));
+  test_make_sine(data, POINTS, 100.0, 16000.0);
+  s.data = data;
+  s.count = POINTS;
+  s.rate = SAMPLE_RATE;
+  s.root_key = 60;
+  test_write_sfont(SMALL_FILE, &s);
+  s.gap = GAP;
+  offset = test_write_sfont(LARGE_FILE, &s);
+  printf("sample data at byte %lld\n", offset);
+  if (offset <= 0x7fffffffLL)
+    TEST_FAIL("The sample data isn't past 2 GB");
+
+  render(SMALL_FILE, LOAD_ALL, ref);
+  for (i = 0; i < FRAMES * 2 && ref[i] == 0.0f; i++);
+  if (i == FRAMES * 2)
+    TEST_FAIL("The note is silent");
+
+  for (load = LOAD_DYNAMIC; load < LOAD_COUNT; load++) {
+    /* The whole sample chunk is mapped, that takes a 64 bit address space */
+    if (load == LOAD_MMAP && sizeof(void*) < 8)
+      continue;
+
+    memset(out, 0, sizeof(out));
+    frames = render(LARGE_FILE, load, out);
+    if (load != LOAD_STREAMING && frames < FRAMES)
+      TEST_FAIL("Stream underrun without streaming (%s)", load_names[load]);
+    if (memcmp(ref, out, frames * 2 * sizeof(float)) != 0)
+      TEST_FAIL("The sample past 2 GB renders differently (%s)", load_names[load]);
+    printf("%s: %d of %d frames ok\n", load_names[load], frames, FRAMES);
+  }
+  return 0;
+}
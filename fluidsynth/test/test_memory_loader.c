@@ -0,0 +1,155 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+/*
+ * SoundFonts loaded from memory (fluid_synth_new_memory_stream_loader).
+ * Two SoundFonts with different samples of the same size are loaded from
+ * files and from memory, under the same name, each by a synth of its own
+ * while the other is still loaded. Both must render like when loaded
+ * from their files. The memory is loaded once where the sample data can
+ * be used in place, and once one byte off, where it's copied.
+ */
+
+#include <fluidsynth.h>
+#include "test_sfont.h"
+
+#define SAMPLE_RATE     44100
+#define POINTS          4410
+#define FRAMES          8192
+#define MEMORY_NAME     "memory.sf2"
+
+static const char* files[] = { "test_memory_loader_a.sf2", "test_memory_loader_b.sf2" };
+
+static fluid_settings_t*
+test_settings(void)
+{
+  fluid_settings_t* settings = new_fluid_settings();
+  fluid_settings_setnum(settings, "synth.sample-rate", SAMPLE_RATE);
+  fluid_settings_setint(settings, "synth.reverb.active", 0);
+  fluid_settings_setint(settings, "synth.chorus.active", 0);
+  return settings;
+}
+
+/* Loads a SoundFont from memory, or from its file if 'data' is NULL */
+static fluid_synth_t*
+load(fluid_settings_t* settings, const char* filename, const char* data, long size)
+{
+  fluid_synth_t* synth = new_fluid_synth(settings);
+  fluid_stream_loader_t* stream;
+
+  if (synth == NULL)
+    TEST_FAIL("Can't create the synth");
+  if (data != NULL) {
+    stream = fluid_synth_new_memory_stream_loader(data, size);
+    if (stream == NULL)
+      TEST_FAIL("Can't create the memory stream loader");
+    fluid_synth_add_sfloader(synth, fluid_synth_new_stream_sfloader(synth, stream));
+    filename = MEMORY_NAME;
+  }
+  if (fluid_synth_sfload(synth, filename, 1) == FLUID_FAILED)
+    TEST_FAIL("Can't load %s", filename);
+  return synth;
+}
+
+static void
+render(fluid_synth_t* synth, float* out)
+{
+  fluid_synth_noteon(synth, 0, 60, 100);
+  if (fluid_synth_write_float(synth, FRAMES, out, 0, 2, out, 1, 2) != FLUID_OK)
+    TEST_FAIL("fluid_synth_write_float failed");
+  fluid_synth_noteoff(synth, 0, 60);
+}
+
+/* Reads a file to 'offset' bytes into a new buffer */
+static char*
+read_file(const char* filename, int offset, long* size)
+{
+  FILE* f = fopen(filename, "rb");
+  char* buf;
+
+  if (f == NULL || fseek(f, 0, SEEK_END) != 0 || (*size = ftell(f)) < 0
+      || fseek(f, 0, SEEK_SET) != 0)
+    TEST_FAIL("Can't read %s", filename);
+  buf = malloc(*size + offset);
+  if (buf == NULL)
+    TEST_FAIL("Out of memory");
+  if (fread(buf + offset, 1, *size, f) != (size_t) *size)
+    TEST_FAIL("Can't read %s", filename);
+  fclose(f);
+  return buf;
+}
+
+int
+main(int argc, char** argv)
+{
+  static short data[POINTS];
+  static float ref[2][2 * FRAMES], out[2 * FRAMES];
+  fluid_settings_t* settings;
+  fluid_synth_t* synth[2];
+  test_sample_t s;
+  char* buf[2];
+  long size;
+  int i, offset;
+
+  if (!test_is_little_endian())
+    return 77;
+
+  memset(&s, 0, sizeof(s));
+  s.data = data;
+  s.count = POINTS;
+  s.loopstart = 100;
+  s.loopend = 4400;
+  s.rate = SAMPLE_RATE;
+  s.root_key = 60;
+  test_make_sine(data, POINTS, 100.0, 16000.0);
+  test_write_sfont(files[0], &s);
+  test_make_sine(data, POINTS, 50.0, 8000.0);
+  test_write_sfont(files[1], &s);
+
+  settings = test_settings();
+  for (i = 0; i < 2; i++) {
+    synth[i] = load(settings, files[i], NULL, 0);
+    render(synth[i], ref[i]);
+    delete_fluid_synth(synth[i]);
+  }
+  if (memcmp(ref[0], ref[1], sizeof(ref[0])) == 0)
+    TEST_FAIL("The SoundFonts render alike");
+
+  for (offset = 0; offset <= 1; offset++) {
+    for (i = 0; i < 2; i++) {
+      buf[i] = read_file(files[i], offset, &size);
+      synth[i] = load(settings, files[i], buf[i] + offset, size);
+    }
+    for (i = 0; i < 2; i++) {
+      render(synth[i], out);
+      if (memcmp(ref[i], out, sizeof(out)) != 0)
+        TEST_FAIL("%s renders differently from memory (offset %d)", files[i], offset);
+    }
+    for (i = 0; i < 2; i++) {
+      delete_fluid_synth(synth[i]);
+      free(buf[i]);
+    }
+  }
+
+  delete_fluid_settings(settings);
+  remove(files[0]);
+  remove(files[1]);
+  return 0;
+}
@@ -0,0 +1,153 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+/*
+ * Sharing of identical samples (synth.sample-dedup). Two SoundFonts hold
+ * the same sample points, followed by zeros in one and by other points
+ * in the other. The samples must be shared all the same, and both must
+ * render as before.
+ */
+
+#include <fluidsynth.h>
+#include "test_sfont.h"
+
+#define SAMPLE_RATE     44100
+#define POINTS          4410
+#define TAIL            100     /* points after the end of the sample in font B */
+#define FRAMES          8192
+
+/* Offset of the end field of the first sample header from the end of the file */
+#define SHDR_END_FROM_EOF  (2 * 46 - 24)
+
+/* The effects are off, so the tails of earlier notes don't add up */
+static fluid_settings_t*
+test_settings(int dedup)
+{
+  fluid_settings_t* settings = new_fluid_settings();
+  fluid_settings_setnum(settings, "synth.sample-rate", SAMPLE_RATE);
+  fluid_settings_setint(settings, "synth.reverb.active", 0);
+  fluid_settings_setint(settings, "synth.chorus.active", 0);
+  fluid_settings_setint(settings, "synth.sample-dedup", dedup);
+  return settings;
+}
+
+/*
+ * Renders a note of the font and resets the synth. The block after the
+ * reset lets the voices release the samples, so the font can be unloaded.
+ */
+static void
+render(fluid_synth_t* synth, int sfont_id, float* out)
+{
+  static float rest[256];
+
+  fluid_synth_program_select(synth, 0, sfont_id, 0, 0);
+  fluid_synth_noteon(synth, 0, 60, 100);
+  if (fluid_synth_write_float(synth, FRAMES, out, 0, 2, out, 1, 2) != FLUID_OK)
+    TEST_FAIL("fluid_synth_write_float failed");
+  fluid_synth_system_reset(synth);
+  fluid_synth_write_float(synth, 128, rest, 0, 2, rest, 1, 2);
+}
+
+/* Renders a note of a font loaded without sharing */
+static void
+render_alone(const char* filename, float* out)
+{
+  fluid_settings_t* settings = test_settings(0);
+  fluid_synth_t* synth;
+  int id;
+
+  synth = new_fluid_synth(settings);
+  id = fluid_synth_sfload(synth, filename, 0);
+  if (id == FLUID_FAILED)
+    TEST_FAIL("Can't load %s", filename);
+  render(synth, id, out);
+  delete_fluid_synth(synth);
+  delete_fluid_settings(settings);
+}
+
+int
+main(int argc, char** argv)
+{
+  static short data[POINTS + TAIL];
+  static float ref[FRAMES * 2], out[FRAMES * 2];
+  fluid_settings_t* settings;
+  fluid_synth_t* synth;
+  unsigned char end[4];
+  test_sample_t s;
+  double shared;
+  int a, b;
+  FILE* f;
+
+  if (!test_is_little_endian())
+    return 77;
+
+  /* Font A: the sample and the zero points the spec demands after it */
+  memset(&s, 0, sizeof(s));
+  test_make_sine(data, POINTS + TAIL, 100.0, 16000.0);
+  s.data = data;
+  s.count = POINTS;
+  s.loopstart = 100;
+  s.loopend = 4400;
+  s.rate = SAMPLE_RATE;
+  s.root_key = 60;
+  test_write_sfont("test_sample_dedup_a.sf2", &s);
+
+  /* Font B: the same points, the sample ends before the last TAIL ones */
+  s.count = POINTS + TAIL;
+  test_write_sfont("test_sample_dedup_b.sf2", &s);
+  f = fopen("test_sample_dedup_b.sf2", "r+b");
+  if (f == NULL || fseek(f, -SHDR_END_FROM_EOF, SEEK_END) != 0)
+    TEST_FAIL("Can't patch the sample header");
+  test_put32(end, POINTS);
+  test_write(f, end, 4);
+  fclose(f);
+
+  settings = test_settings(1);
+  synth = new_fluid_synth(settings);
+  a = fluid_synth_sfload(synth, "test_sample_dedup_a.sf2", 0);
+  b = fluid_synth_sfload(synth, "test_sample_dedup_b.sf2", 0);
+  if (synth == NULL || a == FLUID_FAILED || b == FLUID_FAILED)
+    TEST_FAIL("Can't load the SoundFonts");
+
+  shared = fluid_get_shared_sample_bytes();
+  printf("shared %g bytes\n", shared);
+  if (shared < POINTS * 2)
+    TEST_FAIL("The identical samples aren't shared");
+
+  /* The shared sample plays like the ones loaded on their own */
+  render_alone("test_sample_dedup_a.sf2", ref);
+  render(synth, a, out);
+  if (memcmp(ref, out, sizeof(ref)) != 0)
+    TEST_FAIL("Font A renders differently when shared");
+  render_alone("test_sample_dedup_b.sf2", ref);
+  render(synth, b, out);
+  if (memcmp(ref, out, sizeof(ref)) != 0)
+    TEST_FAIL("Font B renders differently when shared");
+
+  fluid_synth_sfunload(synth, b, 1);
+  if (fluid_get_shared_sample_bytes() != 0.0)
+    TEST_FAIL("Shared bytes left after unloading");
+
+  delete_fluid_synth(synth);
+  delete_fluid_settings(settings);
+  remove("test_sample_dedup_a.sf2");
+  remove("test_sample_dedup_b.sf2");
+  return 0;
+}
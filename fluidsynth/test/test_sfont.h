@@ -0,0 +1,265 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+/*
+ * Helpers shared by the tests: writing a minimal SoundFont with a single
+ * preset playing one sample, and comparing rendered buffers.
+ */
+
+#ifndef _TEST_SFONT_H
+#define _TEST_SFONT_H
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define TEST_FAIL(...) \
+  do { fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); exit(1); } while (0)
+
+/* SoundFont generators used by the tests */
+#define TEST_GEN_RELEASEVOLENV  38
+#define TEST_GEN_INSTRUMENT     41
+#define TEST_GEN_SAMPLEID       53
+#define TEST_GEN_SAMPLEMODES    54
+
+/* Zero points the SoundFont specification requires after each sample */
+#define TEST_SAMPLE_PAD         46
+
+typedef struct {
+  const short* data;          /* sample points */
+  unsigned int count;         /* count of points */
+  unsigned int loopstart;     /* loop points, loopend == loopstart for no loop */
+  unsigned int loopend;
+  unsigned int rate;          /* sample rate */
+  int root_key;               /* MIDI key playing at the sample rate */
+  int release;                /* release time in timecents, 0 for the default */
+  long long gap;              /* zero bytes in front of the sample in the
+                                 sample chunk, written as a hole (sparse) */
+} test_sample_t;
+
+static void
+test_put16(unsigned char* p, unsigned int v)
+{
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+}
+
+static void
+test_put32(unsigned char* p, unsigned int v)
+{
+  test_put16(p, v & 0xffff);
+  test_put16(p + 2, (v >> 16) & 0xffff);
+}
+
+static void
+test_write(FILE* f, const void* data, size_t size)
+{
+  if (size > 0 && fwrite(data, size, 1, f) != 1)
+    TEST_FAIL("Write error");
+}
+
+static void
+test_write_chunk_header(FILE* f, const char* id, unsigned int size)
+{
+  unsigned char hdr[8];
+  memcpy(hdr, id, 4);
+  test_put32(hdr + 4, size);
+  test_write(f, hdr, 8);
+}
+
+/* A sub chunk of the pdta list: header and records */
+static void
+test_write_chunk(FILE* f, const char* id, const unsigned char* data, unsigned int size)
+{
+  test_write_chunk_header(f, id, size);
+  test_write(f, data, size);
+}
+
+/* Move the file position forward by 'size' bytes without writing them */
+static void
+test_skip(FILE* f, long long size)
+{
+#ifdef _WIN32
+  if (_fseeki64(f, size, SEEK_CUR) != 0)
+#else
+  if (fseeko(f, (off_t) size, SEEK_CUR) != 0)
+#endif
+    TEST_FAIL("Seek error");
+}
+
+/*
+ * Write a SoundFont to 'filename' with preset 0:0 playing 's' over the
+ * whole key range. Returns the byte offset of the first sample point.
+ */
+static long long
+test_write_sfont(const char* filename, const test_sample_t* s)
+{
+  unsigned char phdr[2 * 38], pbag[2 * 4], pmod[10], pgen[2 * 4];
+  unsigned char inst[2 * 22], ibag[2 * 4], imod[10], igen[4 * 4];
+  unsigned char shdr[2 * 46], info[4 + 12 + 16], pad[TEST_SAMPLE_PAD * 2];
+  unsigned long long smpl_size, pdta_size, sdta_size, riff_size;
+  int igen_count = 0;
+  long long offset;
+  FILE* f;
+
+  memset(phdr, 0, sizeof(phdr));
+  memset(pbag, 0, sizeof(pbag));
+  memset(pmod, 0, sizeof(pmod));
+  memset(pgen, 0, sizeof(pgen));
+  memset(inst, 0, sizeof(inst));
+  memset(ibag, 0, sizeof(ibag));
+  memset(imod, 0, sizeof(imod));
+  memset(igen, 0, sizeof(igen));
+  memset(shdr, 0, sizeof(shdr));
+  memset(pad, 0, sizeof(pad));
+
+  /* Preset 0:0 with one zone, and the terminal record */
+  strcpy((char*) phdr, "Test");
+  test_put16(phdr + 38 + 24, 1);
+  strcpy((char*) phdr + 38, "EOP");
+  test_put16(pbag + 4, 1);
+  test_put16(pgen, TEST_GEN_INSTRUMENT);
+  test_put16(pgen + 2, 0);
+
+  /* Instrument with one zone */
+  strcpy((char*) inst, "Test");
+  strcpy((char*) inst + 22, "EOI");
+  test_put16(inst + 22 + 20, 1);
+  if (s->release != 0) {
+    test_put16(igen + 4 * igen_count, TEST_GEN_RELEASEVOLENV);
+    test_put16(igen + 4 * igen_count + 2, (unsigned int) s->release & 0xffff);
+    igen_count++;
+  }
+  if (s->loopend > s->loopstart) {
+    test_put16(igen + 4 * igen_count, TEST_GEN_SAMPLEMODES);
+    test_put16(igen + 4 * igen_count + 2, 1);
+    igen_count++;
+  }
+  test_put16(igen + 4 * igen_count, TEST_GEN_SAMPLEID);
+  test_put16(igen + 4 * igen_count + 2, 0);
+  igen_count++;
+  test_put16(ibag + 4, igen_count);
+
+  /* Sample header, positions in points from the start of the chunk */
+  offset = s->gap / 2;
+  strcpy((char*) shdr, "Test");
+  test_put32(shdr + 20, (unsigned int) offset);
+  test_put32(shdr + 24, (unsigned int) (offset + s->count));
+  test_put32(shdr + 28, (unsigned int) (offset + s->loopstart));
+  test_put32(shdr + 32, (unsigned int) (offset + s->loopend));
+  test_put32(shdr + 36, s->rate);
+  shdr[40] = (unsigned char) s->root_key;
+  test_put16(shdr + 44, 1);
+  strcpy((char*) shdr + 46, "EOS");
+
+  smpl_size = (s->gap / 2) * 2 + 2ULL * (s->count + TEST_SAMPLE_PAD);
+  sdta_size = 4 + 8 + smpl_size;
+  pdta_size = 4 + 9 * 8 + sizeof(phdr) + sizeof(pbag) + sizeof(pmod) + sizeof(pgen)
+    + sizeof(inst) + sizeof(ibag) + sizeof(imod) + 4 * (igen_count + 1) + sizeof(shdr);
+  riff_size = 4 + 8 + sizeof(info) + 8 + sdta_size + 8 + pdta_size;
+  if (riff_size > 0xffffffffULL)
+    TEST_FAIL("SoundFont too large for RIFF");
+
+  f = fopen(filename, "wb");
+  if (f == NULL)
+    TEST_FAIL("Can't create %s", filename);
+
+  test_write_chunk_header(f, "RIFF", (unsigned int) riff_size);
+  test_write(f, "sfbk", 4);
+
+  memcpy(info, "INFO", 4);
+  memcpy(info + 4, "ifil", 4);
+  test_put32(info + 8, 4);
+  test_put16(info + 12, 2);
+  test_put16(info + 14, 1);
+  memcpy(info + 16, "INAM", 4);
+  test_put32(info + 20, 8);
+  strcpy((char*) info + 24, "Test");
+  test_write_chunk_header(f, "LIST", sizeof(info));
+  test_write(f, info, sizeof(info));
+
+  test_write_chunk_header(f, "LIST", (unsigned int) sdta_size);
+  test_write(f, "sdta", 4);
+  test_write_chunk_header(f, "smpl", (unsigned int) smpl_size);
+  test_skip(f, (s->gap / 2) * 2);
+  offset = 4 + 8 + 8 + sizeof(info) + 8 + 4 + 8 + (s->gap / 2) * 2;
+  test_write(f, s->data, 2 * s->count);
+  test_write(f, pad, sizeof(pad));
+
+  test_write_chunk_header(f, "LIST", (unsigned int) pdta_size);
+  test_write(f, "pdta", 4);
+  test_write_chunk(f, "phdr", phdr, sizeof(phdr));
+  test_write_chunk(f, "pbag", pbag, sizeof(pbag));
+  test_write_chunk(f, "pmod", pmod, sizeof(pmod));
+  test_write_chunk(f, "pgen", pgen, sizeof(pgen));
+  test_write_chunk(f, "inst", inst, sizeof(inst));
+  test_write_chunk(f, "ibag", ibag, sizeof(ibag));
+  test_write_chunk(f, "imod", imod, sizeof(imod));
+  test_write_chunk(f, "igen", igen, 4 * (igen_count + 1));
+  test_write_chunk(f, "shdr", shdr, sizeof(shdr));
+
+  if (fclose(f) != 0)
+    TEST_FAIL("Write error on %s", filename);
+  return offset;
+}
+
+/*
+ * Fill 'data' with 'count' points of a sine of 'period' points. Sample
+ * points are little endian in the file, the tests run on little endian
+ * hosts or skip themselves.
+ */
+static void
+test_make_sine(short* data, unsigned int count, double period, double amplitude)
+{
+  unsigned int i;
+  for (i = 0; i < count; i++)
+    data[i] = (short) floor(amplitude * sin(2.0 * M_PI * i / period) + 0.5);
+}
+
+static int
+test_is_little_endian(void)
+{
+  unsigned short one = 1;
+  return *(unsigned char*) &one == 1;
+}
+
+/* Signal to noise ratio in dB of 'test' against 'ref' */
+static double
+test_snr(const float* ref, const float* test, int count)
+{
+  double signal = 0.0, noise = 0.0;
+  int i;
+  for (i = 0; i < count; i++) {
+    signal += (double) ref[i] * ref[i];
+    noise += ((double) ref[i] - test[i]) * ((double) ref[i] - test[i]);
+  }
+  if (noise == 0.0)
+    return 1000.0;
+  if (signal == 0.0)
+    return -1000.0;
+  return 10.0 * log10(signal / noise);
+}
+
+#endif /* _TEST_SFONT_H */
@@ -0,0 +1,125 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+/*
+ * Samples shorter than the interpolation kernels. Samples of 1 to 4
+ * points, looped over all of their points or not, are played off their
+ * root key with each interpolation method. The points are allocated
+ * exactly, so a kernel reading off them trips a memory checker, or reads
+ * garbage. All points have the same value, so whatever the kernel, a
+ * looped sample must render like with linear interpolation, and one that
+ * isn't looped must go silent right after its points.
+ */
+
+#include <fluidsynth.h>
+#include "test_sfont.h"
+
+#define SAMPLE_RATE     44100
+#define FRAMES          1024
+#define VALUE           10000
+#define MAX_POINTS      4
+
+/* Relative deviation from linear interpolation allowed for a constant */
+#define TOLERANCE       0.02
+
+static void
+render(int points, int looped, int interp, float* out)
+{
+  fluid_settings_t* settings;
+  fluid_synth_t* synth;
+  fluid_sfont_t* sfont;
+  fluid_sample_t* sample;
+  short* data;
+  int i, id;
+
+  settings = new_fluid_settings();
+  fluid_settings_setnum(settings, "synth.sample-rate", SAMPLE_RATE);
+  fluid_settings_setint(settings, "synth.reverb.active", 0);
+  fluid_settings_setint(settings, "synth.chorus.active", 0);
+  synth = new_fluid_synth(settings);
+  if (synth == NULL)
+    TEST_FAIL("Can't create the synth");
+
+  /* The RAM SoundFont's sample ends on its last point (end is one past
+   * the given count), and a loop may end one past that */
+  data = malloc(points * sizeof(short));
+  if (data == NULL)
+    TEST_FAIL("Out of memory");
+  for (i = 0; i < points; i++)
+    data[i] = VALUE;
+  sample = new_fluid_ramsample();
+  sfont = fluid_ramsfont_create_sfont();
+  if (sample == NULL || sfont == NULL
+      || fluid_sample_set_sound_data(sample, data, points - 1, 0, 60) != FLUID_OK
+      || fluid_ramsfont_add_izone(sfont->data, 0, 0, sample, 0, 127) != FLUID_OK
+      || (looped && fluid_ramsfont_izone_set_loop(sfont->data, 0, 0, sample, 1, 0, 1) != FLUID_OK))
+    TEST_FAIL("Can't create the RAM SoundFont");
+
+  id = fluid_synth_add_sfont(synth, sfont);
+  fluid_synth_program_select(synth, 0, id, 0, 0);
+  fluid_synth_set_interp_method(synth, -1, interp);
+  fluid_synth_noteon(synth, 0, 67, 127);
+  if (fluid_synth_write_float(synth, FRAMES, out, 0, 1, out, 0, 1) != FLUID_OK)
+    TEST_FAIL("fluid_synth_write_float failed");
+
+  /* deletes the SoundFont and its sample */
+  delete_fluid_synth(synth);
+  delete_fluid_settings(settings);
+}
+
+int
+main(int argc, char** argv)
+{
+  static const int interps[] = { FLUID_INTERP_4THORDER, FLUID_INTERP_7THORDER };
+  static float ref[FRAMES], out[FRAMES];
+  int points, looped, i, k;
+  float peak;
+
+  for (points = 1; points <= MAX_POINTS; points++) {
+    for (looped = 0; looped <= 1; looped++) {
+      /* loops are at least 2 points */
+      if (looped && points < 2)
+        continue;
+      render(points, looped, FLUID_INTERP_LINEAR, ref);
+      peak = 0.0f;
+      for (i = 0; i < FRAMES; i++)
+        if (fabs(ref[i]) > peak)
+          peak = fabs(ref[i]);
+
+      for (k = 0; k < 2; k++) {
+        render(points, looped, interps[k], out);
+        for (i = 0; i < FRAMES; i++) {
+          if (out[i] != out[i])
+            TEST_FAIL("%d points, looped %d, interpolation %d: NaN at frame %d",
+                      points, looped, interps[k], i);
+          if (looped && fabs(out[i] - ref[i]) > TOLERANCE * peak)
+            TEST_FAIL("%d looped points, interpolation %d: frame %d is %g instead of %g",
+                      points, interps[k], i, out[i], ref[i]);
+          if (!looped && i >= 2 * MAX_POINTS && out[i] != 0.0f)
+            TEST_FAIL("%d points, interpolation %d: frame %d is %g after the end",
+                      points, interps[k], i, out[i]);
+        }
+      }
+      if (looped && peak == 0.0f)
+        TEST_FAIL("%d looped points render silence", points);
+    }
+  }
+  return 0;
+}
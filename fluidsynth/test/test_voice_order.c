@@ -0,0 +1,130 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+/*
+ * The mixer renders the voices grouped by the sample they play. Three
+ * fonts hold a loud sample A, a very quiet one B and C, the negation of
+ * A. Their voices are started in the orders A, B, C and A, C, B. Grouped
+ * by sample, both are mixed as A, B, C. Mixed in the order they were
+ * started instead, A and C cancel exactly in the second order, while in
+ * the first one part of B is lost when rounding the loud sum, so the
+ * two renderings differ.
+ *
+ * The samples are shared (synth.sample-dedup), so they all start at point
+ * 0 of their own data. In fixed point builds the mix is exact in any
+ * order, so the test passes either way there.
+ */
+
+#include <fluidsynth.h>
+#include "test_sfont.h"
+
+#define SAMPLE_RATE     44100
+#define POINTS          4410
+#define FRAMES          8192
+
+static const char* fonts[] = {
+  "test_voice_order_a.sf2", "test_voice_order_b.sf2", "test_voice_order_c.sf2"
+};
+
+/* Renders the notes of the fonts in the given order */
+static void
+render(const int* order, float* out)
+{
+  static const int velocity[] = { 127, 1, 127 };
+  fluid_settings_t* settings;
+  fluid_synth_t* synth;
+  int i, id[3];
+
+  settings = new_fluid_settings();
+  fluid_settings_setnum(settings, "synth.sample-rate", SAMPLE_RATE);
+  fluid_settings_setint(settings, "synth.reverb.active", 0);
+  fluid_settings_setint(settings, "synth.chorus.active", 0);
+  fluid_settings_setint(settings, "synth.sample-dedup", 1);
+  synth = new_fluid_synth(settings);
+  if (synth == NULL)
+    TEST_FAIL("Can't create the synth");
+
+  /* always loaded in the same order */
+  for (i = 0; i < 3; i++) {
+    id[i] = fluid_synth_sfload(synth, fonts[i], 0);
+    if (id[i] == FLUID_FAILED)
+      TEST_FAIL("Can't load %s", fonts[i]);
+  }
+
+  for (i = 0; i < 3; i++) {
+    fluid_synth_program_select(synth, order[i], id[order[i]], 0, 0);
+    fluid_synth_noteon(synth, order[i], 67, velocity[order[i]]);
+  }
+  if (fluid_synth_write_float(synth, FRAMES, out, 0, 1, out, 0, 1) != FLUID_OK)
+    TEST_FAIL("fluid_synth_write_float failed");
+
+  delete_fluid_synth(synth);
+  delete_fluid_settings(settings);
+}
+
+int
+main(int argc, char** argv)
+{
+  static const int abc[] = { 0, 1, 2 }, acb[] = { 0, 2, 1 };
+  static short loud[POINTS], quiet[POINTS], negated[POINTS];
+  static float out_abc[FRAMES], out_acb[FRAMES];
+  unsigned int seed = 1;
+  int i, audible = 0;
+  test_sample_t s;
+
+  if (!test_is_little_endian())
+    return 77;
+
+  for (i = 0; i < POINTS; i++) {
+    seed = seed * 1103515245 + 12345;
+    loud[i] = (short) ((int) ((seed >> 16) % 40001) - 20000);
+    negated[i] = -loud[i];
+    quiet[i] = (short) ((int) ((seed >> 8) % 7) - 3);
+  }
+
+  memset(&s, 0, sizeof(s));
+  s.count = POINTS;
+  s.loopstart = 8;
+  s.loopend = POINTS - 8;
+  s.rate = SAMPLE_RATE;
+  s.root_key = 60;
+  s.data = loud;
+  test_write_sfont(fonts[0], &s);
+  s.data = quiet;
+  test_write_sfont(fonts[1], &s);
+  s.data = negated;
+  test_write_sfont(fonts[2], &s);
+
+  render(abc, out_abc);
+  render(acb, out_acb);
+  for (i = 0; i < FRAMES; i++) {
+    if (out_abc[i] != out_acb[i])
+      TEST_FAIL("The voices aren't mixed by sample, frame %d is %g and %g",
+                i, out_abc[i], out_acb[i]);
+    if (out_abc[i] != 0.0f)
+      audible = 1;
+  }
+  if (!audible)
+    TEST_FAIL("The quiet sample renders silence");
+
+  for (i = 0; i < 3; i++)
+    remove(fonts[i]);
+  return 0;
+}